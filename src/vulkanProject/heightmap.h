@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+// Row-major grid of height samples shared by every stage of the terrain pipeline
+struct Heightmap {
+  int width = 0;
+  int height = 0;
+  std::vector<float> heights;
+
+  Heightmap() = default;
+  Heightmap(int width, int height, float initialHeight = 0.0f)
+      : width(width), height(height), heights(size_t(width) * size_t(height), initialHeight) {}
+
+  float &at(int x, int y) {
+    assert(x >= 0 && x < width && y >= 0 && y < height);
+    return heights[size_t(y) * size_t(width) + size_t(x)];
+  }
+
+  float at(int x, int y) const {
+    assert(x >= 0 && x < width && y >= 0 && y < height);
+    return heights[size_t(y) * size_t(width) + size_t(x)];
+  }
+
+  float *row(int y) { return heights.data() + size_t(y) * size_t(width); }
+  const float *row(int y) const { return heights.data() + size_t(y) * size_t(width); }
+};
@@ -0,0 +1,83 @@
+#include "heightmapImport.h"
+
+#include "stb_image.h"
+#include <cmath>
+#include <stdexcept>
+
+void HeightmapImage16::StbImageDeleter::operator()(uint16_t *pixels) const { stbi_image_free(pixels); }
+
+HeightmapImage16 HeightmapImage16::loadPng(const std::string &path) {
+  int width, height, channelCount;
+  // Asking for one channel has stb_image convert other formats to grey. It does so into a second buffer and
+  // frees the decoded one afterwards, so only single channel PNGs avoid the temporary copy.
+  const auto pixels = stbi_load_16(path.c_str(), &width, &height, &channelCount, 1);
+  if (pixels == nullptr) {
+    throw std::runtime_error("Failed to load heightmap " + path + ": " + stbi_failure_reason());
+  }
+
+  HeightmapImage16 image;
+  image.decodedPixels.reset(pixels);
+  image.samples = pixels;
+  image.imageWidth = width;
+  image.imageHeight = height;
+  return image;
+}
+
+HeightmapImage16 HeightmapImage16::mapRaw(const std::string &path, int width, int height, bool isBigEndian) {
+  HeightmapImage16 image;
+  image.mappedFile = MappedFile(path);
+
+  const auto sampleCount = image.mappedFile.size() / sizeof(uint16_t);
+  if (width < 0 || height < 0) {
+    throw std::runtime_error("Raw heightmap " + path + " has a negative size!");
+  }
+  if (width == 0 && height == 0) {
+    width = int(std::llround(std::sqrt(double(sampleCount))));
+    height = width;
+  } else if (width == 0) {
+    width = int(sampleCount / size_t(height));
+  } else if (height == 0) {
+    height = int(sampleCount / size_t(width));
+  }
+
+  // Also rejects a derived dimension that leaves part of the file over
+  if (size_t(width) * size_t(height) != sampleCount || image.mappedFile.size() % sizeof(uint16_t) != 0) {
+    throw std::runtime_error("Raw heightmap " + path + " does not match the expected size!");
+  }
+
+  image.samples = reinterpret_cast<const uint16_t *>(image.mappedFile.data());
+  image.imageWidth = width;
+  image.imageHeight = height;
+  image.isBigEndian = isBigEndian;
+  return image;
+}
+
+HeightmapTile16 HeightmapImage16::tile(int x0, int y0, int width, int height) const {
+  if (x0 < 0 || y0 < 0 || width < 0 || height < 0 || x0 + width > imageWidth || y0 + height > imageHeight) {
+    throw std::out_of_range("Heightmap tile is outside of the image!");
+  }
+
+  HeightmapTile16 heightmapTile;
+  heightmapTile.samples = samples + size_t(y0) * size_t(imageWidth) + size_t(x0);
+  heightmapTile.rowPitch = size_t(imageWidth);
+  heightmapTile.width = width;
+  heightmapTile.height = height;
+  heightmapTile.isBigEndian = isBigEndian;
+  return heightmapTile;
+}
+
+void HeightmapImage16::copyTile(int x0, int y0, int width, int height, float heightScale, float heightOffset,
+                                Heightmap *heightmap) const {
+  const auto heightmapTile = tile(x0, y0, width, height);
+
+  if (heightmap->width != width || heightmap->height != height) {
+    *heightmap = Heightmap(width, height);
+  }
+
+  for (auto y = 0; y < height; ++y) {
+    auto row = heightmap->row(y);
+    for (auto x = 0; x < width; ++x) {
+      row[x] = heightOffset + float(heightmapTile.at(x, y)) * heightScale;
+    }
+  }
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "heightmap.h"
+#include "mappedFile.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Non-owning view of a rectangle of 16-bit samples inside an imported image
+struct HeightmapTile16 {
+  const uint16_t *samples = nullptr; // First sample of the tile
+  size_t rowPitch = 0;               // In samples
+  int width = 0;
+  int height = 0;
+  bool isBigEndian = false;
+
+  uint16_t at(int x, int y) const {
+    const auto sample = samples[size_t(y) * rowPitch + size_t(x)];
+    return isBigEndian ? uint16_t((sample >> 8) | (sample << 8)) : sample;
+  }
+};
+
+// 16-bit heightmap image. Raw .r16/.raw files are memory mapped and tiles are served straight from the
+// mapping, so only the pages that are actually read get loaded. PNGs have to be decoded in full, but the
+// decoded stb_image buffer is used in place instead of being copied.
+class HeightmapImage16 {
+public:
+  static HeightmapImage16 loadPng(const std::string &path);
+  // A width or height of 0 is derived from the file size and the other dimension, leaving both at 0 assumes
+  // a square image. Throws when the file size does not match.
+  static HeightmapImage16 mapRaw(const std::string &path, int width = 0, int height = 0,
+                                 bool isBigEndian = false);
+
+  int width() const { return imageWidth; }
+  int height() const { return imageHeight; }
+
+  HeightmapTile16 tile(int x0, int y0, int width, int height) const;
+
+  // Converts a tile to heights, height = heightOffset + sample * heightScale
+  void copyTile(int x0, int y0, int width, int height, float heightScale, float heightOffset,
+                Heightmap *heightmap) const;
+
+private:
+  struct StbImageDeleter {
+    void operator()(uint16_t *pixels) const;
+  };
+
+  MappedFile mappedFile;
+  std::unique_ptr<uint16_t, StbImageDeleter> decodedPixels;
+  const uint16_t *samples = nullptr;
+  int imageWidth = 0;
+  int imageHeight = 0;
+  bool isBigEndian = false;
+};
@@ -0,0 +1,267 @@
+#include "hydraulicErosion.h"
+
+#include "jobSystem.h"
+#include "terrainRandom.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+namespace {
+struct BrushOffset {
+  int dx;
+  int dy;
+  float weight;
+};
+
+struct ErosionTile {
+  int x0, y0, x1, y1; // Droplet spawn area, [x0, x1) x [y0, y1)
+  int phase;          // Checkerboard colour, 0..3
+  size_t dropletCount;
+};
+
+// Plain loads and stores for conflict-free tiles, relaxed atomics when droplets may overlap
+template <bool IsAtomic> struct HeightAccess {
+  float *heights;
+
+  float load(size_t index) const {
+    if constexpr (IsAtomic) {
+      return std::atomic_ref<float>(heights[index]).load(std::memory_order_relaxed);
+    } else {
+      return heights[index];
+    }
+  }
+
+  void add(size_t index, float delta) const {
+    if constexpr (IsAtomic) {
+      std::atomic_ref<float>(heights[index]).fetch_add(delta, std::memory_order_relaxed);
+    } else {
+      heights[index] += delta;
+    }
+  }
+};
+
+std::vector<BrushOffset> createErosionBrush(int radius) {
+  std::vector<BrushOffset> brush;
+  auto weightSum = 0.0f;
+  for (auto dy = -radius; dy <= radius; ++dy) {
+    for (auto dx = -radius; dx <= radius; ++dx) {
+      const auto distance = std::sqrt(float(dx * dx + dy * dy));
+      if (distance <= float(radius)) {
+        const auto weight = radius > 0 ? 1.0f - distance / float(radius) : 1.0f;
+        if (weight > 0.0f) {
+          brush.push_back({dx, dy, weight});
+          weightSum += weight;
+        }
+      }
+    }
+  }
+
+  for (auto &brushOffset : brush) {
+    brushOffset.weight /= weightSum;
+  }
+
+  return brush;
+}
+
+template <bool IsAtomic>
+float heightAndGradient(const HeightAccess<IsAtomic> &access, int width, float x, float y, float *gradientX,
+                        float *gradientY) {
+  const auto nodeX = int(x);
+  const auto nodeY = int(y);
+  const auto fx = x - float(nodeX);
+  const auto fy = y - float(nodeY);
+
+  const auto index = size_t(nodeY) * size_t(width) + size_t(nodeX);
+  const auto heightNW = access.load(index);
+  const auto heightNE = access.load(index + 1);
+  const auto heightSW = access.load(index + width);
+  const auto heightSE = access.load(index + width + 1);
+
+  *gradientX = (heightNE - heightNW) * (1.0f - fy) + (heightSE - heightSW) * fy;
+  *gradientY = (heightSW - heightNW) * (1.0f - fx) + (heightSE - heightNE) * fx;
+
+  return heightNW * (1.0f - fx) * (1.0f - fy) + heightNE * fx * (1.0f - fy) + heightSW * (1.0f - fx) * fy +
+         heightSE * fx * fy;
+}
+
+template <bool IsAtomic>
+void simulateDroplet(const HeightAccess<IsAtomic> &access, int width, int height,
+                     const std::vector<BrushOffset> &brush, const HydraulicErosionParameters &parameters,
+                     float x, float y) {
+  auto directionX = 0.0f;
+  auto directionY = 0.0f;
+  auto speed = parameters.initialSpeed;
+  auto water = parameters.initialWaterVolume;
+  auto sediment = 0.0f;
+
+  for (auto lifetime = 0; lifetime < parameters.maxDropletLifetime; ++lifetime) {
+    const auto nodeX = int(x);
+    const auto nodeY = int(y);
+    const auto cellOffsetX = x - float(nodeX);
+    const auto cellOffsetY = y - float(nodeY);
+
+    float gradientX, gradientY;
+    const auto currentHeight = heightAndGradient(access, width, x, y, &gradientX, &gradientY);
+
+    directionX = directionX * parameters.inertia - gradientX * (1.0f - parameters.inertia);
+    directionY = directionY * parameters.inertia - gradientY * (1.0f - parameters.inertia);
+    const auto length = std::sqrt(directionX * directionX + directionY * directionY);
+    if (length == 0.0f) {
+      break;
+    }
+    directionX /= length;
+    directionY /= length;
+    x += directionX;
+    y += directionY;
+
+    if (x < 0.0f || y < 0.0f || x >= float(width - 1) || y >= float(height - 1)) {
+      break;
+    }
+
+    float newGradientX, newGradientY;
+    const auto newHeight = heightAndGradient(access, width, x, y, &newGradientX, &newGradientY);
+    const auto deltaHeight = newHeight - currentHeight;
+
+    const auto sedimentCapacity = std::max(-deltaHeight * speed * water * parameters.sedimentCapacityFactor,
+                                           parameters.minSedimentCapacity);
+
+    const auto nodeIndex = size_t(nodeY) * size_t(width) + size_t(nodeX);
+    if (sediment > sedimentCapacity || deltaHeight > 0.0f) {
+      // Uphill the droplet fills the pit it came from, otherwise it drops what it can no longer carry
+      const auto depositAmount = deltaHeight > 0.0f ? std::min(deltaHeight, sediment)
+                                                    : (sediment - sedimentCapacity) * parameters.depositSpeed;
+      sediment -= depositAmount;
+
+      access.add(nodeIndex, depositAmount * (1.0f - cellOffsetX) * (1.0f - cellOffsetY));
+      access.add(nodeIndex + 1, depositAmount * cellOffsetX * (1.0f - cellOffsetY));
+      access.add(nodeIndex + width, depositAmount * (1.0f - cellOffsetX) * cellOffsetY);
+      access.add(nodeIndex + width + 1, depositAmount * cellOffsetX * cellOffsetY);
+    } else {
+      // Never erode more than the height difference, that would dig a hole behind the droplet
+      const auto erodeAmount =
+          std::min((sedimentCapacity - sediment) * parameters.erodeSpeed, -deltaHeight);
+
+      for (const auto &brushOffset : brush) {
+        const auto brushX = nodeX + brushOffset.dx;
+        const auto brushY = nodeY + brushOffset.dy;
+        if (brushX < 0 || brushY < 0 || brushX >= width || brushY >= height) {
+          continue;
+        }
+
+        const auto erodedHeight = erodeAmount * brushOffset.weight;
+        access.add(size_t(brushY) * size_t(width) + size_t(brushX), -erodedHeight);
+        sediment += erodedHeight;
+      }
+    }
+
+    speed = std::sqrt(std::max(0.0f, speed * speed - deltaHeight * parameters.gravity));
+    water *= 1.0f - parameters.evaporateSpeed;
+  }
+}
+
+template <bool IsAtomic>
+void erodeTile(Heightmap *heightmap, const ErosionTile &tile, int batch,
+               const std::vector<BrushOffset> &brush, const HydraulicErosionParameters &parameters) {
+  const auto batchCount = size_t(parameters.batchCount);
+  const auto dropletCount =
+      tile.dropletCount * size_t(batch + 1) / batchCount - tile.dropletCount * size_t(batch) / batchCount;
+
+  // Keyed by tile and batch, so the spawn positions never depend on which thread runs the tile
+  CounterRandom random(
+      randomStreamKey(parameters.seed, tile.x0, tile.y0, GenerationStage::Erosion, uint32_t(batch)));
+
+  const HeightAccess<IsAtomic> access = {heightmap->heights.data()};
+  const auto spawnWidth = float(tile.x1 - tile.x0);
+  const auto spawnHeight = float(tile.y1 - tile.y0);
+  // The sum can round up to x1 even though the unit float is below 1, which on the last tile would put the
+  // bilinear footprint one row past the map
+  const auto maxX = std::nextafter(float(tile.x1), float(tile.x0));
+  const auto maxY = std::nextafter(float(tile.y1), float(tile.y0));
+  for (size_t droplet = 0; droplet < dropletCount; ++droplet) {
+    const auto x = std::min(float(tile.x0) + random.nextUnitFloat() * spawnWidth, maxX);
+    const auto y = std::min(float(tile.y0) + random.nextUnitFloat() * spawnHeight, maxY);
+    simulateDroplet(access, heightmap->width, heightmap->height, brush, parameters, x, y);
+  }
+}
+
+std::vector<ErosionTile> createErosionTiles(const Heightmap &heightmap,
+                                            const HydraulicErosionParameters &parameters) {
+  // A droplet touches cells at most lifetime + brush radius (+ bilinear footprint) away from its spawn point.
+  // With tiles twice that size, tiles of the same checkerboard colour never reach the same cell.
+  const auto reach = parameters.maxDropletLifetime + parameters.erosionRadius + 2;
+  const auto tileSize = std::max(2 * reach, 32);
+
+  // Droplets spawn inside [0, size - 1) so that the bilinear footprint stays on the map
+  const auto spawnWidth = heightmap.width - 1;
+  const auto spawnHeight = heightmap.height - 1;
+  const auto spawnArea = uint64_t(spawnWidth) * uint64_t(spawnHeight);
+
+  std::vector<ErosionTile> tiles;
+  uint64_t areaBefore = 0;
+  for (auto y0 = 0; y0 < spawnHeight; y0 += tileSize) {
+    for (auto x0 = 0; x0 < spawnWidth; x0 += tileSize) {
+      ErosionTile tile = {};
+      tile.x0 = x0;
+      tile.y0 = y0;
+      tile.x1 = std::min(x0 + tileSize, spawnWidth);
+      tile.y1 = std::min(y0 + tileSize, spawnHeight);
+      tile.phase = ((x0 / tileSize) & 1) + 2 * ((y0 / tileSize) & 1);
+
+      // Droplets proportional to the tile area, rounded so the total matches exactly
+      const auto areaAfter = areaBefore + uint64_t(tile.x1 - tile.x0) * uint64_t(tile.y1 - tile.y0);
+      tile.dropletCount = size_t(uint64_t(parameters.dropletCount) * areaAfter / spawnArea -
+                                 uint64_t(parameters.dropletCount) * areaBefore / spawnArea);
+      areaBefore = areaAfter;
+
+      tiles.push_back(tile);
+    }
+  }
+
+  return tiles;
+}
+} // namespace
+
+ErosionStats erodeHeightmap(Heightmap *heightmap, const HydraulicErosionParameters &parameters,
+                            JobSystem *jobSystem) {
+  ErosionStats erosionStats = {};
+  if (heightmap->width < 2 || heightmap->height < 2 || parameters.batchCount < 1) {
+    return erosionStats;
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  const auto brush = createErosionBrush(parameters.erosionRadius);
+  const auto tiles = createErosionTiles(*heightmap, parameters);
+
+  if (parameters.isDeterministic) {
+    std::vector<std::vector<size_t>> phaseTiles(4);
+    for (size_t i = 0; i < tiles.size(); ++i) {
+      phaseTiles[tiles[i].phase].push_back(i);
+    }
+
+    for (auto batch = 0; batch < parameters.batchCount; ++batch) {
+      for (const auto &tileIndices : phaseTiles) {
+        jobSystem->parallelFor(0, tileIndices.size(), 1, [&](size_t begin, size_t end) {
+          for (auto i = begin; i < end; ++i) {
+            erodeTile<false>(heightmap, tiles[tileIndices[i]], batch, brush, parameters);
+          }
+        });
+      }
+    }
+  } else {
+    for (auto batch = 0; batch < parameters.batchCount; ++batch) {
+      jobSystem->parallelFor(0, tiles.size(), 1, [&](size_t begin, size_t end) {
+        for (auto i = begin; i < end; ++i) {
+          erodeTile<true>(heightmap, tiles[i], batch, brush, parameters);
+        }
+      });
+    }
+  }
+
+  erosionStats.dropletCount = parameters.dropletCount;
+  erosionStats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  erosionStats.dropletsPerSecond =
+      erosionStats.seconds > 0.0 ? double(erosionStats.dropletCount) / erosionStats.seconds : 0.0;
+  return erosionStats;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "heightmap.h"
+#include <cstddef>
+#include <cstdint>
+
+class JobSystem;
+
+struct HydraulicErosionParameters {
+  uint32_t seed = 0;
+  size_t dropletCount = 1000000;
+  int maxDropletLifetime = 30; // Steps, a droplet moves at most one cell per step
+  int erosionRadius = 3;
+  float inertia = 0.05f; // How much of its previous direction a droplet keeps
+  float sedimentCapacityFactor = 4.0f;
+  float minSedimentCapacity = 0.01f;
+  float erodeSpeed = 0.3f;
+  float depositSpeed = 0.3f;
+  float evaporateSpeed = 0.01f;
+  float gravity = 4.0f;
+  float initialWaterVolume = 1.0f;
+  float initialSpeed = 1.0f;
+  int batchCount = 8; // Droplets are spread over this many rounds so no tile runs all of its droplets first
+
+  // Deterministic mode processes tiles in four checkerboard phases. Tiles of one phase are far enough apart
+  // that their droplets can never touch the same cell, so the output is identical for any thread count.
+  // Otherwise all tiles run at once and overlapping droplets deposit with atomic adds, which is faster but
+  // makes the result depend on scheduling.
+  bool isDeterministic = true;
+};
+
+struct ErosionStats {
+  size_t dropletCount = 0;
+  double seconds = 0.0;
+  double dropletsPerSecond = 0.0;
+};
+
+ErosionStats erodeHeightmap(Heightmap *heightmap, const HydraulicErosionParameters &parameters,
+                            JobSystem *jobSystem);
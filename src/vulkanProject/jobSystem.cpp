@@ -0,0 +1,229 @@
+#include "jobSystem.h"
+
+#include <algorithm>
+
+namespace {
+thread_local const JobSystem *currentJobSystem = nullptr;
+thread_local unsigned currentWorkerIndex = 0;
+} // namespace
+
+JobSystem::JobSystem(unsigned workerCount) {
+  if (workerCount == 0) {
+    const auto hardwareConcurrency = std::thread::hardware_concurrency();
+    workerCount = std::max(1u, hardwareConcurrency > 1 ? hardwareConcurrency - 1 : 1u);
+  }
+
+  for (unsigned i = 0; i <= workerCount; ++i) {
+    queues.push_back(std::make_unique<WorkerQueue>());
+  }
+
+  for (unsigned i = 0; i < workerCount; ++i) {
+    workers.emplace_back(&JobSystem::workerLoop, this, i);
+  }
+}
+
+JobSystem::~JobSystem() {
+  {
+    std::lock_guard<std::mutex> lock(sleepMutex);
+    isShuttingDown = true;
+  }
+  sleepCondition.notify_all();
+
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+
+JobHandle JobSystem::createJob(std::function<void()> function) {
+  auto job = std::make_shared<Job>();
+  job->function = std::move(function);
+  return job;
+}
+
+JobHandle JobSystem::createBackgroundJob(std::function<void()> function) {
+  auto job = createJob(std::move(function));
+  job->isBackground = true;
+  return job;
+}
+
+void JobSystem::addDependency(const JobHandle &job, const JobHandle &dependency) {
+  std::lock_guard<std::mutex> lock(dependency->continuationMutex);
+  if (!dependency->isFinished.load(std::memory_order_acquire)) {
+    job->pendingCount.fetch_add(1, std::memory_order_relaxed);
+    dependency->continuations.push_back(job);
+  }
+}
+
+void JobSystem::submit(const JobHandle &job) {
+  if (job->pendingCount.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    enqueue(job);
+  }
+}
+
+JobHandle JobSystem::schedule(std::function<void()> function, std::initializer_list<JobHandle> dependencies) {
+  auto job = createJob(std::move(function));
+  for (const auto &dependency : dependencies) {
+    addDependency(job, dependency);
+  }
+  submit(job);
+  return job;
+}
+
+void JobSystem::wait(const JobHandle &job) {
+  while (!job->isFinished.load(std::memory_order_acquire)) {
+    if (!runPendingJob()) {
+      std::this_thread::yield();
+    }
+  }
+
+  if (job->exception) {
+    std::rethrow_exception(job->exception);
+  }
+}
+
+void JobSystem::waitAll(const std::vector<JobHandle> &jobs) {
+  for (const auto &job : jobs) {
+    wait(job);
+  }
+}
+
+void JobSystem::parallelFor(size_t begin, size_t end, size_t grainSize,
+                            const std::function<void(size_t, size_t)> &function) {
+  if (begin >= end) {
+    return;
+  }
+
+  grainSize = std::max<size_t>(grainSize, 1);
+  const auto firstRangeEnd = std::min(end, begin + grainSize);
+
+  std::vector<JobHandle> jobs;
+  jobs.reserve((end - begin) / grainSize + 1);
+  for (auto rangeBegin = firstRangeEnd; rangeBegin < end; rangeBegin += grainSize) {
+    const auto rangeEnd = std::min(end, rangeBegin + grainSize);
+    jobs.push_back(schedule([&function, rangeBegin, rangeEnd]() { function(rangeBegin, rangeEnd); }));
+  }
+
+  // The calling thread takes the first range itself instead of idling. The jobs reference function, so all
+  // of them have to finish before this frame is left, also when a range throws.
+  std::exception_ptr exception;
+  try {
+    function(begin, firstRangeEnd);
+  } catch (...) {
+    exception = std::current_exception();
+  }
+
+  for (const auto &job : jobs) {
+    try {
+      wait(job);
+    } catch (...) {
+      if (!exception) {
+        exception = std::current_exception();
+      }
+    }
+  }
+
+  if (exception) {
+    std::rethrow_exception(exception);
+  }
+}
+
+void JobSystem::workerLoop(unsigned workerIndex) {
+  currentJobSystem = this;
+  currentWorkerIndex = workerIndex;
+
+  while (true) {
+    if (const auto job = popOrSteal(workerIndex, true)) {
+      execute(job);
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(sleepMutex);
+    sleepCondition.wait(lock, [this]() { return isShuttingDown || queuedJobCount.load() > 0; });
+    if (isShuttingDown && queuedJobCount.load() == 0) {
+      return;
+    }
+  }
+}
+
+void JobSystem::enqueue(JobHandle job) {
+  // Workers push to their own deque, every other thread shares the last one
+  const auto queueIndex =
+      currentJobSystem == this ? currentWorkerIndex : unsigned(queues.size() - 1);
+  auto &queue = job->isBackground ? backgroundQueue : *queues[queueIndex];
+  {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.jobs.push_back(std::move(job));
+  }
+  queuedJobCount.fetch_add(1);
+
+  // Taking the lock orders the increment before a sleeping worker re-checks its wait predicate
+  { std::lock_guard<std::mutex> lock(sleepMutex); }
+  sleepCondition.notify_one();
+}
+
+JobHandle JobSystem::popOrSteal(unsigned queueIndex, bool allowBackground) {
+  {
+    auto &ownQueue = *queues[queueIndex];
+    std::lock_guard<std::mutex> lock(ownQueue.mutex);
+    if (!ownQueue.jobs.empty()) {
+      auto job = std::move(ownQueue.jobs.back());
+      ownQueue.jobs.pop_back();
+      queuedJobCount.fetch_sub(1);
+      return job;
+    }
+  }
+
+  for (size_t offset = 1; offset < queues.size(); ++offset) {
+    auto &victimQueue = *queues[(queueIndex + offset) % queues.size()];
+    std::lock_guard<std::mutex> lock(victimQueue.mutex);
+    if (!victimQueue.jobs.empty()) {
+      auto job = std::move(victimQueue.jobs.front());
+      victimQueue.jobs.pop_front();
+      queuedJobCount.fetch_sub(1);
+      return job;
+    }
+  }
+
+  if (allowBackground) {
+    std::lock_guard<std::mutex> lock(backgroundQueue.mutex);
+    if (!backgroundQueue.jobs.empty()) {
+      auto job = std::move(backgroundQueue.jobs.front());
+      backgroundQueue.jobs.pop_front();
+      queuedJobCount.fetch_sub(1);
+      return job;
+    }
+  }
+
+  return nullptr;
+}
+
+void JobSystem::execute(const JobHandle &job) {
+  try {
+    job->function();
+  } catch (...) {
+    job->exception = std::current_exception();
+  }
+  job->function = nullptr;
+
+  std::vector<JobHandle> continuations;
+  {
+    std::lock_guard<std::mutex> lock(job->continuationMutex);
+    job->isFinished.store(true, std::memory_order_release);
+    continuations.swap(job->continuations);
+  }
+
+  for (const auto &continuation : continuations) {
+    submit(continuation);
+  }
+}
+
+bool JobSystem::runPendingJob() {
+  const auto isWorker = currentJobSystem == this;
+  const auto queueIndex = isWorker ? currentWorkerIndex : unsigned(queues.size() - 1);
+  if (const auto job = popOrSteal(queueIndex, isWorker)) {
+    execute(job);
+    return true;
+  }
+
+  return false;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct Job {
+  std::function<void()> function;
+  std::atomic<int> pendingCount = 1; // Unfinished dependencies plus one until the job is submitted
+  std::atomic<bool> isFinished = false;
+  bool isBackground = false; // Only picked up by worker threads, never by a thread waiting on other jobs
+  std::exception_ptr exception; // Rethrown by JobSystem::wait
+  std::mutex continuationMutex;
+  std::vector<std::shared_ptr<Job>> continuations; // Jobs waiting on this one
+};
+
+typedef std::shared_ptr<Job> JobHandle;
+
+// Work-stealing scheduler. Every worker owns a deque it pushes to and pops from at the back, idle workers
+// steal from the front of the other deques. Threads waiting on a job execute queued jobs in the meantime.
+class JobSystem {
+public:
+  // workerCount == 0 sizes the pool from the hardware concurrency, leaving one core to the calling thread
+  explicit JobSystem(unsigned workerCount = 0);
+  ~JobSystem();
+
+  JobSystem(const JobSystem &) = delete;
+  JobSystem &operator=(const JobSystem &) = delete;
+
+  JobHandle createJob(std::function<void()> function);
+  JobHandle createBackgroundJob(std::function<void()> function);
+  // Must be called before job is submitted
+  void addDependency(const JobHandle &job, const JobHandle &dependency);
+  void submit(const JobHandle &job);
+
+  // createJob + addDependency + submit
+  JobHandle schedule(std::function<void()> function, std::initializer_list<JobHandle> dependencies = {});
+
+  void wait(const JobHandle &job);
+  void waitAll(const std::vector<JobHandle> &jobs);
+
+  // Splits [begin, end) into ranges of at most grainSize and runs function(rangeBegin, rangeEnd) on all of
+  // them, returning once every range is done
+  void parallelFor(size_t begin, size_t end, size_t grainSize,
+                   const std::function<void(size_t, size_t)> &function);
+
+  unsigned workerCount() const { return unsigned(workers.size()); }
+
+private:
+  struct WorkerQueue {
+    std::mutex mutex;
+    std::deque<JobHandle> jobs;
+  };
+
+  void workerLoop(unsigned workerIndex);
+  void enqueue(JobHandle job);
+  JobHandle popOrSteal(unsigned queueIndex, bool allowBackground);
+  void execute(const JobHandle &job);
+  bool runPendingJob();
+
+  std::vector<std::unique_ptr<WorkerQueue>> queues; // One per worker plus one shared by external threads
+  WorkerQueue backgroundQueue;                      // Drained only once every other queue is empty
+  std::vector<std::thread> workers;
+  std::atomic<size_t> queuedJobCount = 0;
+  std::mutex sleepMutex;
+  std::condition_variable sleepCondition;
+  bool isShuttingDown = false;
+};
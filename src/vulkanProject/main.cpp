@@ -1,8 +1,13 @@
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 
+#include "jobSystem.h"
+#include "terrainBenchmarks.h"
+#include "terrainChunks.h"
+#include "vulkanTerrain.h"
 #include "vulkanUtils.h"
 #include "windowDefs.h"
+#include <cstring>
 #include <iostream>
 
 #ifndef NDEBUG
@@ -11,6 +16,9 @@
 
 WindowData windowData = {};
 VulkanSetupData vulkanSetupData = {};
+std::unique_ptr<JobSystem> jobSystem;
+std::unique_ptr<ChunkManager> chunkManager;
+glm::vec3 cameraPosition = glm::vec3(0.0f);
 
 static std::vector<const char *> getRequiredExtensions() {
   uint32_t glfwExtensionCount = 0;
@@ -44,27 +52,45 @@ void initWindow() {
 void mainLoop() {
   while (!glfwWindowShouldClose(windowData.window.get())) {
     glfwPollEvents();
+    chunkManager->update(cameraPosition);
   }
 }
 
 void cleanup() {
+  chunkManager.reset();
+  jobSystem.reset();
   cleanupVulkan(&vulkanSetupData);
   glfwDestroyWindow(windowData.window.get());
   glfwTerminate();
 }
 
 void runApplication() {
+  jobSystem = std::make_unique<JobSystem>();
+  chunkManager = std::make_unique<ChunkManager>(
+      jobSystem.get(), ChunkStreamingParameters(),
+      [](TerrainChunk *chunk) { createChunkGpuData(&vulkanSetupData, chunk); },
+      [](ChunkGpuData *gpuData) { destroyChunkGpuData(&vulkanSetupData, gpuData); });
   initWindow();
 
   vulkanSetupData.extensions = getRequiredExtensions();
+  const auto &streamingParameters = chunkManager->streamingParameters();
+  vulkanSetupData.terrainData.chunkSize = streamingParameters.chunkSize;
+  // Finished chunks are integrated before the cache is trimmed, so it briefly holds the in-flight ones too
+  vulkanSetupData.vegetationData.maxChunkCount =
+      uint32_t(streamingParameters.maxCachedChunks + streamingParameters.maxInFlightChunks);
   initVulkan(&vulkanSetupData, windowData.window.get());
 
   mainLoop();
   cleanup();
 }
 
-int main() {
+int main(int argc, char **argv) {
   try {
+    if (argc > 1 && strcmp(argv[1], "--benchmark") == 0) {
+      runTerrainBenchmarks();
+      return EXIT_SUCCESS;
+    }
+
     runApplication();
   } catch (const std::exception &e) {
     std::cerr << e.what() << std::endl;
@@ -0,0 +1,105 @@
+#include "mappedFile.h"
+
+#include <stdexcept>
+#include <utility>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string &path) {
+#if defined(_WIN32)
+  const auto file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    throw std::runtime_error("Failed to open " + path);
+  }
+  fileHandle = file;
+
+  LARGE_INTEGER fileSize = {};
+  if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+    close();
+    throw std::runtime_error("Failed to map empty file " + path);
+  }
+  mappedSize = size_t(fileSize.QuadPart);
+
+  mappingHandle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mappingHandle == nullptr) {
+    close();
+    throw std::runtime_error("Failed to create file mapping for " + path);
+  }
+
+  mappedData = static_cast<const uint8_t *>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+  if (mappedData == nullptr) {
+    close();
+    throw std::runtime_error("Failed to map " + path);
+  }
+#else
+  const auto file = open(path.c_str(), O_RDONLY);
+  if (file < 0) {
+    throw std::runtime_error("Failed to open " + path);
+  }
+
+  struct stat fileStat = {};
+  if (fstat(file, &fileStat) != 0 || fileStat.st_size == 0) {
+    ::close(file);
+    throw std::runtime_error("Failed to map empty file " + path);
+  }
+  mappedSize = size_t(fileStat.st_size);
+
+  const auto mapping = mmap(nullptr, mappedSize, PROT_READ, MAP_PRIVATE, file, 0);
+  ::close(file);
+  if (mapping == MAP_FAILED) {
+    mappedSize = 0;
+    throw std::runtime_error("Failed to map " + path);
+  }
+  mappedData = static_cast<const uint8_t *>(mapping);
+#endif
+}
+
+MappedFile::~MappedFile() { close(); }
+
+MappedFile::MappedFile(MappedFile &&other) noexcept { *this = std::move(other); }
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+  if (this != &other) {
+    close();
+    std::swap(mappedData, other.mappedData);
+    std::swap(mappedSize, other.mappedSize);
+#if defined(_WIN32)
+    std::swap(fileHandle, other.fileHandle);
+    std::swap(mappingHandle, other.mappingHandle);
+#endif
+  }
+
+  return *this;
+}
+
+void MappedFile::close() {
+#if defined(_WIN32)
+  if (mappedData != nullptr) {
+    UnmapViewOfFile(mappedData);
+  }
+  if (mappingHandle != nullptr) {
+    CloseHandle(mappingHandle);
+  }
+  if (fileHandle != nullptr) {
+    CloseHandle(fileHandle);
+  }
+  fileHandle = nullptr;
+  mappingHandle = nullptr;
+#else
+  if (mappedData != nullptr) {
+    munmap(const_cast<uint8_t *>(mappedData), mappedSize);
+  }
+#endif
+  mappedData = nullptr;
+  mappedSize = 0;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Read-only memory mapping of a whole file. Pages are only read from disk when they are first touched.
+class MappedFile {
+public:
+  MappedFile() = default;
+  explicit MappedFile(const std::string &path);
+  ~MappedFile();
+
+  MappedFile(MappedFile &&other) noexcept;
+  MappedFile &operator=(MappedFile &&other) noexcept;
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  const uint8_t *data() const { return mappedData; }
+  size_t size() const { return mappedSize; }
+  bool isOpen() const { return mappedData != nullptr; }
+
+private:
+  void close();
+
+  const uint8_t *mappedData = nullptr;
+  size_t mappedSize = 0;
+#if defined(_WIN32)
+  void *fileHandle = nullptr;
+  void *mappingHandle = nullptr;
+#endif
+};
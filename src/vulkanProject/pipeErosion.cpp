@@ -0,0 +1,339 @@
+#include "pipeErosion.h"
+
+#include "jobSystem.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <emmintrin.h>
+
+namespace {
+constexpr float kMinFluxTime = 1.0e-12f;
+constexpr float kMinWaterVolume = 1.0e-12f;
+constexpr float kMinWaterDepth = 1.0e-5f;
+} // namespace
+
+PipeErosionSolver::PipeErosionSolver(const Heightmap &heightmap, const PipeErosionParameters &parameters,
+                                     JobSystem *jobSystem)
+    : parameters(parameters), jobSystem(jobSystem) {
+  const auto cellCount = heightmap.heights.size();
+  pipeErosionGrid.width = heightmap.width;
+  pipeErosionGrid.height = heightmap.height;
+  pipeErosionGrid.terrain = heightmap.heights;
+  pipeErosionGrid.terrainNext = heightmap.heights;
+  for (auto field : {&pipeErosionGrid.water, &pipeErosionGrid.sediment, &pipeErosionGrid.fluxLeft,
+                     &pipeErosionGrid.fluxRight, &pipeErosionGrid.fluxTop, &pipeErosionGrid.fluxBottom,
+                     &pipeErosionGrid.velocityX, &pipeErosionGrid.velocityY, &pipeErosionGrid.outflowPerFlux,
+                     &pipeErosionGrid.sedimentNext,
+                     &pipeErosionGrid.thermalLeft, &pipeErosionGrid.thermalRight, &pipeErosionGrid.thermalTop,
+                     &pipeErosionGrid.thermalBottom}) {
+    field->assign(cellCount, 0.0f);
+  }
+}
+
+void PipeErosionSolver::step() {
+  if (pipeErosionGrid.width < 2 || pipeErosionGrid.height < 2) {
+    return;
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+
+  forEachTile([this](int rowBegin, int rowEnd) { updateFlux(rowBegin, rowEnd); });
+  forEachTile([this](int rowBegin, int rowEnd) { updateWaterAndVelocity(rowBegin, rowEnd); });
+  forEachTile([this](int rowBegin, int rowEnd) { erodeAndDeposit(rowBegin, rowEnd); });
+  pipeErosionGrid.terrain.swap(pipeErosionGrid.terrainNext);
+  forEachTile([this](int rowBegin, int rowEnd) { transportSediment(rowBegin, rowEnd); });
+  pipeErosionGrid.sediment.swap(pipeErosionGrid.sedimentNext);
+  forEachTile([this](int rowBegin, int rowEnd) { computeThermalOutflow(rowBegin, rowEnd); });
+  forEachTile([this](int rowBegin, int rowEnd) { applyThermalOutflow(rowBegin, rowEnd); });
+
+  ++completedStepCount;
+  lastStepMilliseconds =
+      std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int PipeErosionSolver::stepFor(double budgetMilliseconds) {
+  const auto start = std::chrono::steady_clock::now();
+  auto stepCount = 0;
+  do {
+    step();
+    ++stepCount;
+  } while (std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() +
+               lastStepMilliseconds <=
+           budgetMilliseconds);
+
+  return stepCount;
+}
+
+void PipeErosionSolver::copyTerrainTo(Heightmap *heightmap) const {
+  heightmap->width = pipeErosionGrid.width;
+  heightmap->height = pipeErosionGrid.height;
+  heightmap->heights = pipeErosionGrid.terrain;
+}
+
+template <typename Function> void PipeErosionSolver::forEachTile(Function &&function) {
+  const auto tileRows = size_t(std::max(parameters.tileRows, 1));
+  jobSystem->parallelFor(0, size_t(pipeErosionGrid.height), tileRows,
+                         [&function](size_t rowBegin, size_t rowEnd) {
+                           function(int(rowBegin), int(rowEnd));
+                         });
+}
+
+void PipeErosionSolver::updateFlux(int rowBegin, int rowEnd) {
+  auto &grid = pipeErosionGrid;
+  const auto width = grid.width;
+  const auto fluxFactor =
+      parameters.timeStep * parameters.pipeCrossSection * parameters.gravity / parameters.cellSize;
+  const auto cellArea = parameters.cellSize * parameters.cellSize;
+  const auto timeStep = parameters.timeStep;
+
+  const auto updateCell = [&](int x, int y) {
+    const auto i = size_t(y) * size_t(width) + size_t(x);
+    const auto surface = grid.terrain[i] + grid.water[i];
+    const auto outflow = [&](float flux, size_t neighbour) {
+      return std::max(0.0f, flux + fluxFactor * (surface - grid.terrain[neighbour] - grid.water[neighbour]));
+    };
+
+    // Nothing flows over the map border
+    const auto left = x > 0 ? outflow(grid.fluxLeft[i], i - 1) : 0.0f;
+    const auto right = x < width - 1 ? outflow(grid.fluxRight[i], i + 1) : 0.0f;
+    const auto top = y > 0 ? outflow(grid.fluxTop[i], i - width) : 0.0f;
+    const auto bottom = y < grid.height - 1 ? outflow(grid.fluxBottom[i], i + width) : 0.0f;
+
+    // A cell can't lose more water than it holds
+    const auto totalOutflow = left + right + top + bottom;
+    const auto waterVolume = grid.water[i] * cellArea;
+    const auto scale = std::min(1.0f, waterVolume / std::max(totalOutflow * timeStep, kMinFluxTime));
+    grid.outflowPerFlux[i] = timeStep / std::max(waterVolume, kMinWaterVolume);
+    grid.fluxLeft[i] = left * scale;
+    grid.fluxRight[i] = right * scale;
+    grid.fluxTop[i] = top * scale;
+    grid.fluxBottom[i] = bottom * scale;
+  };
+
+  const auto zero = _mm_setzero_ps();
+  const auto one = _mm_set1_ps(1.0f);
+  const auto fluxFactorVector = _mm_set1_ps(fluxFactor);
+  const auto cellAreaVector = _mm_set1_ps(cellArea);
+  const auto timeStepVector = _mm_set1_ps(timeStep);
+  const auto minFluxTimeVector = _mm_set1_ps(kMinFluxTime);
+  const auto minWaterVolumeVector = _mm_set1_ps(kMinWaterVolume);
+
+  for (auto y = rowBegin; y < rowEnd; ++y) {
+    if (y == 0 || y == grid.height - 1) {
+      for (auto x = 0; x < width; ++x) {
+        updateCell(x, y);
+      }
+      continue;
+    }
+
+    updateCell(0, y);
+
+    // Interior cells have all four neighbours, four of them are updated at once
+    auto x = 1;
+    for (; x + 4 <= width - 1; x += 4) {
+      const auto i = size_t(y) * size_t(width) + size_t(x);
+      const auto surfaceAt = [&](size_t index) {
+        return _mm_add_ps(_mm_loadu_ps(&grid.terrain[index]), _mm_loadu_ps(&grid.water[index]));
+      };
+
+      const auto water = _mm_loadu_ps(&grid.water[i]);
+      const auto surface = surfaceAt(i);
+      const auto outflow = [&](float *flux, size_t neighbour) {
+        const auto difference = _mm_sub_ps(surface, surfaceAt(neighbour));
+        return _mm_max_ps(zero, _mm_add_ps(_mm_loadu_ps(flux), _mm_mul_ps(fluxFactorVector, difference)));
+      };
+
+      const auto left = outflow(&grid.fluxLeft[i], i - 1);
+      const auto right = outflow(&grid.fluxRight[i], i + 1);
+      const auto top = outflow(&grid.fluxTop[i], i - width);
+      const auto bottom = outflow(&grid.fluxBottom[i], i + width);
+
+      const auto totalOutflow = _mm_add_ps(_mm_add_ps(left, right), _mm_add_ps(top, bottom));
+      const auto waterVolume = _mm_mul_ps(water, cellAreaVector);
+      const auto outflowVolume = _mm_max_ps(_mm_mul_ps(totalOutflow, timeStepVector), minFluxTimeVector);
+      const auto scale = _mm_min_ps(one, _mm_div_ps(waterVolume, outflowVolume));
+      _mm_storeu_ps(&grid.outflowPerFlux[i],
+                    _mm_div_ps(timeStepVector, _mm_max_ps(waterVolume, minWaterVolumeVector)));
+
+      _mm_storeu_ps(&grid.fluxLeft[i], _mm_mul_ps(left, scale));
+      _mm_storeu_ps(&grid.fluxRight[i], _mm_mul_ps(right, scale));
+      _mm_storeu_ps(&grid.fluxTop[i], _mm_mul_ps(top, scale));
+      _mm_storeu_ps(&grid.fluxBottom[i], _mm_mul_ps(bottom, scale));
+    }
+
+    for (; x < width; ++x) {
+      updateCell(x, y);
+    }
+  }
+}
+
+void PipeErosionSolver::updateWaterAndVelocity(int rowBegin, int rowEnd) {
+  auto &grid = pipeErosionGrid;
+  const auto width = grid.width;
+  const auto height = grid.height;
+  const auto cellArea = parameters.cellSize * parameters.cellSize;
+  const auto rain = parameters.rainRate * parameters.timeStep;
+  // Thin films produce huge velocities that would inflate the erosion capacity, cap them at a cell per step
+  const auto maxSpeed = parameters.cellSize / parameters.timeStep;
+
+  for (auto y = rowBegin; y < rowEnd; ++y) {
+    for (auto x = 0; x < width; ++x) {
+      const auto i = size_t(y) * size_t(width) + size_t(x);
+
+      // Flux arriving from each neighbour is that neighbour's outflow towards this cell
+      const auto inflowLeft = x > 0 ? grid.fluxRight[i - 1] : 0.0f;
+      const auto inflowRight = x < width - 1 ? grid.fluxLeft[i + 1] : 0.0f;
+      const auto inflowTop = y > 0 ? grid.fluxBottom[i - width] : 0.0f;
+      const auto inflowBottom = y < height - 1 ? grid.fluxTop[i + width] : 0.0f;
+
+      const auto inflow = inflowLeft + inflowRight + inflowTop + inflowBottom;
+      const auto outflow = grid.fluxLeft[i] + grid.fluxRight[i] + grid.fluxTop[i] + grid.fluxBottom[i];
+
+      const auto oldWater = grid.water[i];
+      const auto newWater = std::max(0.0f, oldWater + parameters.timeStep * (inflow - outflow) / cellArea);
+      grid.water[i] = newWater + rain;
+
+      const auto averageWater = 0.5f * (oldWater + newWater);
+      if (averageWater > kMinWaterDepth) {
+        const auto throughflowX = 0.5f * (inflowLeft - grid.fluxLeft[i] + grid.fluxRight[i] - inflowRight);
+        const auto throughflowY = 0.5f * (inflowTop - grid.fluxTop[i] + grid.fluxBottom[i] - inflowBottom);
+        const auto crossSection = averageWater * parameters.cellSize;
+        grid.velocityX[i] = std::clamp(throughflowX / crossSection, -maxSpeed, maxSpeed);
+        grid.velocityY[i] = std::clamp(throughflowY / crossSection, -maxSpeed, maxSpeed);
+      } else {
+        grid.velocityX[i] = 0.0f;
+        grid.velocityY[i] = 0.0f;
+      }
+    }
+  }
+}
+
+void PipeErosionSolver::erodeAndDeposit(int rowBegin, int rowEnd) {
+  auto &grid = pipeErosionGrid;
+  const auto width = grid.width;
+  const auto height = grid.height;
+  const auto inverseDoubleCellSize = 0.5f / parameters.cellSize;
+
+  for (auto y = rowBegin; y < rowEnd; ++y) {
+    const auto yUp = std::max(y - 1, 0);
+    const auto yDown = std::min(y + 1, height - 1);
+    for (auto x = 0; x < width; ++x) {
+      const auto i = size_t(y) * size_t(width) + size_t(x);
+      const auto xLeft = std::max(x - 1, 0);
+      const auto xRight = std::min(x + 1, width - 1);
+
+      const auto row = size_t(y) * size_t(width);
+      const auto slopeX = (grid.terrain[row + xRight] - grid.terrain[row + xLeft]) * inverseDoubleCellSize;
+      const auto slopeY = (grid.terrain[size_t(yDown) * width + x] - grid.terrain[size_t(yUp) * width + x]) *
+                          inverseDoubleCellSize;
+      const auto slopeSquared = slopeX * slopeX + slopeY * slopeY;
+      const auto sinTilt = std::max(std::sqrt(slopeSquared / (1.0f + slopeSquared)), parameters.minTilt);
+
+      const auto velocityX = grid.velocityX[i];
+      const auto velocityY = grid.velocityY[i];
+      const auto speed = std::sqrt(velocityX * velocityX + velocityY * velocityY);
+      const auto depthFactor = std::min(grid.water[i] / parameters.maxErosionDepth, 1.0f);
+      const auto capacity = parameters.sedimentCapacity * sinTilt * speed * depthFactor;
+
+      const auto sediment = grid.sediment[i];
+      auto terrainChange = capacity > sediment
+                               ? -parameters.timeStep * parameters.dissolvingRate * (capacity - sediment)
+                               : parameters.timeStep * parameters.depositionRate * (sediment - capacity);
+      terrainChange = std::min(terrainChange, sediment); // Can't deposit more than the water carries
+
+      grid.terrainNext[i] = grid.terrain[i] + terrainChange;
+      grid.sediment[i] = sediment - terrainChange;
+    }
+  }
+}
+
+void PipeErosionSolver::transportSediment(int rowBegin, int rowEnd) {
+  auto &grid = pipeErosionGrid;
+  const auto width = grid.width;
+  const auto height = grid.height;
+  const auto evaporation = std::max(0.0f, 1.0f - parameters.evaporationRate * parameters.timeStep);
+
+  for (auto y = rowBegin; y < rowEnd; ++y) {
+    for (auto x = 0; x < width; ++x) {
+      const auto i = size_t(y) * size_t(width) + size_t(x);
+
+      // Sediment leaves and arrives in the same proportion as the water moved by this step's fluxes, so
+      // whatever one cell loses its neighbours gain
+      const auto outflow = grid.fluxLeft[i] + grid.fluxRight[i] + grid.fluxTop[i] + grid.fluxBottom[i];
+      const auto remainingFraction = std::max(0.0f, 1.0f - outflow * grid.outflowPerFlux[i]);
+
+      auto sediment = grid.sediment[i] * remainingFraction;
+      if (x > 0) {
+        sediment += grid.sediment[i - 1] * grid.fluxRight[i - 1] * grid.outflowPerFlux[i - 1];
+      }
+      if (x < width - 1) {
+        sediment += grid.sediment[i + 1] * grid.fluxLeft[i + 1] * grid.outflowPerFlux[i + 1];
+      }
+      if (y > 0) {
+        sediment += grid.sediment[i - width] * grid.fluxBottom[i - width] * grid.outflowPerFlux[i - width];
+      }
+      if (y < height - 1) {
+        sediment += grid.sediment[i + width] * grid.fluxTop[i + width] * grid.outflowPerFlux[i + width];
+      }
+
+      grid.sedimentNext[i] = sediment;
+      grid.water[i] *= evaporation;
+    }
+  }
+}
+
+void PipeErosionSolver::computeThermalOutflow(int rowBegin, int rowEnd) {
+  auto &grid = pipeErosionGrid;
+  const auto width = grid.width;
+  const auto height = grid.height;
+  const auto talusHeight = parameters.talusTangent * parameters.cellSize;
+  const auto rate = parameters.timeStep * parameters.thermalErosionRate;
+
+  for (auto y = rowBegin; y < rowEnd; ++y) {
+    for (auto x = 0; x < width; ++x) {
+      const auto i = size_t(y) * size_t(width) + size_t(x);
+      const auto terrain = grid.terrain[i];
+
+      const auto excess = [&](bool hasNeighbour, size_t neighbour) {
+        return hasNeighbour ? std::max(0.0f, terrain - grid.terrain[neighbour] - talusHeight) : 0.0f;
+      };
+
+      const auto left = excess(x > 0, i - 1);
+      const auto right = excess(x < width - 1, i + 1);
+      const auto top = excess(y > 0, i - width);
+      const auto bottom = excess(y < height - 1, i + width);
+      const auto totalExcess = left + right + top + bottom;
+
+      if (totalExcess <= 0.0f) {
+        grid.thermalLeft[i] = grid.thermalRight[i] = grid.thermalTop[i] = grid.thermalBottom[i] = 0.0f;
+        continue;
+      }
+
+      // Half of the steepest excess moves, split across the neighbours in proportion to their excess
+      const auto scale = rate * 0.5f * std::max(std::max(left, right), std::max(top, bottom)) / totalExcess;
+      grid.thermalLeft[i] = left * scale;
+      grid.thermalRight[i] = right * scale;
+      grid.thermalTop[i] = top * scale;
+      grid.thermalBottom[i] = bottom * scale;
+    }
+  }
+}
+
+void PipeErosionSolver::applyThermalOutflow(int rowBegin, int rowEnd) {
+  auto &grid = pipeErosionGrid;
+  const auto width = grid.width;
+  const auto height = grid.height;
+
+  for (auto y = rowBegin; y < rowEnd; ++y) {
+    for (auto x = 0; x < width; ++x) {
+      const auto i = size_t(y) * size_t(width) + size_t(x);
+      const auto inflow = (x > 0 ? grid.thermalRight[i - 1] : 0.0f) +
+                          (x < width - 1 ? grid.thermalLeft[i + 1] : 0.0f) +
+                          (y > 0 ? grid.thermalBottom[i - width] : 0.0f) +
+                          (y < height - 1 ? grid.thermalTop[i + width] : 0.0f);
+      const auto outflow =
+          grid.thermalLeft[i] + grid.thermalRight[i] + grid.thermalTop[i] + grid.thermalBottom[i];
+      grid.terrain[i] += inflow - outflow;
+    }
+  }
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "heightmap.h"
+#include <cstddef>
+#include <vector>
+
+class JobSystem;
+
+struct PipeErosionParameters {
+  float timeStep = 0.02f;
+  float cellSize = 1.0f;
+  float pipeCrossSection = 1.0f;
+  float gravity = 9.81f;
+  float rainRate = 0.012f;         // Water depth added per second
+  float evaporationRate = 0.015f;  // Fraction of the water evaporating per second
+  float sedimentCapacity = 1.0f;   // Kc
+  float dissolvingRate = 0.5f;     // Ks
+  float depositionRate = 1.0f;     // Kd
+  float minTilt = 0.05f;           // Keeps flat areas from never eroding
+  float maxErosionDepth = 0.1f;    // Water depth at which the full capacity is reached
+  float talusTangent = 0.6f;       // Steepest stable slope for thermal weathering (~31 degrees)
+  float thermalErosionRate = 0.15f;
+  int tileRows = 32; // Rows per parallel tile
+};
+
+// Structure-of-arrays grid of the virtual pipe model, every field is width * height floats
+struct PipeErosionGrid {
+  int width = 0;
+  int height = 0;
+  std::vector<float> terrain;
+  std::vector<float> water;
+  std::vector<float> sediment;
+  std::vector<float> fluxLeft;
+  std::vector<float> fluxRight;
+  std::vector<float> fluxTop;
+  std::vector<float> fluxBottom;
+  std::vector<float> velocityX;
+  std::vector<float> velocityY;
+  std::vector<float> outflowPerFlux; // Fraction of a cell's contents one unit of flux drains per step
+
+  // Double buffers for passes that read neighbouring cells of the field they update
+  std::vector<float> terrainNext;
+  std::vector<float> sedimentNext;
+
+  // Material each cell sheds to its four neighbours during thermal weathering
+  std::vector<float> thermalLeft;
+  std::vector<float> thermalRight;
+  std::vector<float> thermalTop;
+  std::vector<float> thermalBottom;
+};
+
+// Shallow-water hydraulic erosion (Mei et al. 2007) plus thermal weathering on a grid. Sediment moves along
+// the pipes together with the water instead of being advected semi-Lagrangian, which keeps the total mass
+// constant. Every pass runs row tiles in parallel. A tile reads a one-cell halo from its neighbours, and the
+// barrier between passes is what publishes the halo, so no tile ever reads a value another tile is writing.
+class PipeErosionSolver {
+public:
+  PipeErosionSolver(const Heightmap &heightmap, const PipeErosionParameters &parameters,
+                    JobSystem *jobSystem);
+
+  void step();
+  // Runs whole steps until the next one would exceed the budget, always at least one. Returns the steps run.
+  int stepFor(double budgetMilliseconds);
+
+  void copyTerrainTo(Heightmap *heightmap) const;
+
+  const PipeErosionGrid &grid() const { return pipeErosionGrid; }
+  size_t stepCount() const { return completedStepCount; }
+
+private:
+  template <typename Function> void forEachTile(Function &&function);
+
+  void updateFlux(int rowBegin, int rowEnd);
+  void updateWaterAndVelocity(int rowBegin, int rowEnd);
+  void erodeAndDeposit(int rowBegin, int rowEnd);
+  void transportSediment(int rowBegin, int rowEnd);
+  void computeThermalOutflow(int rowBegin, int rowEnd);
+  void applyThermalOutflow(int rowBegin, int rowEnd);
+
+  PipeErosionGrid pipeErosionGrid;
+  PipeErosionParameters parameters;
+  JobSystem *jobSystem;
+  size_t completedStepCount = 0;
+  double lastStepMilliseconds = 0.0;
+};
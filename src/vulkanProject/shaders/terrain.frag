@@ -0,0 +1,17 @@
+#version 450
+
+layout(location = 0) in vec3 inNormal;
+layout(location = 1) in float inHeight;
+
+layout(location = 0) out vec4 outColor;
+
+const vec3 kSunDirection = vec3(0.4, 0.8, 0.3);
+const vec3 kLowlandColor = vec3(0.25, 0.4, 0.15);
+const vec3 kHighlandColor = vec3(0.55, 0.5, 0.45);
+
+void main() {
+  vec3 normal = normalize(inNormal);
+  float diffuse = max(dot(normal, normalize(kSunDirection)), 0.0);
+  vec3 albedo = mix(kLowlandColor, kHighlandColor, smoothstep(0.0, 150.0, inHeight));
+  outColor = vec4(albedo * (0.2 + 0.8 * diffuse), 1.0);
+}
@@ -0,0 +1,49 @@
+#version 450
+
+// Must match TerrainPushConstants in terrainMesh.h
+layout(push_constant) uniform TerrainPushConstants {
+  mat4 viewProjection;
+  vec3 cameraPosition;
+  float sampleSpacing;
+  vec2 gridOrigin;
+  float heightOffset;
+  float heightRange;
+  float morphStart;
+  float morphEnd;
+  uint morphMask;
+  uint morphBits;
+} pushConstants;
+
+layout(location = 0) in uvec2 inSamplePosition;
+layout(location = 1) in vec2 inHeights;  // R16G16_UNORM, height and morph height
+layout(location = 2) in vec4 inNormals;  // R8G8B8A8_SNORM, octahedral normal and morph normal
+
+layout(location = 0) out vec3 outNormal;
+layout(location = 1) out float outHeight;
+
+vec3 decodeOctahedral(vec2 projected) {
+  vec3 normal = vec3(projected.x, 1.0 - abs(projected.x) - abs(projected.y), projected.y);
+  if (normal.y < 0.0) {
+    vec2 signs = vec2(projected.x >= 0.0 ? 1.0 : -1.0, projected.y >= 0.0 ? 1.0 : -1.0);
+    normal.xz = (1.0 - abs(projected.yx)) * signs;
+  }
+  return normalize(normal);
+}
+
+void main() {
+  vec2 position = pushConstants.gridOrigin + vec2(inSamplePosition) * pushConstants.sampleSpacing;
+  vec2 heights = pushConstants.heightOffset + inHeights * pushConstants.heightRange;
+
+  // Only the vertices the next coarser LOD drops morph, everything else already matches it
+  float morph = 0.0;
+  if (((inSamplePosition.x | inSamplePosition.y) & pushConstants.morphMask) == pushConstants.morphBits) {
+    float distanceToCamera = distance(vec3(position.x, heights.x, position.y), pushConstants.cameraPosition);
+    morph = clamp((distanceToCamera - pushConstants.morphStart) /
+                      max(pushConstants.morphEnd - pushConstants.morphStart, 1e-3), 0.0, 1.0);
+  }
+
+  float height = mix(heights.x, heights.y, morph);
+  gl_Position = pushConstants.viewProjection * vec4(position.x, height, position.y, 1.0);
+  outNormal = normalize(mix(decodeOctahedral(inNormals.xy), decodeOctahedral(inNormals.zw), morph));
+  outHeight = height;
+}
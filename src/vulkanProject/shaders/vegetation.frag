@@ -0,0 +1,14 @@
+#version 450
+
+layout(location = 0) in vec3 inNormal;
+layout(location = 1) in vec3 inColor;
+
+layout(location = 0) out vec4 outColor;
+
+const vec3 kSunDirection = vec3(0.4, 0.8, 0.3);
+
+void main() {
+  vec3 normal = normalize(inNormal);
+  float diffuse = max(dot(normal, normalize(kSunDirection)), 0.0);
+  outColor = vec4(inColor * (0.2 + 0.8 * diffuse), 1.0);
+}
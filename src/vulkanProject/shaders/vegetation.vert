@@ -0,0 +1,46 @@
+#version 450
+
+// Must match VegetationDrawPushConstants in vegetationMesh.h
+layout(push_constant) uniform VegetationDrawPushConstants {
+  mat4 viewProjection;
+  uint visibleInstanceOffset;
+  uint instanceCapacity;
+} pushConstants;
+
+// Structure of arrays, see VegetationInstanceField in vegetationMesh.h
+layout(std430, set = 0, binding = 0) readonly buffer InstanceBuffer {
+  float instanceData[];
+};
+
+// Written by shaders/vegetationCull.comp
+layout(std430, set = 0, binding = 2) readonly buffer VisibleInstanceBuffer {
+  uint visibleInstances[];
+};
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inNormal;
+
+layout(location = 0) out vec3 outNormal;
+layout(location = 1) out vec3 outColor;
+
+// Indexed by scatter layer, see defaultScatterLayers()
+const vec3 kLayerColors[3] = vec3[](vec3(0.1, 0.3, 0.1), vec3(0.3, 0.45, 0.15), vec3(0.45, 0.43, 0.4));
+
+void main() {
+  uint instance = visibleInstances[pushConstants.visibleInstanceOffset + gl_InstanceIndex];
+  uint capacity = pushConstants.instanceCapacity;
+  vec3 instancePosition = vec3(instanceData[instance], instanceData[capacity + instance],
+                               instanceData[2 * capacity + instance]);
+  float rotation = instanceData[3 * capacity + instance];
+  float scale = instanceData[4 * capacity + instance];
+  uint layer = floatBitsToUint(instanceData[5 * capacity + instance]);
+
+  // Rotation around the y axis
+  float sine = sin(rotation);
+  float cosine = cos(rotation);
+  mat3 orientation = mat3(cosine, 0.0, -sine, 0.0, 1.0, 0.0, sine, 0.0, cosine);
+
+  gl_Position = pushConstants.viewProjection * vec4(instancePosition + orientation * (inPosition * scale), 1.0);
+  outNormal = orientation * inNormal;
+  outColor = kLayerColors[min(layer, 2u)];
+}
@@ -0,0 +1,60 @@
+#include "simdUtils.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace {
+SimdLevel querySimdLevel() {
+#if defined(_MSC_VER)
+  int cpuInfo[4] = {};
+  __cpuid(cpuInfo, 0);
+  const auto maxLeaf = cpuInfo[0];
+
+  __cpuid(cpuInfo, 1);
+  const auto hasSse41 = (cpuInfo[2] & (1 << 19)) != 0;
+  const auto hasOsxsave = (cpuInfo[2] & (1 << 27)) != 0;
+  const auto hasAvx = (cpuInfo[2] & (1 << 28)) != 0;
+
+  auto hasAvx2 = false;
+  if (maxLeaf >= 7 && hasOsxsave && hasAvx) {
+    // The OS has to save the upper halves of the ymm registers on context switches
+    const auto xcr0 = _xgetbv(0);
+    if ((xcr0 & 0x6) == 0x6) {
+      __cpuidex(cpuInfo, 7, 0);
+      hasAvx2 = (cpuInfo[1] & (1 << 5)) != 0;
+    }
+  }
+#else
+  __builtin_cpu_init();
+  const auto hasSse41 = __builtin_cpu_supports("sse4.1") != 0;
+  const auto hasAvx2 = __builtin_cpu_supports("avx2") != 0;
+#endif
+
+  if (hasAvx2) {
+    return SimdLevel::Avx2;
+  }
+
+  if (hasSse41) {
+    return SimdLevel::Sse41;
+  }
+
+  return SimdLevel::Scalar;
+}
+} // namespace
+
+SimdLevel detectSimdLevel() {
+  static const auto simdLevel = querySimdLevel();
+  return simdLevel;
+}
+
+const char *simdLevelName(SimdLevel simdLevel) {
+  switch (simdLevel) {
+  case SimdLevel::Avx2:
+    return "AVX2";
+  case SimdLevel::Sse41:
+    return "SSE4.1";
+  default:
+    return "Scalar";
+  }
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+// MSVC emits any intrinsic regardless of /arch, other compilers need the target enabled per function.
+#if defined(_MSC_VER)
+#define SIMD_TARGET_SSE41
+#define SIMD_TARGET_AVX2
+#else
+#define SIMD_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+enum class SimdLevel { Scalar, Sse41, Avx2 };
+
+SimdLevel detectSimdLevel();
+const char *simdLevelName(SimdLevel simdLevel);
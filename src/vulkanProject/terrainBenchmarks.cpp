@@ -0,0 +1,1282 @@
+#include "terrainBenchmarks.h"
+
+#include "glm/gtc/matrix_transform.hpp"
+#include "glm/gtc/noise.hpp"
+#include "heightmap.h"
+#include "hydraulicErosion.h"
+#include "jobSystem.h"
+#include "terrainBiomes.h"
+#include "terrainCellularNoise.h"
+#include "terrainChunks.h"
+#include "terrainCulling.h"
+#include "terrainHorizon.h"
+#include "terrainHydrology.h"
+#include "terrainLod.h"
+#include "terrainNoise.h"
+#include "terrainNoiseGraph.h"
+#include "terrainNormals.h"
+#include "terrainQueries.h"
+#include "terrainRaycast.h"
+#include "terrainScatter.h"
+#include "terrainSculpt.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+constexpr auto kNoiseTileSize = 1024;
+constexpr auto kNoiseGraphTileSize = 512;
+constexpr auto kBandLimitTileSize = 512;
+constexpr auto kBandLimitOctaveCount = 10;
+constexpr auto kErosionMapSize = 1024;
+constexpr size_t kErosionDropletCount = 250000;
+constexpr auto kHydrologyMapSize = 2048;
+constexpr auto kCdlodMapSize = 4097;
+constexpr auto kCdlodLeafNodeSize = 16;
+constexpr auto kCdlodCameraCount = 64;
+constexpr auto kCullingRepeatCount = 100;
+constexpr auto kHorizonCheckSampleCount = 8; // Per side of the top of a rejected node's bounds
+constexpr auto kScatterAreaSize = 256.0f;
+constexpr auto kScatterMinDistance = 2.0f;
+constexpr auto kScatterCandidateCount = 30;
+constexpr auto kRaycastMapSize = 1025;
+constexpr size_t kRaycastRayCount = 16384;
+constexpr auto kRaycastMarchStep = 0.25f;
+constexpr auto kRaycastHitTolerance = 0.05f;
+constexpr auto kHorizonMapSize = 512;
+constexpr auto kQueryChunkCount = 4; // Per side
+constexpr size_t kQueryAgentCount = 65536;
+constexpr auto kHashChunkCount = 8; // Per side
+constexpr auto kSculptDabCount = 256;
+constexpr auto kSculptStrokeDabCount = 64; // The last dabs raise one spot, as when pulling up a peak
+constexpr auto kSculptBrushRadius = 6.0f;
+
+template <typename Function> double measureSeconds(Function &&function) {
+  const auto start = std::chrono::steady_clock::now();
+  function();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void printThroughput(const char *name, double seconds, size_t sampleCount, double baselineSeconds) {
+  std::cout << '\t' << name << ": " << seconds * 1000.0 << " ms, " << double(sampleCount) / seconds / 1.0e6
+            << " Msamples/s, " << baselineSeconds / seconds << "x\n";
+}
+
+void benchmarkFbmNoise() {
+  FbmParameters fbmParameters;
+  const auto sampleCount = size_t(kNoiseTileSize) * kNoiseTileSize;
+  std::vector<float> glmHeights(sampleCount);
+  std::vector<float> scalarHeights(sampleCount);
+  std::vector<float> simdHeights(sampleCount);
+
+  // Baseline: one glm::perlin call per sample and octave
+  const auto glmSeconds = measureSeconds([&]() {
+    for (auto row = 0; row < kNoiseTileSize; ++row) {
+      for (auto column = 0; column < kNoiseTileSize; ++column) {
+        auto sum = 0.0f;
+        auto frequency = fbmParameters.frequency;
+        auto amplitude = fbmParameters.amplitude;
+        for (auto octave = 0; octave < fbmParameters.octaveCount; ++octave) {
+          sum += amplitude * glm::perlin(glm::vec2(float(column), float(row)) * frequency);
+          frequency *= fbmParameters.lacunarity;
+          amplitude *= fbmParameters.gain;
+        }
+        glmHeights[size_t(row) * kNoiseTileSize + column] = sum;
+      }
+    }
+  });
+
+  std::cout << "fBm noise, " << kNoiseTileSize << "x" << kNoiseTileSize << ", " << fbmParameters.octaveCount
+            << " octaves\n";
+  printThroughput("glm::perlin", glmSeconds, sampleCount, glmSeconds);
+
+  const auto scalarSeconds = measureSeconds([&]() {
+    generateFbmTile(fbmParameters, 0.0f, 0.0f, 1.0f, kNoiseTileSize, kNoiseTileSize, scalarHeights.data(),
+                    kNoiseTileSize, SimdLevel::Scalar);
+  });
+  printThroughput(simdLevelName(SimdLevel::Scalar), scalarSeconds, sampleCount, glmSeconds);
+
+  for (const auto simdLevel : {SimdLevel::Sse41, SimdLevel::Avx2}) {
+    if (simdLevel > detectSimdLevel()) {
+      continue;
+    }
+
+    const auto simdSeconds = measureSeconds([&]() {
+      generateFbmTile(fbmParameters, 0.0f, 0.0f, 1.0f, kNoiseTileSize, kNoiseTileSize, simdHeights.data(),
+                      kNoiseTileSize, simdLevel);
+    });
+    printThroughput(simdLevelName(simdLevel), simdSeconds, sampleCount, glmSeconds);
+
+    if (std::memcmp(simdHeights.data(), scalarHeights.data(), sampleCount * sizeof(float)) != 0) {
+      std::cout << "\t\t" << simdLevelName(simdLevel) << " output differs from the scalar path!\n";
+    }
+  }
+}
+
+Heightmap createBenchmarkHeightmap(int size) {
+  FbmParameters fbmParameters;
+  fbmParameters.amplitude = 128.0f;
+
+  Heightmap heightmap(size, size);
+  generateFbmTile(fbmParameters, 0.0f, 0.0f, 1.0f, size, size, heightmap.heights.data(), size_t(size));
+  return heightmap;
+}
+
+void benchmarkHeightsAndNormals() {
+  FbmParameters fbmParameters;
+  fbmParameters.amplitude = 128.0f;
+  const auto sampleCount = size_t(kNoiseTileSize) * kNoiseTileSize;
+  Heightmap heightmap(kNoiseTileSize, kNoiseTileSize);
+
+  std::cout << "Heights and normals, " << kNoiseTileSize << "x" << kNoiseTileSize << "\n";
+
+  for (const auto encoding :
+       {NormalEncoding::Float32x3, NormalEncoding::Octahedral16x2, NormalEncoding::Octahedral8x2}) {
+    std::vector<uint8_t> normals(sampleCount * normalEncodingSize(encoding));
+
+    // Baseline: a second sweep over the finished heightmap. The fused pass is there for its seamless borders,
+    // this checks that sampling the halo from the noise costs nothing. Even at 8192x8192, well past the last
+    // level cache, the noise takes about 95% of the time and both stay within noise of each other.
+    const auto twoPassSeconds = measureSeconds([&]() {
+      generateFbmTile(fbmParameters, 0.0f, 0.0f, 1.0f, kNoiseTileSize, kNoiseTileSize,
+                      heightmap.heights.data(), kNoiseTileSize);
+      computeHeightmapNormals(heightmap, 1.0f, encoding, normals.data(), kNoiseTileSize);
+    });
+    const auto fusedSeconds = measureSeconds([&]() {
+      generateHeightsAndNormals(fbmParameters, 0.0f, 0.0f, 1.0f, kNoiseTileSize, kNoiseTileSize, 1.0f,
+                                heightmap.heights.data(), kNoiseTileSize, encoding, normals.data(),
+                                kNoiseTileSize);
+    });
+
+    std::cout << '\t' << normalEncodingSize(encoding) << " bytes per normal\n";
+    printThroughput("two passes", twoPassSeconds, sampleCount, twoPassSeconds);
+    printThroughput("fused, noise halo", fusedSeconds, sampleCount, twoPassSeconds);
+  }
+}
+
+// Tiles of the same sample count at ever coarser spacings, as generated for successive LOD levels
+void benchmarkBandLimitedFbm() {
+  FbmParameters fbmParameters;
+  fbmParameters.octaveCount = kBandLimitOctaveCount;
+  const auto sampleCount = size_t(kBandLimitTileSize) * kBandLimitTileSize;
+  std::vector<float> fullHeights(sampleCount);
+  std::vector<float> limitedHeights(sampleCount);
+
+  std::cout << "Band-limited fBm, " << kBandLimitTileSize << "x" << kBandLimitTileSize << ", "
+            << fbmParameters.octaveCount << " octaves\n";
+
+  for (const auto spacing : {1.0f, 4.0f, 16.0f, 64.0f}) {
+    const auto limitedParameters = bandLimitFbm(fbmParameters, spacing);
+    const auto fullSeconds = measureSeconds([&]() {
+      generateFbmTile(fbmParameters, 0.0f, 0.0f, spacing, kBandLimitTileSize, kBandLimitTileSize,
+                      fullHeights.data(), kBandLimitTileSize);
+    });
+    const auto limitedSeconds = measureSeconds([&]() {
+      generateFbmTile(limitedParameters, 0.0f, 0.0f, spacing, kBandLimitTileSize, kBandLimitTileSize,
+                      limitedHeights.data(), kBandLimitTileSize);
+    });
+
+    // What the dropped octaves added, which is all aliasing at this spacing
+    auto squaredDifference = 0.0;
+    for (size_t i = 0; i < sampleCount; ++i) {
+      const auto difference = double(fullHeights[i]) - double(limitedHeights[i]);
+      squaredDifference += difference * difference;
+    }
+
+    std::cout << "\tspacing " << spacing << ", octaves kept: " << limitedParameters.octaveCount
+              << ", rms difference: " << std::sqrt(squaredDifference / double(sampleCount)) << "\n";
+    printThroughput("\tall octaves", fullSeconds, sampleCount, fullSeconds);
+    printThroughput("\tband-limited", limitedSeconds, sampleCount, fullSeconds);
+  }
+}
+
+// The default graph compiles to a fused kernel, the second one matches no known chain and runs in blocks
+void benchmarkNoiseGraph() {
+  const auto sampleCount = size_t(kNoiseGraphTileSize) * kNoiseGraphTileSize;
+  const auto tileBytes = sampleCount * sizeof(float);
+
+  NoiseGraph unknownGraph;
+  FbmParameters ridgeNoise;
+  ridgeNoise.seed = 7;
+  ridgeNoise.frequency = 1.0f / 128.0f;
+  unknownGraph.addTerrace(unknownGraph.addAdd(unknownGraph.addFbm(FbmParameters()),
+                                              unknownGraph.addRidgedFbm(ridgeNoise)),
+                          0.25f, 0.5f);
+
+  std::cout << "Noise graph, " << kNoiseGraphTileSize << "x" << kNoiseGraphTileSize << "\n";
+
+  std::vector<float> referenceHeights(sampleCount);
+  std::vector<float> unfusedHeights(sampleCount);
+  std::vector<float> compiledHeights(sampleCount);
+  const std::pair<const char *, NoiseGraph> graphs[] = {{"default graph", defaultTerrainNoiseGraph(0)},
+                                                        {"unknown graph", unknownGraph}};
+  for (const auto &graph : graphs) {
+    std::cout << '\t' << graph.first << ", unfused peak "
+              << unfusedBufferCount(graph.second) * tileBytes / (1024 * 1024) << " MB\n";
+
+    generateNoiseGraphTileUnfused(graph.second, 0.0f, 0.0f, 1.0f, kNoiseGraphTileSize, kNoiseGraphTileSize,
+                                  referenceHeights.data(), kNoiseGraphTileSize, SimdLevel::Scalar);
+    for (const auto simdLevel : {SimdLevel::Scalar, SimdLevel::Sse41, SimdLevel::Avx2}) {
+      if (simdLevel > detectSimdLevel()) {
+        continue;
+      }
+
+      const auto unfusedSeconds = measureSeconds([&]() {
+        generateNoiseGraphTileUnfused(graph.second, 0.0f, 0.0f, 1.0f, kNoiseGraphTileSize,
+                                      kNoiseGraphTileSize, unfusedHeights.data(), kNoiseGraphTileSize,
+                                      simdLevel);
+      });
+      const CompiledNoiseGraph compiledGraph(graph.second, simdLevel);
+      const auto compiledSeconds = measureSeconds([&]() {
+        compiledGraph.generateTile(0.0f, 0.0f, 1.0f, kNoiseGraphTileSize, kNoiseGraphTileSize,
+                                   compiledHeights.data(), kNoiseGraphTileSize);
+      });
+
+      std::cout << "\t\t" << simdLevelName(simdLevel) << "\n";
+      printThroughput("\tunfused", unfusedSeconds, sampleCount, unfusedSeconds);
+      printThroughput(compiledGraph.isFused() ? "\tfused" : "\tblocks", compiledSeconds, sampleCount,
+                      unfusedSeconds);
+      if (unfusedHeights != referenceHeights || compiledHeights != referenceHeights) {
+        std::cout << "\t\t" << simdLevelName(simdLevel) << " output differs from the scalar path!\n";
+      }
+    }
+  }
+}
+
+// Baseline: one octave of the gradient noise under fBm, at the same frequency
+void benchmarkCellularNoise() {
+  CellularParameters cellularParameters;
+  FbmParameters fbmParameters;
+  fbmParameters.octaveCount = 1;
+  fbmParameters.frequency = cellularParameters.frequency;
+  const auto sampleCount = size_t(kNoiseTileSize) * kNoiseTileSize;
+  std::vector<float> heights(sampleCount);
+  std::vector<float> scalarF1(sampleCount);
+  std::vector<float> scalarF2(sampleCount);
+  std::vector<uint32_t> scalarCellIds(sampleCount);
+  std::vector<float> f1(sampleCount);
+  std::vector<float> f2(sampleCount);
+  std::vector<uint32_t> cellIds(sampleCount);
+
+  std::cout << "Cellular noise, " << kNoiseTileSize << "x" << kNoiseTileSize << ", F1, F2 and cell IDs\n";
+
+  for (const auto simdLevel : {SimdLevel::Scalar, SimdLevel::Sse41, SimdLevel::Avx2}) {
+    if (simdLevel > detectSimdLevel()) {
+      continue;
+    }
+
+    const auto octaveSeconds = measureSeconds([&]() {
+      generateFbmTile(fbmParameters, 0.0f, 0.0f, 1.0f, kNoiseTileSize, kNoiseTileSize, heights.data(),
+                      kNoiseTileSize, simdLevel);
+    });
+    const auto cellularSeconds = measureSeconds([&]() {
+      generateCellularTile(cellularParameters, 0.0f, 0.0f, 1.0f, kNoiseTileSize, kNoiseTileSize, f1.data(),
+                           f2.data(), cellIds.data(), kNoiseTileSize, simdLevel);
+    });
+
+    std::cout << "\t\t" << simdLevelName(simdLevel) << "\n";
+    printThroughput("\tgradient octave", octaveSeconds, sampleCount, octaveSeconds);
+    printThroughput("\tcellular", cellularSeconds, sampleCount, octaveSeconds);
+
+    if (simdLevel == SimdLevel::Scalar) {
+      scalarF1 = f1;
+      scalarF2 = f2;
+      scalarCellIds = cellIds;
+    } else if (std::memcmp(f1.data(), scalarF1.data(), sampleCount * sizeof(float)) != 0 ||
+               std::memcmp(f2.data(), scalarF2.data(), sampleCount * sizeof(float)) != 0 ||
+               cellIds != scalarCellIds) {
+      std::cout << "\t\t" << simdLevelName(simdLevel) << " output differs from the scalar path!\n";
+    }
+  }
+}
+
+void benchmarkHydraulicErosion() {
+  const auto sourceHeightmap = createBenchmarkHeightmap(kErosionMapSize);
+  HydraulicErosionParameters erosionParameters;
+  erosionParameters.dropletCount = kErosionDropletCount;
+
+  std::cout << "Hydraulic erosion, " << kErosionMapSize << "x" << kErosionMapSize << ", "
+            << kErosionDropletCount << " droplets\n";
+
+  Heightmap referenceHeightmap;
+  for (const auto workerCount : {1u, 0u}) {
+    JobSystem jobSystem(workerCount);
+    for (const auto isDeterministic : {true, false}) {
+      auto heightmap = sourceHeightmap;
+      erosionParameters.isDeterministic = isDeterministic;
+      const auto erosionStats = erodeHeightmap(&heightmap, erosionParameters, &jobSystem);
+
+      std::cout << '\t' << (isDeterministic ? "deterministic" : "atomic") << ", "
+                << jobSystem.workerCount() + 1 << " threads: " << erosionStats.seconds * 1000.0 << " ms, "
+                << erosionStats.dropletsPerSecond / 1.0e6 << " Mdroplets/s\n";
+
+      if (isDeterministic) {
+        if (referenceHeightmap.heights.empty()) {
+          referenceHeightmap = heightmap;
+        } else if (referenceHeightmap.heights != heightmap.heights) {
+          std::cout << "\t\tDeterministic output differs between thread counts!\n";
+        }
+      }
+    }
+  }
+}
+
+void benchmarkHydrology() {
+  const auto sourceHeightmap = createBenchmarkHeightmap(kHydrologyMapSize);
+  HydrologyParameters hydrologyParameters;
+
+  std::cout << "Hydrology, " << kHydrologyMapSize << "x" << kHydrologyMapSize << ", "
+            << hydrologyParameters.tileSize << " sample tiles\n";
+
+  // A single tile floods the whole map at once, which is the plain priority-flood the tiles have to match
+  Heightmap referenceHeightmap;
+  DrainageMap referenceDrainageMap;
+  {
+    JobSystem jobSystem(1);
+    referenceHeightmap = sourceHeightmap;
+    fillDepressions(&referenceHeightmap, kHydrologyMapSize, &jobSystem);
+    computeFlowDirections(referenceHeightmap, kHydrologyMapSize, &jobSystem, &referenceDrainageMap);
+    accumulateFlow(&referenceDrainageMap, kHydrologyMapSize, &jobSystem);
+  }
+
+  for (const auto workerCount : {1u, 0u}) {
+    JobSystem jobSystem(workerCount);
+    auto filledHeightmap = sourceHeightmap;
+    fillDepressions(&filledHeightmap, hydrologyParameters.tileSize, &jobSystem);
+    if (filledHeightmap.heights != referenceHeightmap.heights) {
+      std::cout << "\t\tTiled depression filling differs from the single tile!\n";
+    }
+
+    auto heightmap = sourceHeightmap;
+    DrainageMap drainageMap;
+    std::vector<RiverReach> rivers;
+    const auto hydrologyStats =
+        runHydrology(&heightmap, hydrologyParameters, &jobSystem, &drainageMap, &rivers);
+    if (drainageMap.accumulation != referenceDrainageMap.accumulation) {
+      std::cout << "\t\tTiled flow accumulation differs from the single tile!\n";
+    }
+
+    std::cout << '\t' << jobSystem.workerCount() + 1 << " threads: " << hydrologyStats.seconds * 1000.0
+              << " ms (fill " << hydrologyStats.fillSeconds * 1000.0 << " ms, flow directions "
+              << hydrologyStats.flowDirectionSeconds * 1000.0 << " ms, accumulation "
+              << hydrologyStats.accumulationSeconds * 1000.0 << " ms, rivers "
+              << hydrologyStats.riverSeconds * 1000.0 << " ms), " << rivers.size() << " reaches, "
+              << hydrologyStats.riverCellCount << " river cells\n";
+  }
+}
+
+void benchmarkFrustumCulling(const CdlodQuadtree &quadtree, const Heightmap &heightmap, float sampleSpacing,
+                             const glm::vec3 &cameraPosition) {
+  const auto view = glm::lookAt(cameraPosition, cameraPosition + glm::vec3(1.0f, -0.1f, 1.0f),
+                                glm::vec3(0.0f, 1.0f, 0.0f));
+  const auto projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 1.0f, 30000.0f);
+  const auto frustum = extractFrustum(projection * view);
+
+  std::cout << "Frustum culling, " << quadtree.nodeCount() << " nodes\n";
+
+  // Baseline: every node against every plane with glm, without using the hierarchy
+  std::vector<CullResult> flatVisibility(quadtree.nodeCount());
+  const auto flatSeconds = measureSeconds([&]() {
+    for (auto repeat = 0; repeat < kCullingRepeatCount; ++repeat) {
+      for (uint32_t nodeIndex = 0; nodeIndex < quadtree.nodeCount(); ++nodeIndex) {
+        glm::vec3 boundsMin, boundsMax;
+        quadtree.nodeBounds(quadtree.node(nodeIndex), &boundsMin, &boundsMax);
+        auto cullResult = CullResult::Inside;
+        for (const auto &plane : frustum.planes) {
+          const auto normal = glm::vec3(plane);
+          const auto isPositive = glm::greaterThan(normal, glm::vec3(0.0f));
+          const auto positiveVertex = glm::mix(boundsMin, boundsMax, isPositive);
+          const auto negativeVertex = glm::mix(boundsMax, boundsMin, isPositive);
+          if (glm::dot(normal, positiveVertex) + plane.w < 0.0f) {
+            cullResult = CullResult::Outside;
+            break;
+          }
+          if (glm::dot(normal, negativeVertex) + plane.w < 0.0f) {
+            cullResult = CullResult::Intersecting;
+          }
+        }
+        flatVisibility[nodeIndex] = cullResult;
+      }
+    }
+  });
+  std::cout << "\tflat glm: " << flatSeconds / kCullingRepeatCount * 1000.0 << " ms\n";
+
+  CdlodFrustumCuller culler(&quadtree);
+  std::vector<CullResult> referenceVisibility;
+  for (const auto simdLevel : {SimdLevel::Scalar, SimdLevel::Sse41, SimdLevel::Avx2}) {
+    if (simdLevel > detectSimdLevel()) {
+      continue;
+    }
+
+    CullingStats cullingStats;
+    const auto seconds = measureSeconds([&]() {
+      for (auto repeat = 0; repeat < kCullingRepeatCount; ++repeat) {
+        cullingStats = culler.cull(frustum, simdLevel);
+      }
+    });
+    std::cout << "\thierarchical " << simdLevelName(simdLevel) << ": "
+              << seconds / kCullingRepeatCount * 1000.0 << " ms, " << cullingStats.testedNodes
+              << " nodes tested, " << cullingStats.visibleNodes << " visible, " << flatSeconds / seconds
+              << "x\n";
+
+    if (referenceVisibility.empty()) {
+      referenceVisibility = culler.nodeVisibility();
+    } else if (referenceVisibility != culler.nodeVisibility()) {
+      std::cout << "\t\t" << simdLevelName(simdLevel) << " visibility differs from the scalar path!\n";
+    }
+  }
+
+  std::vector<CdlodSelectedNode> selectedNodes;
+  quadtree.select(cameraPosition, &selectedNodes);
+  const auto unculledCount = selectedNodes.size();
+  quadtree.select(cameraPosition, culler.nodeVisibility(), &selectedNodes);
+  std::cout << "\t" << selectedNodes.size() << " of " << unculledCount << " selected nodes in the frustum\n";
+
+  const auto frustumNodes = selectedNodes;
+  HorizonOcclusionCuller horizonCuller;
+  const auto horizonStats = horizonCuller.cull(quadtree, cameraPosition, &selectedNodes);
+  std::cout << "\thorizon occlusion: " << horizonStats.seconds * 1000.0 << " ms, "
+            << horizonStats.visibleNodes << " of " << horizonStats.testedNodes << " nodes visible\n";
+
+  // A rejected node has to be hidden by the terrain itself, so no ray from the camera may reach any point on
+  // the top of its bounds. Samples are kept inside the heightmap, rays beyond it would miss trivially.
+  std::vector<bool> isVisible(quadtree.nodeCount(), false);
+  for (const auto &selectedNode : selectedNodes) {
+    isVisible[selectedNode.node] = true;
+  }
+  const HeightPyramid pyramid(&heightmap, glm::vec2(0.0f), sampleSpacing);
+  const auto terrainSize = glm::vec2(float(heightmap.width - 1), float(heightmap.height - 1)) * sampleSpacing;
+  size_t rejectedCount = 0;
+  size_t unobstructedCount = 0;
+  for (const auto &frustumNode : frustumNodes) {
+    if (isVisible[frustumNode.node]) {
+      continue;
+    }
+    ++rejectedCount;
+
+    glm::vec3 boundsMin, boundsMax;
+    quadtree.nodeBounds(quadtree.node(frustumNode.node), &boundsMin, &boundsMax);
+    auto isUnobstructed = false;
+    for (auto sampleZ = 0; sampleZ < kHorizonCheckSampleCount && !isUnobstructed; ++sampleZ) {
+      for (auto sampleX = 0; sampleX < kHorizonCheckSampleCount && !isUnobstructed; ++sampleX) {
+        const auto t = (glm::vec2(float(sampleX), float(sampleZ)) + 0.5f) / float(kHorizonCheckSampleCount);
+        const auto sample = glm::min(glm::mix(glm::vec2(boundsMin.x, boundsMin.z),
+                                              glm::vec2(boundsMax.x, boundsMax.z), t),
+                                     terrainSize);
+        const auto target = glm::vec3(sample.x, boundsMax.y, sample.y);
+        // Stopping just short of the target keeps the terrain right under it from counting as a hit
+        TerrainRay ray;
+        ray.origin = cameraPosition;
+        ray.direction = target - cameraPosition;
+        ray.maxDistance = glm::length(ray.direction) * 0.999f;
+        isUnobstructed = !pyramid.raycast(ray).isHit;
+      }
+    }
+    unobstructedCount += isUnobstructed ? 1 : 0;
+  }
+  std::cout << "\t\t" << rejectedCount << " rejected nodes checked with up to "
+            << kHorizonCheckSampleCount * kHorizonCheckSampleCount << " rays each\n";
+  if (unobstructedCount != 0) {
+    std::cout << "\t\t" << unobstructedCount << " rejected nodes have an unobstructed sample!\n";
+  }
+}
+
+void benchmarkCdlodSelection() {
+  const auto heightmap = createBenchmarkHeightmap(kCdlodMapSize);
+  CdlodParameters cdlodParameters;
+  cdlodParameters.leafNodeSize = kCdlodLeafNodeSize;
+  cdlodParameters.sampleSpacing = 4.0f;
+
+  std::unique_ptr<CdlodQuadtree> quadtree;
+  const auto buildSeconds =
+      measureSeconds([&]() { quadtree = std::make_unique<CdlodQuadtree>(heightmap, cdlodParameters); });
+
+  std::cout << "CDLOD selection, " << kCdlodMapSize << "x" << kCdlodMapSize << ", " << quadtree->nodeCount()
+            << " nodes, " << quadtree->levelCount() << " levels, built in " << buildSeconds * 1000.0
+            << " ms\n";
+
+  // Cameras on a diagonal across the terrain, from ground level up to a few kilometres
+  const auto terrainSize = float(kCdlodMapSize - 1) * cdlodParameters.sampleSpacing;
+  std::vector<CdlodSelectedNode> selectedNodes;
+  auto maxSeconds = 0.0;
+  auto totalSeconds = 0.0;
+  size_t totalSelectedNodes = 0;
+  for (auto camera = 0; camera < kCdlodCameraCount; ++camera) {
+    const auto t = (float(camera) + 0.5f) / float(kCdlodCameraCount);
+    const auto cameraHeight = quadtree->maxHeight() + t * 4000.0f;
+    const auto cameraPosition = glm::vec3(t * terrainSize, cameraHeight, t * terrainSize);
+    const auto seconds = measureSeconds([&]() { quadtree->select(cameraPosition, &selectedNodes); });
+    maxSeconds = std::max(maxSeconds, seconds);
+    totalSeconds += seconds;
+    totalSelectedNodes += selectedNodes.size();
+  }
+
+  std::cout << "\t" << totalSelectedNodes / kCdlodCameraCount << " nodes selected on average, "
+            << totalSeconds / kCdlodCameraCount * 1000.0 << " ms average, " << maxSeconds * 1000.0
+            << " ms worst\n";
+
+  // Just above the ground, where the terrain hides the most
+  const auto cullingSample = (kCdlodMapSize - 1) / 4;
+  const auto cullingCameraPosition =
+      glm::vec3(float(cullingSample) * cdlodParameters.sampleSpacing,
+                heightmap.at(cullingSample, cullingSample) + 2.0f,
+                float(cullingSample) * cdlodParameters.sampleSpacing);
+  benchmarkFrustumCulling(*quadtree, heightmap, cdlodParameters.sampleSpacing, cullingCameraPosition);
+}
+
+void benchmarkBiomeClassification() {
+  ClimateParameters climateParameters;
+  const auto heightmap = createBenchmarkHeightmap(kNoiseTileSize);
+  const auto sampleCount = heightmap.heights.size();
+  std::vector<uint8_t> normals(sampleCount * normalEncodingSize(NormalEncoding::Float32x3));
+  computeHeightmapNormals(heightmap, 1.0f, NormalEncoding::Float32x3, normals.data(), kNoiseTileSize);
+
+  std::vector<float> temperature(sampleCount);
+  std::vector<float> moisture(sampleCount);
+  std::vector<float> altitude(sampleCount);
+  std::vector<float> slope(sampleCount);
+  generateFbmTile(climateParameters.temperatureNoise, 0.0f, 0.0f, 1.0f, kNoiseTileSize, kNoiseTileSize,
+                  temperature.data(), kNoiseTileSize);
+  generateFbmTile(climateParameters.moistureNoise, 0.0f, 0.0f, 1.0f, kNoiseTileSize, kNoiseTileSize,
+                  moisture.data(), kNoiseTileSize);
+  for (size_t i = 0; i < sampleCount; ++i) {
+    temperature[i] = 0.5f + 0.5f * temperature[i];
+    moisture[i] = 0.5f + 0.5f * moisture[i];
+    altitude[i] = heightmap.heights[i] - climateParameters.seaLevel;
+    slope[i] = 1.0f - decodeNormal(normals.data() + i * sizeof(glm::vec3), NormalEncoding::Float32x3).y;
+  }
+
+  std::cout << "Biome classification, " << kNoiseTileSize << "x" << kNoiseTileSize << "\n";
+
+  std::vector<Biome> scalarBiomes(sampleCount);
+  std::vector<uint32_t> scalarSplatWeights(sampleCount);
+  const auto scalarSeconds = measureSeconds([&]() {
+    classifyBiomes(climateParameters, sampleCount, temperature.data(), moisture.data(), altitude.data(),
+                   slope.data(), scalarBiomes.data(), scalarSplatWeights.data(), SimdLevel::Scalar);
+  });
+  printThroughput(simdLevelName(SimdLevel::Scalar), scalarSeconds, sampleCount, scalarSeconds);
+
+  std::vector<Biome> simdBiomes(sampleCount);
+  std::vector<uint32_t> simdSplatWeights(sampleCount);
+  for (const auto simdLevel : {SimdLevel::Sse41, SimdLevel::Avx2}) {
+    if (simdLevel > detectSimdLevel()) {
+      continue;
+    }
+
+    const auto simdSeconds = measureSeconds([&]() {
+      classifyBiomes(climateParameters, sampleCount, temperature.data(), moisture.data(), altitude.data(),
+                     slope.data(), simdBiomes.data(), simdSplatWeights.data(), simdLevel);
+    });
+    printThroughput(simdLevelName(simdLevel), simdSeconds, sampleCount, scalarSeconds);
+
+    if (simdBiomes != scalarBiomes || simdSplatWeights != scalarSplatWeights) {
+      std::cout << "\t\t" << simdLevelName(simdLevel) << " output differs from the scalar path!\n";
+    }
+  }
+}
+
+void benchmarkPoissonDiskSampling() {
+  std::cout << "Poisson-disk sampling, " << kScatterAreaSize << "x" << kScatterAreaSize
+            << ", minimum distance " << kScatterMinDistance << "\n";
+
+  std::vector<glm::vec2> points;
+  const auto gridSeconds = measureSeconds([&]() {
+    generatePoissonDiskPoints(kScatterAreaSize, kScatterAreaSize, kScatterMinDistance, kScatterCandidateCount,
+                              1, &points);
+  });
+
+  // Baseline: rejection sampling against every accepted point, with as many candidates as the grid version
+  // tried at most
+  std::vector<glm::vec2> rejectionPoints;
+  const auto rejectionSeconds = measureSeconds([&]() {
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> coordinate(0.0f, kScatterAreaSize);
+    for (size_t attempt = 0; attempt < points.size() * kScatterCandidateCount; ++attempt) {
+      const glm::vec2 candidate(coordinate(random), coordinate(random));
+      const auto isFarEnough = std::none_of(
+          rejectionPoints.begin(), rejectionPoints.end(), [&](const glm::vec2 &point) {
+            return glm::dot(point - candidate, point - candidate) < kScatterMinDistance * kScatterMinDistance;
+          });
+      if (isFarEnough) {
+        rejectionPoints.push_back(candidate);
+      }
+    }
+  });
+
+  std::cout << "\trejection: " << rejectionSeconds * 1000.0 << " ms, " << rejectionPoints.size()
+            << " points\n";
+  std::cout << "\tgrid: " << gridSeconds * 1000.0 << " ms, " << points.size() << " points, "
+            << rejectionSeconds / gridSeconds << "x\n";
+}
+// Baseline for the height pyramid: fixed steps against the bilinear surface, refined by bisection. Ridges
+// thinner than one step can be missed.
+TerrainRayHit marchTerrainRay(const Heightmap &heightmap, const TerrainRay &ray) {
+  const auto sampleHeight = [&](const glm::vec3 &position) {
+    const auto x0 = std::clamp(int(position.x), 0, heightmap.width - 2);
+    const auto z0 = std::clamp(int(position.z), 0, heightmap.height - 2);
+    const auto fractionX = position.x - float(x0);
+    const auto fractionZ = position.z - float(z0);
+    const auto top = glm::mix(heightmap.at(x0, z0), heightmap.at(x0 + 1, z0), fractionX);
+    const auto bottom = glm::mix(heightmap.at(x0, z0 + 1), heightmap.at(x0 + 1, z0 + 1), fractionX);
+    return glm::mix(top, bottom, fractionZ);
+  };
+  const auto isInside = [&](const glm::vec3 &position) {
+    return position.x >= 0.0f && position.z >= 0.0f && position.x <= float(heightmap.width - 1) &&
+           position.z <= float(heightmap.height - 1);
+  };
+
+  TerrainRayHit hit;
+  const auto direction = glm::normalize(ray.direction);
+  auto previousDistance = 0.0f;
+  auto wasInside = false;
+  for (auto distance = 0.0f; distance <= ray.maxDistance; distance += kRaycastMarchStep) {
+    const auto position = ray.origin + distance * direction;
+    if (!isInside(position)) {
+      if (wasInside || position.y < -1000.0f) {
+        break;
+      }
+      previousDistance = distance;
+      continue;
+    }
+    wasInside = true;
+
+    if (position.y <= sampleHeight(position)) {
+      auto above = previousDistance;
+      auto below = distance;
+      for (auto iteration = 0; iteration < 16; ++iteration) {
+        const auto middle = 0.5f * (above + below);
+        const auto middlePosition = ray.origin + middle * direction;
+        (middlePosition.y <= sampleHeight(middlePosition) ? below : above) = middle;
+      }
+      hit.isHit = true;
+      hit.distance = below;
+      hit.position = ray.origin + below * direction;
+      return hit;
+    }
+    previousDistance = distance;
+  }
+  return hit;
+}
+
+void benchmarkTerrainRaycast() {
+  const auto heightmap = createBenchmarkHeightmap(kRaycastMapSize);
+  const auto sampleCount = heightmap.heights.size();
+
+  std::cout << "Terrain raycast, " << kRaycastMapSize << "x" << kRaycastMapSize << ", " << kRaycastRayCount
+            << " rays\n";
+
+  HeightPyramid scalarPyramid;
+  const auto scalarBuildSeconds = measureSeconds([&]() {
+    scalarPyramid = HeightPyramid(&heightmap, glm::vec2(0.0f), 1.0f, SimdLevel::Scalar);
+  });
+  printThroughput("pyramid build, Scalar", scalarBuildSeconds, sampleCount, scalarBuildSeconds);
+  if (detectSimdLevel() >= SimdLevel::Sse41) {
+    HeightPyramid simdPyramid;
+    const auto simdBuildSeconds = measureSeconds([&]() {
+      simdPyramid = HeightPyramid(&heightmap, glm::vec2(0.0f), 1.0f, SimdLevel::Sse41);
+    });
+    printThroughput("pyramid build, SSE4.1", simdBuildSeconds, sampleCount, scalarBuildSeconds);
+
+    for (auto level = 0; level < scalarPyramid.levelCount(); ++level) {
+      for (auto y = 0; y < scalarPyramid.levelHeight(level); ++y) {
+        for (auto x = 0; x < scalarPyramid.levelWidth(level); ++x) {
+          if (simdPyramid.minHeight(level, x, y) != scalarPyramid.minHeight(level, x, y) ||
+              simdPyramid.maxHeight(level, x, y) != scalarPyramid.maxHeight(level, x, y)) {
+            std::cout << "\t\tSSE4.1 pyramid differs from the scalar path!\n";
+            level = scalarPyramid.levelCount();
+            break;
+          }
+        }
+      }
+    }
+  }
+
+  // Picking-style rays from a few hundred units above the terrain, looking down at shallow to steep angles
+  std::mt19937 random(1);
+  std::uniform_real_distribution<float> coordinate(0.0f, float(kRaycastMapSize - 1));
+  std::uniform_real_distribution<float> signedUnit(-1.0f, 1.0f);
+  std::uniform_real_distribution<float> downward(-1.0f, -0.05f);
+  std::vector<TerrainRay> rays(kRaycastRayCount);
+  for (auto &ray : rays) {
+    ray.origin = glm::vec3(coordinate(random), 300.0f, coordinate(random));
+    ray.direction = glm::vec3(signedUnit(random), downward(random), signedUnit(random));
+  }
+
+  std::vector<TerrainRayHit> marchedHits(rays.size());
+  const auto marchSeconds = measureSeconds([&]() {
+    for (size_t i = 0; i < rays.size(); ++i) {
+      marchedHits[i] = marchTerrainRay(heightmap, rays[i]);
+    }
+  });
+  printThroughput("fixed step", marchSeconds, rays.size(), marchSeconds);
+
+  std::vector<TerrainRayHit> hits(rays.size());
+  const auto pyramidSeconds = measureSeconds([&]() {
+    scalarPyramid.raycast(rays.data(), rays.size(), hits.data(), nullptr);
+  });
+  printThroughput("pyramid", pyramidSeconds, rays.size(), marchSeconds);
+
+  JobSystem jobSystem;
+  std::vector<TerrainRayHit> batchedHits(rays.size());
+  const auto batchedSeconds = measureSeconds([&]() {
+    scalarPyramid.raycast(rays.data(), rays.size(), batchedHits.data(), &jobSystem);
+  });
+  printThroughput("pyramid, job system", batchedSeconds, rays.size(), marchSeconds);
+
+  // The marcher intersects the bilinear surface rather than the mesh triangles, so distances only agree
+  // to within a fraction of a cell
+  size_t agreementCount = 0;
+  for (size_t i = 0; i < rays.size(); ++i) {
+    if (batchedHits[i].isHit != hits[i].isHit || batchedHits[i].distance != hits[i].distance) {
+      std::cout << "\t\tBatched raycasts differ from the single-threaded ones!\n";
+      break;
+    }
+    if (hits[i].isHit == marchedHits[i].isHit &&
+        (!hits[i].isHit || std::abs(hits[i].distance - marchedHits[i].distance) < kRaycastHitTolerance *
+                                                                                  hits[i].distance)) {
+      ++agreementCount;
+    }
+  }
+  std::cout << "\t" << agreementCount << " of " << rays.size()
+            << " rays agree with the fixed step baseline\n";
+}
+
+void benchmarkHorizonMap() {
+  const auto heightmap = createBenchmarkHeightmap(kHorizonMapSize);
+  const HeightPyramid pyramid(&heightmap, glm::vec2(0.0f), 1.0f);
+  HorizonParameters horizonParameters;
+  const auto rayCount = heightmap.heights.size() * size_t(horizonParameters.directionCount);
+
+  std::cout << "Horizon map, " << kHorizonMapSize << "x" << kHorizonMapSize << ", "
+            << horizonParameters.directionCount << " directions\n";
+
+  // Baseline: the same rays visiting every cell they cross
+  JobSystem jobSystem;
+  HorizonMap referenceMap;
+  horizonParameters.isHierarchical = false;
+  const auto cellStats =
+      bakeHorizonMap(heightmap, pyramid, 1.0f, horizonParameters, &jobSystem, &referenceMap);
+  printThroughput("every cell, job system", cellStats.seconds, rayCount, cellStats.seconds);
+  std::cout << "\t\t" << cellStats.stepsPerRay << " steps per ray\n";
+
+  horizonParameters.isHierarchical = true;
+  for (const auto workerCount : {1u, 0u}) {
+    JobSystem bakeJobSystem(workerCount);
+    HorizonMap horizonMap;
+    const auto stats =
+        bakeHorizonMap(heightmap, pyramid, 1.0f, horizonParameters, &bakeJobSystem, &horizonMap);
+    const auto name = "pyramid, " + std::to_string(bakeJobSystem.workerCount() + 1) + " threads";
+    printThroughput(name.c_str(), stats.seconds, rayCount, cellStats.seconds);
+    std::cout << "\t\t" << stats.stepsPerRay << " steps per ray\n";
+    if (horizonMap.horizons != referenceMap.horizons) {
+      std::cout << "\t\tPyramid horizons differ from visiting every cell!\n";
+    }
+  }
+
+  // What a later run pays instead of the bake
+  const auto path = (std::filesystem::temp_directory_path() / "benchmarkHorizons.hrzn").string();
+  std::filesystem::remove(path);
+  HorizonMap bakedMap;
+  loadOrBakeHorizonMap(path, heightmap, pyramid, 1.0f, horizonParameters, &jobSystem, &bakedMap);
+  HorizonMap cachedMap;
+  const auto cachedStats =
+      loadOrBakeHorizonMap(path, heightmap, pyramid, 1.0f, horizonParameters, &jobSystem, &cachedMap);
+  // A file cut short, e.g. by a crash of an older build, has to be baked again instead of failing the load
+  std::filesystem::resize_file(path, std::filesystem::file_size(path) / 2);
+  HorizonMap rebakedMap;
+  const auto rebakedStats =
+      loadOrBakeHorizonMap(path, heightmap, pyramid, 1.0f, horizonParameters, &jobSystem, &rebakedMap);
+  std::filesystem::remove(path);
+  std::cout << "\tcached: " << cachedStats.seconds * 1000.0 << " ms, "
+            << cachedMap.horizons.size() / 1024 << " KiB\n";
+  if (!cachedStats.isCached || cachedMap.horizons != bakedMap.horizons) {
+    std::cout << "\t\tCached horizons differ from the bake!\n";
+  }
+  if (rebakedStats.isCached || rebakedMap.horizons != bakedMap.horizons) {
+    std::cout << "\t\tTruncated horizon file was not baked again!\n";
+  }
+
+  auto ambientOcclusion = 0.0;
+  for (auto y = 0; y < cachedMap.height; ++y) {
+    for (auto x = 0; x < cachedMap.width; ++x) {
+      ambientOcclusion += horizonAmbientOcclusion(cachedMap, x, y);
+    }
+  }
+  std::cout << "\tmean ambient occlusion " << ambientOcclusion / double(heightmap.heights.size()) << "\n";
+}
+typedef std::unordered_map<ChunkCoord, std::unique_ptr<TerrainChunk>, ChunkCoordHash> ChunkMap;
+
+// Baseline for the batched queries: one virtual call per agent and sample, each looking up its chunk
+class TerrainHeightSource {
+public:
+  virtual ~TerrainHeightSource() = default;
+  virtual float heightAt(float x, float z) const = 0;
+  virtual glm::vec3 normalAt(float x, float z) const = 0;
+};
+
+class ChunkHeightSource : public TerrainHeightSource {
+public:
+  ChunkHeightSource(const ChunkMap *chunks, const ChunkStreamingParameters &parameters)
+      : chunks(chunks), chunkSize(parameters.chunkSize), sampleSpacing(parameters.sampleSpacing) {}
+
+  float heightAt(float x, float z) const override {
+    float height;
+    glm::vec3 normal;
+    sample(x, z, &height, &normal);
+    return height;
+  }
+
+  glm::vec3 normalAt(float x, float z) const override {
+    float height;
+    glm::vec3 normal;
+    sample(x, z, &height, &normal);
+    return normal;
+  }
+
+private:
+  void sample(float x, float z, float *height, glm::vec3 *normal) const {
+    const auto chunkExtent = float(chunkSize) * sampleSpacing;
+    const ChunkCoord coord{int32_t(std::floor(x / chunkExtent)), int32_t(std::floor(z / chunkExtent))};
+    const auto chunk = chunks->find(coord);
+    if (chunk == chunks->end()) {
+      *height = std::numeric_limits<float>::quiet_NaN();
+      *normal = glm::vec3(0.0f, 1.0f, 0.0f);
+      return;
+    }
+
+    const auto &heightmap = chunk->second->heightmap();
+    const auto gridX = (x - float(coord.x) * chunkExtent) / sampleSpacing;
+    const auto gridZ = (z - float(coord.z) * chunkExtent) / sampleSpacing;
+    const auto cellX = std::clamp(int(gridX), 0, heightmap.width - 2);
+    const auto cellZ = std::clamp(int(gridZ), 0, heightmap.height - 2);
+    const auto fractionX = std::clamp(gridX - float(cellX), 0.0f, 1.0f);
+    const auto fractionZ = std::clamp(gridZ - float(cellZ), 0.0f, 1.0f);
+    const auto height00 = heightmap.at(cellX, cellZ);
+    const auto height10 = heightmap.at(cellX + 1, cellZ);
+    const auto height01 = heightmap.at(cellX, cellZ + 1);
+    const auto height11 = heightmap.at(cellX + 1, cellZ + 1);
+
+    *height = glm::mix(glm::mix(height00, height10, fractionX), glm::mix(height01, height11, fractionX),
+                       fractionZ);
+    const auto slopeX = glm::mix(height10 - height00, height11 - height01, fractionZ) / sampleSpacing;
+    const auto slopeZ = glm::mix(height01 - height00, height11 - height10, fractionX) / sampleSpacing;
+    *normal = glm::normalize(glm::vec3(-slopeX, 1.0f, -slopeZ));
+  }
+
+  const ChunkMap *chunks;
+  int chunkSize;
+  float sampleSpacing;
+};
+
+void benchmarkTerrainQueries() {
+  ChunkStreamingParameters parameters;
+  parameters.scatterLayers.clear();
+  ChunkMap chunks;
+  for (auto z = 0; z < kQueryChunkCount; ++z) {
+    for (auto x = 0; x < kQueryChunkCount; ++x) {
+      chunks[{x, z}] = generateChunk(parameters, {x, z});
+    }
+  }
+  const auto findChunk = [&](ChunkCoord coord) -> const TerrainChunk * {
+    const auto chunk = chunks.find(coord);
+    return chunk != chunks.end() ? chunk->second.get() : nullptr;
+  };
+
+  std::cout << "Terrain queries, " << kQueryChunkCount << "x" << kQueryChunkCount << " chunks, "
+            << kQueryAgentCount << " agents\n";
+
+  std::mt19937 random(1);
+  std::uniform_real_distribution<float> coordinate(
+      0.0f, float(kQueryChunkCount * parameters.chunkSize) * parameters.sampleSpacing);
+  std::vector<float> positionX(kQueryAgentCount);
+  std::vector<float> positionZ(kQueryAgentCount);
+  for (size_t i = 0; i < kQueryAgentCount; ++i) {
+    positionX[i] = coordinate(random);
+    positionZ[i] = coordinate(random);
+  }
+
+  ChunkHeightSource heightSource(&chunks, parameters);
+  const TerrainHeightSource *source = &heightSource;
+  std::vector<float> baselineHeights(kQueryAgentCount);
+  std::vector<glm::vec3> baselineNormals(kQueryAgentCount);
+  const auto baselineSeconds = measureSeconds([&]() {
+    for (size_t i = 0; i < kQueryAgentCount; ++i) {
+      baselineHeights[i] = source->heightAt(positionX[i], positionZ[i]);
+      baselineNormals[i] = source->normalAt(positionX[i], positionZ[i]);
+    }
+  });
+  printThroughput("virtual call per agent", baselineSeconds, kQueryAgentCount, baselineSeconds);
+
+  std::vector<float> scalarHeights;
+  std::vector<float> heights(kQueryAgentCount);
+  std::vector<float> normalX(kQueryAgentCount);
+  std::vector<float> normalY(kQueryAgentCount);
+  std::vector<float> normalZ(kQueryAgentCount);
+  for (const auto simdLevel : {SimdLevel::Scalar, SimdLevel::Sse41, SimdLevel::Avx2}) {
+    if (simdLevel > detectSimdLevel()) {
+      continue;
+    }
+
+    TerrainQueries queries(parameters.chunkSize, parameters.sampleSpacing, findChunk, simdLevel);
+    const auto batchedSeconds = measureSeconds([&]() {
+      queries.sample(kQueryAgentCount, positionX.data(), positionZ.data(), heights.data(), normalX.data(),
+                     normalY.data(), normalZ.data());
+    });
+    printThroughput(simdLevelName(simdLevel), batchedSeconds, kQueryAgentCount, baselineSeconds);
+
+    if (scalarHeights.empty()) {
+      scalarHeights = heights;
+    } else if (heights != scalarHeights) {
+      std::cout << "\t\t" << simdLevelName(simdLevel) << " output differs from the scalar path!\n";
+    }
+  }
+
+  size_t mismatchCount = 0;
+  for (size_t i = 0; i < kQueryAgentCount; ++i) {
+    const auto normalError = glm::length(baselineNormals[i] - glm::vec3(normalX[i], normalY[i], normalZ[i]));
+    if (std::abs(baselineHeights[i] - heights[i]) > 1.0e-3f || normalError > 1.0e-4f) {
+      ++mismatchCount;
+    }
+  }
+  if (mismatchCount > 0) {
+    std::cout << "\t\t" << mismatchCount << " agents differ from the per-agent baseline!\n";
+  }
+
+  // Every agent drops a capsule onto the ground while walking a few samples
+  std::uniform_real_distribution<float> walk(-2.0f, 2.0f);
+  std::vector<float> startY(kQueryAgentCount);
+  std::vector<float> endX(kQueryAgentCount);
+  std::vector<float> endY(kQueryAgentCount);
+  std::vector<float> endZ(kQueryAgentCount);
+  std::vector<float> radius(kQueryAgentCount, 0.5f);
+  std::vector<float> axisX(kQueryAgentCount, 0.0f);
+  std::vector<float> axisY(kQueryAgentCount, 1.0f);
+  std::vector<float> axisZ(kQueryAgentCount, 0.0f);
+  for (size_t i = 0; i < kQueryAgentCount; ++i) {
+    startY[i] = heights[i] + 2.0f;
+    endX[i] = positionX[i] + walk(random);
+    endY[i] = heights[i] - 2.0f;
+    endZ[i] = positionZ[i] + walk(random);
+  }
+
+  TerrainSweepQueries sweepQueries;
+  sweepQueries.count = kQueryAgentCount;
+  sweepQueries.startX = positionX.data();
+  sweepQueries.startY = startY.data();
+  sweepQueries.startZ = positionZ.data();
+  sweepQueries.endX = endX.data();
+  sweepQueries.endY = endY.data();
+  sweepQueries.endZ = endZ.data();
+  sweepQueries.radius = radius.data();
+  sweepQueries.axisX = axisX.data();
+  sweepQueries.axisY = axisY.data();
+  sweepQueries.axisZ = axisZ.data();
+
+  std::vector<uint8_t> isHit(kQueryAgentCount);
+  std::vector<float> fractions(kQueryAgentCount);
+  TerrainSweepHits sweepHits;
+  sweepHits.isHit = isHit.data();
+  sweepHits.fraction = fractions.data();
+  sweepHits.normalX = normalX.data();
+  sweepHits.normalY = normalY.data();
+  sweepHits.normalZ = normalZ.data();
+
+  TerrainQueries queries(parameters.chunkSize, parameters.sampleSpacing, findChunk);
+  const auto sphereSeconds = measureSeconds([&]() { queries.sweepSpheres(sweepQueries, sweepHits); });
+  const auto sphereHitCount = size_t(std::count(isHit.begin(), isHit.end(), uint8_t(1)));
+  const auto capsuleSeconds = measureSeconds([&]() { queries.sweepCapsules(sweepQueries, sweepHits); });
+  const auto capsuleHitCount = size_t(std::count(isHit.begin(), isHit.end(), uint8_t(1)));
+  std::cout << "\tsphere sweeps: " << sphereSeconds * 1000.0 << " ms, " << sphereHitCount << " hits\n";
+  std::cout << "\tcapsule sweeps: " << capsuleSeconds * 1000.0 << " ms, " << capsuleHitCount << " hits\n";
+}
+
+void benchmarkChunkHashes() {
+  ChunkStreamingParameters parameters;
+  const auto chunkCount = size_t(kHashChunkCount) * kHashChunkCount;
+
+  std::cout << "Chunk generation, " << kHashChunkCount << "x" << kHashChunkCount << " chunks\n";
+
+  std::vector<uint64_t> referenceHashes;
+  std::vector<std::unique_ptr<TerrainChunk>> chunks(chunkCount);
+  for (const auto workerCount : {1u, 0u}) {
+    JobSystem jobSystem(workerCount);
+    const auto generationSeconds = measureSeconds([&]() {
+      jobSystem.parallelFor(0, chunkCount, 1, [&](size_t begin, size_t end) {
+        for (auto i = begin; i < end; ++i) {
+          chunks[i] = generateChunk(parameters, {int32_t(i % kHashChunkCount), int32_t(i / kHashChunkCount)});
+        }
+      });
+    });
+    std::cout << '\t' << jobSystem.workerCount() + 1 << " threads: " << generationSeconds * 1000.0 << " ms\n";
+
+    std::vector<uint64_t> hashes(chunkCount);
+    for (size_t i = 0; i < chunkCount; ++i) {
+      hashes[i] = chunks[i]->contentHash;
+    }
+    if (referenceHashes.empty()) {
+      referenceHashes = hashes;
+    } else if (hashes != referenceHashes) {
+      std::cout << "\t\tChunk hashes differ between thread counts!\n";
+    }
+  }
+
+  size_t byteCount = 0;
+  for (const auto &chunk : chunks) {
+    byteCount += chunk->heightmap().heights.size() * sizeof(float) + chunk->normals().size() +
+                 chunk->biomeMap().biomes.size() * sizeof(Biome) +
+                 chunk->biomeMap().splatWeights.size() * sizeof(uint32_t) +
+                 (chunk->scatter ? chunk->scatter->instances.size() : 0) * sizeof(ScatterInstance);
+  }
+  uint64_t combinedHash = 0;
+  const auto hashSeconds = measureSeconds([&]() {
+    for (const auto &chunk : chunks) {
+      combinedHash ^= hashChunkContent(*chunk);
+    }
+  });
+  std::cout << "\thashing: " << hashSeconds * 1000.0 << " ms, " << double(byteCount) / hashSeconds / 1.0e9
+            << " GB/s, combined hash " << std::hex << combinedHash << std::dec << "\n";
+}
+
+void benchmarkIncrementalRegeneration() {
+  ChunkStreamingParameters parameters;
+  const auto chunkCount = size_t(kHashChunkCount) * kHashChunkCount;
+  ChunkStageCache stageCache(chunkCount);
+  JobSystem jobSystem;
+
+  std::cout << "Incremental regeneration, " << kHashChunkCount << "x" << kHashChunkCount << " chunks\n";
+
+  std::vector<std::unique_ptr<TerrainChunk>> chunks(chunkCount);
+  const auto generateChunks = [&](ChunkStageCache *cache) {
+    jobSystem.parallelFor(0, chunkCount, 1, [&](size_t begin, size_t end) {
+      for (auto i = begin; i < end; ++i) {
+        chunks[i] =
+            generateChunk(parameters, {int32_t(i % kHashChunkCount), int32_t(i / kHashChunkCount)}, cache);
+      }
+    });
+  };
+
+  const auto coldSeconds = measureSeconds([&]() { generateChunks(&stageCache); });
+  std::cout << "\tcold: " << coldSeconds * 1000.0 << " ms\n";
+
+  const std::pair<const char *, std::function<void()>> edits[] = {
+      {"scatter edit", [&]() { parameters.scatterLayers[0].biomeDensity[size_t(Biome::Forest)] *= 0.5f; }},
+      {"climate edit", [&]() { parameters.climateParameters.rockSlope += 0.05f; }},
+      {"noise edit", [&]() { parameters.heightNoise = defaultTerrainNoiseGraph(1); }},
+  };
+  for (const auto &edit : edits) {
+    edit.second();
+
+    const auto heightHits = stageCache.heights.hits();
+    const auto biomeHits = stageCache.biomes.hits();
+    const auto scatterHits = stageCache.scatter.hits();
+    const auto editSeconds = measureSeconds([&]() { generateChunks(&stageCache); });
+    std::cout << '\t' << edit.first << ": " << editSeconds * 1000.0 << " ms, " << coldSeconds / editSeconds
+              << "x, cache hits heights " << stageCache.heights.hits() - heightHits << ", biomes "
+              << stageCache.biomes.hits() - biomeHits << ", scatter "
+              << stageCache.scatter.hits() - scatterHits << "\n";
+
+    std::vector<uint64_t> cachedHashes(chunkCount);
+    for (size_t i = 0; i < chunkCount; ++i) {
+      cachedHashes[i] = chunks[i]->contentHash;
+    }
+    generateChunks(nullptr);
+    for (size_t i = 0; i < chunkCount; ++i) {
+      if (chunks[i]->contentHash != cachedHashes[i]) {
+        std::cout << "\t\tCached chunks differ from a full regeneration!\n";
+        break;
+      }
+    }
+  }
+}
+
+// Dabs around the corner shared by four chunks, against refreshing the normals, vertices and pyramids of
+// every touched chunk in full
+void benchmarkSculpting() {
+  ChunkStreamingParameters parameters;
+  parameters.loadRadius = 2;
+  JobSystem jobSystem;
+  ChunkManager chunkManager(&jobSystem, parameters);
+  while (chunkManager.residentChunks().size() < 13) {
+    chunkManager.update(glm::vec3(0.0f));
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  const auto sampleCount = parameters.chunkSize + 1;
+  const auto chunkExtent = float(parameters.chunkSize) * parameters.sampleSpacing;
+  std::unordered_map<ChunkCoord, HeightPyramid, ChunkCoordHash> pyramids;
+  for (const auto residentChunk : chunkManager.residentChunks()) {
+    // The chunk's own copy of the heights, which the dabs then write in place
+    const auto chunk = chunkManager.findChunk(residentChunk->coord);
+    const auto origin = glm::vec2(float(chunk->coord.x), float(chunk->coord.z)) * chunkExtent;
+    pyramids[chunk->coord] =
+        HeightPyramid(&chunk->editHeights()->heightmap, origin, parameters.sampleSpacing);
+  }
+
+  std::cout << "Sculpting, " << kSculptDabCount << " dabs of radius " << kSculptBrushRadius << "\n";
+
+  std::vector<SculptBrush> brushes(kSculptDabCount);
+  std::vector<glm::vec2> dabPositions(kSculptDabCount);
+  std::mt19937 generator(13);
+  std::uniform_real_distribution<float> offsetDistribution(-2.0f * kSculptBrushRadius,
+                                                           2.0f * kSculptBrushRadius);
+  const auto &peakHeights = chunkManager.findChunk(ChunkCoord{0, 0})->heightmap();
+  const auto peakIndex = size_t(std::max_element(peakHeights.heights.begin(), peakHeights.heights.end()) -
+                                peakHeights.heights.begin());
+  const auto peakPosition = glm::vec2(float(peakIndex % size_t(sampleCount)),
+                                      float(peakIndex / size_t(sampleCount))) *
+                            parameters.sampleSpacing;
+  for (auto dab = 0; dab < kSculptDabCount; ++dab) {
+    brushes[size_t(dab)].mode = SculptMode(dab % 4);
+    brushes[size_t(dab)].radius = kSculptBrushRadius;
+    brushes[size_t(dab)].strength = dab % 4 < 2 ? 2.0f : 0.5f;
+    dabPositions[size_t(dab)] = glm::vec2(offsetDistribution(generator), offsetDistribution(generator));
+    if (dab >= kSculptDabCount - kSculptStrokeDabCount) {
+      brushes[size_t(dab)].mode = SculptMode::Raise;
+      dabPositions[size_t(dab)] = peakPosition;
+    }
+  }
+
+  // The packed vertices stand in for the vertex buffers, they are not released without a GPU
+  std::vector<TerrainVertex> stagedVertices;
+  size_t partialBytes = 0;
+  size_t fullBytes = 0;
+  auto fullRepackCount = 0;
+  double brushSeconds = 0.0;
+  double partialSeconds = 0.0;
+  double fullSeconds = 0.0;
+  std::vector<SculptChunkEdit> edits;
+  std::vector<uint8_t> fullNormals;
+  std::vector<TerrainVertex> fullVertices;
+  for (auto dab = 0; dab < kSculptDabCount; ++dab) {
+    edits.clear();
+    brushSeconds += measureSeconds(
+        [&]() { applySculptBrush(&chunkManager, brushes[size_t(dab)], dabPositions[size_t(dab)], &edits); });
+
+    partialSeconds += measureSeconds([&]() {
+      for (const auto &edit : edits) {
+        auto &vertexData = edit.chunk->vertexData;
+        const auto &rect = edit.vertices;
+        if (edit.needsFullRepack) {
+          packTerrainVertices(edit.chunk->heightmap(), edit.chunk->normals().data(),
+                              parameters.normalEncoding, edit.heightOffset,
+                              edit.heightOffset + edit.heightRange, MorphTarget::ChunkLods, &vertexData);
+          ++fullRepackCount;
+        } else {
+          stagedVertices.resize(size_t(rect.width()) * size_t(rect.height()));
+          packTerrainVertexRect(edit.chunk->heightmap(), edit.chunk->normals().data(),
+                                parameters.normalEncoding, vertexData.heightOffset, vertexData.heightRange,
+                                MorphTarget::ChunkLods, rect.x0, rect.z0, rect.x1, rect.z1,
+                                stagedVertices.data());
+          for (auto z = rect.z0; z < rect.z1; ++z) {
+            std::copy_n(stagedVertices.begin() + ptrdiff_t(z - rect.z0) * rect.width(), rect.width(),
+                        vertexData.vertices.begin() + ptrdiff_t(z) * sampleCount + rect.x0);
+          }
+        }
+        pyramids[edit.chunk->coord].update(edit.heights.x0, edit.heights.z0, edit.heights.x1,
+                                           edit.heights.z1);
+        partialBytes += size_t(rect.width()) * size_t(rect.height()) * sizeof(TerrainVertex);
+      }
+    });
+
+    fullSeconds += measureSeconds([&]() {
+      for (const auto &edit : edits) {
+        const auto chunk = edit.chunk;
+        fullNormals.resize(chunk->normals().size());
+        computeHeightmapNormals(chunk->heightmap(), parameters.sampleSpacing, parameters.normalEncoding,
+                                fullNormals.data(), size_t(sampleCount));
+        fullVertices.resize(size_t(sampleCount) * size_t(sampleCount));
+        packTerrainVertexRect(chunk->heightmap(), fullNormals.data(), parameters.normalEncoding,
+                              chunk->vertexData.heightOffset, chunk->vertexData.heightRange,
+                              MorphTarget::ChunkLods, 0, 0, sampleCount, sampleCount, fullVertices.data());
+        HeightPyramid(&chunk->heightmap(), glm::vec2(0.0f), parameters.sampleSpacing);
+        fullBytes += fullVertices.size() * sizeof(TerrainVertex);
+      }
+    });
+  }
+
+  std::cout << "\tfull refresh: " << fullSeconds * 1000.0 << " ms, " << fullBytes / 1024 << " KiB uploaded\n";
+  std::cout << "\tbrush + partial refresh: " << (brushSeconds + partialSeconds) * 1000.0 << " ms ("
+            << brushSeconds * 1000.0 << " ms brush), " << partialBytes / 1024 << " KiB uploaded, "
+            << fullSeconds / (brushSeconds + partialSeconds) << "x\n";
+  std::cout << "\t\t" << fullRepackCount << " chunks requantized\n";
+
+  // The partial updates have to add up to what a full refresh of the final heights produces
+  const auto normalSize = normalEncodingSize(parameters.normalEncoding);
+  const auto isSampleEqual = [&](const TerrainChunk &chunk, int x, int z, const TerrainChunk &other,
+                                 int otherX, int otherZ) {
+    const auto index = size_t(z) * size_t(sampleCount) + size_t(x);
+    const auto otherIndex = size_t(otherZ) * size_t(sampleCount) + size_t(otherX);
+    return chunk.heightmap().heights[index] == other.heightmap().heights[otherIndex] &&
+           std::memcmp(&chunk.normals()[index * normalSize], &other.normals()[otherIndex * normalSize],
+                       normalSize) == 0;
+  };
+  auto isSeamClosed = true;
+  auto isPartialExact = true;
+  for (const auto chunk : chunkManager.residentChunks()) {
+    const auto right = chunkManager.findChunk({chunk->coord.x + 1, chunk->coord.z});
+    const auto below = chunkManager.findChunk({chunk->coord.x, chunk->coord.z + 1});
+    for (auto i = 0; i < sampleCount; ++i) {
+      isSeamClosed &= right == nullptr || isSampleEqual(*chunk, sampleCount - 1, i, *right, 0, i);
+      isSeamClosed &= below == nullptr || isSampleEqual(*chunk, i, sampleCount - 1, *below, i, 0);
+    }
+
+    fullVertices.resize(size_t(sampleCount) * size_t(sampleCount));
+    packTerrainVertexRect(chunk->heightmap(), chunk->normals().data(), parameters.normalEncoding,
+                          chunk->vertexData.heightOffset, chunk->vertexData.heightRange,
+                          MorphTarget::ChunkLods, 0, 0, sampleCount, sampleCount, fullVertices.data());
+    isPartialExact &= std::memcmp(fullVertices.data(), chunk->vertexData.vertices.data(),
+                                  fullVertices.size() * sizeof(TerrainVertex)) == 0;
+
+    const auto &pyramid = pyramids[chunk->coord];
+    const auto rebuiltPyramid =
+        HeightPyramid(&chunk->heightmap(), glm::vec2(0.0f), parameters.sampleSpacing);
+    for (auto level = 0; level < pyramid.levelCount(); ++level) {
+      for (auto y = 0; y < pyramid.levelHeight(level); ++y) {
+        for (auto x = 0; x < pyramid.levelWidth(level); ++x) {
+          isPartialExact &= pyramid.minHeight(level, x, y) == rebuiltPyramid.minHeight(level, x, y) &&
+                            pyramid.maxHeight(level, x, y) == rebuiltPyramid.maxHeight(level, x, y);
+        }
+      }
+    }
+    const auto minMaxHeights =
+        std::minmax_element(chunk->heightmap().heights.begin(), chunk->heightmap().heights.end());
+    isPartialExact &=
+        chunk->minHeight() == *minMaxHeights.first && chunk->maxHeight() == *minMaxHeights.second;
+  }
+  if (!isSeamClosed) {
+    std::cout << "\t\tSculpted chunk edges differ!\n";
+  }
+  if (!isPartialExact) {
+    std::cout << "\t\tPartial updates differ from a full refresh!\n";
+  }
+}
+} // namespace
+
+void runTerrainBenchmarks() {
+  benchmarkFbmNoise();
+  benchmarkHeightsAndNormals();
+  benchmarkBandLimitedFbm();
+  benchmarkNoiseGraph();
+  benchmarkCellularNoise();
+  benchmarkHydraulicErosion();
+  benchmarkHydrology();
+  benchmarkCdlodSelection();
+  benchmarkBiomeClassification();
+  benchmarkPoissonDiskSampling();
+  benchmarkTerrainRaycast();
+  benchmarkHorizonMap();
+  benchmarkTerrainQueries();
+  benchmarkChunkHashes();
+  benchmarkIncrementalRegeneration();
+  benchmarkSculpting();
+}
@@ -0,0 +1,4 @@
+#pragma once
+
+// Micro-benchmarks for the terrain pipeline, run with --benchmark instead of opening a window
+void runTerrainBenchmarks();
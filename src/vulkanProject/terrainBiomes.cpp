@@ -0,0 +1,320 @@
+#include "terrainBiomes.h"
+
+#include <algorithm>
+#include <cstring>
+#include <immintrin.h>
+
+namespace {
+// Splat weight ramp saturate(value * scale + offset)
+struct Ramp {
+  float scale;
+  float offset;
+};
+
+// The classification inputs with the divisions of the blend ramps folded into scale and offset
+struct BiomeThresholds {
+  float beachHeight;
+  float rockSlope;
+  float snowTemperature;
+  float coldTemperature;
+  float hotTemperature;
+  float dryMoisture;
+  float wetMoisture;
+  Ramp beachSand;         // Of altitude
+  Ramp desertMoisture;    // Of moisture
+  Ramp desertTemperature; // Of temperature
+  Ramp snow;              // Of temperature
+  Ramp rock;              // Of slope
+};
+
+// 0 at start, 1 at start + width, width may be negative
+Ramp makeRamp(float start, float width) { return {1.0f / width, -start / width}; }
+
+BiomeThresholds makeBiomeThresholds(const ClimateParameters &climateParameters) {
+  BiomeThresholds thresholds;
+  thresholds.beachHeight = climateParameters.beachHeight;
+  thresholds.rockSlope = climateParameters.rockSlope;
+  thresholds.snowTemperature = climateParameters.snowTemperature;
+  thresholds.coldTemperature = climateParameters.coldTemperature;
+  thresholds.hotTemperature = climateParameters.hotTemperature;
+  thresholds.dryMoisture = climateParameters.dryMoisture;
+  thresholds.wetMoisture = climateParameters.wetMoisture;
+  thresholds.beachSand = makeRamp(climateParameters.beachHeight, -climateParameters.beachBlend);
+  thresholds.desertMoisture = makeRamp(climateParameters.dryMoisture, -climateParameters.climateBlend);
+  thresholds.desertTemperature = makeRamp(climateParameters.hotTemperature, climateParameters.climateBlend);
+  thresholds.snow = makeRamp(climateParameters.snowTemperature, -climateParameters.climateBlend);
+  thresholds.rock = makeRamp(climateParameters.rockSlope, climateParameters.rockBlend);
+  return thresholds;
+}
+
+float ramp(float value, const Ramp &ramp) {
+  return std::min(std::max(value * ramp.scale + ramp.offset, 0.0f), 1.0f);
+}
+
+uint32_t toWeightByte(float cumulativeWeight) { return uint32_t(int32_t(cumulativeWeight * 255.0f + 0.5f)); }
+
+// Layers are stacked rock over snow over sand over grass. The weights are rounded cumulatively, so they
+// always add up to exactly 255.
+uint32_t packSplatWeights(float rock, float snow, float sand) {
+  const auto snowWeight = snow * (1.0f - rock);
+  const auto sandWeight = sand * (1.0f - rock - snowWeight);
+
+  const auto rockEnd = toWeightByte(rock);
+  const auto snowEnd = toWeightByte(rock + snowWeight);
+  const auto sandEnd = toWeightByte(rock + snowWeight + sandWeight);
+  return (255 - sandEnd) | (rockEnd << 8) | ((sandEnd - snowEnd) << 16) | ((snowEnd - rockEnd) << 24);
+}
+
+void classifyBiomesScalar(const BiomeThresholds &thresholds, size_t begin, size_t end,
+                          const float *temperature, const float *moisture, const float *altitude,
+                          const float *slope, Biome *biomes, uint32_t *splatWeights) {
+  for (auto i = begin; i < end; ++i) {
+    const auto isDry = moisture[i] < thresholds.dryMoisture;
+
+    auto biome = moisture[i] < thresholds.wetMoisture ? Biome::Grassland : Biome::Rainforest;
+    if (isDry) {
+      biome = Biome::Desert;
+    }
+    if (temperature[i] < thresholds.hotTemperature) {
+      biome = isDry ? Biome::Grassland : Biome::Forest;
+    }
+    if (temperature[i] < thresholds.coldTemperature) {
+      biome = isDry ? Biome::Tundra : Biome::Taiga;
+    }
+    if (temperature[i] < thresholds.snowTemperature) {
+      biome = Biome::Snow;
+    }
+    if (slope[i] > thresholds.rockSlope) {
+      biome = Biome::Rock;
+    }
+    if (altitude[i] < thresholds.beachHeight) {
+      biome = Biome::Beach;
+    }
+    if (altitude[i] < 0.0f) {
+      biome = Biome::Water;
+    }
+    biomes[i] = biome;
+
+    const auto beachSand = ramp(altitude[i], thresholds.beachSand);
+    const auto desertSand =
+        ramp(moisture[i], thresholds.desertMoisture) * ramp(temperature[i], thresholds.desertTemperature);
+    const auto snow = ramp(temperature[i], thresholds.snow);
+    const auto rock = ramp(slope[i], thresholds.rock);
+    splatWeights[i] = packSplatWeights(rock, snow, std::max(beachSand, desertSand));
+  }
+}
+
+SIMD_TARGET_SSE41 __m128 rampSse(__m128 value, const Ramp &ramp) {
+  const auto ramped = _mm_add_ps(_mm_mul_ps(value, _mm_set1_ps(ramp.scale)), _mm_set1_ps(ramp.offset));
+  return _mm_min_ps(_mm_max_ps(ramped, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+}
+
+SIMD_TARGET_SSE41 __m128i toWeightBytesSse(__m128 cumulativeWeight) {
+  return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(cumulativeWeight, _mm_set1_ps(255.0f)), _mm_set1_ps(0.5f)));
+}
+
+SIMD_TARGET_SSE41 __m128 biomeIdSse(Biome biome) { return _mm_set1_ps(float(biome)); }
+
+SIMD_TARGET_SSE41 __m128 lessThanSse(__m128 value, float threshold) {
+  return _mm_cmplt_ps(value, _mm_set1_ps(threshold));
+}
+
+SIMD_TARGET_SSE41 void classifyBiomesSse(const BiomeThresholds &thresholds, size_t count,
+                                         const float *temperature, const float *moisture,
+                                         const float *altitude, const float *slope, Biome *biomes,
+                                         uint32_t *splatWeights) {
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const auto t = _mm_loadu_ps(temperature + i);
+    const auto m = _mm_loadu_ps(moisture + i);
+    const auto a = _mm_loadu_ps(altitude + i);
+    const auto s = _mm_loadu_ps(slope + i);
+    const auto isDry = lessThanSse(m, thresholds.dryMoisture);
+
+    // Biome ids are blended as floats from the lowest to the highest precedence
+    auto biome = _mm_blendv_ps(biomeIdSse(Biome::Rainforest), biomeIdSse(Biome::Grassland),
+                               lessThanSse(m, thresholds.wetMoisture));
+    biome = _mm_blendv_ps(biome, biomeIdSse(Biome::Desert), isDry);
+    const auto temperate = _mm_blendv_ps(biomeIdSse(Biome::Forest), biomeIdSse(Biome::Grassland), isDry);
+    const auto cold = _mm_blendv_ps(biomeIdSse(Biome::Taiga), biomeIdSse(Biome::Tundra), isDry);
+    biome = _mm_blendv_ps(biome, temperate, lessThanSse(t, thresholds.hotTemperature));
+    biome = _mm_blendv_ps(biome, cold, lessThanSse(t, thresholds.coldTemperature));
+    biome = _mm_blendv_ps(biome, biomeIdSse(Biome::Snow), lessThanSse(t, thresholds.snowTemperature));
+    biome = _mm_blendv_ps(biome, biomeIdSse(Biome::Rock), _mm_cmpgt_ps(s, _mm_set1_ps(thresholds.rockSlope)));
+    biome = _mm_blendv_ps(biome, biomeIdSse(Biome::Beach), lessThanSse(a, thresholds.beachHeight));
+    biome = _mm_blendv_ps(biome, biomeIdSse(Biome::Water), lessThanSse(a, 0.0f));
+
+    const auto biomeWords = _mm_packus_epi32(_mm_cvttps_epi32(biome), _mm_setzero_si128());
+    const auto packedBiomes = _mm_cvtsi128_si32(_mm_packus_epi16(biomeWords, biomeWords));
+    std::memcpy(biomes + i, &packedBiomes, 4);
+
+    const auto desertSand =
+        _mm_mul_ps(rampSse(m, thresholds.desertMoisture), rampSse(t, thresholds.desertTemperature));
+    const auto sand = _mm_max_ps(rampSse(a, thresholds.beachSand), desertSand);
+    const auto snow = rampSse(t, thresholds.snow);
+    const auto rock = rampSse(s, thresholds.rock);
+
+    const auto snowWeight = _mm_mul_ps(snow, _mm_sub_ps(_mm_set1_ps(1.0f), rock));
+    const auto sandWeight = _mm_mul_ps(sand, _mm_sub_ps(_mm_sub_ps(_mm_set1_ps(1.0f), rock), snowWeight));
+    const auto rockEnd = toWeightBytesSse(rock);
+    const auto snowEnd = toWeightBytesSse(_mm_add_ps(rock, snowWeight));
+    const auto sandEnd = toWeightBytesSse(_mm_add_ps(_mm_add_ps(rock, snowWeight), sandWeight));
+
+    auto packed = _mm_sub_epi32(_mm_set1_epi32(255), sandEnd);
+    packed = _mm_or_si128(packed, _mm_slli_epi32(rockEnd, 8));
+    packed = _mm_or_si128(packed, _mm_slli_epi32(_mm_sub_epi32(sandEnd, snowEnd), 16));
+    packed = _mm_or_si128(packed, _mm_slli_epi32(_mm_sub_epi32(snowEnd, rockEnd), 24));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(splatWeights + i), packed);
+  }
+
+  classifyBiomesScalar(thresholds, i, count, temperature, moisture, altitude, slope, biomes, splatWeights);
+}
+
+SIMD_TARGET_AVX2 __m256 rampAvx2(__m256 value, const Ramp &ramp) {
+  const auto ramped =
+      _mm256_add_ps(_mm256_mul_ps(value, _mm256_set1_ps(ramp.scale)), _mm256_set1_ps(ramp.offset));
+  return _mm256_min_ps(_mm256_max_ps(ramped, _mm256_setzero_ps()), _mm256_set1_ps(1.0f));
+}
+
+SIMD_TARGET_AVX2 __m256i toWeightBytesAvx2(__m256 cumulativeWeight) {
+  return _mm256_cvttps_epi32(
+      _mm256_add_ps(_mm256_mul_ps(cumulativeWeight, _mm256_set1_ps(255.0f)), _mm256_set1_ps(0.5f)));
+}
+
+SIMD_TARGET_AVX2 __m256 biomeIdAvx2(Biome biome) { return _mm256_set1_ps(float(biome)); }
+
+SIMD_TARGET_AVX2 __m256 lessThanAvx2(__m256 value, float threshold) {
+  return _mm256_cmp_ps(value, _mm256_set1_ps(threshold), _CMP_LT_OQ);
+}
+
+SIMD_TARGET_AVX2 void classifyBiomesAvx2(const BiomeThresholds &thresholds, size_t count,
+                                         const float *temperature, const float *moisture,
+                                         const float *altitude, const float *slope, Biome *biomes,
+                                         uint32_t *splatWeights) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const auto t = _mm256_loadu_ps(temperature + i);
+    const auto m = _mm256_loadu_ps(moisture + i);
+    const auto a = _mm256_loadu_ps(altitude + i);
+    const auto s = _mm256_loadu_ps(slope + i);
+    const auto isDry = lessThanAvx2(m, thresholds.dryMoisture);
+
+    auto biome = _mm256_blendv_ps(biomeIdAvx2(Biome::Rainforest), biomeIdAvx2(Biome::Grassland),
+                                  lessThanAvx2(m, thresholds.wetMoisture));
+    biome = _mm256_blendv_ps(biome, biomeIdAvx2(Biome::Desert), isDry);
+    const auto temperate = _mm256_blendv_ps(biomeIdAvx2(Biome::Forest), biomeIdAvx2(Biome::Grassland), isDry);
+    const auto cold = _mm256_blendv_ps(biomeIdAvx2(Biome::Taiga), biomeIdAvx2(Biome::Tundra), isDry);
+    biome = _mm256_blendv_ps(biome, temperate, lessThanAvx2(t, thresholds.hotTemperature));
+    biome = _mm256_blendv_ps(biome, cold, lessThanAvx2(t, thresholds.coldTemperature));
+    biome = _mm256_blendv_ps(biome, biomeIdAvx2(Biome::Snow), lessThanAvx2(t, thresholds.snowTemperature));
+    biome = _mm256_blendv_ps(biome, biomeIdAvx2(Biome::Rock),
+                             _mm256_cmp_ps(s, _mm256_set1_ps(thresholds.rockSlope), _CMP_GT_OQ));
+    biome = _mm256_blendv_ps(biome, biomeIdAvx2(Biome::Beach), lessThanAvx2(a, thresholds.beachHeight));
+    biome = _mm256_blendv_ps(biome, biomeIdAvx2(Biome::Water), lessThanAvx2(a, 0.0f));
+
+    const auto biomeInts = _mm256_cvttps_epi32(biome);
+    const auto biomeWords =
+        _mm_packus_epi32(_mm256_castsi256_si128(biomeInts), _mm256_extracti128_si256(biomeInts, 1));
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(biomes + i), _mm_packus_epi16(biomeWords, biomeWords));
+
+    const auto desertSand =
+        _mm256_mul_ps(rampAvx2(m, thresholds.desertMoisture), rampAvx2(t, thresholds.desertTemperature));
+    const auto sand = _mm256_max_ps(rampAvx2(a, thresholds.beachSand), desertSand);
+    const auto snow = rampAvx2(t, thresholds.snow);
+    const auto rock = rampAvx2(s, thresholds.rock);
+
+    const auto snowWeight = _mm256_mul_ps(snow, _mm256_sub_ps(_mm256_set1_ps(1.0f), rock));
+    const auto sandWeight =
+        _mm256_mul_ps(sand, _mm256_sub_ps(_mm256_sub_ps(_mm256_set1_ps(1.0f), rock), snowWeight));
+    const auto rockEnd = toWeightBytesAvx2(rock);
+    const auto snowEnd = toWeightBytesAvx2(_mm256_add_ps(rock, snowWeight));
+    const auto sandEnd = toWeightBytesAvx2(_mm256_add_ps(_mm256_add_ps(rock, snowWeight), sandWeight));
+
+    auto packed = _mm256_sub_epi32(_mm256_set1_epi32(255), sandEnd);
+    packed = _mm256_or_si256(packed, _mm256_slli_epi32(rockEnd, 8));
+    packed = _mm256_or_si256(packed, _mm256_slli_epi32(_mm256_sub_epi32(sandEnd, snowEnd), 16));
+    packed = _mm256_or_si256(packed, _mm256_slli_epi32(_mm256_sub_epi32(snowEnd, rockEnd), 24));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(splatWeights + i), packed);
+  }
+
+  classifyBiomesScalar(thresholds, i, count, temperature, moisture, altitude, slope, biomes, splatWeights);
+}
+} // namespace
+
+const char *biomeName(Biome biome) {
+  switch (biome) {
+  case Biome::Water:
+    return "water";
+  case Biome::Beach:
+    return "beach";
+  case Biome::Rock:
+    return "rock";
+  case Biome::Snow:
+    return "snow";
+  case Biome::Tundra:
+    return "tundra";
+  case Biome::Taiga:
+    return "taiga";
+  case Biome::Grassland:
+    return "grassland";
+  case Biome::Forest:
+    return "forest";
+  case Biome::Desert:
+    return "desert";
+  case Biome::Rainforest:
+    return "rainforest";
+  }
+  return "unknown";
+}
+
+void classifyBiomes(const ClimateParameters &climateParameters, size_t count, const float *temperature,
+                    const float *moisture, const float *altitude, const float *slope, Biome *biomes,
+                    uint32_t *splatWeights, SimdLevel simdLevel) {
+  const auto thresholds = makeBiomeThresholds(climateParameters);
+  switch (simdLevel) {
+  case SimdLevel::Avx2:
+    classifyBiomesAvx2(thresholds, count, temperature, moisture, altitude, slope, biomes, splatWeights);
+    break;
+  case SimdLevel::Sse41:
+    classifyBiomesSse(thresholds, count, temperature, moisture, altitude, slope, biomes, splatWeights);
+    break;
+  default:
+    classifyBiomesScalar(thresholds, 0, count, temperature, moisture, altitude, slope, biomes, splatWeights);
+    break;
+  }
+}
+
+void generateBiomeMap(const ClimateParameters &climateParameters, const Heightmap &heightmap,
+                      const void *normals, NormalEncoding normalEncoding, float x0, float y0, float spacing,
+                      BiomeMap *biomeMap) {
+  const auto width = heightmap.width;
+  const auto height = heightmap.height;
+  const auto texelCount = heightmap.heights.size();
+
+  // Structure of arrays, so that the classification pass runs on full SIMD registers
+  std::vector<float> temperature(texelCount);
+  std::vector<float> moisture(texelCount);
+  std::vector<float> altitude(texelCount);
+  std::vector<float> slope(texelCount);
+
+  generateFbmTile(climateParameters.temperatureNoise, x0, y0, spacing, width, height, temperature.data(),
+                  size_t(width));
+  generateFbmTile(climateParameters.moistureNoise, x0, y0, spacing, width, height, moisture.data(),
+                  size_t(width));
+
+  const auto normalSize = normalEncodingSize(normalEncoding);
+  for (size_t i = 0; i < texelCount; ++i) {
+    altitude[i] = heightmap.heights[i] - climateParameters.seaLevel;
+    temperature[i] = 0.5f + 0.5f * temperature[i] -
+                     climateParameters.temperatureLapseRate * std::max(altitude[i], 0.0f);
+    moisture[i] = 0.5f + 0.5f * moisture[i];
+    slope[i] = 1.0f - decodeNormal(static_cast<const uint8_t *>(normals) + i * normalSize, normalEncoding).y;
+  }
+
+  biomeMap->width = width;
+  biomeMap->height = height;
+  biomeMap->biomes.resize(texelCount);
+  biomeMap->splatWeights.resize(texelCount);
+  classifyBiomes(climateParameters, texelCount, temperature.data(), moisture.data(), altitude.data(),
+                 slope.data(), biomeMap->biomes.data(), biomeMap->splatWeights.data(), detectSimdLevel());
+}
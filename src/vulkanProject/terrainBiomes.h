@@ -0,0 +1,65 @@
+#pragma once
+
+#include "heightmap.h"
+#include "simdUtils.h"
+#include "terrainNoise.h"
+#include "terrainNormals.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+enum class Biome : uint8_t { Water, Beach, Rock, Snow, Tundra, Taiga, Grassland, Forest, Desert, Rainforest };
+constexpr size_t kBiomeCount = size_t(Biome::Rainforest) + 1;
+
+const char *biomeName(Biome biome);
+
+// Temperature and moisture are fBm mapped to roughly [0, 1], temperature additionally drops with altitude.
+// Biomes follow a simplified Whittaker diagram, with water, beaches, steep rock and snow taking precedence.
+struct ClimateParameters {
+  FbmParameters temperatureNoise = {101, 3, 1.0f / 4096.0f, 2.0f, 0.5f, 1.0f};
+  FbmParameters moistureNoise = {202, 3, 1.0f / 2048.0f, 2.0f, 0.5f, 1.0f};
+  float seaLevel = -64.0f;
+  float beachHeight = 4.0f;                   // Above sea level
+  float temperatureLapseRate = 1.0f / 512.0f; // Temperature drop per world unit above sea level
+  float snowTemperature = 0.15f;
+  float coldTemperature = 0.35f; // Tundra and taiga below
+  float hotTemperature = 0.7f;   // Desert and rainforest above
+  float dryMoisture = 0.35f;
+  float wetMoisture = 0.65f;
+  float rockSlope = 0.35f; // 1 - normal.y
+  // Splat weights fade in over these widths below or above the thresholds
+  float beachBlend = 2.0f;
+  float climateBlend = 0.05f; // Temperature and moisture
+  float rockBlend = 0.1f;
+};
+
+// Splat layers in the bytes of BiomeMap::splatWeights, from least to most significant. The four weights of
+// a texel always add up to 255.
+enum class SplatLayer : uint32_t { Grass, Rock, Sand, Snow };
+
+// One byte of biome and four bytes of splat weights per heightmap texel, shared by the renderer and object
+// scattering so that neither has to evaluate the climate noise again
+struct BiomeMap {
+  int width = 0;
+  int height = 0;
+  std::vector<Biome> biomes;
+  std::vector<uint32_t> splatWeights;
+
+  Biome biomeAt(int x, int y) const { return biomes[size_t(y) * size_t(width) + size_t(x)]; }
+  uint8_t splatWeight(int x, int y, SplatLayer layer) const {
+    return uint8_t(splatWeights[size_t(y) * size_t(width) + size_t(x)] >> (8 * uint32_t(layer)));
+  }
+};
+
+// Classifies count texels given as structure of arrays. altitude is relative to sea level and slope is
+// 1 - normal.y. Like the fBm kernels, every SIMD level produces bit-identical output.
+void classifyBiomes(const ClimateParameters &climateParameters, size_t count, const float *temperature,
+                    const float *moisture, const float *altitude, const float *slope, Biome *biomes,
+                    uint32_t *splatWeights, SimdLevel simdLevel);
+
+// Evaluates the climate fields for the heightmap's texels and classifies them. Texel (i, j) samples the
+// climate noise at (x0 + i * spacing, y0 + j * spacing), like generateFbmTile(), and normals are laid out
+// like the heightmap.
+void generateBiomeMap(const ClimateParameters &climateParameters, const Heightmap &heightmap,
+                      const void *normals, NormalEncoding normalEncoding, float x0, float y0, float spacing,
+                      BiomeMap *biomeMap);
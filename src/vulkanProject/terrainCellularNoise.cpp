@@ -0,0 +1,438 @@
+#include "terrainCellularNoise.h"
+
+#include "terrainNoiseKernels.h"
+#include <algorithm>
+#include <limits>
+
+namespace {
+// Keeps the feature points unrelated to the gradients of fBm with the same seed
+constexpr uint32_t kCellularSeedMix = 0x5bd1e995u;
+// The low and high 16 bits of a cell's hash place its feature point
+constexpr float kFeatureStep = 1.0f / 65536.0f;
+
+// The own cell first and the edge neighbours next, so by the corners f2 is usually small enough to skip some
+constexpr int kCellOffsets[9][2] = {{0, 0},  {-1, 0}, {1, 0},  {0, -1}, {0, 1},
+                                    {-1, -1}, {1, -1}, {-1, 1}, {1, 1}};
+constexpr int kFirstCornerCell = 5;
+
+struct CellularKernel {
+  explicit CellularKernel(const CellularParameters &cellularParameters)
+      : frequency(cellularParameters.frequency), seed(cellularParameters.seed ^ kCellularSeedMix) {
+    const auto jitter = std::clamp(cellularParameters.jitter, 0.0f, 1.0f);
+    pointMin = 0.5f - 0.5f * jitter;
+    pointStep = jitter * kFeatureStep;
+    pointMax = pointMin + pointStep * 65535.0f;
+    lowerNeighbourMax = -1.0f + pointMax;
+    upperNeighbourMin = 1.0f + pointMin;
+  }
+
+  float frequency;
+  uint32_t seed;
+  // Feature points lie in [pointMin, pointMax] within their cell on both axes
+  float pointMin;
+  float pointStep;
+  float pointMax;
+  // The same bounds for the cells one to the left or below and one to the right or above
+  float lowerNeighbourMax;
+  float upperNeighbourMin;
+};
+
+// The squared distances along one axis to the nearest spots the neighbours at offset -1, 0 and 1 can hold a
+// feature point at. Computed with the same operations as the distance to the point itself, so they never
+// exceed it despite the rounding, and a cell whose bound is not below f2 can be skipped without changing
+// the result.
+void axisBounds(const CellularKernel &kernel, float f, float *bounds) {
+  const auto lower = kernel.lowerNeighbourMax - f;
+  const auto own = std::max(std::max(kernel.pointMin - f, f - kernel.pointMax), 0.0f);
+  const auto upper = kernel.upperNeighbourMin - f;
+  bounds[0] = lower * lower;
+  bounds[1] = own * own;
+  bounds[2] = upper * upper;
+}
+
+// What all samples of one row share: the row of cells they are in, and the feature points around the cell the
+// last samples fell into. With samples closer than the cell size most SIMD registers fall into a single cell
+// and measure those points instead of hashing every cell per lane.
+struct CellularRow {
+  CellularRow(const CellularKernel &kernel, float y) {
+    const auto scaledY = y * kernel.frequency;
+    const auto yFloor = std::floor(scaledY);
+    iy = int32_t(yFloor);
+    fy = scaledY - yFloor;
+    axisBounds(kernel, fy, boundsY);
+  }
+
+  bool isAround(int32_t cellX) const { return hasNeighbourhood && ix == cellX; }
+
+  int32_t iy;
+  float fy;
+  float boundsY[3];
+
+  // The 3x3 cells around (ix, iy) in kCellOffsets order, with the points relative to that cell
+  int32_t ix = 0;
+  bool hasNeighbourhood = false;
+  float pointX[9];
+  float squaredDistanceY[9]; // From the row
+  uint32_t hashes[9];
+};
+
+void updateNeighbourhood(const CellularKernel &kernel, int32_t ix, CellularRow *row) {
+  for (auto cell = 0; cell < 9; ++cell) {
+    const auto offset = kCellOffsets[cell];
+    const auto hash = hashLattice(ix + offset[0], row->iy + offset[1], kernel.seed);
+    const auto pointY = kernel.pointMin + kernel.pointStep * float(hash >> 16);
+    const auto deltaY = (float(offset[1]) + pointY) - row->fy;
+    row->pointX[cell] = float(offset[0]) + (kernel.pointMin + kernel.pointStep * float(hash & 0xffffu));
+    row->squaredDistanceY[cell] = deltaY * deltaY;
+    row->hashes[cell] = hash;
+  }
+  row->ix = ix;
+  row->hasNeighbourhood = true;
+}
+
+CellularSample cellularSample(const CellularKernel &kernel, float x, CellularRow *row) {
+  const auto scaledX = x * kernel.frequency;
+  const auto xFloor = std::floor(scaledX);
+  const auto ix = int32_t(xFloor);
+  const auto fx = scaledX - xFloor;
+  if (!row->isAround(ix)) {
+    updateNeighbourhood(kernel, ix, row);
+  }
+
+  auto f1 = std::numeric_limits<float>::infinity();
+  auto f2 = f1;
+  auto cellId = 0u;
+  for (auto cell = 0; cell < 9; ++cell) {
+    const auto deltaX = row->pointX[cell] - fx;
+    const auto distance = deltaX * deltaX + row->squaredDistanceY[cell];
+    if (distance < f1) {
+      f2 = f1;
+      f1 = distance;
+      cellId = row->hashes[cell];
+    } else if (distance < f2) {
+      f2 = distance;
+    }
+  }
+
+  return {std::sqrt(f1), std::sqrt(f2), cellId};
+}
+
+void generateCellularRowScalar(const CellularKernel &kernel, float x0, float dx, int begin, int end,
+                               float *f1, float *f2, uint32_t *cellIds, CellularRow *row) {
+  for (auto i = begin; i < end; ++i) {
+    const auto sample = cellularSample(kernel, x0 + float(i) * dx, row);
+    f1[i] = sample.f1;
+    if (f2 != nullptr) {
+      f2[i] = sample.f2;
+    }
+    if (cellIds != nullptr) {
+      cellIds[i] = sample.cellId;
+    }
+  }
+}
+
+// Squared distances until the samples are returned
+struct CellularSse {
+  __m128 f1;
+  __m128 f2;
+  __m128i cellId;
+};
+
+SIMD_TARGET_SSE41 void axisBoundsSse(const CellularKernel &kernel, __m128 f, __m128 *bounds) {
+  const auto lower = _mm_sub_ps(_mm_set1_ps(kernel.lowerNeighbourMax), f);
+  const auto own = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_set1_ps(kernel.pointMin), f),
+                                         _mm_sub_ps(f, _mm_set1_ps(kernel.pointMax))),
+                              _mm_setzero_ps());
+  const auto upper = _mm_sub_ps(_mm_set1_ps(kernel.upperNeighbourMin), f);
+  bounds[0] = _mm_mul_ps(lower, lower);
+  bounds[1] = _mm_mul_ps(own, own);
+  bounds[2] = _mm_mul_ps(upper, upper);
+}
+
+// Same values as the branches of cellularSample(), distances are never NaN
+SIMD_TARGET_SSE41 inline void updateNearestSse(__m128 distance, __m128i hash, CellularSse *nearest) {
+  const auto closest = _mm_cmplt_ps(distance, nearest->f1);
+  nearest->f2 = _mm_min_ps(nearest->f2, _mm_max_ps(nearest->f1, distance));
+  nearest->f1 = _mm_min_ps(nearest->f1, distance);
+  nearest->cellId =
+      _mm_castps_si128(_mm_blendv_ps(_mm_castsi128_ps(nearest->cellId), _mm_castsi128_ps(hash), closest));
+}
+
+// The nearest points over two runs of cells, ties going to the first run like in cellularSample()
+SIMD_TARGET_SSE41 inline CellularSse mergeNearestSse(const CellularSse &first, const CellularSse &second) {
+  const auto closest = _mm_cmplt_ps(second.f1, first.f1);
+  return {_mm_min_ps(first.f1, second.f1),
+          _mm_min_ps(_mm_max_ps(first.f1, second.f1), _mm_min_ps(first.f2, second.f2)),
+          _mm_castps_si128(
+              _mm_blendv_ps(_mm_castsi128_ps(first.cellId), _mm_castsi128_ps(second.cellId), closest))};
+}
+
+SIMD_TARGET_SSE41 inline __m128 cellDistanceSse(const CellularRow &row, int cell, __m128 fx) {
+  const auto deltaX = _mm_sub_ps(_mm_set1_ps(row.pointX[cell]), fx);
+  return _mm_add_ps(_mm_mul_ps(deltaX, deltaX), _mm_set1_ps(row.squaredDistanceY[cell]));
+}
+
+// The nearest points among three cells of the row's neighbourhood, starting at firstCell
+SIMD_TARGET_SSE41 inline CellularSse nearestInRunSse(const CellularRow &row, int firstCell, __m128 fx) {
+  CellularSse nearest = {cellDistanceSse(row, firstCell, fx),
+                         _mm_set1_ps(std::numeric_limits<float>::infinity()),
+                         _mm_set1_epi32(int32_t(row.hashes[firstCell]))};
+  updateNearestSse(cellDistanceSse(row, firstCell + 1, fx),
+                   _mm_set1_epi32(int32_t(row.hashes[firstCell + 1])), &nearest);
+  updateNearestSse(cellDistanceSse(row, firstCell + 2, fx),
+                   _mm_set1_epi32(int32_t(row.hashes[firstCell + 2])), &nearest);
+  return nearest;
+}
+
+SIMD_TARGET_SSE41 CellularSse cellularSampleSse(const CellularKernel &kernel, __m128 x, CellularRow *row) {
+  const auto scaledX = _mm_mul_ps(x, _mm_set1_ps(kernel.frequency));
+  const auto xFloor = _mm_floor_ps(scaledX);
+  const auto ix = _mm_cvttps_epi32(xFloor);
+  const auto fx = _mm_sub_ps(scaledX, xFloor);
+
+  // The cached points are cheaper to measure than to bound. They are searched as three independent runs of
+  // cells merged at the end, so the comparisons do not form one long dependency chain.
+  const auto cellX = _mm_cvtsi128_si32(ix);
+  if (_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(ix, _mm_set1_epi32(cellX)))) == 0xf) {
+    if (!row->isAround(cellX)) {
+      updateNeighbourhood(kernel, cellX, row);
+    }
+    const auto nearest =
+        mergeNearestSse(mergeNearestSse(nearestInRunSse(*row, 0, fx), nearestInRunSse(*row, 3, fx)),
+                        nearestInRunSse(*row, 6, fx));
+    return {_mm_sqrt_ps(nearest.f1), _mm_sqrt_ps(nearest.f2), nearest.cellId};
+  }
+
+  // A register spanning several cells hashes every cell per lane, and skips the corners that cannot hold a
+  // point closer than f2 in any lane
+  __m128 boundsX[3];
+  axisBoundsSse(kernel, fx, boundsX);
+
+  // The lattice hash of a cell xors a column and a row term, each shared by three of the nine cells
+  __m128i columnTerms[3];
+  for (auto offset = -1; offset <= 1; ++offset) {
+    columnTerms[offset + 1] = _mm_mullo_epi32(_mm_add_epi32(ix, _mm_set1_epi32(offset)),
+                                              _mm_set1_epi32(int32_t(kHashPrimeX)));
+  }
+
+  const auto fy = _mm_set1_ps(row->fy);
+  const auto pointMin = _mm_set1_ps(kernel.pointMin);
+  const auto pointStep = _mm_set1_ps(kernel.pointStep);
+  const auto infinity = _mm_set1_ps(std::numeric_limits<float>::infinity());
+  CellularSse nearest = {infinity, infinity, _mm_setzero_si128()};
+  for (auto cell = 0; cell < 9; ++cell) {
+    const auto offset = kCellOffsets[cell];
+    const auto bound = _mm_add_ps(boundsX[offset[0] + 1], _mm_set1_ps(row->boundsY[offset[1] + 1]));
+    if (cell >= kFirstCornerCell && _mm_movemask_ps(_mm_cmplt_ps(bound, nearest.f2)) == 0) {
+      continue;
+    }
+
+    const auto rowTerm = (uint32_t(row->iy + offset[1]) * kHashPrimeY) ^ kernel.seed;
+    auto hash = _mm_xor_si128(columnTerms[offset[0] + 1], _mm_set1_epi32(int32_t(rowTerm)));
+    hash = _mm_xor_si128(hash, _mm_srli_epi32(hash, 15));
+    hash = _mm_mullo_epi32(hash, _mm_set1_epi32(int32_t(kHashMix)));
+    hash = _mm_xor_si128(hash, _mm_srli_epi32(hash, 13));
+
+    const auto pointX = _mm_add_ps(
+        pointMin, _mm_mul_ps(pointStep, _mm_cvtepi32_ps(_mm_and_si128(hash, _mm_set1_epi32(0xffff)))));
+    const auto pointY =
+        _mm_add_ps(pointMin, _mm_mul_ps(pointStep, _mm_cvtepi32_ps(_mm_srli_epi32(hash, 16))));
+    const auto deltaX = _mm_sub_ps(_mm_add_ps(_mm_set1_ps(float(offset[0])), pointX), fx);
+    const auto deltaY = _mm_sub_ps(_mm_add_ps(_mm_set1_ps(float(offset[1])), pointY), fy);
+    const auto distance = _mm_add_ps(_mm_mul_ps(deltaX, deltaX), _mm_mul_ps(deltaY, deltaY));
+    updateNearestSse(distance, hash, &nearest);
+  }
+
+  return {_mm_sqrt_ps(nearest.f1), _mm_sqrt_ps(nearest.f2), nearest.cellId};
+}
+
+SIMD_TARGET_SSE41 void generateCellularRowSse(const CellularKernel &kernel, float x0, float dx, int count,
+                                              float *f1, float *f2, uint32_t *cellIds, CellularRow *row) {
+  const auto laneOffsets = _mm_setr_epi32(0, 1, 2, 3);
+  auto i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const auto index = _mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32(i), laneOffsets));
+    const auto x = _mm_add_ps(_mm_set1_ps(x0), _mm_mul_ps(index, _mm_set1_ps(dx)));
+    const auto sample = cellularSampleSse(kernel, x, row);
+    _mm_storeu_ps(f1 + i, sample.f1);
+    if (f2 != nullptr) {
+      _mm_storeu_ps(f2 + i, sample.f2);
+    }
+    if (cellIds != nullptr) {
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(cellIds + i), sample.cellId);
+    }
+  }
+
+  generateCellularRowScalar(kernel, x0, dx, i, count, f1, f2, cellIds, row);
+}
+
+struct CellularAvx2 {
+  __m256 f1;
+  __m256 f2;
+  __m256i cellId;
+};
+
+SIMD_TARGET_AVX2 void axisBoundsAvx2(const CellularKernel &kernel, __m256 f, __m256 *bounds) {
+  const auto lower = _mm256_sub_ps(_mm256_set1_ps(kernel.lowerNeighbourMax), f);
+  const auto own = _mm256_max_ps(_mm256_max_ps(_mm256_sub_ps(_mm256_set1_ps(kernel.pointMin), f),
+                                               _mm256_sub_ps(f, _mm256_set1_ps(kernel.pointMax))),
+                                 _mm256_setzero_ps());
+  const auto upper = _mm256_sub_ps(_mm256_set1_ps(kernel.upperNeighbourMin), f);
+  bounds[0] = _mm256_mul_ps(lower, lower);
+  bounds[1] = _mm256_mul_ps(own, own);
+  bounds[2] = _mm256_mul_ps(upper, upper);
+}
+
+SIMD_TARGET_AVX2 inline void updateNearestAvx2(__m256 distance, __m256i hash, CellularAvx2 *nearest) {
+  const auto closest = _mm256_cmp_ps(distance, nearest->f1, _CMP_LT_OQ);
+  nearest->f2 = _mm256_min_ps(nearest->f2, _mm256_max_ps(nearest->f1, distance));
+  nearest->f1 = _mm256_min_ps(nearest->f1, distance);
+  nearest->cellId = _mm256_castps_si256(
+      _mm256_blendv_ps(_mm256_castsi256_ps(nearest->cellId), _mm256_castsi256_ps(hash), closest));
+}
+
+SIMD_TARGET_AVX2 inline CellularAvx2 mergeNearestAvx2(const CellularAvx2 &first, const CellularAvx2 &second) {
+  const auto closest = _mm256_cmp_ps(second.f1, first.f1, _CMP_LT_OQ);
+  return {_mm256_min_ps(first.f1, second.f1),
+          _mm256_min_ps(_mm256_max_ps(first.f1, second.f1), _mm256_min_ps(first.f2, second.f2)),
+          _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(first.cellId),
+                                               _mm256_castsi256_ps(second.cellId), closest))};
+}
+
+SIMD_TARGET_AVX2 inline __m256 cellDistanceAvx2(const CellularRow &row, int cell, __m256 fx) {
+  const auto deltaX = _mm256_sub_ps(_mm256_set1_ps(row.pointX[cell]), fx);
+  return _mm256_add_ps(_mm256_mul_ps(deltaX, deltaX), _mm256_set1_ps(row.squaredDistanceY[cell]));
+}
+
+SIMD_TARGET_AVX2 inline CellularAvx2 nearestInRunAvx2(const CellularRow &row, int firstCell, __m256 fx) {
+  CellularAvx2 nearest = {cellDistanceAvx2(row, firstCell, fx),
+                          _mm256_set1_ps(std::numeric_limits<float>::infinity()),
+                          _mm256_set1_epi32(int32_t(row.hashes[firstCell]))};
+  updateNearestAvx2(cellDistanceAvx2(row, firstCell + 1, fx),
+                    _mm256_set1_epi32(int32_t(row.hashes[firstCell + 1])), &nearest);
+  updateNearestAvx2(cellDistanceAvx2(row, firstCell + 2, fx),
+                    _mm256_set1_epi32(int32_t(row.hashes[firstCell + 2])), &nearest);
+  return nearest;
+}
+
+SIMD_TARGET_AVX2 CellularAvx2 cellularSampleAvx2(const CellularKernel &kernel, __m256 x, CellularRow *row) {
+  const auto scaledX = _mm256_mul_ps(x, _mm256_set1_ps(kernel.frequency));
+  const auto xFloor = _mm256_floor_ps(scaledX);
+  const auto ix = _mm256_cvttps_epi32(xFloor);
+  const auto fx = _mm256_sub_ps(scaledX, xFloor);
+
+  const auto cellX = _mm256_cvtsi256_si32(ix);
+  if (_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(ix, _mm256_set1_epi32(cellX)))) == 0xff) {
+    if (!row->isAround(cellX)) {
+      // The scalar code is not VEX encoded and pays for every instruction while the upper halves are dirty
+      _mm256_zeroupper();
+      updateNeighbourhood(kernel, cellX, row);
+    }
+    const auto nearest =
+        mergeNearestAvx2(mergeNearestAvx2(nearestInRunAvx2(*row, 0, fx), nearestInRunAvx2(*row, 3, fx)),
+                         nearestInRunAvx2(*row, 6, fx));
+    return {_mm256_sqrt_ps(nearest.f1), _mm256_sqrt_ps(nearest.f2), nearest.cellId};
+  }
+
+  __m256 boundsX[3];
+  axisBoundsAvx2(kernel, fx, boundsX);
+
+  __m256i columnTerms[3];
+  for (auto offset = -1; offset <= 1; ++offset) {
+    columnTerms[offset + 1] = _mm256_mullo_epi32(_mm256_add_epi32(ix, _mm256_set1_epi32(offset)),
+                                                 _mm256_set1_epi32(int32_t(kHashPrimeX)));
+  }
+
+  const auto fy = _mm256_set1_ps(row->fy);
+  const auto pointMin = _mm256_set1_ps(kernel.pointMin);
+  const auto pointStep = _mm256_set1_ps(kernel.pointStep);
+  const auto infinity = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+  CellularAvx2 nearest = {infinity, infinity, _mm256_setzero_si256()};
+  for (auto cell = 0; cell < 9; ++cell) {
+    const auto offset = kCellOffsets[cell];
+    const auto bound = _mm256_add_ps(boundsX[offset[0] + 1], _mm256_set1_ps(row->boundsY[offset[1] + 1]));
+    if (cell >= kFirstCornerCell && _mm256_movemask_ps(_mm256_cmp_ps(bound, nearest.f2, _CMP_LT_OQ)) == 0) {
+      continue;
+    }
+
+    const auto rowTerm = (uint32_t(row->iy + offset[1]) * kHashPrimeY) ^ kernel.seed;
+    auto hash = _mm256_xor_si256(columnTerms[offset[0] + 1], _mm256_set1_epi32(int32_t(rowTerm)));
+    hash = _mm256_xor_si256(hash, _mm256_srli_epi32(hash, 15));
+    hash = _mm256_mullo_epi32(hash, _mm256_set1_epi32(int32_t(kHashMix)));
+    hash = _mm256_xor_si256(hash, _mm256_srli_epi32(hash, 13));
+
+    const auto pointX = _mm256_add_ps(
+        pointMin,
+        _mm256_mul_ps(pointStep, _mm256_cvtepi32_ps(_mm256_and_si256(hash, _mm256_set1_epi32(0xffff)))));
+    const auto pointY =
+        _mm256_add_ps(pointMin, _mm256_mul_ps(pointStep, _mm256_cvtepi32_ps(_mm256_srli_epi32(hash, 16))));
+    const auto deltaX = _mm256_sub_ps(_mm256_add_ps(_mm256_set1_ps(float(offset[0])), pointX), fx);
+    const auto deltaY = _mm256_sub_ps(_mm256_add_ps(_mm256_set1_ps(float(offset[1])), pointY), fy);
+    const auto distance = _mm256_add_ps(_mm256_mul_ps(deltaX, deltaX), _mm256_mul_ps(deltaY, deltaY));
+    updateNearestAvx2(distance, hash, &nearest);
+  }
+
+  return {_mm256_sqrt_ps(nearest.f1), _mm256_sqrt_ps(nearest.f2), nearest.cellId};
+}
+
+SIMD_TARGET_AVX2 void generateCellularRowAvx2(const CellularKernel &kernel, float x0, float dx, int count,
+                                              float *f1, float *f2, uint32_t *cellIds, CellularRow *row) {
+  const auto laneOffsets = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  auto i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const auto index = _mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(i), laneOffsets));
+    const auto x = _mm256_add_ps(_mm256_set1_ps(x0), _mm256_mul_ps(index, _mm256_set1_ps(dx)));
+    const auto sample = cellularSampleAvx2(kernel, x, row);
+    _mm256_storeu_ps(f1 + i, sample.f1);
+    if (f2 != nullptr) {
+      _mm256_storeu_ps(f2 + i, sample.f2);
+    }
+    if (cellIds != nullptr) {
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(cellIds + i), sample.cellId);
+    }
+  }
+
+  generateCellularRowScalar(kernel, x0, dx, i, count, f1, f2, cellIds, row);
+}
+} // namespace
+
+CellularSample cellularNoise(const CellularParameters &cellularParameters, float x, float y) {
+  const CellularKernel kernel(cellularParameters);
+  CellularRow row(kernel, y);
+  return cellularSample(kernel, x, &row);
+}
+
+void generateCellularRow(const CellularParameters &cellularParameters, float x0, float y, float dx, int count,
+                         float *f1, float *f2, uint32_t *cellIds, SimdLevel simdLevel) {
+  const CellularKernel kernel(cellularParameters);
+  CellularRow row(kernel, y);
+  switch (simdLevel) {
+  case SimdLevel::Avx2:
+    generateCellularRowAvx2(kernel, x0, dx, count, f1, f2, cellIds, &row);
+    break;
+  case SimdLevel::Sse41:
+    generateCellularRowSse(kernel, x0, dx, count, f1, f2, cellIds, &row);
+    break;
+  default:
+    generateCellularRowScalar(kernel, x0, dx, 0, count, f1, f2, cellIds, &row);
+    break;
+  }
+}
+
+void generateCellularTile(const CellularParameters &cellularParameters, float x0, float y0, float spacing,
+                          int width, int height, float *f1, float *f2, uint32_t *cellIds, size_t rowPitch) {
+  generateCellularTile(cellularParameters, x0, y0, spacing, width, height, f1, f2, cellIds, rowPitch,
+                       detectSimdLevel());
+}
+
+void generateCellularTile(const CellularParameters &cellularParameters, float x0, float y0, float spacing,
+                          int width, int height, float *f1, float *f2, uint32_t *cellIds, size_t rowPitch,
+                          SimdLevel simdLevel) {
+  for (auto row = 0; row < height; ++row) {
+    const auto y = y0 + float(row) * spacing;
+    const auto offset = size_t(row) * rowPitch;
+    generateCellularRow(cellularParameters, x0, y, spacing, width, f1 + offset,
+                        f2 != nullptr ? f2 + offset : nullptr,
+                        cellIds != nullptr ? cellIds + offset : nullptr, simdLevel);
+  }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "simdUtils.h"
+#include <cstddef>
+#include <cstdint>
+
+struct CellularParameters {
+  uint32_t seed = 0;
+  float frequency = 1.0f / 64.0f; // Cells per world unit along each axis
+  // How far the feature points stray from the cell centers: 0 gives a regular grid, 1 anywhere in the cell.
+  // Values above 1 are not supported.
+  float jitter = 0.9f;
+};
+
+// Distances are in cells, f1 to the nearest feature point and f2 to the second nearest. cellId identifies the
+// cell of the nearest point and is the same for every sample in it, e.g. for plateau heights or biome picks.
+struct CellularSample {
+  float f1 = 0.0f;
+  float f2 = 0.0f;
+  uint32_t cellId = 0;
+};
+
+// Worley noise with one hashed feature point per cell. Only the 3x3 cells around the sample are searched, so
+// at jitters near 1 a point two cells away is occasionally missed. Runs of samples inside one cell share its
+// hashed neighbourhood, registers spanning several cells hash per lane and skip the corners that cannot beat
+// f2. Every path evaluates the same float operations per lane, so the scalar, SSE4.1 and AVX2 kernels produce
+// bit-identical results.
+CellularSample cellularNoise(const CellularParameters &cellularParameters, float x, float y);
+
+// Writes count samples taken at (x0 + i * dx, y). f2 and cellIds may be null when they are not needed.
+void generateCellularRow(const CellularParameters &cellularParameters, float x0, float y, float dx, int count,
+                         float *f1, float *f2, uint32_t *cellIds, SimdLevel simdLevel);
+
+// Writes a width x height tile whose sample (i, j) is taken at (x0 + i * spacing, y0 + j * spacing), at the
+// same positions as generateFbmTile(). rowPitch is in elements and shared by all outputs.
+void generateCellularTile(const CellularParameters &cellularParameters, float x0, float y0, float spacing,
+                          int width, int height, float *f1, float *f2, uint32_t *cellIds, size_t rowPitch);
+void generateCellularTile(const CellularParameters &cellularParameters, float x0, float y0, float spacing,
+                          int width, int height, float *f1, float *f2, uint32_t *cellIds, size_t rowPitch,
+                          SimdLevel simdLevel);
@@ -0,0 +1,401 @@
+#include "terrainChunks.h"
+
+#include "terrainRandom.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+// The stage keys hash the parameter structs as raw bytes, which only works as long as they have no padding
+static_assert(sizeof(FbmParameters) == 6 * sizeof(uint32_t), "FbmParameters must not contain padding");
+static_assert(sizeof(ClimateParameters) == 2 * sizeof(FbmParameters) + 12 * sizeof(float),
+              "ClimateParameters must not contain padding");
+static_assert(sizeof(ScatterLayer) == (7 + kBiomeCount) * sizeof(float),
+              "ScatterLayer must not contain padding");
+static_assert(sizeof(NoiseNode) == sizeof(FbmParameters) + 9 * sizeof(uint32_t),
+              "NoiseNode must not contain padding");
+
+uint64_t heightStageKey(const ChunkStreamingParameters &parameters, ChunkCoord coord) {
+  ContentHash key;
+  key.addValue(coord.x);
+  key.addValue(coord.z);
+  key.addValue(parameters.chunkSize);
+  key.addValue(parameters.sampleSpacing);
+  key.addValue(parameters.heightScale);
+  key.addValue(parameters.normalEncoding);
+  key.add(parameters.heightNoise.nodes());
+  return key.value();
+}
+
+// Downstream keys include the upstream keys, which already cover the chunk coordinate and layout
+uint64_t biomeStageKey(const ChunkStreamingParameters &parameters, uint64_t heightKey) {
+  ContentHash key;
+  key.addValue(heightKey);
+  key.addValue(parameters.climateParameters);
+  return key.value();
+}
+
+uint64_t scatterStageKey(const ChunkStreamingParameters &parameters, uint64_t heightKey, uint64_t biomeKey) {
+  ContentHash key;
+  key.addValue(heightKey);
+  key.addValue(biomeKey);
+  key.add(parameters.scatterLayers);
+  return key.value();
+}
+
+uint64_t scatterPointsKey(const ChunkStreamingParameters &parameters, ChunkCoord coord,
+                          const ScatterLayer &layer) {
+  ContentHash key;
+  key.addValue(coord.x);
+  key.addValue(coord.z);
+  key.addValue(parameters.chunkSize);
+  key.addValue(parameters.sampleSpacing);
+  key.addValue(layer.seed);
+  key.addValue(layer.minDistance);
+  key.addValue(layer.candidateCount);
+  return key.value();
+}
+
+template <typename Result, typename Function>
+std::shared_ptr<const Result> findOrRunStage(StageResultCache<Result> *cache, uint64_t key, Function &&run) {
+  if (cache == nullptr) {
+    return run();
+  }
+
+  auto result = cache->find(key);
+  if (result == nullptr) {
+    result = run();
+    cache->insert(key, result);
+  }
+  return result;
+}
+
+std::shared_ptr<const HeightStageResult> runHeightStage(const ChunkStreamingParameters &parameters,
+                                                        ChunkCoord coord) {
+  const auto sampleCount = parameters.chunkSize + 1;
+
+  auto result = std::make_shared<HeightStageResult>();
+  result->heightmap = Heightmap(sampleCount, sampleCount);
+  result->normals.resize(size_t(sampleCount) * sampleCount * normalEncodingSize(parameters.normalEncoding));
+
+  // Noise is evaluated in integer sample space so that neighbouring chunks produce bit-identical values on
+  // their shared edge. The spacing is folded into the graph instead, the height scale is applied to its
+  // output. The normals see the neighbours' samples through the one sample halo, so they match across the
+  // edge as well. Octaves finer than a coarse sample spacing can resolve are dropped rather than aliased.
+  const CompiledNoiseGraph heightNoise(parameters.heightNoise.inSampleSpace(parameters.sampleSpacing));
+  const auto haloWidth = sampleCount + 2;
+  std::vector<float> haloHeights(size_t(haloWidth) * size_t(haloWidth));
+  heightNoise.generateTile(float(coord.x * parameters.chunkSize - 1),
+                           float(coord.z * parameters.chunkSize - 1), 1.0f, haloWidth, haloWidth,
+                           haloHeights.data(), size_t(haloWidth));
+  for (auto &height : haloHeights) {
+    height *= parameters.heightScale;
+  }
+
+  const auto heights = haloHeights.data() + haloWidth + 1;
+  computeHaloedNormals(heights, size_t(haloWidth), sampleCount, sampleCount, parameters.sampleSpacing,
+                       parameters.normalEncoding, result->normals.data(), size_t(sampleCount));
+  for (auto z = 0; z < sampleCount; ++z) {
+    std::copy_n(heights + size_t(z) * size_t(haloWidth), sampleCount, result->heightmap.row(z));
+  }
+
+  const auto minMaxHeights =
+      std::minmax_element(result->heightmap.heights.begin(), result->heightmap.heights.end());
+  result->minHeight = *minMaxHeights.first;
+  result->maxHeight = *minMaxHeights.second;
+  return result;
+}
+
+std::shared_ptr<const BiomeStageResult> runBiomeStage(const ChunkStreamingParameters &parameters,
+                                                      ChunkCoord coord, const HeightStageResult &heights) {
+  // Climate noise follows the same integer sample space, its thresholds are in world units
+  auto climateParameters = parameters.climateParameters;
+  climateParameters.temperatureNoise.frequency *= parameters.sampleSpacing;
+  climateParameters.moistureNoise.frequency *= parameters.sampleSpacing;
+  climateParameters.temperatureNoise = bandLimitFbm(climateParameters.temperatureNoise, 1.0f);
+  climateParameters.moistureNoise = bandLimitFbm(climateParameters.moistureNoise, 1.0f);
+
+  auto result = std::make_shared<BiomeStageResult>();
+  generateBiomeMap(climateParameters, heights.heightmap, heights.normals.data(), parameters.normalEncoding,
+                   float(coord.x * parameters.chunkSize), float(coord.z * parameters.chunkSize), 1.0f,
+                   &result->biomeMap);
+  return result;
+}
+
+// Same as scatterObjects(), but the Poisson-disk points, which take most of the time, come from the cache
+std::shared_ptr<const ScatterStageResult> runScatterStage(const ChunkStreamingParameters &parameters,
+                                                          ChunkCoord coord, const HeightStageResult &heights,
+                                                          const BiomeStageResult &biomes,
+                                                          ChunkStageCache *stageCache) {
+  const auto chunkExtent = float(parameters.chunkSize) * parameters.sampleSpacing;
+
+  auto result = std::make_shared<ScatterStageResult>();
+  for (size_t layerIndex = 0; layerIndex < parameters.scatterLayers.size(); ++layerIndex) {
+    const auto &layer = parameters.scatterLayers[layerIndex];
+    const auto points = findOrRunStage(
+        stageCache ? &stageCache->scatterPoints : nullptr, scatterPointsKey(parameters, coord, layer), [&]() {
+          auto pointsResult = std::make_shared<ScatterPointsResult>();
+          generateScatterPoints(layer, chunkExtent, chunkExtent, coord.x, coord.z, &pointsResult->points);
+          return pointsResult;
+        });
+    placeScatterInstances(layer, uint32_t(layerIndex), points->points, heights.heightmap,
+                          heights.normals.data(), parameters.normalEncoding, biomes.biomeMap,
+                          glm::vec2(float(coord.x), float(coord.z)) * chunkExtent, parameters.sampleSpacing,
+                          coord.x, coord.z, &result->instances);
+  }
+  return result;
+}
+} // namespace
+
+ChunkManager::ChunkManager(JobSystem *jobSystem, const ChunkStreamingParameters &parameters,
+                           CreateGpuDataFunction createGpuData, ReleaseGpuDataFunction releaseGpuData)
+    : jobSystem(jobSystem), parameters(parameters), createGpuData(std::move(createGpuData)),
+      releaseGpuData(std::move(releaseGpuData)), completedChunks(std::make_shared<CompletedChunkQueue>()),
+      stageCache(
+          std::make_shared<ChunkStageCache>(parameters.maxCachedChunks + parameters.maxInFlightChunks)) {
+  const auto loadRadius = parameters.loadRadius;
+  for (auto z = -loadRadius; z <= loadRadius; ++z) {
+    for (auto x = -loadRadius; x <= loadRadius; ++x) {
+      if (x * x + z * z <= loadRadius * loadRadius) {
+        loadOffsets.push_back({x, z});
+      }
+    }
+  }
+
+  std::sort(loadOffsets.begin(), loadOffsets.end(), [](const ChunkCoord &a, const ChunkCoord &b) {
+    return a.x * a.x + a.z * a.z < b.x * b.x + b.z * b.z;
+  });
+
+  if (parameters.maxCachedChunks < loadOffsets.size()) {
+    throw std::runtime_error("Chunk cache is smaller than the load radius requires!");
+  }
+}
+
+ChunkManager::~ChunkManager() {
+  for (auto &pendingChunk : pendingChunks) {
+    pendingChunk.second->store(true);
+  }
+
+  for (auto &cacheEntry : chunkCache) {
+    if (releaseGpuData) {
+      releaseGpuData(&cacheEntry.second.chunk->gpuData);
+    }
+  }
+}
+
+void ChunkManager::update(const glm::vec3 &cameraPosition) {
+  integrateCompletedChunks();
+
+  const auto center = chunkCoordAt(cameraPosition);
+  const auto loadRadiusSquared = parameters.loadRadius * parameters.loadRadius;
+
+  // Requests that fell out of range are dropped before they waste a worker
+  for (auto it = pendingChunks.begin(); it != pendingChunks.end();) {
+    const auto dx = it->first.x - center.x;
+    const auto dz = it->first.z - center.z;
+    if (dx * dx + dz * dz > loadRadiusSquared) {
+      it->second->store(true);
+      it = pendingChunks.erase(it);
+    } else {
+      ++it;
+    }
+  }
+
+  residentChunkList.clear();
+  for (const auto &loadOffset : loadOffsets) {
+    const ChunkCoord coord = {center.x + loadOffset.x, center.z + loadOffset.z};
+
+    const auto cacheEntry = chunkCache.find(coord);
+    const auto isCached = cacheEntry != chunkCache.end();
+    if (isCached) {
+      touchChunk(&cacheEntry->second);
+      residentChunkList.push_back(cacheEntry->second.chunk.get());
+    }
+
+    if ((!isCached || cacheEntry->second.isStale) && pendingChunks.size() < parameters.maxInFlightChunks &&
+        pendingChunks.find(coord) == pendingChunks.end()) {
+      requestChunk(coord);
+    }
+  }
+
+  // Every chunk in range was just touched, so the least recently used ones are always out of range
+  while (chunkCache.size() > parameters.maxCachedChunks) {
+    evictLeastRecentlyUsed();
+  }
+}
+
+void ChunkManager::setStreamingParameters(const ChunkStreamingParameters &newParameters) {
+  if (newParameters.chunkSize != parameters.chunkSize ||
+      newParameters.sampleSpacing != parameters.sampleSpacing ||
+      newParameters.loadRadius != parameters.loadRadius ||
+      newParameters.maxCachedChunks != parameters.maxCachedChunks ||
+      newParameters.maxInFlightChunks != parameters.maxInFlightChunks) {
+    throw std::runtime_error("Only the generation parameters of a chunk manager can be changed!");
+  }
+
+  parameters = newParameters;
+
+  // Requests in flight still use the old parameters
+  for (auto &pendingChunk : pendingChunks) {
+    pendingChunk.second->store(true);
+  }
+  pendingChunks.clear();
+
+  // update() regenerates the stale chunks once they are in range, until then they are still drawn
+  for (auto &cacheEntry : chunkCache) {
+    cacheEntry.second.isStale = true;
+  }
+}
+
+ChunkCoord ChunkManager::chunkCoordAt(const glm::vec3 &position) const {
+  const auto chunkExtent = float(parameters.chunkSize) * parameters.sampleSpacing;
+  return {int32_t(std::floor(position.x / chunkExtent)), int32_t(std::floor(position.z / chunkExtent))};
+}
+
+const TerrainChunk *ChunkManager::findChunk(ChunkCoord coord) const {
+  const auto cacheEntry = chunkCache.find(coord);
+  return cacheEntry != chunkCache.end() ? cacheEntry->second.chunk.get() : nullptr;
+}
+
+TerrainChunk *ChunkManager::findChunk(ChunkCoord coord) {
+  const auto cacheEntry = chunkCache.find(coord);
+  return cacheEntry != chunkCache.end() ? cacheEntry->second.chunk.get() : nullptr;
+}
+
+void ChunkManager::integrateCompletedChunks() {
+  std::vector<CompletedChunk> chunks;
+  {
+    std::lock_guard<std::mutex> lock(completedChunks->mutex);
+    chunks.swap(completedChunks->chunks);
+  }
+
+  for (auto &completedChunk : chunks) {
+    // Cancelled requests may still finish if a worker had already started on them
+    if (completedChunk.isCancelled->load()) {
+      continue;
+    }
+
+    const auto coord = completedChunk.chunk->coord;
+    pendingChunks.erase(coord);
+
+    // A regenerated chunk replaces the stale one, unless the edit did not change it at all
+    const auto cacheEntry = chunkCache.find(coord);
+    if (cacheEntry != chunkCache.end()) {
+      cacheEntry->second.isStale = false;
+      cacheEntry->second.chunk->updateContentHash();
+      if (cacheEntry->second.chunk->contentHash == completedChunk.chunk->contentHash) {
+        continue;
+      }
+
+      if (releaseGpuData) {
+        releaseGpuData(&cacheEntry->second.chunk->gpuData);
+      }
+      if (createGpuData) {
+        createGpuData(completedChunk.chunk.get());
+      }
+      cacheEntry->second.chunk = std::move(completedChunk.chunk);
+      continue;
+    }
+
+    if (createGpuData) {
+      createGpuData(completedChunk.chunk.get());
+    }
+
+    lruOrder.push_front(coord);
+    chunkCache[coord] = {std::move(completedChunk.chunk), lruOrder.begin()};
+  }
+}
+
+void ChunkManager::requestChunk(ChunkCoord coord) {
+  auto isCancelled = std::make_shared<std::atomic<bool>>(false);
+  pendingChunks[coord] = isCancelled;
+
+  auto job = jobSystem->createBackgroundJob(
+      [parameters = parameters, coord, isCancelled, completedChunks = completedChunks,
+       stageCache = stageCache]() {
+        if (isCancelled->load()) {
+          return;
+        }
+
+        auto chunk = generateChunk(parameters, coord, stageCache.get());
+
+        std::lock_guard<std::mutex> lock(completedChunks->mutex);
+        completedChunks->chunks.push_back({std::move(chunk), isCancelled});
+      });
+  jobSystem->submit(job);
+}
+
+void ChunkManager::touchChunk(CacheEntry *cacheEntry) {
+  lruOrder.splice(lruOrder.begin(), lruOrder, cacheEntry->lruPosition);
+}
+
+void ChunkManager::evictLeastRecentlyUsed() {
+  const auto coord = lruOrder.back();
+  lruOrder.pop_back();
+
+  const auto cacheEntry = chunkCache.find(coord);
+  if (releaseGpuData) {
+    releaseGpuData(&cacheEntry->second.chunk->gpuData);
+  }
+  chunkCache.erase(cacheEntry);
+}
+
+std::unique_ptr<TerrainChunk> generateChunk(const ChunkStreamingParameters &parameters, ChunkCoord coord,
+                                            ChunkStageCache *stageCache) {
+  const auto heightKey = heightStageKey(parameters, coord);
+  const auto biomeKey = biomeStageKey(parameters, heightKey);
+  const auto scatterKey = scatterStageKey(parameters, heightKey, biomeKey);
+
+  const auto heights = findOrRunStage(stageCache ? &stageCache->heights : nullptr, heightKey,
+                                      [&]() { return runHeightStage(parameters, coord); });
+  const auto biomes = findOrRunStage(stageCache ? &stageCache->biomes : nullptr, biomeKey,
+                                     [&]() { return runBiomeStage(parameters, coord, *heights); });
+  const auto scatter = findOrRunStage(stageCache ? &stageCache->scatter : nullptr, scatterKey, [&]() {
+    return runScatterStage(parameters, coord, *heights, *biomes, stageCache);
+  });
+
+  auto chunk = std::make_unique<TerrainChunk>();
+  chunk->coord = coord;
+  chunk->heights = heights;
+  chunk->biomes = biomes;
+  chunk->scatter = scatter;
+  chunk->contentHash = hashChunkContent(*chunk);
+
+  packTerrainVertices(chunk->heightmap(), chunk->normals().data(), parameters.normalEncoding,
+                      chunk->minHeight(), chunk->maxHeight(), MorphTarget::ChunkLods, &chunk->vertexData);
+
+  return chunk;
+}
+
+uint64_t hashChunkContent(const TerrainChunk &chunk) {
+  static_assert(sizeof(ScatterInstance) == 6 * sizeof(float), "ScatterInstance must not contain padding");
+
+  ContentHash contentHash;
+  contentHash.addValue(chunk.coord.x);
+  contentHash.addValue(chunk.coord.z);
+  contentHash.addValue(chunk.heightmap().width);
+  contentHash.addValue(chunk.heightmap().height);
+  contentHash.add(chunk.heightmap().heights);
+  contentHash.add(chunk.normals());
+  contentHash.add(chunk.biomeMap().biomes);
+  contentHash.add(chunk.biomeMap().splatWeights);
+  if (chunk.scatter) {
+    contentHash.add(chunk.scatter->instances);
+  }
+  return contentHash.value();
+}
+
+HeightStageResult *TerrainChunk::editHeights() {
+  if (!editedHeights) {
+    editedHeights = std::make_shared<HeightStageResult>(*heights);
+    heights = editedHeights;
+  }
+  return editedHeights.get();
+}
+
+void TerrainChunk::updateContentHash() {
+  if (isContentHashDirty) {
+    contentHash = hashChunkContent(*this);
+    isContentHashDirty = false;
+  }
+}
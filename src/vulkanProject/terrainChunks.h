@@ -0,0 +1,167 @@
+#pragma once
+
+#include "glm/glm.hpp"
+#include "heightmap.h"
+#include "jobSystem.h"
+#include "terrainBiomes.h"
+#include "terrainMesh.h"
+#include "terrainNoise.h"
+#include "terrainNoiseGraph.h"
+#include "terrainNormals.h"
+#include "terrainScatter.h"
+#include "terrainStageCache.h"
+#include "vulkan/vulkan.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+struct ChunkCoord {
+  int32_t x = 0;
+  int32_t z = 0;
+
+  bool operator==(const ChunkCoord &other) const { return x == other.x && z == other.z; }
+  bool operator!=(const ChunkCoord &other) const { return !(*this == other); }
+};
+
+struct ChunkCoordHash {
+  size_t operator()(const ChunkCoord &coord) const {
+    return std::hash<uint64_t>()((uint64_t(uint32_t(coord.x)) << 32) | uint32_t(coord.z));
+  }
+};
+
+constexpr uint32_t kInvalidVegetationSlot = ~0u;
+
+struct ChunkGpuData {
+  VkBuffer vertexBuffer = VK_NULL_HANDLE;
+  VkDeviceMemory vertexBufferMemory = VK_NULL_HANDLE;
+  uint32_t vegetationSlot = kInvalidVegetationSlot; // Chunk slot of the vegetation instance buffer
+};
+
+// The stage results are shared with the stage cache rather than copied out of it. Edits go through
+// editHeights(), which gives the chunk a copy of its own on the first write.
+struct TerrainChunk {
+  ChunkCoord coord;
+  // Heightmap of (chunkSize + 1)^2 samples, the last row and column are shared with the neighbours. The
+  // normals have the same layout, see ChunkStreamingParameters::normalEncoding.
+  std::shared_ptr<const HeightStageResult> heights;
+  std::shared_ptr<const BiomeStageResult> biomes; // Same layout as the heightmap
+  // See ChunkStreamingParameters::scatterLayers, null once uploaded into a vegetation slot
+  std::shared_ptr<const ScatterStageResult> scatter;
+  uint64_t contentHash = 0;        // See hashChunkContent(), out of date while isContentHashDirty is set
+  bool isContentHashDirty = false; // Set by edits instead of rehashing the whole chunk every time
+  ChunkVertexData vertexData;      // Packed on the worker, may be released once it has been uploaded
+  ChunkGpuData gpuData;
+
+  const Heightmap &heightmap() const { return heights->heightmap; }
+  const std::vector<uint8_t> &normals() const { return heights->normals; }
+  float minHeight() const { return heights->minHeight; }
+  float maxHeight() const { return heights->maxHeight; }
+  const BiomeMap &biomeMap() const { return biomes->biomeMap; }
+
+  // Copies the heights and normals on the first call, later calls return the same copy. Anything that keeps
+  // a pointer to the heightmap across edits, such as a HeightPyramid, has to take it from here.
+  HeightStageResult *editHeights();
+  // Rehashes the chunk if an edit has marked the hash dirty, to be called wherever the hash is compared
+  void updateContentHash();
+
+private:
+  std::shared_ptr<HeightStageResult> editedHeights;
+};
+
+struct ChunkStreamingParameters {
+  int chunkSize = 128;        // Quads per chunk side
+  float sampleSpacing = 1.0f; // World units between two height samples
+  float heightScale = 256.0f;
+  int loadRadius = 8; // Chunks kept around the camera in each direction
+  size_t maxCachedChunks = 512;
+  size_t maxInFlightChunks = 64;
+  NormalEncoding normalEncoding = NormalEncoding::Octahedral8x2; // Matches TerrainVertex::normal
+  NoiseGraph heightNoise = defaultTerrainNoiseGraph(0); // In world units, scaled by heightScale
+  ClimateParameters climateParameters;
+  std::vector<ScatterLayer> scatterLayers = defaultScatterLayers();
+};
+
+// Streams chunks around the camera. Generation runs as background jobs on the job system workers, the
+// thread calling update() only integrates finished chunks and maintains the LRU cache. The GPU data callbacks
+// are called from update() and the destructor.
+class ChunkManager {
+public:
+  typedef std::function<void(TerrainChunk *)> CreateGpuDataFunction;
+  typedef std::function<void(ChunkGpuData *)> ReleaseGpuDataFunction;
+
+  ChunkManager(JobSystem *jobSystem, const ChunkStreamingParameters &parameters,
+               CreateGpuDataFunction createGpuData = nullptr,
+               ReleaseGpuDataFunction releaseGpuData = nullptr);
+  ~ChunkManager();
+
+  ChunkManager(const ChunkManager &) = delete;
+  ChunkManager &operator=(const ChunkManager &) = delete;
+
+  void update(const glm::vec3 &cameraPosition);
+  // Regenerates every cached chunk in the background, the old chunks stay resident until their replacement
+  // is ready. Stages whose inputs did not change are served from the stage cache, so e.g. a scatter edit
+  // never reruns the noise. Only the generation parameters may change, not the chunk layout or streaming.
+  void setStreamingParameters(const ChunkStreamingParameters &newParameters);
+
+  ChunkCoord chunkCoordAt(const glm::vec3 &position) const;
+  const TerrainChunk *findChunk(ChunkCoord coord) const;
+  // For edits such as sculpting. Generation jobs never see cached chunks, so they may be modified from the
+  // thread calling update().
+  TerrainChunk *findChunk(ChunkCoord coord);
+  // Chunks within the load radius of the last update() that are ready to be rendered
+  const std::vector<const TerrainChunk *> &residentChunks() const { return residentChunkList; }
+
+  size_t cachedChunkCount() const { return chunkCache.size(); }
+  size_t inFlightChunkCount() const { return pendingChunks.size(); }
+  const ChunkStreamingParameters &streamingParameters() const { return parameters; }
+
+private:
+  struct CacheEntry {
+    std::unique_ptr<TerrainChunk> chunk;
+    std::list<ChunkCoord>::iterator lruPosition;
+    bool isStale = false; // Generated with parameters that have been edited since
+  };
+
+  struct CompletedChunk {
+    std::unique_ptr<TerrainChunk> chunk;
+    std::shared_ptr<std::atomic<bool>> isCancelled;
+  };
+
+  // Shared with the generation jobs so they never reference the manager itself
+  struct CompletedChunkQueue {
+    std::mutex mutex;
+    std::vector<CompletedChunk> chunks;
+  };
+
+  void integrateCompletedChunks();
+  void requestChunk(ChunkCoord coord);
+  void touchChunk(CacheEntry *cacheEntry);
+  void evictLeastRecentlyUsed();
+
+  JobSystem *jobSystem;
+  ChunkStreamingParameters parameters;
+  CreateGpuDataFunction createGpuData;
+  ReleaseGpuDataFunction releaseGpuData;
+
+  std::unordered_map<ChunkCoord, CacheEntry, ChunkCoordHash> chunkCache;
+  std::list<ChunkCoord> lruOrder; // Most recently used first
+  std::unordered_map<ChunkCoord, std::shared_ptr<std::atomic<bool>>, ChunkCoordHash> pendingChunks;
+  std::vector<const TerrainChunk *> residentChunkList;
+  std::vector<ChunkCoord> loadOffsets; // Chunk offsets within the load radius, nearest first
+  std::shared_ptr<CompletedChunkQueue> completedChunks;
+  std::shared_ptr<ChunkStageCache> stageCache;
+};
+
+// Runs the height, biome and scatter stages, taking each from the stage cache when one is given and it holds
+// a result for the same inputs
+std::unique_ptr<TerrainChunk> generateChunk(const ChunkStreamingParameters &parameters, ChunkCoord coord,
+                                            ChunkStageCache *stageCache = nullptr);
+// Covers everything generateChunk() derives from the parameters except the packed vertices, and the scatter
+// instances once the upload has released them. Every stage is deterministic, so equal hashes mean equal
+// chunks for any thread count and job order, and a bake can be regression tested by comparing hashes.
+uint64_t hashChunkContent(const TerrainChunk &chunk);
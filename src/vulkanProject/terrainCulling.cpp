@@ -0,0 +1,396 @@
+#include "terrainCulling.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <immintrin.h>
+#include <limits>
+
+namespace {
+constexpr float kPseudoAzimuthPeriod = 4.0f;
+
+struct FrustumPlanes {
+  float normalX[6], normalY[6], normalZ[6];
+  float absNormalX[6], absNormalY[6], absNormalZ[6];
+  float distance[6];
+};
+
+FrustumPlanes splitFrustumPlanes(const Frustum &frustum) {
+  FrustumPlanes frustumPlanes;
+  for (auto plane = 0; plane < 6; ++plane) {
+    frustumPlanes.normalX[plane] = frustum.planes[plane].x;
+    frustumPlanes.normalY[plane] = frustum.planes[plane].y;
+    frustumPlanes.normalZ[plane] = frustum.planes[plane].z;
+    frustumPlanes.absNormalX[plane] = std::abs(frustum.planes[plane].x);
+    frustumPlanes.absNormalY[plane] = std::abs(frustum.planes[plane].y);
+    frustumPlanes.absNormalZ[plane] = std::abs(frustum.planes[plane].z);
+    frustumPlanes.distance[plane] = frustum.planes[plane].w;
+  }
+  return frustumPlanes;
+}
+
+CullResult toCullResult(bool isOutside, bool isIntersecting) {
+  if (isOutside) {
+    return CullResult::Outside;
+  }
+  return isIntersecting ? CullResult::Intersecting : CullResult::Inside;
+}
+
+// Monotonic in the azimuth of (x, z) and four times cheaper than atan2, the horizon columns only need a
+// consistent order around the camera, not equal angles. Maps the full circle to [0, 4).
+float pseudoAzimuth(float x, float z) {
+  if (z >= 0.0f) {
+    return x >= 0.0f ? z / (x + z) : 1.0f - x / (z - x);
+  }
+  return x < 0.0f ? 2.0f - z / (-x - z) : 3.0f + x / (x - z);
+}
+
+struct NodeBounds {
+  const float *centerX, *centerY, *centerZ;
+  const float *extentX, *extentY, *extentZ;
+};
+
+// A box is outside when its center is further behind any plane than its projected half extent, and inside
+// when it is in front of every plane by at least that much
+void cullNodesScalar(const FrustumPlanes &frustumPlanes, const NodeBounds &bounds, const uint32_t *nodes,
+                     size_t begin, size_t end, CullResult *results) {
+  for (auto i = begin; i < end; ++i) {
+    const auto node = nodes[i];
+    auto isOutside = false;
+    auto isIntersecting = false;
+    for (auto plane = 0; plane < 6; ++plane) {
+      const auto distance = frustumPlanes.normalX[plane] * bounds.centerX[node] +
+                            frustumPlanes.normalY[plane] * bounds.centerY[node] +
+                            frustumPlanes.normalZ[plane] * bounds.centerZ[node] +
+                            frustumPlanes.distance[plane];
+      const auto radius = frustumPlanes.absNormalX[plane] * bounds.extentX[node] +
+                          frustumPlanes.absNormalY[plane] * bounds.extentY[node] +
+                          frustumPlanes.absNormalZ[plane] * bounds.extentZ[node];
+      isOutside |= distance < -radius;
+      isIntersecting |= distance < radius;
+    }
+    results[i] = toCullResult(isOutside, isIntersecting);
+  }
+}
+
+void storeCullResults(int outsideMask, int intersectingMask, int laneCount, CullResult *results) {
+  for (auto lane = 0; lane < laneCount; ++lane) {
+    results[lane] = toCullResult(((outsideMask >> lane) & 1) != 0, ((intersectingMask >> lane) & 1) != 0);
+  }
+}
+
+SIMD_TARGET_SSE41 void cullNodesSse(const FrustumPlanes &frustumPlanes, const NodeBounds &bounds,
+                                    const uint32_t *nodes, size_t count, CullResult *results) {
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const auto n = nodes + i;
+    const auto centerX = _mm_setr_ps(bounds.centerX[n[0]], bounds.centerX[n[1]], bounds.centerX[n[2]],
+                                     bounds.centerX[n[3]]);
+    const auto centerY = _mm_setr_ps(bounds.centerY[n[0]], bounds.centerY[n[1]], bounds.centerY[n[2]],
+                                     bounds.centerY[n[3]]);
+    const auto centerZ = _mm_setr_ps(bounds.centerZ[n[0]], bounds.centerZ[n[1]], bounds.centerZ[n[2]],
+                                     bounds.centerZ[n[3]]);
+    const auto extentX = _mm_setr_ps(bounds.extentX[n[0]], bounds.extentX[n[1]], bounds.extentX[n[2]],
+                                     bounds.extentX[n[3]]);
+    const auto extentY = _mm_setr_ps(bounds.extentY[n[0]], bounds.extentY[n[1]], bounds.extentY[n[2]],
+                                     bounds.extentY[n[3]]);
+    const auto extentZ = _mm_setr_ps(bounds.extentZ[n[0]], bounds.extentZ[n[1]], bounds.extentZ[n[2]],
+                                     bounds.extentZ[n[3]]);
+
+    auto isOutside = _mm_setzero_ps();
+    auto isIntersecting = _mm_setzero_ps();
+    for (auto plane = 0; plane < 6; ++plane) {
+      const auto distance = _mm_add_ps(
+          _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(frustumPlanes.normalX[plane]), centerX),
+                                _mm_mul_ps(_mm_set1_ps(frustumPlanes.normalY[plane]), centerY)),
+                     _mm_mul_ps(_mm_set1_ps(frustumPlanes.normalZ[plane]), centerZ)),
+          _mm_set1_ps(frustumPlanes.distance[plane]));
+      const auto radius =
+          _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(frustumPlanes.absNormalX[plane]), extentX),
+                                _mm_mul_ps(_mm_set1_ps(frustumPlanes.absNormalY[plane]), extentY)),
+                     _mm_mul_ps(_mm_set1_ps(frustumPlanes.absNormalZ[plane]), extentZ));
+      const auto negativeRadius = _mm_sub_ps(_mm_setzero_ps(), radius);
+      isOutside = _mm_or_ps(isOutside, _mm_cmplt_ps(distance, negativeRadius));
+      isIntersecting = _mm_or_ps(isIntersecting, _mm_cmplt_ps(distance, radius));
+    }
+
+    storeCullResults(_mm_movemask_ps(isOutside), _mm_movemask_ps(isIntersecting), 4, results + i);
+  }
+
+  cullNodesScalar(frustumPlanes, bounds, nodes, i, count, results);
+}
+
+SIMD_TARGET_AVX2 void cullNodesAvx2(const FrustumPlanes &frustumPlanes, const NodeBounds &bounds,
+                                    const uint32_t *nodes, size_t count, CullResult *results) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const auto nodeIndices = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(nodes + i));
+    const auto centerX = _mm256_i32gather_ps(bounds.centerX, nodeIndices, 4);
+    const auto centerY = _mm256_i32gather_ps(bounds.centerY, nodeIndices, 4);
+    const auto centerZ = _mm256_i32gather_ps(bounds.centerZ, nodeIndices, 4);
+    const auto extentX = _mm256_i32gather_ps(bounds.extentX, nodeIndices, 4);
+    const auto extentY = _mm256_i32gather_ps(bounds.extentY, nodeIndices, 4);
+    const auto extentZ = _mm256_i32gather_ps(bounds.extentZ, nodeIndices, 4);
+
+    auto isOutside = _mm256_setzero_ps();
+    auto isIntersecting = _mm256_setzero_ps();
+    for (auto plane = 0; plane < 6; ++plane) {
+      const auto distance = _mm256_add_ps(
+          _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(frustumPlanes.normalX[plane]), centerX),
+                                      _mm256_mul_ps(_mm256_set1_ps(frustumPlanes.normalY[plane]), centerY)),
+                        _mm256_mul_ps(_mm256_set1_ps(frustumPlanes.normalZ[plane]), centerZ)),
+          _mm256_set1_ps(frustumPlanes.distance[plane]));
+      const auto radius = _mm256_add_ps(
+          _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(frustumPlanes.absNormalX[plane]), extentX),
+                        _mm256_mul_ps(_mm256_set1_ps(frustumPlanes.absNormalY[plane]), extentY)),
+          _mm256_mul_ps(_mm256_set1_ps(frustumPlanes.absNormalZ[plane]), extentZ));
+      const auto negativeRadius = _mm256_sub_ps(_mm256_setzero_ps(), radius);
+      isOutside = _mm256_or_ps(isOutside, _mm256_cmp_ps(distance, negativeRadius, _CMP_LT_OQ));
+      isIntersecting = _mm256_or_ps(isIntersecting, _mm256_cmp_ps(distance, radius, _CMP_LT_OQ));
+    }
+
+    storeCullResults(_mm256_movemask_ps(isOutside), _mm256_movemask_ps(isIntersecting), 8, results + i);
+  }
+
+  cullNodesScalar(frustumPlanes, bounds, nodes, i, count, results);
+}
+} // namespace
+
+Frustum extractFrustum(const glm::mat4 &viewProjection) {
+  const auto row = [&viewProjection](int index) {
+    return glm::vec4(viewProjection[0][index], viewProjection[1][index], viewProjection[2][index],
+                     viewProjection[3][index]);
+  };
+
+  Frustum frustum;
+  frustum.planes[0] = row(3) + row(0); // Left
+  frustum.planes[1] = row(3) - row(0); // Right
+  frustum.planes[2] = row(3) + row(1); // Bottom
+  frustum.planes[3] = row(3) - row(1); // Top
+  frustum.planes[4] = row(3) + row(2); // Near
+  frustum.planes[5] = row(3) - row(2); // Far
+
+  for (auto &plane : frustum.planes) {
+    plane /= glm::length(glm::vec3(plane));
+  }
+  return frustum;
+}
+
+CdlodFrustumCuller::CdlodFrustumCuller(const CdlodQuadtree *quadtree) : quadtree(quadtree) {
+  const auto nodeCount = quadtree->nodeCount();
+  centerX.resize(nodeCount);
+  centerY.resize(nodeCount);
+  centerZ.resize(nodeCount);
+  extentX.resize(nodeCount);
+  extentY.resize(nodeCount);
+  extentZ.resize(nodeCount);
+  subtreeEnd.resize(nodeCount);
+  visibility.resize(nodeCount);
+
+  for (uint32_t nodeIndex = 0; nodeIndex < nodeCount; ++nodeIndex) {
+    glm::vec3 boundsMin, boundsMax;
+    quadtree->nodeBounds(quadtree->node(nodeIndex), &boundsMin, &boundsMax);
+    const auto center = 0.5f * (boundsMin + boundsMax);
+    const auto extent = 0.5f * (boundsMax - boundsMin);
+    centerX[nodeIndex] = center.x;
+    centerY[nodeIndex] = center.y;
+    centerZ[nodeIndex] = center.z;
+    extentX[nodeIndex] = extent.x;
+    extentY[nodeIndex] = extent.y;
+    extentZ[nodeIndex] = extent.z;
+  }
+
+  // Nodes are stored depth first, so a subtree ends where the subtree of the last child ends
+  for (auto nodeIndex = uint32_t(nodeCount); nodeIndex-- > 0;) {
+    subtreeEnd[nodeIndex] = nodeIndex + 1;
+    for (const auto child : quadtree->node(nodeIndex).children) {
+      if (child != kInvalidCdlodNode) {
+        subtreeEnd[nodeIndex] = std::max(subtreeEnd[nodeIndex], subtreeEnd[child]);
+      }
+    }
+  }
+}
+
+CullingStats CdlodFrustumCuller::cull(const Frustum &frustum) { return cull(frustum, detectSimdLevel()); }
+
+CullingStats CdlodFrustumCuller::cull(const Frustum &frustum, SimdLevel simdLevel) {
+  const auto start = std::chrono::steady_clock::now();
+  const auto frustumPlanes = splitFrustumPlanes(frustum);
+  const NodeBounds bounds = {centerX.data(), centerY.data(), centerZ.data(),
+                             extentX.data(), extentY.data(), extentZ.data()};
+
+  CullingStats cullingStats;
+  frontier.assign(1, quadtree->rootNode());
+  while (!frontier.empty()) {
+    frontierResults.resize(frontier.size());
+    switch (simdLevel) {
+    case SimdLevel::Avx2:
+      cullNodesAvx2(frustumPlanes, bounds, frontier.data(), frontier.size(), frontierResults.data());
+      break;
+    case SimdLevel::Sse41:
+      cullNodesSse(frustumPlanes, bounds, frontier.data(), frontier.size(), frontierResults.data());
+      break;
+    default:
+      cullNodesScalar(frustumPlanes, bounds, frontier.data(), 0, frontier.size(), frontierResults.data());
+      break;
+    }
+    cullingStats.testedNodes += frontier.size();
+
+    nextFrontier.clear();
+    for (size_t i = 0; i < frontier.size(); ++i) {
+      const auto nodeIndex = frontier[i];
+      const auto cullResult = frontierResults[i];
+      const auto &node = quadtree->node(nodeIndex);
+
+      if (cullResult == CullResult::Intersecting && node.level > 0) {
+        visibility[nodeIndex] = cullResult;
+        ++cullingStats.visibleNodes;
+        for (const auto child : node.children) {
+          if (child != kInvalidCdlodNode) {
+            nextFrontier.push_back(child);
+          }
+        }
+      } else {
+        std::fill(visibility.begin() + nodeIndex, visibility.begin() + subtreeEnd[nodeIndex], cullResult);
+        if (cullResult != CullResult::Outside) {
+          cullingStats.visibleNodes += subtreeEnd[nodeIndex] - nodeIndex;
+        }
+      }
+    }
+    frontier.swap(nextFrontier);
+  }
+
+  cullingStats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return cullingStats;
+}
+
+HorizonOcclusionCuller::HorizonOcclusionCuller(int columnCount)
+    : columnCount(columnCount), horizon(size_t(columnCount)) {}
+
+CullingStats HorizonOcclusionCuller::cull(const CdlodQuadtree &quadtree, const glm::vec3 &cameraPosition,
+                                          std::vector<CdlodSelectedNode> *selectedNodes) {
+  const auto start = std::chrono::steady_clock::now();
+
+  footprints.clear();
+  for (uint32_t selectedNode = 0; selectedNode < selectedNodes->size(); ++selectedNode) {
+    glm::vec3 boundsMin, boundsMax;
+    quadtree.nodeBounds(quadtree.node((*selectedNodes)[selectedNode].node), &boundsMin, &boundsMax);
+
+    NodeFootprint footprint;
+    footprint.selectedNode = selectedNode;
+    footprint.minHeight = boundsMin.y - cameraPosition.y;
+    footprint.maxHeight = boundsMax.y - cameraPosition.y;
+
+    const auto nearX = std::max({boundsMin.x - cameraPosition.x, cameraPosition.x - boundsMax.x, 0.0f});
+    const auto nearZ = std::max({boundsMin.z - cameraPosition.z, cameraPosition.z - boundsMax.z, 0.0f});
+    const auto farX = std::max(cameraPosition.x - boundsMin.x, boundsMax.x - cameraPosition.x);
+    const auto farZ = std::max(cameraPosition.z - boundsMin.z, boundsMax.z - cameraPosition.z);
+    footprint.nearDistance = std::sqrt(nearX * nearX + nearZ * nearZ);
+    footprint.farDistance = std::sqrt(farX * farX + farZ * farZ);
+
+    if (footprint.nearDistance == 0.0f) {
+      // The camera is above the node, which covers every azimuth
+      footprint.minAzimuth = 0.0f;
+      footprint.maxAzimuth = kPseudoAzimuthPeriod;
+    } else {
+      // Seen from outside, the footprint spans less than half a circle, so the corner azimuths relative to
+      // the center don't wrap around
+      const auto center = 0.5f * (boundsMin + boundsMax) - cameraPosition;
+      const auto centerAzimuth = pseudoAzimuth(center.x, center.z);
+      auto minOffset = 0.5f * kPseudoAzimuthPeriod;
+      auto maxOffset = -0.5f * kPseudoAzimuthPeriod;
+      for (const auto cornerX : {boundsMin.x, boundsMax.x}) {
+        for (const auto cornerZ : {boundsMin.z, boundsMax.z}) {
+          auto offset = pseudoAzimuth(cornerX - cameraPosition.x, cornerZ - cameraPosition.z) - centerAzimuth;
+          if (offset > 0.5f * kPseudoAzimuthPeriod) {
+            offset -= kPseudoAzimuthPeriod;
+          } else if (offset < -0.5f * kPseudoAzimuthPeriod) {
+            offset += kPseudoAzimuthPeriod;
+          }
+          minOffset = std::min(minOffset, offset);
+          maxOffset = std::max(maxOffset, offset);
+        }
+      }
+
+      footprint.minAzimuth = centerAzimuth + minOffset;
+      footprint.maxAzimuth = centerAzimuth + maxOffset;
+      if (footprint.minAzimuth < 0.0f) {
+        footprint.minAzimuth += kPseudoAzimuthPeriod;
+        footprint.maxAzimuth += kPseudoAzimuthPeriod;
+      }
+    }
+
+    footprints.push_back(footprint);
+  }
+
+  std::sort(footprints.begin(), footprints.end(), [](const NodeFootprint &a, const NodeFootprint &b) {
+    return a.nearDistance < b.nearDistance;
+  });
+
+  // Occluders in the order they become usable, a node can only hide nodes that start behind its far end
+  occluderOrder.resize(footprints.size());
+  for (uint32_t footprintIndex = 0; footprintIndex < footprints.size(); ++footprintIndex) {
+    occluderOrder[footprintIndex] = footprintIndex;
+  }
+  std::sort(occluderOrder.begin(), occluderOrder.end(), [this](uint32_t a, uint32_t b) {
+    return footprints[a].farDistance < footprints[b].farDistance;
+  });
+
+  std::fill(horizon.begin(), horizon.end(), -std::numeric_limits<float>::infinity());
+  visibleNodes.clear();
+  size_t nextOccluder = 0;
+  for (const auto &footprint : footprints) {
+    while (nextOccluder < occluderOrder.size() &&
+           footprints[occluderOrder[nextOccluder]].farDistance <= footprint.nearDistance) {
+      raiseHorizon(footprints[occluderOrder[nextOccluder]]);
+      ++nextOccluder;
+    }
+
+    if (!isHidden(footprint)) {
+      visibleNodes.push_back((*selectedNodes)[footprint.selectedNode]);
+    }
+  }
+
+  CullingStats cullingStats;
+  cullingStats.testedNodes = selectedNodes->size();
+  cullingStats.visibleNodes = visibleNodes.size();
+  selectedNodes->swap(visibleNodes);
+  cullingStats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return cullingStats;
+}
+
+bool HorizonOcclusionCuller::isHidden(const NodeFootprint &footprint) const {
+  if (footprint.nearDistance == 0.0f) {
+    return false;
+  }
+
+  // Largest tangent of the top of the bounding box, which is at the near end when it is above the camera
+  const auto topTangent = footprint.maxHeight / (footprint.maxHeight >= 0.0f ? footprint.nearDistance
+                                                                              : footprint.farDistance);
+  const auto columnsPerAzimuth = float(columnCount) / kPseudoAzimuthPeriod;
+  const auto firstColumn = int(std::floor(footprint.minAzimuth * columnsPerAzimuth));
+  const auto lastColumn = int(std::floor(footprint.maxAzimuth * columnsPerAzimuth));
+  for (auto column = firstColumn; column <= lastColumn; ++column) {
+    if (topTangent >= horizon[size_t(column < columnCount ? column : column - columnCount)]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void HorizonOcclusionCuller::raiseHorizon(const NodeFootprint &footprint) {
+  if (footprint.nearDistance == 0.0f) {
+    return;
+  }
+
+  // Smallest tangent of the bottom of the bounding box, which is at the far end when it is above the camera
+  const auto bottomTangent = footprint.minHeight / (footprint.minHeight >= 0.0f ? footprint.farDistance
+                                                                                 : footprint.nearDistance);
+  const auto columnsPerAzimuth = float(columnCount) / kPseudoAzimuthPeriod;
+  const auto firstColumn = int(std::ceil(footprint.minAzimuth * columnsPerAzimuth));
+  const auto endColumn = int(std::floor(footprint.maxAzimuth * columnsPerAzimuth));
+  for (auto column = firstColumn; column < endColumn; ++column) {
+    auto &horizonTangent = horizon[size_t(column < columnCount ? column : column - columnCount)];
+    horizonTangent = std::max(horizonTangent, bottomTangent);
+  }
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "glm/glm.hpp"
+#include "simdUtils.h"
+#include "terrainLod.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Planes point inwards, a point p is inside a plane when dot(plane.xyz, p) + plane.w >= 0
+struct Frustum {
+  glm::vec4 planes[6];
+};
+
+// Works for both OpenGL and Vulkan depth ranges, with the latter the near plane ends up behind the real one,
+// which only makes culling slightly conservative
+Frustum extractFrustum(const glm::mat4 &viewProjection);
+
+enum class CullResult : uint8_t { Outside, Intersecting, Inside };
+
+struct CullingStats {
+  size_t testedNodes = 0;
+  size_t visibleNodes = 0; // Nodes that are not outside, including the untested children of inside nodes
+  double seconds = 0.0;
+};
+
+// Hierarchical view frustum culling of a CdlodQuadtree. Each level is tested as one batch of nodes whose
+// parents intersect the frustum, eight at a time with AVX2 (four with SSE4.1). Nodes that are fully inside
+// or outside pass their result to their whole subtree without testing it, which is a single fill because
+// the quadtree stores subtrees contiguously. The result feeds CdlodQuadtree::select().
+class CdlodFrustumCuller {
+public:
+  explicit CdlodFrustumCuller(const CdlodQuadtree *quadtree);
+
+  CullingStats cull(const Frustum &frustum);
+  CullingStats cull(const Frustum &frustum, SimdLevel simdLevel);
+
+  // Indexed by node, valid until the next cull()
+  const std::vector<CullResult> &nodeVisibility() const { return visibility; }
+
+private:
+  const CdlodQuadtree *quadtree;
+  // Bounding boxes as center and half extent, structure of arrays indexed by node
+  std::vector<float> centerX, centerY, centerZ;
+  std::vector<float> extentX, extentY, extentZ;
+  std::vector<uint32_t> subtreeEnd; // One past the last node of the node's subtree
+
+  std::vector<CullResult> visibility;
+  std::vector<uint32_t> frontier;
+  std::vector<uint32_t> nextFrontier;
+  std::vector<CullResult> frontierResults;
+};
+
+// Horizon-based occlusion culling of selected CDLOD nodes. The horizon is the largest elevation tangent
+// (height above the camera over horizontal distance) covered by terrain so far, per azimuth column around the
+// camera. Nodes are visited front to back. A node is hidden when the tangent of its top stays below the
+// horizon over every column it touches, and every node raises the horizon with the bottom of its bounding box
+// over the columns it fully covers, because the terrain surface inside the node is never below that. A node
+// only occludes nodes that start behind its far end, so a hidden node is always hidden by nearer terrain.
+class HorizonOcclusionCuller {
+public:
+  explicit HorizonOcclusionCuller(int columnCount = 2048);
+
+  // Removes hidden nodes and sorts the remaining ones front to back
+  CullingStats cull(const CdlodQuadtree &quadtree, const glm::vec3 &cameraPosition,
+                    std::vector<CdlodSelectedNode> *selectedNodes);
+
+private:
+  struct NodeFootprint {
+    uint32_t selectedNode;
+    float nearDistance; // Horizontal distances from the camera
+    float farDistance;
+    float minAzimuth; // Pseudo azimuth in [0, 4), maxAzimuth may exceed 4 when the node straddles 0
+    float maxAzimuth;
+    float minHeight; // Relative to the camera
+    float maxHeight;
+  };
+
+  bool isHidden(const NodeFootprint &footprint) const;
+  void raiseHorizon(const NodeFootprint &footprint);
+
+  int columnCount;
+  std::vector<float> horizon;
+  std::vector<NodeFootprint> footprints;
+  std::vector<uint32_t> occluderOrder; // Footprints sorted by farDistance
+  std::vector<CdlodSelectedNode> visibleNodes;
+};
@@ -0,0 +1,296 @@
+#include "terrainFile.h"
+
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+// Level 0 is the heightmap itself, so its three planes all point at the source heights. The coarser levels
+// keep their planes in storage.
+struct PyramidLevel {
+  uint32_t width = 0;
+  uint32_t height = 0;
+  const float *average = nullptr;
+  const float *minimum = nullptr;
+  const float *maximum = nullptr;
+  std::vector<float> storage;
+};
+
+size_t alignUp(size_t value, size_t alignment) { return (value + alignment - 1) / alignment * alignment; }
+
+size_t pageByteSize(const TerrainFileHeader &header, uint32_t level) {
+  return alignUp(size_t(header.levels[level].planeCount) * header.tileSize * header.tileSize * sizeof(float),
+                 kTerrainFilePageSize);
+}
+
+size_t firstPageOffset(const TerrainFileHeader &header) {
+  return alignUp(size_t(header.tileIndexOffset) + size_t(header.tileCount) * sizeof(TerrainFileTileEntry),
+                 kTerrainFilePageSize);
+}
+
+size_t expectedTerrainFileSize(const TerrainFileHeader &header) {
+  auto fileSize = firstPageOffset(header);
+  for (uint32_t level = 0; level < header.levelCount; ++level) {
+    const auto &fileLevel = header.levels[level];
+    fileSize += size_t(fileLevel.tilesX) * fileLevel.tilesY * pageByteSize(header, level);
+  }
+  return fileSize;
+}
+
+uint32_t spreadBits(uint32_t value) {
+  value &= 0xffff;
+  value = (value | (value << 8)) & 0x00ff00ff;
+  value = (value | (value << 4)) & 0x0f0f0f0f;
+  value = (value | (value << 2)) & 0x33333333;
+  value = (value | (value << 1)) & 0x55555555;
+  return value;
+}
+
+uint32_t mortonCode(uint32_t x, uint32_t y) { return spreadBits(x) | (spreadBits(y) << 1); }
+
+PyramidLevel downsampleLevel(const PyramidLevel &source) {
+  PyramidLevel level;
+  level.width = std::max(1u, (source.width + 1) / 2);
+  level.height = std::max(1u, (source.height + 1) / 2);
+  const auto sampleCount = size_t(level.width) * level.height;
+  level.storage.resize(3 * sampleCount);
+  const auto average = level.storage.data();
+  const auto minimum = average + sampleCount;
+  const auto maximum = minimum + sampleCount;
+
+  for (uint32_t y = 0; y < level.height; ++y) {
+    const auto sourceY0 = size_t(std::min(2 * y, source.height - 1)) * source.width;
+    const auto sourceY1 = size_t(std::min(2 * y + 1, source.height - 1)) * source.width;
+    for (uint32_t x = 0; x < level.width; ++x) {
+      const auto sourceX0 = std::min(2 * x, source.width - 1);
+      const auto sourceX1 = std::min(2 * x + 1, source.width - 1);
+      const size_t indices[] = {sourceY0 + sourceX0, sourceY0 + sourceX1, sourceY1 + sourceX0,
+                                sourceY1 + sourceX1};
+
+      auto averageSum = 0.0f;
+      auto minimumHeight = std::numeric_limits<float>::max();
+      auto maximumHeight = std::numeric_limits<float>::lowest();
+      for (const auto index : indices) {
+        averageSum += source.average[index];
+        minimumHeight = std::min(minimumHeight, source.minimum[index]);
+        maximumHeight = std::max(maximumHeight, source.maximum[index]);
+      }
+
+      const auto index = size_t(y) * level.width + x;
+      average[index] = averageSum * 0.25f;
+      minimum[index] = minimumHeight;
+      maximum[index] = maximumHeight;
+    }
+  }
+
+  level.average = average;
+  level.minimum = minimum;
+  level.maximum = maximum;
+  return level;
+}
+
+std::vector<PyramidLevel> buildPyramid(const Heightmap &heightmap, uint32_t tileSize) {
+  std::vector<PyramidLevel> levels(1);
+  levels[0].width = uint32_t(heightmap.width);
+  levels[0].height = uint32_t(heightmap.height);
+  levels[0].average = heightmap.heights.data();
+  levels[0].minimum = heightmap.heights.data();
+  levels[0].maximum = heightmap.heights.data();
+
+  while (levels.back().width > tileSize || levels.back().height > tileSize) {
+    if (levels.size() == kMaxTerrainFileLevels) {
+      throw std::runtime_error("Heightmap needs too many mip levels for the tile size!");
+    }
+    levels.push_back(downsampleLevel(levels.back()));
+  }
+
+  return levels;
+}
+} // namespace
+
+void writeTerrainFile(const std::string &path, const Heightmap &heightmap, uint32_t tileSize) {
+  if (heightmap.width <= 0 || heightmap.height <= 0 || tileSize == 0) {
+    throw std::runtime_error("Invalid heightmap or tile size for terrain file!");
+  }
+
+  const auto pyramid = buildPyramid(heightmap, tileSize);
+
+  TerrainFileHeader header = {};
+  header.magic = kTerrainFileMagic;
+  header.version = kTerrainFileVersion;
+  header.width = uint32_t(heightmap.width);
+  header.height = uint32_t(heightmap.height);
+  header.tileSize = tileSize;
+  header.levelCount = uint32_t(pyramid.size());
+  header.tileIndexOffset = sizeof(TerrainFileHeader);
+
+  const auto minMaxHeights = std::minmax_element(heightmap.heights.begin(), heightmap.heights.end());
+  header.minHeight = *minMaxHeights.first;
+  header.maxHeight = *minMaxHeights.second;
+
+  for (uint32_t levelIndex = 0; levelIndex < header.levelCount; ++levelIndex) {
+    auto &level = header.levels[levelIndex];
+    level.width = pyramid[levelIndex].width;
+    level.height = pyramid[levelIndex].height;
+    level.tilesX = (level.width + tileSize - 1) / tileSize;
+    level.tilesY = (level.height + tileSize - 1) / tileSize;
+    level.firstTile = header.tileCount;
+    level.planeCount = levelIndex == 0 ? 1 : 3;
+    header.tileCount += level.tilesX * level.tilesY;
+  }
+
+  std::vector<TerrainFileTileEntry> tileEntries(header.tileCount);
+  std::vector<const TerrainFileTileEntry *> pageOrder;
+  pageOrder.reserve(header.tileCount);
+
+  auto dataOffset = firstPageOffset(header);
+  for (uint32_t levelIndex = 0; levelIndex < header.levelCount; ++levelIndex) {
+    const auto &level = header.levels[levelIndex];
+    const auto &pyramidLevel = pyramid[levelIndex];
+    const auto pageSize = pageByteSize(header, levelIndex);
+
+    std::vector<uint32_t> zOrder(level.tilesX * level.tilesY);
+    for (uint32_t i = 0; i < zOrder.size(); ++i) {
+      zOrder[i] = i;
+    }
+    std::sort(zOrder.begin(), zOrder.end(), [&level](uint32_t a, uint32_t b) {
+      return mortonCode(a % level.tilesX, a / level.tilesX) < mortonCode(b % level.tilesX, b / level.tilesX);
+    });
+
+    for (const auto tileIndex : zOrder) {
+      auto &tileEntry = tileEntries[level.firstTile + tileIndex];
+      tileEntry.dataOffset = dataOffset;
+      tileEntry.level = levelIndex;
+      tileEntry.tileX = tileIndex % level.tilesX;
+      tileEntry.tileY = tileIndex / level.tilesX;
+
+      tileEntry.minHeight = std::numeric_limits<float>::max();
+      tileEntry.maxHeight = std::numeric_limits<float>::lowest();
+      auto heightSum = 0.0;
+      const auto x1 = std::min(level.width, (tileEntry.tileX + 1) * tileSize);
+      const auto y1 = std::min(level.height, (tileEntry.tileY + 1) * tileSize);
+      for (auto y = tileEntry.tileY * tileSize; y < y1; ++y) {
+        for (auto x = tileEntry.tileX * tileSize; x < x1; ++x) {
+          const auto index = size_t(y) * level.width + x;
+          tileEntry.minHeight = std::min(tileEntry.minHeight, pyramidLevel.minimum[index]);
+          tileEntry.maxHeight = std::max(tileEntry.maxHeight, pyramidLevel.maximum[index]);
+          heightSum += pyramidLevel.average[index];
+        }
+      }
+      const auto texelCount = size_t(x1 - tileEntry.tileX * tileSize) * (y1 - tileEntry.tileY * tileSize);
+      tileEntry.averageHeight = float(heightSum / double(texelCount));
+
+      pageOrder.push_back(&tileEntry);
+      dataOffset += pageSize;
+    }
+  }
+
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  if (!file) {
+    throw std::runtime_error("Failed to create terrain file " + path);
+  }
+
+  file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char *>(tileEntries.data()),
+             std::streamsize(tileEntries.size() * sizeof(TerrainFileTileEntry)));
+
+  std::vector<float> page;
+  for (const auto tileEntry : pageOrder) {
+    const auto &level = header.levels[tileEntry->level];
+    const auto &pyramidLevel = pyramid[tileEntry->level];
+    const float *planes[] = {pyramidLevel.average, pyramidLevel.minimum, pyramidLevel.maximum};
+
+    // Padding texels repeat the last row and column so filtering at tile edges stays well defined
+    page.assign(pageByteSize(header, tileEntry->level) / sizeof(float), 0.0f);
+    for (uint32_t plane = 0; plane < level.planeCount; ++plane) {
+      auto planeTexels = page.data() + size_t(plane) * tileSize * tileSize;
+      for (uint32_t y = 0; y < tileSize; ++y) {
+        const auto sourceY = std::min(tileEntry->tileY * tileSize + y, level.height - 1);
+        for (uint32_t x = 0; x < tileSize; ++x) {
+          const auto sourceX = std::min(tileEntry->tileX * tileSize + x, level.width - 1);
+          planeTexels[size_t(y) * tileSize + x] = planes[plane][size_t(sourceY) * level.width + sourceX];
+        }
+      }
+    }
+
+    file.seekp(std::streamoff(tileEntry->dataOffset));
+    file.write(reinterpret_cast<const char *>(page.data()), std::streamsize(page.size() * sizeof(float)));
+  }
+
+  if (!file) {
+    throw std::runtime_error("Failed to write terrain file " + path);
+  }
+}
+
+TerrainFile::TerrainFile(const std::string &path) : mappedFile(path) {
+  if (mappedFile.size() < sizeof(TerrainFileHeader)) {
+    throw std::runtime_error("Terrain file " + path + " is truncated!");
+  }
+
+  fileHeader = reinterpret_cast<const TerrainFileHeader *>(mappedFile.data());
+  if (fileHeader->magic != kTerrainFileMagic || fileHeader->version != kTerrainFileVersion ||
+      fileHeader->levelCount == 0 || fileHeader->levelCount > kMaxTerrainFileLevels) {
+    throw std::runtime_error("Terrain file " + path + " has an unsupported format!");
+  }
+
+  // The level table has to stay within the tile index, and the tile index and a single page within the file,
+  // before any size derived from them can be trusted
+  const auto fileSize = uint64_t(mappedFile.size());
+  for (uint32_t level = 0; level < fileHeader->levelCount; ++level) {
+    const auto &fileLevel = fileHeader->levels[level];
+    const auto levelTileCount = uint64_t(fileLevel.tilesX) * fileLevel.tilesY;
+    if (fileLevel.planeCount == 0 || fileLevel.planeCount > 3 ||
+        fileLevel.firstTile + levelTileCount > fileHeader->tileCount) {
+      throw std::runtime_error("Terrain file " + path + " has an invalid level table!");
+    }
+  }
+  if (fileHeader->tileIndexOffset < sizeof(TerrainFileHeader) ||
+      fileHeader->tileIndexOffset % alignof(TerrainFileTileEntry) != 0 || fileHeader->tileSize == 0) {
+    throw std::runtime_error("Terrain file " + path + " has an unsupported format!");
+  }
+  const auto tileIndexSize = uint64_t(fileHeader->tileCount) * sizeof(TerrainFileTileEntry);
+  if (fileHeader->tileIndexOffset > fileSize || tileIndexSize > fileSize - fileHeader->tileIndexOffset ||
+      uint64_t(fileHeader->tileSize) * fileHeader->tileSize > fileSize ||
+      fileSize < expectedTerrainFileSize(*fileHeader)) {
+    throw std::runtime_error("Terrain file " + path + " is truncated!");
+  }
+
+  tileEntries =
+      reinterpret_cast<const TerrainFileTileEntry *>(mappedFile.data() + fileHeader->tileIndexOffset);
+}
+
+const TerrainFileTileEntry *TerrainFile::findTile(uint32_t level, uint32_t tileX, uint32_t tileY) const {
+  if (level >= fileHeader->levelCount) {
+    return nullptr;
+  }
+
+  const auto &fileLevel = fileHeader->levels[level];
+  if (tileX >= fileLevel.tilesX || tileY >= fileLevel.tilesY) {
+    return nullptr;
+  }
+
+  return &tileEntries[fileLevel.firstTile + tileY * fileLevel.tilesX + tileX];
+}
+
+size_t TerrainFile::tileByteSize(uint32_t level) const {
+  return size_t(fileHeader->levels[level].planeCount) * fileHeader->tileSize * fileHeader->tileSize *
+         sizeof(float);
+}
+
+const uint8_t *TerrainFile::tileBytes(const TerrainFileTileEntry &tileEntry) const {
+  // Tile entries are only read on access, so a corrupt one is caught here rather than in the constructor
+  if (tileEntry.level >= fileHeader->levelCount || tileEntry.dataOffset % kTerrainFilePageSize != 0 ||
+      tileEntry.dataOffset > mappedFile.size() ||
+      tileByteSize(tileEntry.level) > mappedFile.size() - tileEntry.dataOffset) {
+    throw std::runtime_error("Terrain file tile lies outside of the file!");
+  }
+  return mappedFile.data() + tileEntry.dataOffset;
+}
+
+const float *TerrainFile::tilePlane(const TerrainFileTileEntry &tileEntry, TerrainFilePlane plane) const {
+  const auto tile = reinterpret_cast<const float *>(tileBytes(tileEntry));
+  const auto planeIndex = std::min(uint32_t(plane), fileHeader->levels[tileEntry.level].planeCount - 1);
+  return tile + size_t(planeIndex) * fileHeader->tileSize * fileHeader->tileSize;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "heightmap.h"
+#include "mappedFile.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+constexpr uint32_t kTerrainFileMagic = 0x4e525254; // "TRRN"
+constexpr uint32_t kTerrainFileVersion = 1;
+constexpr uint32_t kMaxTerrainFileLevels = 16;
+constexpr size_t kTerrainFilePageSize = 4096;
+
+// The file is laid out so that it can be used directly after a single mmap:
+//   TerrainFileHeader | TerrainFileTileEntry[tileCount] | tile pages
+// Tile entries are row-major per level for O(1) lookup, while the pages themselves are stored in Z-order
+// (Morton order) so that neighbouring tiles are close on disk. Every page starts on a kTerrainFilePageSize
+// boundary and is padded to full tileSize x tileSize, so a tile can be copied into a staging buffer with one
+// memcpy. Level 0 pages hold one plane of heights, the coarser mip levels hold average, minimum and maximum
+// planes in that order.
+struct TerrainFileLevel {
+  uint32_t width; // Samples
+  uint32_t height;
+  uint32_t tilesX;
+  uint32_t tilesY;
+  uint32_t firstTile; // Index of the level's first TerrainFileTileEntry
+  uint32_t planeCount;
+};
+
+struct TerrainFileHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t width;
+  uint32_t height;
+  uint32_t tileSize;
+  uint32_t levelCount;
+  uint32_t tileCount;
+  uint32_t reserved;
+  float minHeight;
+  float maxHeight;
+  uint64_t tileIndexOffset;
+  TerrainFileLevel levels[kMaxTerrainFileLevels];
+};
+
+struct TerrainFileTileEntry {
+  uint64_t dataOffset;
+  uint32_t level;
+  uint32_t tileX;
+  uint32_t tileY;
+  float minHeight;
+  float maxHeight;
+  float averageHeight;
+};
+
+enum class TerrainFilePlane : uint32_t { Average = 0, Minimum = 1, Maximum = 2 };
+
+void writeTerrainFile(const std::string &path, const Heightmap &heightmap, uint32_t tileSize = 256);
+
+class TerrainFile {
+public:
+  // Only the header and its level table are validated, nothing else is read until it is accessed. Tiles are
+  // bounds checked in tileBytes() and tilePlane(), which throw for a tile entry outside of the file.
+  explicit TerrainFile(const std::string &path);
+
+  const TerrainFileHeader &header() const { return *fileHeader; }
+  const TerrainFileLevel &level(uint32_t level) const { return fileHeader->levels[level]; }
+
+  const TerrainFileTileEntry *findTile(uint32_t level, uint32_t tileX, uint32_t tileY) const;
+  size_t tileByteSize(uint32_t level) const;
+  const uint8_t *tileBytes(const TerrainFileTileEntry &tileEntry) const;
+  // tileSize x tileSize floats. Level 0 has a single plane of heights that is returned for every plane.
+  const float *tilePlane(const TerrainFileTileEntry &tileEntry, TerrainFilePlane plane) const;
+
+private:
+  MappedFile mappedFile;
+  const TerrainFileHeader *fileHeader = nullptr;
+  const TerrainFileTileEntry *tileEntries = nullptr;
+};
@@ -0,0 +1,375 @@
+#include "terrainHorizon.h"
+
+#include "jobSystem.h"
+#include "terrainMesh.h"
+#include "terrainRandom.h"
+#include "terrainRaycast.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <numbers>
+#include <stdexcept>
+
+namespace {
+constexpr auto kMaxHorizonDirections = 64;
+constexpr size_t kHorizonRowGrain = 4;
+
+struct HorizonRay {
+  int x, y;
+  glm::vec2 direction;        // In samples, unit length
+  glm::vec2 inverseDirection; // 0 for a zero component
+  float endDistance;          // Where the ray leaves the heightmap or reaches the maximum distance
+};
+
+// On a cell boundary the ray belongs to the cell it moves into, like the pyramid raycasts. Cell sizes are
+// powers of two, so multiplying by their inverse is exact.
+int cellIndex(float position, float direction, float inverseCellSize, int cellCount) {
+  const auto cell = direction < 0.0f ? int(std::ceil(position * inverseCellSize)) - 1
+                                     : int(std::floor(position * inverseCellSize));
+  return std::clamp(cell, 0, cellCount - 1);
+}
+
+float advanceDistance(float distance, float cellExit) {
+  return std::max(cellExit, std::nextafter(distance, std::numeric_limits<float>::infinity()));
+}
+
+// Height of the mesh at a point on the edge of a cell, where both of its triangles are linear
+float edgeHeight(const Heightmap &heightmap, const glm::vec2 &position) {
+  const auto x = std::clamp(position.x, 0.0f, float(heightmap.width - 1));
+  const auto y = std::clamp(position.y, 0.0f, float(heightmap.height - 1));
+  const auto x0 = std::min(int(x), heightmap.width - 2);
+  const auto y0 = std::min(int(y), heightmap.height - 2);
+  const auto fractionX = x - float(x0);
+  const auto fractionY = y - float(y0);
+  const auto top = glm::mix(heightmap.at(x0, y0), heightmap.at(x0 + 1, y0), fractionX);
+  const auto bottom = glm::mix(heightmap.at(x0, y0 + 1), heightmap.at(x0 + 1, y0 + 1), fractionX);
+  return glm::mix(top, bottom, fractionY);
+}
+
+// Within a cell the mesh is linear on either side of its diagonal, and (height - originHeight) / distance
+// along a linear stretch peaks at one of its ends. The crossing with the diagonal and the exit are therefore
+// the only points of the cell that can raise the horizon, the entry was the exit of the previous cell.
+float cellTangent(const Heightmap &heightmap, const HorizonRay &ray, int cellX, int cellY, float distance,
+                  float cellExit, float originHeight, float sampleSpacing, float tangent) {
+  const auto tangentAt = [&](float pointDistance, float pointHeight) {
+    return (pointHeight - originHeight) / (pointDistance * sampleSpacing);
+  };
+
+  const auto u0 = float(ray.x - cellX);
+  const auto v0 = float(ray.y - cellY);
+  const auto mainDiagonal = usesMainDiagonal(cellX, cellY, 1);
+  const auto denominator =
+      mainDiagonal ? ray.direction.x - ray.direction.y : ray.direction.x + ray.direction.y;
+  if (denominator != 0.0f) {
+    const auto crossing = mainDiagonal ? (v0 - u0) / denominator : (1.0f - u0 - v0) / denominator;
+    if (crossing > distance && crossing < cellExit) {
+      const auto u = std::clamp(u0 + crossing * ray.direction.x, 0.0f, 1.0f);
+      const auto height =
+          mainDiagonal ? glm::mix(heightmap.at(cellX, cellY), heightmap.at(cellX + 1, cellY + 1), u)
+                       : glm::mix(heightmap.at(cellX, cellY + 1), heightmap.at(cellX + 1, cellY), u);
+      tangent = std::max(tangent, tangentAt(crossing, height));
+    }
+  }
+
+  const auto exitPosition = glm::vec2(float(ray.x), float(ray.y)) + cellExit * ray.direction;
+  return std::max(tangent, tangentAt(cellExit, edgeHeight(heightmap, exitPosition)));
+}
+
+// Tangent of the horizon elevation, never below 0. steps counts the nodes and cells visited.
+float traceHorizon(const Heightmap &heightmap, const HeightPyramid &pyramid, const HorizonRay &ray,
+                   float sampleSpacing, bool isHierarchical, size_t *steps) {
+  const auto originHeight = heightmap.at(ray.x, ray.y);
+  const auto origin = glm::vec2(float(ray.x), float(ray.y));
+  const auto topLevel = isHierarchical ? pyramid.levelCount() - 1 : 0;
+  auto tangent = 0.0f;
+  auto distance = 0.0f;
+  auto level = 0;
+  while (distance < ray.endDistance) {
+    ++*steps;
+    const auto position = origin + distance * ray.direction;
+    const auto cellSize = float(1 << level);
+    const auto inverseCellSize = 1.0f / cellSize;
+    const auto cellX = cellIndex(position.x, ray.direction.x, inverseCellSize, pyramid.levelWidth(level));
+    const auto cellY = cellIndex(position.y, ray.direction.y, inverseCellSize, pyramid.levelHeight(level));
+
+    auto cellExit = ray.endDistance;
+    if (ray.direction.x != 0.0f) {
+      const auto boundaryX = (ray.direction.x > 0.0f ? float(cellX + 1) : float(cellX)) * cellSize;
+      cellExit = std::min(cellExit, (boundaryX - origin.x) * ray.inverseDirection.x);
+    }
+    if (ray.direction.y != 0.0f) {
+      const auto boundaryY = (ray.direction.y > 0.0f ? float(cellY + 1) : float(cellY)) * cellSize;
+      cellExit = std::min(cellExit, (boundaryY - origin.y) * ray.inverseDirection.y);
+    }
+
+    // Everything in the node is seen at least this far away, so no part of it rises above the horizon
+    if (isHierarchical &&
+        pyramid.maxHeight(level, cellX, cellY) <= originHeight + tangent * distance * sampleSpacing) {
+      distance = advanceDistance(distance, cellExit);
+      level = std::min(level + 1, topLevel);
+      continue;
+    }
+
+    if (level > 0) {
+      --level;
+      continue;
+    }
+
+    cellExit = std::min(std::max(cellExit, distance), ray.endDistance);
+    tangent = cellTangent(heightmap, ray, cellX, cellY, distance, cellExit, originHeight, sampleSpacing,
+                          tangent);
+    distance = advanceDistance(distance, cellExit);
+    level = std::min(level + 1, topLevel);
+  }
+
+  return tangent;
+}
+
+// Distance along direction from (x, y) to the edge of [0, limitX] x [0, limitY]
+float distanceToBorder(int x, int y, const glm::vec2 &direction, int limitX, int limitY) {
+  auto distance = std::numeric_limits<float>::infinity();
+  if (direction.x != 0.0f) {
+    distance = std::min(distance, (direction.x > 0.0f ? float(limitX - x) : float(-x)) / direction.x);
+  }
+  if (direction.y != 0.0f) {
+    distance = std::min(distance, (direction.y > 0.0f ? float(limitY - y) : float(-y)) / direction.y);
+  }
+  return distance;
+}
+
+uint8_t encodeHorizon(float tangent) {
+  const auto sine = tangent / std::sqrt(1.0f + tangent * tangent);
+  return uint8_t(std::lround(std::clamp(sine, 0.0f, 1.0f) * 255.0f));
+}
+
+bool isValidDirectionCount(int directionCount) {
+  return directionCount > 0 && directionCount % 4 == 0 && directionCount <= kMaxHorizonDirections;
+}
+
+void validateHorizonMap(const HorizonMap &horizonMap) {
+  if (!isValidDirectionCount(horizonMap.directionCount)) {
+    throw std::runtime_error("Horizon maps need a multiple of 4 directions, up to 64!");
+  }
+}
+} // namespace
+
+HorizonBakeStats bakeHorizonMap(const Heightmap &heightmap, const HeightPyramid &pyramid, float sampleSpacing,
+                                const HorizonParameters &parameters, JobSystem *jobSystem,
+                                HorizonMap *horizonMap) {
+  horizonMap->width = heightmap.width;
+  horizonMap->height = heightmap.height;
+  horizonMap->directionCount = parameters.directionCount;
+  validateHorizonMap(*horizonMap);
+  if (pyramid.levelCount() == 0 || pyramid.levelWidth(0) != heightmap.width - 1 ||
+      pyramid.levelHeight(0) != heightmap.height - 1) {
+    throw std::runtime_error("Height pyramid does not match the heightmap of the horizon map!");
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  horizonMap->sourceHash = horizonSourceHash(heightmap, sampleSpacing, parameters);
+  horizonMap->horizons.assign(size_t(heightmap.width) * size_t(heightmap.height) *
+                                  size_t(parameters.directionCount),
+                              0);
+
+  // Axis aligned directions have exactly one zero component, so their rays never cross a cell boundary
+  // along the other axis because of rounding
+  std::vector<glm::vec2> directions(size_t(parameters.directionCount));
+  for (size_t direction = 0; direction < directions.size(); ++direction) {
+    const auto angle = 2.0f * std::numbers::pi_v<float> * float(direction) / float(directions.size());
+    directions[direction] = glm::vec2(std::cos(angle), std::sin(angle));
+    for (auto axis = 0; axis < 2; ++axis) {
+      if (std::abs(directions[direction][axis]) < 1.0e-6f) {
+        directions[direction][axis] = 0.0f;
+        directions[direction][1 - axis] = std::round(directions[direction][1 - axis]);
+      }
+    }
+  }
+
+  std::vector<glm::vec2> inverseDirections(directions.size());
+  for (size_t direction = 0; direction < directions.size(); ++direction) {
+    for (auto axis = 0; axis < 2; ++axis) {
+      const auto component = directions[direction][axis];
+      inverseDirections[direction][axis] = component != 0.0f ? 1.0f / component : 0.0f;
+    }
+  }
+
+  const auto maxDistance = parameters.maxDistance / sampleSpacing;
+  std::vector<size_t> rowSteps(size_t(heightmap.height), 0);
+  const auto bakeRows = [&](size_t rowBegin, size_t rowEnd) {
+    for (auto y = int(rowBegin); y < int(rowEnd); ++y) {
+      // Neighbouring texels trace parallel rays through the same nodes, so one direction at a time
+      for (auto direction = 0; direction < parameters.directionCount; ++direction) {
+        const auto rowOffset =
+            (size_t(direction / 4) * size_t(heightmap.height) + size_t(y)) * size_t(heightmap.width);
+        auto texel = horizonMap->horizons.data() + rowOffset * 4 + size_t(direction % 4);
+        for (auto x = 0; x < heightmap.width; ++x, texel += 4) {
+          HorizonRay ray;
+          ray.x = x;
+          ray.y = y;
+          ray.direction = directions[size_t(direction)];
+          ray.inverseDirection = inverseDirections[size_t(direction)];
+          ray.endDistance = std::min(maxDistance, distanceToBorder(x, y, ray.direction, heightmap.width - 1,
+                                                                   heightmap.height - 1));
+          *texel = encodeHorizon(traceHorizon(heightmap, pyramid, ray, sampleSpacing,
+                                              parameters.isHierarchical, &rowSteps[size_t(y)]));
+        }
+      }
+    }
+  };
+
+  if (jobSystem == nullptr) {
+    bakeRows(0, size_t(heightmap.height));
+  } else {
+    jobSystem->parallelFor(0, size_t(heightmap.height), kHorizonRowGrain, bakeRows);
+  }
+
+  HorizonBakeStats stats;
+  stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  const auto rayCount =
+      double(heightmap.width) * double(heightmap.height) * double(parameters.directionCount);
+  stats.raysPerSecond = rayCount / std::max(stats.seconds, 1.0e-9);
+  auto stepCount = 0.0;
+  for (const auto steps : rowSteps) {
+    stepCount += double(steps);
+  }
+  stats.stepsPerRay = stepCount / std::max(rayCount, 1.0);
+  return stats;
+}
+
+uint64_t horizonSourceHash(const Heightmap &heightmap, float sampleSpacing,
+                           const HorizonParameters &parameters) {
+  ContentHash hash;
+  hash.addValue(kHorizonFileVersion);
+  hash.addValue(heightmap.width);
+  hash.addValue(heightmap.height);
+  hash.add(heightmap.heights);
+  hash.addValue(sampleSpacing);
+  hash.addValue(parameters.directionCount);
+  hash.addValue(parameters.maxDistance);
+  return hash.value();
+}
+
+void writeHorizonFile(const std::string &path, const HorizonMap &horizonMap) {
+  validateHorizonMap(horizonMap);
+
+  HorizonFileHeader header = {};
+  header.magic = kHorizonFileMagic;
+  header.version = kHorizonFileVersion;
+  header.width = uint32_t(horizonMap.width);
+  header.height = uint32_t(horizonMap.height);
+  header.directionCount = uint32_t(horizonMap.directionCount);
+  header.sourceHash = horizonMap.sourceHash;
+
+  // Written next to the destination and renamed over it, so an interrupted write never leaves a partial file
+  // at path that a later run would have to read
+  const auto temporaryPath = path + ".tmp";
+  {
+    std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+    if (!file) {
+      throw std::runtime_error("Failed to create horizon file " + temporaryPath + "!");
+    }
+
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(horizonMap.horizons.data()),
+               std::streamsize(horizonMap.horizons.size()));
+    file.close();
+    if (!file) {
+      std::filesystem::remove(temporaryPath);
+      throw std::runtime_error("Failed to write horizon file " + temporaryPath + "!");
+    }
+  }
+
+  std::error_code error;
+  std::filesystem::rename(temporaryPath, path, error);
+  if (error) {
+    std::filesystem::remove(temporaryPath, error);
+    throw std::runtime_error("Failed to replace horizon file " + path + "!");
+  }
+}
+
+bool readHorizonFile(const std::string &path, uint64_t sourceHash, HorizonMap *horizonMap) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    return false;
+  }
+
+  // Anything that does not hold exactly the map described by its header, e.g. a file of an older version or
+  // one cut short, is only a cache miss and gets baked again
+  HorizonFileHeader header = {};
+  if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)) || header.magic != kHorizonFileMagic ||
+      header.version != kHorizonFileVersion || header.sourceHash != sourceHash ||
+      header.width > uint32_t(std::numeric_limits<int>::max()) ||
+      header.height > uint32_t(std::numeric_limits<int>::max()) ||
+      !isValidDirectionCount(int(header.directionCount))) {
+    return false;
+  }
+  // Compared per direction, the product of all three could overflow for a corrupt header
+  std::error_code error;
+  const auto fileSize = std::filesystem::file_size(path, error);
+  if (error || fileSize < sizeof(header) || (fileSize - sizeof(header)) % header.directionCount != 0 ||
+      (fileSize - sizeof(header)) / header.directionCount != uint64_t(header.width) * header.height) {
+    return false;
+  }
+  const auto horizonSize = fileSize - sizeof(header);
+
+  // Read into a separate map so that horizonMap is left as it was on a miss
+  HorizonMap fileMap;
+  fileMap.width = int(header.width);
+  fileMap.height = int(header.height);
+  fileMap.directionCount = int(header.directionCount);
+  fileMap.sourceHash = header.sourceHash;
+  fileMap.horizons.resize(size_t(horizonSize));
+  if (!file.read(reinterpret_cast<char *>(fileMap.horizons.data()), std::streamsize(horizonSize))) {
+    return false;
+  }
+  *horizonMap = std::move(fileMap);
+  return true;
+}
+
+HorizonBakeStats loadOrBakeHorizonMap(const std::string &path, const Heightmap &heightmap,
+                                      const HeightPyramid &pyramid, float sampleSpacing,
+                                      const HorizonParameters &parameters, JobSystem *jobSystem,
+                                      HorizonMap *horizonMap) {
+  const auto start = std::chrono::steady_clock::now();
+  if (readHorizonFile(path, horizonSourceHash(heightmap, sampleSpacing, parameters), horizonMap)) {
+    HorizonBakeStats stats;
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    stats.isCached = true;
+    return stats;
+  }
+
+  const auto stats = bakeHorizonMap(heightmap, pyramid, sampleSpacing, parameters, jobSystem, horizonMap);
+  writeHorizonFile(path, *horizonMap);
+  return stats;
+}
+
+float horizonAmbientOcclusion(const HorizonMap &horizonMap, int x, int y) {
+  auto visibility = 0.0f;
+  for (auto direction = 0; direction < horizonMap.directionCount; ++direction) {
+    const auto sine = horizonMap.horizonSine(x, y, direction);
+    visibility += 1.0f - sine * sine;
+  }
+  return visibility / float(horizonMap.directionCount);
+}
+
+float horizonSunVisibility(const HorizonMap &horizonMap, int x, int y, const glm::vec3 &sunDirection,
+                           float penumbraSine) {
+  const auto sunLength = glm::length(sunDirection);
+  if (sunLength == 0.0f) {
+    return 0.0f;
+  }
+
+  auto azimuth = std::atan2(sunDirection.z, sunDirection.x) / (2.0f * std::numbers::pi_v<float>);
+  azimuth = (azimuth - std::floor(azimuth)) * float(horizonMap.directionCount);
+  const auto direction0 = std::min(int(azimuth), horizonMap.directionCount - 1);
+  const auto direction1 = (direction0 + 1) % horizonMap.directionCount;
+  const auto horizonSine = glm::mix(horizonMap.horizonSine(x, y, direction0),
+                                    horizonMap.horizonSine(x, y, direction1), azimuth - float(direction0));
+
+  const auto sunSine = sunDirection.y / sunLength;
+  return std::clamp((sunSine - horizonSine + penumbraSine) / (2.0f * std::max(penumbraSine, 1.0e-6f)), 0.0f,
+                    1.0f);
+}
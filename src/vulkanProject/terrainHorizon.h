@@ -0,0 +1,96 @@
+#pragma once
+
+#include "glm/glm.hpp"
+#include "heightmap.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class HeightPyramid;
+class JobSystem;
+
+constexpr uint32_t kHorizonFileMagic = 0x4e5a5248; // "HRZN"
+constexpr uint32_t kHorizonFileVersion = 1;
+
+struct HorizonParameters {
+  // Azimuths per texel, evenly spaced starting at +x and turning towards +z. A multiple of 4 so that every
+  // four of them fill one RGBA8 texel.
+  int directionCount = 8;
+  float maxDistance = 2048.0f; // World units, terrain further away does not cast onto a texel
+  // Skips the pyramid nodes that lie entirely below the horizon found so far. Without it every cell along
+  // the ray is visited, which gives the same horizons and is only kept for comparison.
+  bool isHierarchical = true;
+};
+
+// One byte per texel and direction holding the sine of the horizon elevation angle, 0 for a horizon at or
+// below the texel and 255 for straight up. 8 bits resolve the angle to a quarter degree near the horizon,
+// where sun shadows need it most. The directions are stored in directionCount / 4 layers of RGBA8 texels,
+// layer-major, so the data uploads as is into a 2D array texture and a shader fetches four directions with
+// one sample.
+struct HorizonMap {
+  int width = 0;
+  int height = 0;
+  int directionCount = 0;
+  uint64_t sourceHash = 0; // horizonSourceHash() of the inputs the map was baked from
+  std::vector<uint8_t> horizons;
+
+  int layerCount() const { return directionCount / 4; }
+  float horizonSine(int x, int y, int direction) const {
+    const auto layer = size_t(direction / 4);
+    const auto texel = (layer * size_t(height) + size_t(y)) * size_t(width) + size_t(x);
+    return float(horizons[texel * 4 + size_t(direction % 4)]) * (1.0f / 255.0f);
+  }
+};
+
+struct HorizonFileHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t width;
+  uint32_t height;
+  uint32_t directionCount;
+  uint32_t reserved;
+  uint64_t sourceHash;
+};
+
+struct HorizonBakeStats {
+  double seconds = 0.0;
+  double raysPerSecond = 0.0;
+  double stepsPerRay = 0.0; // Pyramid nodes and cells visited
+  bool isCached = false;    // Loaded from disk instead of baked
+};
+
+// Traces a ray per texel and direction over the triangles the terrain mesh draws and keeps the steepest
+// elevation seen from the texel. The pyramid has to be built over heightmap with a sample spacing of
+// sampleSpacing. A node of it whose maximum lies below the horizon found so far cannot raise it, so the ray
+// skips the node in one step and moves up a level, and only the cells that stick out of the horizon are
+// sampled. Rows are spread over the job system. Rays that leave the heightmap see flat terrain beyond it.
+HorizonBakeStats bakeHorizonMap(const Heightmap &heightmap, const HeightPyramid &pyramid, float sampleSpacing,
+                                const HorizonParameters &parameters, JobSystem *jobSystem,
+                                HorizonMap *horizonMap);
+
+// Identifies the heights and every parameter that changes the baked horizons
+uint64_t horizonSourceHash(const Heightmap &heightmap, float sampleSpacing,
+                           const HorizonParameters &parameters);
+
+// File layout: HorizonFileHeader followed by the horizons exactly as they are held in memory. The file is
+// written under a temporary name and renamed to path once it is complete.
+void writeHorizonFile(const std::string &path, const HorizonMap &horizonMap);
+// Returns false when there is no file, it cannot be read or has another format version, or it was baked from
+// other inputs than sourceHash identifies. horizonMap is only modified when it returns true.
+bool readHorizonFile(const std::string &path, uint64_t sourceHash, HorizonMap *horizonMap);
+
+// For static terrain: the bake is paid once and later runs only read the file at path. A file that
+// readHorizonFile() rejects is baked again and replaced.
+HorizonBakeStats loadOrBakeHorizonMap(const std::string &path, const Heightmap &heightmap,
+                                      const HeightPyramid &pyramid, float sampleSpacing,
+                                      const HorizonParameters &parameters, JobSystem *jobSystem,
+                                      HorizonMap *horizonMap);
+
+// What the terrain shader derives from the horizons, e.g. for lightmaps and tests on the CPU.
+// Ambient occlusion is the cosine weighted sky visibility of an upward facing texel, 1 when nothing rises
+// above it. Each direction leaves 1 - sin^2 of its horizon angle visible.
+float horizonAmbientOcclusion(const HorizonMap &horizonMap, int x, int y);
+// Soft sun shadow: 1 while the sun is more than penumbraSine above the horizon interpolated between the two
+// directions around its azimuth, 0 when it is as far below, and a linear ramp in between
+float horizonSunVisibility(const HorizonMap &horizonMap, int x, int y, const glm::vec3 &sunDirection,
+                           float penumbraSine = 0.02f);
@@ -0,0 +1,793 @@
+#include "terrainHydrology.h"
+
+#include "jobSystem.h"
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace {
+constexpr uint32_t kNoCell = std::numeric_limits<uint32_t>::max();
+// Flow direction of the cells on flats until they are pointed towards the flat's outlet
+constexpr uint8_t kUnresolvedDirection = 9;
+constexpr float kDiagonalDistanceFactor = 0.70710678f;
+
+struct HydrologyTile {
+  int x0, y0, x1, y1; // [x0, x1) x [y0, y1)
+
+  bool contains(int x, int y) const { return x >= x0 && x < x1 && y >= y0 && y < y1; }
+  int width() const { return x1 - x0; }
+  int height() const { return y1 - y0; }
+};
+
+class TileGrid {
+public:
+  TileGrid(int width, int height, int tileSize)
+      : width(width), height(height), tileSize(std::max(tileSize, 1)),
+        tileCountX((width + this->tileSize - 1) / this->tileSize) {
+    if (uint64_t(width) * uint64_t(height) >= uint64_t(kNoCell)) {
+      throw std::runtime_error("Heightmap is too large for the hydrology stage!");
+    }
+
+    for (auto y0 = 0; y0 < height; y0 += this->tileSize) {
+      for (auto x0 = 0; x0 < width; x0 += this->tileSize) {
+        tiles.push_back(
+            {x0, y0, std::min(x0 + this->tileSize, width), std::min(y0 + this->tileSize, height)});
+      }
+    }
+  }
+
+  size_t tileIndexAt(int x, int y) const {
+    return size_t(y / tileSize) * size_t(tileCountX) + size_t(x / tileSize);
+  }
+
+  int width;
+  int height;
+  int tileSize;
+  int tileCountX;
+  std::vector<HydrologyTile> tiles;
+};
+
+// Calls function(x, y) for every cell on the edge of the tile, each once
+template <typename Function> void forEachPerimeterCell(const HydrologyTile &tile, Function &&function) {
+  for (auto x = tile.x0; x < tile.x1; ++x) {
+    function(x, tile.y0);
+    if (tile.y1 - 1 > tile.y0) {
+      function(x, tile.y1 - 1);
+    }
+  }
+  for (auto y = tile.y0 + 1; y < tile.y1 - 1; ++y) {
+    function(tile.x0, y);
+    if (tile.x1 - 1 > tile.x0) {
+      function(tile.x1 - 1, y);
+    }
+  }
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Monotone priority queue over the bits of the heights, for floods where nothing is pushed below the last
+// level popped. Amortized O(1) per push and O(log range) per pop, without the unpredictable comparisons of a
+// binary heap that dominate a priority-flood otherwise.
+class RadixHeap {
+public:
+  bool empty() const { return count == 0; }
+
+  void push(float height, uint32_t index) {
+    const auto key = orderedKey(height);
+    buckets[bucketOf(key)].push_back({key, index});
+    ++count;
+  }
+
+  uint32_t pop() {
+    if (buckets[0].empty()) {
+      auto bucket = 1;
+      while (buckets[bucket].empty()) {
+        ++bucket;
+      }
+      // The lowest key of the first non-empty bucket becomes the new reference, which spreads the bucket over
+      // the buckets below
+      auto &source = buckets[bucket];
+      lastKey = source.front().key;
+      for (const auto &entry : source) {
+        lastKey = std::min(lastKey, entry.key);
+      }
+      for (const auto &entry : source) {
+        buckets[bucketOf(entry.key)].push_back(entry);
+      }
+      source.clear();
+    }
+
+    const auto index = buckets[0].back().index;
+    buckets[0].pop_back();
+    --count;
+    return index;
+  }
+
+private:
+  struct Entry {
+    uint32_t key;
+    uint32_t index;
+  };
+
+  // Unsigned integers in the same order as the floats
+  static uint32_t orderedKey(float height) {
+    const auto bits = std::bit_cast<uint32_t>(height);
+    return (bits & 0x80000000u) ? ~bits : bits | 0x80000000u;
+  }
+
+  // Keys sharing more leading bits with the last key popped go into lower buckets
+  int bucketOf(uint32_t key) const { return key == lastKey ? 0 : 32 - std::countl_zero(key ^ lastKey); }
+
+  std::vector<Entry> buckets[33];
+  uint32_t lastKey = 0;
+  size_t count = 0;
+};
+
+// The lowest level at which the water of two neighbouring watersheds meets
+struct SpillEdge {
+  uint32_t label0;
+  uint32_t label1;
+  float height;
+};
+
+// Labels are numbered from 1 within their tile until the merge offsets them
+struct TileFlood {
+  uint32_t labelCount = 0;
+  std::vector<SpillEdge> spillEdges;
+};
+
+uint64_t spillKey(uint32_t label0, uint32_t label1) {
+  return (uint64_t(std::min(label0, label1)) << 32) | uint64_t(std::max(label0, label1));
+}
+
+bool hasUnqueuedNeighbourAtOrBelow(const float *heights, int width, const HydrologyTile &tile,
+                               const std::vector<uint8_t> &isQueued, int x, int y) {
+  const auto cellHeight = heights[size_t(y) * size_t(width) + size_t(x)];
+  for (const auto &offset : kFlowOffsets) {
+    const auto neighbourX = x + offset[0];
+    const auto neighbourY = y + offset[1];
+    if (tile.contains(neighbourX, neighbourY) &&
+        !isQueued[uint32_t(neighbourY - tile.y0) * uint32_t(tile.width()) + uint32_t(neighbourX - tile.x0)] &&
+        heights[size_t(neighbourY) * size_t(width) + size_t(neighbourX)] <= cellHeight) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Priority-flood of one tile from its perimeter cells, which every watershed of the tile drains to. A
+// perimeter cell that no neighbour has reached yet starts a watershed of its own. Cells below the level they
+// are reached at are raised to it and skip the heap through the unordered queue, as do the higher cells on
+// slopes that have no lower neighbour left to flood.
+void floodTile(Heightmap *heightmap, const HydrologyTile &tile, uint32_t *labels, TileFlood *tileFlood) {
+  const auto width = heightmap->width;
+  auto *heights = heightmap->heights.data();
+  const auto tileWidth = tile.width();
+
+  std::vector<uint8_t> isQueued(size_t(tileWidth) * size_t(tile.height()), 0);
+  RadixHeap heap;
+  std::queue<uint32_t> unorderedCells;
+  forEachPerimeterCell(tile, [&](int x, int y) {
+    const auto index = uint32_t(y - tile.y0) * uint32_t(tileWidth) + uint32_t(x - tile.x0);
+    isQueued[index] = 1;
+    heap.push(heightmap->at(x, y), index);
+  });
+
+  std::unordered_map<uint64_t, float> spillHeights;
+  uint32_t labelCount = 0;
+  while (!unorderedCells.empty() || !heap.empty()) {
+    uint32_t index;
+    if (!unorderedCells.empty()) {
+      index = unorderedCells.front();
+      unorderedCells.pop();
+    } else {
+      index = heap.pop();
+    }
+
+    const auto x = tile.x0 + int(index % uint32_t(tileWidth));
+    const auto y = tile.y0 + int(index / uint32_t(tileWidth));
+    const auto cell = size_t(y) * size_t(width) + size_t(x);
+    if (labels[cell] == 0) {
+      labels[cell] = ++labelCount;
+    }
+    const auto label = labels[cell];
+    const auto level = heights[cell];
+
+    for (const auto &offset : kFlowOffsets) {
+      const auto neighbourX = x + offset[0];
+      const auto neighbourY = y + offset[1];
+      if (!tile.contains(neighbourX, neighbourY)) {
+        continue;
+      }
+
+      const auto neighbour = size_t(neighbourY) * size_t(width) + size_t(neighbourX);
+      const auto neighbourLabel = labels[neighbour];
+      if (neighbourLabel != 0) {
+        if (neighbourLabel != label) {
+          const auto spillHeight = std::max(level, heights[neighbour]);
+          const auto inserted = spillHeights.emplace(spillKey(label, neighbourLabel), spillHeight);
+          if (!inserted.second) {
+            inserted.first->second = std::min(inserted.first->second, spillHeight);
+          }
+        }
+        continue;
+      }
+
+      // A perimeter cell that is still queued joins this watershed unless it is lower, which only happens
+      // when this cell lies on a slope and was taken out of order
+      const auto neighbourIndex =
+          uint32_t(neighbourY - tile.y0) * uint32_t(tileWidth) + uint32_t(neighbourX - tile.x0);
+      if (isQueued[neighbourIndex]) {
+        if (heights[neighbour] >= level) {
+          labels[neighbour] = label;
+        }
+        continue;
+      }
+      labels[neighbour] = label;
+      isQueued[neighbourIndex] = 1;
+      // A higher cell keeps its height. It only has to wait for its turn in the heap if it could otherwise
+      // flood a cell at or below it, which could then be raised before its own spill level is known.
+      if (heights[neighbour] <= level) {
+        heights[neighbour] = level;
+        unorderedCells.push(neighbourIndex);
+      } else if (!hasUnqueuedNeighbourAtOrBelow(heights, width, tile, isQueued, neighbourX, neighbourY)) {
+        unorderedCells.push(neighbourIndex);
+      } else {
+        heap.push(heights[neighbour], neighbourIndex);
+      }
+    }
+  }
+
+  tileFlood->labelCount = labelCount;
+  tileFlood->spillEdges.clear();
+  for (const auto &spillHeight : spillHeights) {
+    tileFlood->spillEdges.push_back(
+        {uint32_t(spillHeight.first >> 32), uint32_t(spillHeight.first), spillHeight.second});
+  }
+}
+
+struct WatershedLevel {
+  float level;
+  uint32_t node;
+
+  bool operator>(const WatershedLevel &other) const { return level > other.level; }
+};
+
+typedef std::priority_queue<WatershedLevel, std::vector<WatershedLevel>, std::greater<WatershedLevel>>
+    WatershedQueue;
+
+// The level every watershed has to be raised to: the lowest spill height on any path to the outside (node 0)
+std::vector<float> floodWatershedGraph(size_t nodeCount, const std::vector<SpillEdge> &edges) {
+  // Compressed adjacency lists, every edge in both directions
+  std::vector<uint32_t> edgeBegins(nodeCount + 1, 0);
+  for (const auto &edge : edges) {
+    ++edgeBegins[edge.label0 + 1];
+    ++edgeBegins[edge.label1 + 1];
+  }
+  for (size_t node = 0; node < nodeCount; ++node) {
+    edgeBegins[node + 1] += edgeBegins[node];
+  }
+  std::vector<std::pair<uint32_t, float>> adjacency(edgeBegins.back());
+  auto nextEdge = edgeBegins;
+  for (const auto &edge : edges) {
+    adjacency[nextEdge[edge.label0]++] = {edge.label1, edge.height};
+    adjacency[nextEdge[edge.label1]++] = {edge.label0, edge.height};
+  }
+
+  std::vector<float> levels(nodeCount, std::numeric_limits<float>::infinity());
+  levels[0] = -std::numeric_limits<float>::infinity();
+  WatershedQueue queue;
+  queue.push({levels[0], 0});
+  while (!queue.empty()) {
+    const auto current = queue.top();
+    queue.pop();
+    if (current.level > levels[current.node]) {
+      continue;
+    }
+
+    for (auto edge = edgeBegins[current.node]; edge < edgeBegins[current.node + 1]; ++edge) {
+      const auto neighbour = adjacency[edge].first;
+      const auto level = std::max(current.level, adjacency[edge].second);
+      if (level < levels[neighbour]) {
+        levels[neighbour] = level;
+        queue.push({level, neighbour});
+      }
+    }
+  }
+
+  return levels;
+}
+
+size_t receiverOf(const DrainageMap &drainageMap, int x, int y) {
+  const auto direction = drainageMap.flowDirections[size_t(y) * size_t(drainageMap.width) + size_t(x)];
+  if (direction >= kOutletDirection) {
+    return kNoCell;
+  }
+  return size_t(y + kFlowOffsets[direction][1]) * size_t(drainageMap.width) +
+         size_t(x + kFlowOffsets[direction][0]);
+}
+
+// Where the flow crossing tile edges enters and leaves one tile
+struct TileAccumulation {
+  std::vector<uint32_t> exitingCells; // Cells whose receiver is in another tile
+  std::vector<uint32_t> inflowCells;  // Perimeter cells with donors in other tiles
+  // For every inflow cell the exiting cell its flow leaves the tile through, kNoCell if it reaches an outlet
+  std::vector<uint32_t> inflowExits;
+  std::vector<uint32_t> inflows; // Accumulation entering at every inflow cell, known after the merge
+};
+
+// Accumulates the flow of the tile's own cells plus the known inflows, donors before receivers. The first
+// pass also records how the tile links its inflow cells to its exiting cells.
+void accumulateTile(DrainageMap *drainageMap, const HydrologyTile &tile, bool isFirstPass,
+                    TileAccumulation *tileAccumulation) {
+  const auto width = drainageMap->width;
+  const auto tileWidth = tile.width();
+  const auto tileCellCount = size_t(tileWidth) * size_t(tile.height());
+  auto *accumulation = drainageMap->accumulation.data();
+
+  const auto localIndex = [&](size_t cell) {
+    const auto x = int(cell % size_t(width));
+    const auto y = int(cell / size_t(width));
+    return tile.contains(x, y) ? uint32_t(y - tile.y0) * uint32_t(tileWidth) + uint32_t(x - tile.x0)
+                               : kNoCell;
+  };
+  const auto globalIndex = [&](uint32_t index) {
+    return size_t(tile.y0 + int(index / uint32_t(tileWidth))) * size_t(width) +
+           size_t(tile.x0 + int(index % uint32_t(tileWidth)));
+  };
+
+  std::vector<uint32_t> receivers(tileCellCount);
+  std::vector<uint8_t> donorCounts(tileCellCount, 0);
+  for (auto y = tile.y0; y < tile.y1; ++y) {
+    for (auto x = tile.x0; x < tile.x1; ++x) {
+      const auto index = uint32_t(y - tile.y0) * uint32_t(tileWidth) + uint32_t(x - tile.x0);
+      const auto receiver = receiverOf(*drainageMap, x, y);
+      receivers[index] = receiver == kNoCell ? kNoCell : localIndex(receiver);
+      if (receivers[index] != kNoCell) {
+        ++donorCounts[receivers[index]];
+      } else if (isFirstPass && receiver != kNoCell) {
+        tileAccumulation->exitingCells.push_back(uint32_t(size_t(y) * size_t(width) + size_t(x)));
+      }
+      accumulation[size_t(y) * size_t(width) + size_t(x)] = 1;
+    }
+  }
+  for (size_t i = 0; i < tileAccumulation->inflows.size(); ++i) {
+    accumulation[tileAccumulation->inflowCells[i]] += tileAccumulation->inflows[i];
+  }
+
+  std::vector<uint32_t> order;
+  order.reserve(tileCellCount);
+  for (uint32_t index = 0; index < uint32_t(tileCellCount); ++index) {
+    if (donorCounts[index] == 0) {
+      order.push_back(index);
+    }
+  }
+  for (size_t head = 0; head < order.size(); ++head) {
+    const auto index = order[head];
+    const auto receiver = receivers[index];
+    if (receiver != kNoCell) {
+      accumulation[globalIndex(receiver)] += accumulation[globalIndex(index)];
+      if (--donorCounts[receiver] == 0) {
+        order.push_back(receiver);
+      }
+    }
+  }
+
+  if (!isFirstPass) {
+    return;
+  }
+
+  // Receivers first, so every cell can take its exit from its receiver
+  std::vector<uint32_t> exits(tileCellCount, kNoCell);
+  for (auto position = order.rbegin(); position != order.rend(); ++position) {
+    const auto receiver = receivers[*position];
+    if (receiver != kNoCell) {
+      exits[*position] = exits[receiver];
+    } else if (receiverOf(*drainageMap, tile.x0 + int(*position % uint32_t(tileWidth)),
+                          tile.y0 + int(*position / uint32_t(tileWidth))) != kNoCell) {
+      exits[*position] = uint32_t(globalIndex(*position));
+    }
+  }
+
+  forEachPerimeterCell(tile, [&](int x, int y) {
+    const auto cell = size_t(y) * size_t(width) + size_t(x);
+    for (const auto &offset : kFlowOffsets) {
+      const auto donorX = x + offset[0];
+      const auto donorY = y + offset[1];
+      if (donorX < 0 || donorY < 0 || donorX >= width || donorY >= drainageMap->height ||
+          tile.contains(donorX, donorY) || receiverOf(*drainageMap, donorX, donorY) != cell) {
+        continue;
+      }
+
+      tileAccumulation->inflowCells.push_back(uint32_t(cell));
+      tileAccumulation->inflowExits.push_back(
+          exits[uint32_t(y - tile.y0) * uint32_t(tileWidth) + uint32_t(x - tile.x0)]);
+      break;
+    }
+  });
+}
+} // namespace
+
+void fillDepressions(Heightmap *heightmap, int tileSize, JobSystem *jobSystem) {
+  if (heightmap->width < 1 || heightmap->height < 1) {
+    return;
+  }
+
+  const TileGrid grid(heightmap->width, heightmap->height, tileSize);
+  const auto width = heightmap->width;
+  std::vector<uint32_t> labels(heightmap->heights.size(), 0);
+  std::vector<TileFlood> tileFloods(grid.tiles.size());
+  jobSystem->parallelFor(0, grid.tiles.size(), 1, [&](size_t begin, size_t end) {
+    for (auto i = begin; i < end; ++i) {
+      floodTile(heightmap, grid.tiles[i], labels.data(), &tileFloods[i]);
+    }
+  });
+
+  // Node 0 is the outside of the map, the labels of tile i follow those of the tiles before it
+  std::vector<uint32_t> labelOffsets(grid.tiles.size());
+  size_t nodeCount = 1;
+  for (size_t i = 0; i < grid.tiles.size(); ++i) {
+    labelOffsets[i] = uint32_t(nodeCount - 1);
+    nodeCount += tileFloods[i].labelCount;
+  }
+
+  std::vector<SpillEdge> edges;
+  for (size_t i = 0; i < grid.tiles.size(); ++i) {
+    for (const auto &spillEdge : tileFloods[i].spillEdges) {
+      edges.push_back(
+          {spillEdge.label0 + labelOffsets[i], spillEdge.label1 + labelOffsets[i], spillEdge.height});
+    }
+
+    // Perimeter cells keep their height within the tile, water crosses to the next tile or off the map
+    // wherever it tops both sides
+    const auto &tile = grid.tiles[i];
+    forEachPerimeterCell(tile, [&](int x, int y) {
+      const auto cell = size_t(y) * size_t(width) + size_t(x);
+      const auto node = labels[cell] + labelOffsets[i];
+      if (x == 0 || y == 0 || x == width - 1 || y == heightmap->height - 1) {
+        edges.push_back({node, 0, heightmap->heights[cell]});
+      }
+
+      for (const auto &offset : kFlowOffsets) {
+        const auto neighbourX = x + offset[0];
+        const auto neighbourY = y + offset[1];
+        if (neighbourX < 0 || neighbourY < 0 || neighbourX >= width || neighbourY >= heightmap->height) {
+          continue;
+        }
+        // Every pair of tiles once
+        const auto neighbourTile = grid.tileIndexAt(neighbourX, neighbourY);
+        if (neighbourTile <= i) {
+          continue;
+        }
+
+        const auto neighbour = size_t(neighbourY) * size_t(width) + size_t(neighbourX);
+        edges.push_back({node, labels[neighbour] + labelOffsets[neighbourTile],
+                         std::max(heightmap->heights[cell], heightmap->heights[neighbour])});
+      }
+    });
+  }
+
+  const auto levels = floodWatershedGraph(nodeCount, edges);
+  jobSystem->parallelFor(0, grid.tiles.size(), 1, [&](size_t begin, size_t end) {
+    for (auto i = begin; i < end; ++i) {
+      const auto &tile = grid.tiles[i];
+      for (auto y = tile.y0; y < tile.y1; ++y) {
+        auto *heights = heightmap->row(y);
+        const auto *rowLabels = labels.data() + size_t(y) * size_t(width);
+        for (auto x = tile.x0; x < tile.x1; ++x) {
+          heights[x] = std::max(heights[x], levels[rowLabels[x] + labelOffsets[i]]);
+        }
+      }
+    }
+  });
+}
+
+void computeFlowDirections(const Heightmap &filledHeightmap, int tileSize, JobSystem *jobSystem,
+                           DrainageMap *drainageMap) {
+  const auto width = filledHeightmap.width;
+  const auto height = filledHeightmap.height;
+  drainageMap->width = width;
+  drainageMap->height = height;
+  drainageMap->flowDirections.assign(filledHeightmap.heights.size(), kUnresolvedDirection);
+  drainageMap->accumulation.clear();
+  if (width < 1 || height < 1) {
+    return;
+  }
+
+  const TileGrid grid(width, height, tileSize);
+  auto *directions = drainageMap->flowDirections.data();
+  std::vector<std::vector<uint32_t>> flatCells(grid.tiles.size());
+  jobSystem->parallelFor(0, grid.tiles.size(), 1, [&](size_t begin, size_t end) {
+    for (auto i = begin; i < end; ++i) {
+      const auto &tile = grid.tiles[i];
+      for (auto y = tile.y0; y < tile.y1; ++y) {
+        for (auto x = tile.x0; x < tile.x1; ++x) {
+          const auto cellHeight = filledHeightmap.at(x, y);
+          auto direction = kUnresolvedDirection;
+          auto steepestDrop = 0.0f;
+          for (uint8_t neighbourDirection = 0; neighbourDirection < 8; ++neighbourDirection) {
+            const auto neighbourX = x + kFlowOffsets[neighbourDirection][0];
+            const auto neighbourY = y + kFlowOffsets[neighbourDirection][1];
+            if (neighbourX < 0 || neighbourY < 0 || neighbourX >= width || neighbourY >= height) {
+              continue;
+            }
+            // Odd directions are diagonal
+            const auto drop = (cellHeight - filledHeightmap.at(neighbourX, neighbourY)) *
+                              ((neighbourDirection & 1) ? kDiagonalDistanceFactor : 1.0f);
+            if (drop > steepestDrop) {
+              steepestDrop = drop;
+              direction = neighbourDirection;
+            }
+          }
+
+          if (direction == kUnresolvedDirection && (x == 0 || y == 0 || x == width - 1 || y == height - 1)) {
+            direction = kOutletDirection;
+          }
+          directions[size_t(y) * size_t(width) + size_t(x)] = direction;
+          if (direction == kUnresolvedDirection) {
+            flatCells[i].push_back(uint32_t(size_t(y) * size_t(width) + size_t(x)));
+          }
+        }
+      }
+    }
+  });
+
+  // Flat cells next to a cell of the same height that drains, pointed at it. The directions are only read
+  // here, so the tiles can look across their edges.
+  std::vector<std::vector<std::pair<uint32_t, uint8_t>>> flatOutlets(grid.tiles.size());
+  jobSystem->parallelFor(0, grid.tiles.size(), 1, [&](size_t begin, size_t end) {
+    for (auto i = begin; i < end; ++i) {
+      for (const auto cell : flatCells[i]) {
+        const auto x = int(cell % uint32_t(width));
+        const auto y = int(cell / uint32_t(width));
+        for (uint8_t neighbourDirection = 0; neighbourDirection < 8; ++neighbourDirection) {
+          const auto neighbourX = x + kFlowOffsets[neighbourDirection][0];
+          const auto neighbourY = y + kFlowOffsets[neighbourDirection][1];
+          if (neighbourX < 0 || neighbourY < 0 || neighbourX >= width || neighbourY >= height) {
+            continue;
+          }
+          const auto neighbour = size_t(neighbourY) * size_t(width) + size_t(neighbourX);
+          if (directions[neighbour] != kUnresolvedDirection &&
+              filledHeightmap.heights[neighbour] == filledHeightmap.heights[cell]) {
+            flatOutlets[i].push_back({cell, neighbourDirection});
+            break;
+          }
+        }
+      }
+    }
+  });
+
+  // Breadth-first from those across the flats, so every flat cell drains along the shortest path. Flats only
+  // cover a fraction of the map, this part runs on the calling thread.
+  std::queue<uint32_t> queue;
+  for (const auto &tileOutlets : flatOutlets) {
+    for (const auto &flatOutlet : tileOutlets) {
+      directions[flatOutlet.first] = flatOutlet.second;
+      queue.push(flatOutlet.first);
+    }
+  }
+  while (!queue.empty()) {
+    const auto cell = queue.front();
+    queue.pop();
+    const auto x = int(cell % uint32_t(width));
+    const auto y = int(cell / uint32_t(width));
+    for (uint8_t neighbourDirection = 0; neighbourDirection < 8; ++neighbourDirection) {
+      const auto neighbourX = x + kFlowOffsets[neighbourDirection][0];
+      const auto neighbourY = y + kFlowOffsets[neighbourDirection][1];
+      if (neighbourX < 0 || neighbourY < 0 || neighbourX >= width || neighbourY >= height) {
+        continue;
+      }
+      const auto neighbour = size_t(neighbourY) * size_t(width) + size_t(neighbourX);
+      if (directions[neighbour] == kUnresolvedDirection &&
+          filledHeightmap.heights[neighbour] == filledHeightmap.heights[cell]) {
+        directions[neighbour] = uint8_t((neighbourDirection + 4) % 8); // Back towards this cell
+        queue.push(uint32_t(neighbour));
+      }
+    }
+  }
+
+  // Only pits of a heightmap that was not filled are left, they end their flow paths
+  for (const auto &tileFlatCells : flatCells) {
+    for (const auto cell : tileFlatCells) {
+      if (directions[cell] == kUnresolvedDirection) {
+        directions[cell] = kOutletDirection;
+      }
+    }
+  }
+}
+
+void accumulateFlow(DrainageMap *drainageMap, int tileSize, JobSystem *jobSystem) {
+  drainageMap->accumulation.assign(drainageMap->flowDirections.size(), 0);
+  if (drainageMap->width < 1 || drainageMap->height < 1) {
+    return;
+  }
+
+  const TileGrid grid(drainageMap->width, drainageMap->height, tileSize);
+  std::vector<TileAccumulation> tileAccumulations(grid.tiles.size());
+  jobSystem->parallelFor(0, grid.tiles.size(), 1, [&](size_t begin, size_t end) {
+    for (auto i = begin; i < end; ++i) {
+      accumulateTile(drainageMap, grid.tiles[i], true, &tileAccumulations[i]);
+    }
+  });
+
+  // Every exiting cell passes its tile's own flow plus whatever enters the tile upstream of it on to an
+  // inflow cell of another tile. Along those links, donors before receivers, the totals are exact.
+  std::unordered_map<uint32_t, uint32_t> exitingCellIndices;
+  std::unordered_map<uint32_t, uint32_t> inflowExits;
+  std::vector<uint32_t> exitingCells;
+  for (const auto &tileAccumulation : tileAccumulations) {
+    for (const auto cell : tileAccumulation.exitingCells) {
+      exitingCellIndices.emplace(cell, uint32_t(exitingCells.size()));
+      exitingCells.push_back(cell);
+    }
+    for (size_t i = 0; i < tileAccumulation.inflowCells.size(); ++i) {
+      inflowExits.emplace(tileAccumulation.inflowCells[i], tileAccumulation.inflowExits[i]);
+    }
+  }
+
+  const auto width = drainageMap->width;
+  std::vector<uint32_t> receivers(exitingCells.size());
+  std::vector<uint32_t> nextExits(exitingCells.size(), kNoCell);
+  std::vector<uint32_t> upstreamCounts(exitingCells.size(), 0);
+  std::vector<uint32_t> totals(exitingCells.size());
+  for (size_t i = 0; i < exitingCells.size(); ++i) {
+    const auto x = int(exitingCells[i] % uint32_t(width));
+    const auto y = int(exitingCells[i] / uint32_t(width));
+    receivers[i] = uint32_t(receiverOf(*drainageMap, x, y));
+    totals[i] = drainageMap->accumulation[exitingCells[i]];
+    const auto exit = inflowExits.at(receivers[i]);
+    if (exit != kNoCell) {
+      nextExits[i] = exitingCellIndices.at(exit);
+      ++upstreamCounts[nextExits[i]];
+    }
+  }
+
+  std::vector<uint32_t> order;
+  order.reserve(exitingCells.size());
+  for (uint32_t i = 0; i < uint32_t(exitingCells.size()); ++i) {
+    if (upstreamCounts[i] == 0) {
+      order.push_back(i);
+    }
+  }
+  for (size_t head = 0; head < order.size(); ++head) {
+    const auto next = nextExits[order[head]];
+    if (next != kNoCell) {
+      totals[next] += totals[order[head]];
+      if (--upstreamCounts[next] == 0) {
+        order.push_back(next);
+      }
+    }
+  }
+
+  std::unordered_map<uint32_t, uint32_t> inflows;
+  for (size_t i = 0; i < exitingCells.size(); ++i) {
+    inflows[receivers[i]] += totals[i];
+  }
+  for (auto &tileAccumulation : tileAccumulations) {
+    tileAccumulation.inflows.resize(tileAccumulation.inflowCells.size());
+    for (size_t i = 0; i < tileAccumulation.inflowCells.size(); ++i) {
+      tileAccumulation.inflows[i] = inflows.at(tileAccumulation.inflowCells[i]);
+    }
+  }
+
+  jobSystem->parallelFor(0, grid.tiles.size(), 1, [&](size_t begin, size_t end) {
+    for (auto i = begin; i < end; ++i) {
+      accumulateTile(drainageMap, grid.tiles[i], false, &tileAccumulations[i]);
+    }
+  });
+}
+
+std::vector<RiverReach> extractRivers(const DrainageMap &drainageMap, uint32_t riverThreshold) {
+  const auto width = drainageMap.width;
+  std::vector<uint32_t> riverCells;
+  for (size_t cell = 0; cell < drainageMap.accumulation.size(); ++cell) {
+    if (drainageMap.accumulation[cell] >= riverThreshold) {
+      riverCells.push_back(uint32_t(cell));
+    }
+  }
+
+  // River cells only drain into river cells, which have at least as much accumulation
+  const auto riverReceiver = [&](uint32_t cell) {
+    return receiverOf(drainageMap, int(cell % uint32_t(width)), int(cell / uint32_t(width)));
+  };
+  const auto riverIndex = [&](size_t cell) {
+    return size_t(std::lower_bound(riverCells.begin(), riverCells.end(), uint32_t(cell)) -
+                  riverCells.begin());
+  };
+  std::vector<uint8_t> riverDonorCounts(riverCells.size(), 0);
+  for (const auto cell : riverCells) {
+    const auto receiver = riverReceiver(cell);
+    if (receiver != kNoCell) {
+      auto &donorCount = riverDonorCounts[riverIndex(receiver)];
+      donorCount = uint8_t(std::min(donorCount + 1, 2));
+    }
+  }
+
+  // Sources and confluences start a reach, which runs until the next confluence or the outlet
+  const auto toPoint = [&](size_t cell) {
+    return glm::ivec2(int(cell % size_t(width)), int(cell / size_t(width)));
+  };
+  std::vector<RiverReach> rivers;
+  for (size_t i = 0; i < riverCells.size(); ++i) {
+    if (riverDonorCounts[i] == 1) {
+      continue;
+    }
+
+    RiverReach reach;
+    size_t cell = riverCells[i];
+    while (true) {
+      reach.points.push_back(toPoint(cell));
+      const auto receiver = riverReceiver(uint32_t(cell));
+      if (receiver == kNoCell) {
+        break;
+      }
+      if (riverDonorCounts[riverIndex(receiver)] != 1) {
+        reach.points.push_back(toPoint(receiver));
+        break;
+      }
+      cell = receiver;
+    }
+    rivers.push_back(std::move(reach));
+  }
+
+  return rivers;
+}
+
+void carveRivers(Heightmap *heightmap, const Heightmap &filledHeightmap, const DrainageMap &drainageMap,
+                 const HydrologyParameters &parameters, JobSystem *jobSystem) {
+  const auto threshold = std::max(parameters.riverThreshold, 1u);
+  jobSystem->parallelFor(0, size_t(heightmap->height), 64, [&](size_t begin, size_t end) {
+    for (auto y = int(begin); y < int(end); ++y) {
+      auto *heights = heightmap->row(y);
+      const auto *filledHeights = filledHeightmap.row(y);
+      const auto *accumulation = drainageMap.accumulation.data() + size_t(y) * size_t(heightmap->width);
+      for (auto x = 0; x < heightmap->width; ++x) {
+        if (accumulation[x] < threshold) {
+          continue;
+        }
+        const auto depth =
+            std::min(parameters.carveDepth * std::pow(float(accumulation[x]) / float(threshold),
+                                                      parameters.carveDepthExponent),
+                     parameters.maxCarveDepth);
+        heights[x] = std::min(heights[x], filledHeights[x] - depth);
+      }
+    }
+  });
+}
+
+HydrologyStats runHydrology(Heightmap *heightmap, const HydrologyParameters &parameters, JobSystem *jobSystem,
+                            DrainageMap *drainageMap, std::vector<RiverReach> *rivers) {
+  HydrologyStats hydrologyStats = {};
+  const auto start = std::chrono::steady_clock::now();
+
+  auto filledHeightmap = *heightmap;
+  fillDepressions(&filledHeightmap, parameters.tileSize, jobSystem);
+  hydrologyStats.fillSeconds = secondsSince(start);
+
+  auto stageStart = std::chrono::steady_clock::now();
+  computeFlowDirections(filledHeightmap, parameters.tileSize, jobSystem, drainageMap);
+  hydrologyStats.flowDirectionSeconds = secondsSince(stageStart);
+
+  stageStart = std::chrono::steady_clock::now();
+  accumulateFlow(drainageMap, parameters.tileSize, jobSystem);
+  hydrologyStats.accumulationSeconds = secondsSince(stageStart);
+
+  stageStart = std::chrono::steady_clock::now();
+  *rivers = extractRivers(*drainageMap, parameters.riverThreshold);
+  carveRivers(heightmap, filledHeightmap, *drainageMap, parameters, jobSystem);
+  hydrologyStats.riverSeconds = secondsSince(stageStart);
+
+  for (const auto cellAccumulation : drainageMap->accumulation) {
+    hydrologyStats.riverCellCount += cellAccumulation >= parameters.riverThreshold ? 1 : 0;
+  }
+  hydrologyStats.seconds = secondsSince(start);
+  return hydrologyStats;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "glm/glm.hpp"
+#include "heightmap.h"
+#include <cstdint>
+#include <vector>
+
+class JobSystem;
+
+// D8 flow directions index these offsets, clockwise from east with y growing downwards
+constexpr int kFlowOffsets[8][2] = {{1, 0}, {1, 1}, {0, 1}, {-1, 1}, {-1, 0}, {-1, -1}, {0, -1}, {1, -1}};
+// Water leaves the map at this cell
+constexpr uint8_t kOutletDirection = 8;
+
+struct HydrologyParameters {
+  // Samples per side of the tiles filled and accumulated in parallel. Each tile is flooded on its own, and
+  // only the spill heights between the watersheds of the tile edges are merged globally.
+  int tileSize = 512;
+  uint32_t riverThreshold = 4096; // Cells draining through a cell, including itself, for it to carry a river
+  float carveDepth = 1.0f;        // Channel depth where a river starts
+  float carveDepthExponent = 0.5f; // Downstream the depth grows with (accumulation / riverThreshold)^exponent
+  float maxCarveDepth = 12.0f;
+};
+
+struct DrainageMap {
+  int width = 0;
+  int height = 0;
+  // Index into kFlowOffsets of the neighbour every cell drains to, or kOutletDirection
+  std::vector<uint8_t> flowDirections;
+  std::vector<uint32_t> accumulation; // Cells draining through each cell, including itself
+};
+
+// One stretch of river from a source or confluence down to the next confluence or outlet. The last point is
+// the first point of the reach it flows into, so the polylines connect.
+struct RiverReach {
+  std::vector<glm::ivec2> points; // Heightmap samples, upstream first
+};
+
+struct HydrologyStats {
+  double fillSeconds = 0.0;
+  double flowDirectionSeconds = 0.0;
+  double accumulationSeconds = 0.0;
+  double riverSeconds = 0.0; // Extraction and carving
+  double seconds = 0.0;
+  size_t riverCellCount = 0;
+};
+
+// Priority-flood depression filling: raises every cell to the lowest level at which water can leave the map
+// from it. Tiles are flooded in parallel from their own edges, which yields both the filled heights within
+// the tile and the spill heights between the watersheds draining to each stretch of the tile edge. A flood
+// over that much smaller graph of watersheds, started from the map edge, then gives the level every
+// watershed has to be raised to. O(n log n), with most cells of a depression bypassing the heap.
+void fillDepressions(Heightmap *heightmap, int tileSize, JobSystem *jobSystem);
+
+// Steepest descent over the eight neighbours. Cells on the filled flats have no lower neighbour and drain
+// towards the nearest cell of the same height that does, so every cell of a filled heightmap reaches the map
+// edge. Only the flats are resolved on the calling thread.
+void computeFlowDirections(const Heightmap &filledHeightmap, int tileSize, JobSystem *jobSystem,
+                           DrainageMap *drainageMap);
+
+// Tiles accumulate the flow of their own cells in parallel and record where the flow entering them leaves
+// again. The flow crossing tile edges is then propagated along those links, and a second pass over every
+// tile adds it in. O(n), and the result does not depend on the tile size.
+void accumulateFlow(DrainageMap *drainageMap, int tileSize, JobSystem *jobSystem);
+
+std::vector<RiverReach> extractRivers(const DrainageMap &drainageMap, uint32_t riverThreshold);
+
+// Lowers the river cells below the filled surface by a depth growing with their accumulation. The depth never
+// shrinks downstream, so outside of depressions the channels keep draining. The depressions themselves are
+// left as they are and hold lakes.
+void carveRivers(Heightmap *heightmap, const Heightmap &filledHeightmap, const DrainageMap &drainageMap,
+                 const HydrologyParameters &parameters, JobSystem *jobSystem);
+
+// All of the above on a copy of the heightmap, carving the rivers into the heightmap itself. Maps are limited
+// to 2^32 cells.
+HydrologyStats runHydrology(Heightmap *heightmap, const HydrologyParameters &parameters, JobSystem *jobSystem,
+                            DrainageMap *drainageMap, std::vector<RiverReach> *rivers);
@@ -0,0 +1,294 @@
+#include "terrainLod.h"
+
+#include "terrainCulling.h"
+#include "terrainNormals.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+float clampedHeight(const Heightmap &heightmap, int x, int z) {
+  return heightmap.at(std::min(x, heightmap.width - 1), std::min(z, heightmap.height - 1));
+}
+
+// Largest height difference between the vertices of the finer level with the given sample step inside the
+// rectangle and the mesh of the next coarser level, i.e. the error that morphing them away introduces
+float morphError(const Heightmap &heightmap, int x0, int z0, int size, int step) {
+  auto error = 0.0f;
+  for (auto z = z0; z <= z0 + size; z += step) {
+    for (auto x = x0; x <= x0 + size; x += step) {
+      const auto endpoints = findMorphEndpoints(x, z, step);
+      const auto morphHeight = 0.5f * (clampedHeight(heightmap, endpoints.x0, endpoints.z0) +
+                                       clampedHeight(heightmap, endpoints.x1, endpoints.z1));
+      error = std::max(error, std::abs(clampedHeight(heightmap, x, z) - morphHeight));
+    }
+  }
+  return error;
+}
+} // namespace
+
+CdlodQuadtree::CdlodQuadtree(const Heightmap &heightmap, const CdlodParameters &parameters)
+    : parameters(parameters) {
+  const auto leafNodeSize = parameters.leafNodeSize;
+  if (leafNodeSize < 2 || (leafNodeSize & (leafNodeSize - 1)) != 0) {
+    throw std::runtime_error("CDLOD leaf node size must be a power of two!");
+  }
+  if (heightmap.width < 2 || heightmap.height < 2) {
+    throw std::runtime_error("Heightmap is too small for a CDLOD quadtree!");
+  }
+
+  // Levels are added until a single root node covers the heightmap
+  size_t totalNodeCount = 0;
+  for (auto samplesPerNode = leafNodeSize;; samplesPerNode *= 2) {
+    Level level = {};
+    level.nodeCountX = (heightmap.width - 2) / samplesPerNode + 1;
+    level.nodeCountZ = (heightmap.height - 2) / samplesPerNode + 1;
+    level.nodeSize = float(samplesPerNode) * parameters.sampleSpacing;
+    if (levels.size() == kMaxCdlodLevels || level.nodeCountX * leafNodeSize >= 65536 ||
+        level.nodeCountZ * leafNodeSize >= 65536) {
+      throw std::runtime_error("Heightmap needs too many CDLOD levels for the leaf node size!");
+    }
+
+    levels.push_back(level);
+    totalNodeCount += size_t(level.nodeCountX) * size_t(level.nodeCountZ);
+    if (level.nodeCountX == 1 && level.nodeCountZ == 1) {
+      break;
+    }
+  }
+
+  nodes.reserve(totalNodeCount);
+  buildNode(heightmap, levelCount() - 1, 0, 0);
+  computeLodRanges();
+}
+
+uint32_t CdlodQuadtree::buildNode(const Heightmap &heightmap, uint32_t level, int x, int z) {
+  if (x >= levels[level].nodeCountX || z >= levels[level].nodeCountZ) {
+    return kInvalidCdlodNode;
+  }
+
+  const auto nodeIndex = uint32_t(nodes.size());
+  nodes.push_back({});
+
+  CdlodNode node = {};
+  node.x = uint16_t(x);
+  node.z = uint16_t(z);
+  node.level = level;
+  node.minHeight = std::numeric_limits<float>::max();
+  node.maxHeight = std::numeric_limits<float>::lowest();
+
+  const auto samplesPerNode = parameters.leafNodeSize << level;
+  const auto sampleX0 = x * samplesPerNode;
+  const auto sampleZ0 = z * samplesPerNode;
+
+  if (level == 0) {
+    const auto sampleX1 = std::min(sampleX0 + samplesPerNode, heightmap.width - 1);
+    const auto sampleZ1 = std::min(sampleZ0 + samplesPerNode, heightmap.height - 1);
+    for (auto sampleZ = sampleZ0; sampleZ <= sampleZ1; ++sampleZ) {
+      const auto heights = heightmap.row(sampleZ);
+      for (auto sampleX = sampleX0; sampleX <= sampleX1; ++sampleX) {
+        node.minHeight = std::min(node.minHeight, heights[sampleX]);
+        node.maxHeight = std::max(node.maxHeight, heights[sampleX]);
+      }
+    }
+    for (auto &child : node.children) {
+      child = kInvalidCdlodNode;
+    }
+  } else {
+    auto childError = 0.0f;
+    for (auto quadrant = 0; quadrant < 4; ++quadrant) {
+      const auto childIndex =
+          buildNode(heightmap, level - 1, 2 * x + (quadrant & 1), 2 * z + (quadrant >> 1));
+      node.children[quadrant] = childIndex;
+      if (childIndex != kInvalidCdlodNode) {
+        const auto &child = nodes[childIndex];
+        node.minHeight = std::min(node.minHeight, child.minHeight);
+        node.maxHeight = std::max(node.maxHeight, child.maxHeight);
+        childError = std::max(childError, child.geometricError);
+      }
+    }
+
+    // The error of the finer levels adds up with the error of dropping the next finer level's vertices
+    node.geometricError =
+        childError + morphError(heightmap, sampleX0, sampleZ0, samplesPerNode, 1 << (level - 1));
+  }
+
+  nodes[nodeIndex] = node;
+  return nodeIndex;
+}
+
+void CdlodQuadtree::computeLodRanges() {
+  std::vector<float> levelErrors(levels.size(), 0.0f);
+  for (const auto &node : nodes) {
+    levelErrors[node.level] = std::max(levelErrors[node.level], node.geometricError);
+  }
+
+  // An error of e world units at distance d covers e * errorToDistance / d pixels
+  const auto errorToDistance =
+      parameters.viewportHeight / (2.0f * std::tan(0.5f * parameters.verticalFieldOfView)) /
+      parameters.maxPixelError;
+
+  // Nodes of level l + 1 are only drawn outside the range of level l. Ranges at least double per level and
+  // cover at least two node diagonals, so that neighbouring nodes are never more than one level apart.
+  auto previousRange = 0.0f;
+  for (size_t level = 0; level < levels.size(); ++level) {
+    auto range = std::max(2.0f * previousRange, 2.0f * std::sqrt(2.0f) * levels[level].nodeSize);
+    if (level == 0) {
+      range = std::max(range, parameters.minLodRange);
+    }
+    if (level + 1 < levels.size()) {
+      range = std::max(range, levelErrors[level + 1] * errorToDistance);
+    } else {
+      range = std::max(range, parameters.viewDistance);
+    }
+
+    levels[level].range = range;
+    levels[level].morphStart = previousRange + (range - previousRange) * parameters.morphStartRatio;
+    previousRange = range;
+  }
+}
+
+void CdlodQuadtree::select(const glm::vec3 &cameraPosition,
+                           std::vector<CdlodSelectedNode> *selectedNodes) const {
+  selectedNodes->clear();
+  selectNode(rootNode(), cameraPosition, nullptr, selectedNodes);
+}
+
+void CdlodQuadtree::select(const glm::vec3 &cameraPosition, const std::vector<CullResult> &nodeVisibility,
+                           std::vector<CdlodSelectedNode> *selectedNodes) const {
+  selectedNodes->clear();
+  selectNode(rootNode(), cameraPosition, nodeVisibility.data(), selectedNodes);
+}
+
+bool CdlodQuadtree::selectNode(uint32_t nodeIndex, const glm::vec3 &cameraPosition,
+                               const CullResult *nodeVisibility,
+                               std::vector<CdlodSelectedNode> *selectedNodes) const {
+  const auto isVisible = [nodeVisibility](uint32_t index) {
+    return nodeVisibility == nullptr || nodeVisibility[index] != CullResult::Outside;
+  };
+
+  // Invisible nodes count as handled, so that their parent doesn't draw the quadrant instead
+  if (!isVisible(nodeIndex)) {
+    return true;
+  }
+
+  const auto &node = nodes[nodeIndex];
+  const auto &level = levels[node.level];
+
+  // Squared distance from the camera to the node's bounding box
+  const auto minX = parameters.origin.x + float(node.x) * level.nodeSize;
+  const auto minZ = parameters.origin.y + float(node.z) * level.nodeSize;
+  const auto dx = std::max({minX - cameraPosition.x, cameraPosition.x - (minX + level.nodeSize), 0.0f});
+  const auto dy = std::max({node.minHeight - cameraPosition.y, cameraPosition.y - node.maxHeight, 0.0f});
+  const auto dz = std::max({minZ - cameraPosition.z, cameraPosition.z - (minZ + level.nodeSize), 0.0f});
+  const auto distanceSquared = dx * dx + dy * dy + dz * dz;
+
+  if (distanceSquared > level.range * level.range) {
+    return false;
+  }
+
+  uint32_t quadrantMask = 0;
+  const auto finerRange = node.level > 0 ? levels[node.level - 1].range : 0.0f;
+  if (node.level == 0 || distanceSquared > finerRange * finerRange) {
+    // Entirely outside the finer level's range, draw every visible quadrant that covers the heightmap
+    quadrantMask = 0xf;
+    for (auto quadrant = 0; node.level > 0 && quadrant < 4; ++quadrant) {
+      const auto childIndex = node.children[quadrant];
+      if (childIndex == kInvalidCdlodNode || !isVisible(childIndex)) {
+        quadrantMask &= ~(1u << quadrant);
+      }
+    }
+  } else {
+    // Children outside the finer level's range are drawn as quadrants of this node
+    for (auto quadrant = 0; quadrant < 4; ++quadrant) {
+      const auto childIndex = node.children[quadrant];
+      if (childIndex != kInvalidCdlodNode &&
+          !selectNode(childIndex, cameraPosition, nodeVisibility, selectedNodes)) {
+        quadrantMask |= 1u << quadrant;
+      }
+    }
+  }
+
+  if (quadrantMask != 0) {
+    selectedNodes->push_back({nodeIndex, node.level, quadrantMask});
+  }
+  return true;
+}
+
+void CdlodQuadtree::nodeBounds(const CdlodNode &node, glm::vec3 *boundsMin, glm::vec3 *boundsMax) const {
+  const auto nodeSize = levels[node.level].nodeSize;
+  *boundsMin = glm::vec3(parameters.origin.x + float(node.x) * nodeSize, node.minHeight,
+                         parameters.origin.y + float(node.z) * nodeSize);
+  *boundsMax = glm::vec3(boundsMin->x + nodeSize, node.maxHeight, boundsMin->z + nodeSize);
+}
+
+int32_t CdlodQuadtree::nodeVertexOffset(const CdlodNode &node) const {
+  const auto leafNodeSize = parameters.leafNodeSize;
+  return int32_t(node.z) * leafNodeSize * levelGridWidth(node.level) + int32_t(node.x) * leafNodeSize;
+}
+
+void CdlodQuadtree::levelPushConstants(uint32_t level, TerrainPushConstants *pushConstants) const {
+  pushConstants->sampleSpacing = parameters.sampleSpacing * float(1 << level);
+  pushConstants->gridOrigin = parameters.origin;
+  pushConstants->heightOffset = minHeight();
+  pushConstants->heightRange = maxHeight() - minHeight();
+  pushConstants->morphStart = levels[level].morphStart;
+  pushConstants->morphEnd = levels[level].range;
+
+  // The odd vertices morph towards the next level, the coarsest level has nothing to morph to
+  chunkLodMorphBits(0, &pushConstants->morphMask, &pushConstants->morphBits);
+  if (level + 1 == levelCount()) {
+    pushConstants->morphMask = 0;
+  }
+}
+
+CdlodLevelMesh buildCdlodLevelMesh(const Heightmap &heightmap, const CdlodQuadtree &quadtree,
+                                   uint32_t level) {
+  const auto step = 1 << level;
+  Heightmap levelHeightmap(quadtree.levelGridWidth(level), quadtree.levelGridHeight(level));
+  for (auto z = 0; z < levelHeightmap.height; ++z) {
+    auto heights = levelHeightmap.row(z);
+    for (auto x = 0; x < levelHeightmap.width; ++x) {
+      heights[x] = clampedHeight(heightmap, x * step, z * step);
+    }
+  }
+
+  const auto normalEncoding = NormalEncoding::Octahedral8x2;
+  std::vector<uint8_t> normals(levelHeightmap.heights.size() * normalEncodingSize(normalEncoding));
+  computeHeightmapNormals(levelHeightmap, quadtree.lodParameters().sampleSpacing * float(step),
+                          normalEncoding, normals.data(), size_t(levelHeightmap.width));
+
+  CdlodLevelMesh levelMesh;
+  packTerrainVertices(levelHeightmap, normals.data(), normalEncoding, quadtree.minHeight(),
+                      quadtree.maxHeight(), MorphTarget::NextLevel, &levelMesh.vertexData);
+  levelMesh.indices = buildCdlodNodeIndices(quadtree.lodParameters().leafNodeSize, levelHeightmap.width);
+  return levelMesh;
+}
+
+std::vector<uint32_t> buildCdlodNodeIndices(int leafNodeSize, int vertexRowLength) {
+  const auto quadrantSize = leafNodeSize / 2;
+  std::vector<uint32_t> indices;
+  indices.reserve(size_t(leafNodeSize) * size_t(leafNodeSize) * 6);
+
+  for (auto quadrant = 0; quadrant < 4; ++quadrant) {
+    const auto quadrantX = (quadrant & 1) * quadrantSize;
+    const auto quadrantZ = (quadrant >> 1) * quadrantSize;
+    for (auto z = quadrantZ; z < quadrantZ + quadrantSize; ++z) {
+      for (auto x = quadrantX; x < quadrantX + quadrantSize; ++x) {
+        const auto topLeft = uint32_t(z * vertexRowLength + x);
+        const auto topRight = topLeft + 1;
+        const auto bottomLeft = topLeft + uint32_t(vertexRowLength);
+        const auto bottomRight = bottomLeft + 1;
+
+        // Same split as the morph targets of the finer level, see findMorphEndpoints()
+        if (usesMainDiagonal(x, z, 1)) {
+          indices.insert(indices.end(), {topLeft, bottomLeft, bottomRight, topLeft, bottomRight, topRight});
+        } else {
+          indices.insert(indices.end(), {topLeft, bottomLeft, topRight, topRight, bottomLeft, bottomRight});
+        }
+      }
+    }
+  }
+
+  return indices;
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "glm/glm.hpp"
+#include "heightmap.h"
+#include "terrainMesh.h"
+#include <cstdint>
+#include <vector>
+
+enum class CullResult : uint8_t; // terrainCulling.h
+
+constexpr uint32_t kInvalidCdlodNode = ~0u;
+constexpr uint32_t kMaxCdlodLevels = 16;
+
+struct CdlodParameters {
+  int leafNodeSize = 32;              // Quads per node side on every level, a power of two
+  float sampleSpacing = 1.0f;         // World units between two heightmap samples
+  glm::vec2 origin = glm::vec2(0.0f); // World position of heightmap sample (0, 0)
+  // Screen space error budget, the LOD ranges are derived from it and the nodes' geometric errors
+  float maxPixelError = 1.0f;
+  float viewportHeight = 1080.0f;
+  float verticalFieldOfView = glm::radians(60.0f);
+  float minLodRange = 64.0f;     // Range of the finest level
+  float viewDistance = 20000.0f; // Range of the coarsest level
+  float morphStartRatio = 0.7f;  // Morphing runs over the last 30% of every level's distance band
+};
+
+struct CdlodNode {
+  uint16_t x; // In nodes of the node's level
+  uint16_t z;
+  uint32_t level;
+  float minHeight;
+  float maxHeight;
+  // Largest height difference to the full resolution heightmap when the node is drawn at its level
+  float geometricError;
+  uint32_t children[4]; // Quadrants -x-z, +x-z, -x+z, +x+z, kInvalidCdlodNode outside the heightmap
+};
+
+struct CdlodSelectedNode {
+  uint32_t node;
+  uint32_t level;
+  // Bit i is set when the node draws its quadrant i, the other quadrants are drawn by finer nodes
+  uint32_t quadrantMask;
+};
+
+// Continuous distance-dependent LOD (Strugar, "Continuous Distance-Dependent Level of Detail for Rendering
+// Heightmaps"). Level l draws every 2^l-th heightmap sample with nodes of leafNodeSize quads, so a node on
+// level l covers leafNodeSize * 2^l samples. Every level has a distance range derived from the geometric
+// error of the next coarser level, and selection picks the coarsest node whose error stays below
+// maxPixelError at its distance. Vertices morph towards the next level over the end of their range (see
+// shaders/terrain.vert), which keeps neighbouring nodes crack free as long as they are at most one level
+// apart.
+class CdlodQuadtree {
+public:
+  CdlodQuadtree(const Heightmap &heightmap, const CdlodParameters &parameters);
+
+  // Replaces the contents of selectedNodes, nodes outside the view distance are not selected
+  void select(const glm::vec3 &cameraPosition, std::vector<CdlodSelectedNode> *selectedNodes) const;
+  // Also skips nodes and quadrants outside the frustum, nodeVisibility comes from CdlodFrustumCuller
+  void select(const glm::vec3 &cameraPosition, const std::vector<CullResult> &nodeVisibility,
+              std::vector<CdlodSelectedNode> *selectedNodes) const;
+
+  const CdlodParameters &lodParameters() const { return parameters; }
+  uint32_t levelCount() const { return uint32_t(levels.size()); }
+  size_t nodeCount() const { return nodes.size(); }
+  const CdlodNode &node(uint32_t index) const { return nodes[index]; }
+  uint32_t rootNode() const { return 0; }
+  float minHeight() const { return nodes[0].minHeight; }
+  float maxHeight() const { return nodes[0].maxHeight; }
+
+  float lodRange(uint32_t level) const { return levels[level].range; }
+  void nodeBounds(const CdlodNode &node, glm::vec3 *boundsMin, glm::vec3 *boundsMax) const;
+
+  // Vertices per row and column of the level's vertex grid, which covers whole nodes and therefore
+  // repeats the last heightmap row and column where the heightmap doesn't fill them
+  int levelGridWidth(uint32_t level) const { return levels[level].nodeCountX * parameters.leafNodeSize + 1; }
+  int levelGridHeight(uint32_t level) const { return levels[level].nodeCountZ * parameters.leafNodeSize + 1; }
+  // vertexOffset for drawing the node from its level's vertex grid with buildCdlodNodeIndices()
+  int32_t nodeVertexOffset(const CdlodNode &node) const;
+  // Everything except viewProjection and cameraPosition
+  void levelPushConstants(uint32_t level, TerrainPushConstants *pushConstants) const;
+
+private:
+  struct Level {
+    int nodeCountX;
+    int nodeCountZ;
+    float nodeSize; // World units
+    float range;
+    float morphStart;
+  };
+
+  uint32_t buildNode(const Heightmap &heightmap, uint32_t level, int x, int z);
+  void computeLodRanges();
+  bool selectNode(uint32_t nodeIndex, const glm::vec3 &cameraPosition, const CullResult *nodeVisibility,
+                  std::vector<CdlodSelectedNode> *selectedNodes) const;
+
+  CdlodParameters parameters;
+  std::vector<Level> levels;
+  std::vector<CdlodNode> nodes; // Depth first, so the subtree of a node is contiguous
+};
+
+struct CdlodLevelMesh {
+  ChunkVertexData vertexData; // levelGridWidth x levelGridHeight vertices, packed with MorphTarget::NextLevel
+  std::vector<uint32_t> indices;
+};
+
+// Every 2^level-th sample of the heightmap as a vertex grid, normals are recomputed at that spacing
+CdlodLevelMesh buildCdlodLevelMesh(const Heightmap &heightmap, const CdlodQuadtree &quadtree, uint32_t level);
+
+// Indices of one node for a vertex grid with vertexRowLength vertices per row. The quadrants are stored one
+// after another in CdlodNode::children order, so quadrant i is drawn with indices.size() / 4 indices
+// starting at i * indices.size() / 4 and consecutive quadrants can share a draw.
+std::vector<uint32_t> buildCdlodNodeIndices(int leafNodeSize, int vertexRowLength);
@@ -0,0 +1,173 @@
+#include "terrainMesh.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+VkVertexInputBindingDescription TerrainVertex::bindingDescription() {
+  VkVertexInputBindingDescription vertexInputBindingDescription = {};
+  vertexInputBindingDescription.binding = 0;
+  vertexInputBindingDescription.stride = sizeof(TerrainVertex);
+  vertexInputBindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+  return vertexInputBindingDescription;
+}
+
+std::array<VkVertexInputAttributeDescription, 3> TerrainVertex::attributeDescriptions() {
+  std::array<VkVertexInputAttributeDescription, 3> vertexInputAttributeDescriptions = {};
+
+  vertexInputAttributeDescriptions[0].location = 0;
+  vertexInputAttributeDescriptions[0].format = VK_FORMAT_R16G16_UINT;
+  vertexInputAttributeDescriptions[0].offset = offsetof(TerrainVertex, x);
+
+  // height and morphHeight
+  vertexInputAttributeDescriptions[1].location = 1;
+  vertexInputAttributeDescriptions[1].format = VK_FORMAT_R16G16_UNORM;
+  vertexInputAttributeDescriptions[1].offset = offsetof(TerrainVertex, height);
+
+  // normal and morphNormal
+  vertexInputAttributeDescriptions[2].location = 2;
+  vertexInputAttributeDescriptions[2].format = VK_FORMAT_R8G8B8A8_SNORM;
+  vertexInputAttributeDescriptions[2].offset = offsetof(TerrainVertex, normal);
+
+  return vertexInputAttributeDescriptions;
+}
+
+namespace {
+int countTrailingZeros(uint32_t value) {
+  auto count = 0;
+  while ((value & 1) == 0) {
+    value >>= 1;
+    ++count;
+  }
+  return count;
+}
+} // namespace
+
+MorphEndpoints findMorphEndpoints(int x, int z, int step) {
+  const auto coarseStep = 2 * step;
+  const auto isXOdd = x % coarseStep != 0;
+  const auto isZOdd = z % coarseStep != 0;
+
+  if (isXOdd && isZOdd) {
+    // Center of a coarse quad, which lies on the diagonal the quad is split along
+    const auto cellX = x - step;
+    const auto cellZ = z - step;
+    if (usesMainDiagonal(cellX, cellZ, coarseStep)) {
+      return {cellX, cellZ, x + step, z + step};
+    }
+    return {x + step, cellZ, cellX, z + step};
+  }
+
+  if (isXOdd) {
+    return {x - step, z, x + step, z};
+  }
+  if (isZOdd) {
+    return {x, z - step, x, z + step};
+  }
+  return {x, z, x, z};
+}
+
+void packTerrainVertices(const Heightmap &heightmap, const uint8_t *normals, NormalEncoding normalEncoding,
+                         float minHeight, float maxHeight, MorphTarget morphTarget,
+                         ChunkVertexData *vertexData) {
+  if (heightmap.width > 65536 || heightmap.height > 65536) {
+    throw std::runtime_error("Grid is too large for 16-bit vertex positions!");
+  }
+
+  vertexData->heightOffset = minHeight;
+  vertexData->heightRange = maxHeight - minHeight;
+  vertexData->vertices.resize(heightmap.heights.size());
+  packTerrainVertexRect(heightmap, normals, normalEncoding, vertexData->heightOffset, vertexData->heightRange,
+                        morphTarget, 0, 0, heightmap.width, heightmap.height, vertexData->vertices.data());
+}
+
+void packTerrainVertexRect(const Heightmap &heightmap, const uint8_t *normals, NormalEncoding normalEncoding,
+                           float heightOffset, float heightRange, MorphTarget morphTarget, int x0, int z0,
+                           int x1, int z1, TerrainVertex *vertices) {
+  const auto heightToUnorm = heightRange > 0.0f ? 65535.0f / heightRange : 0.0f;
+  const auto normalSize = normalEncodingSize(normalEncoding);
+  const auto normalAt = [&](int x, int z) {
+    const auto index = size_t(z) * size_t(heightmap.width) + size_t(x);
+    return decodeNormal(normals + index * normalSize, normalEncoding);
+  };
+
+  for (auto z = z0; z < z1; ++z) {
+    const auto heights = heightmap.row(z);
+    for (auto x = x0; x < x1; ++x) {
+      const auto index = size_t(z) * size_t(heightmap.width) + size_t(x);
+      auto &vertex = vertices[size_t(z - z0) * size_t(x1 - x0) + size_t(x - x0)];
+      vertex.x = uint16_t(x);
+      vertex.z = uint16_t(z);
+      vertex.height = uint16_t((heights[x] - heightOffset) * heightToUnorm + 0.5f);
+
+      const auto normal = normals + index * normalSize;
+      if (normalEncoding == NormalEncoding::Octahedral8x2) {
+        std::memcpy(&vertex.normal, normal, sizeof(vertex.normal));
+      } else {
+        vertex.normal = encodeOctahedral8(decodeNormal(normal, normalEncoding));
+      }
+
+      // Vertices on the coarsest chunk LOD never morph, chunkLodMorphBits() never selects them
+      auto morphStep = 1;
+      if (morphTarget == MorphTarget::ChunkLods) {
+        const auto lod = (x | z) == 0 ? int(kTerrainLodCount) : countTrailingZeros(uint32_t(x | z));
+        morphStep = lod < int(kTerrainLodCount) - 1 ? 1 << lod : 0;
+      }
+
+      auto endpoints = MorphEndpoints{x, z, x, z};
+      if (morphStep != 0) {
+        endpoints = findMorphEndpoints(x, z, morphStep);
+        endpoints.x0 = std::min(endpoints.x0, heightmap.width - 1);
+        endpoints.z0 = std::min(endpoints.z0, heightmap.height - 1);
+        endpoints.x1 = std::min(endpoints.x1, heightmap.width - 1);
+        endpoints.z1 = std::min(endpoints.z1, heightmap.height - 1);
+      }
+
+      const auto morphHeight = 0.5f * (heightmap.at(endpoints.x0, endpoints.z0) +
+                                       heightmap.at(endpoints.x1, endpoints.z1));
+      vertex.morphHeight = uint16_t((morphHeight - heightOffset) * heightToUnorm + 0.5f);
+      if (endpoints.x0 == x && endpoints.z0 == z) {
+        vertex.morphNormal = vertex.normal;
+      } else {
+        const auto morphNormal = normalAt(endpoints.x0, endpoints.z0) + normalAt(endpoints.x1, endpoints.z1);
+        vertex.morphNormal = encodeOctahedral8(glm::normalize(morphNormal));
+      }
+    }
+  }
+}
+
+void chunkLodMorphBits(uint32_t lod, uint32_t *morphMask, uint32_t *morphBits) {
+  // A vertex is dropped by LOD lod + 1 when its lowest set coordinate bit is bit lod
+  *morphMask = (2u << lod) - 1;
+  *morphBits = 1u << lod;
+}
+
+std::vector<uint16_t> buildLodIndices(int chunkSize, uint32_t lod) {
+  const auto step = 1 << lod;
+  const auto vertexRowLength = chunkSize + 1;
+  if (chunkSize % step != 0 || vertexRowLength * vertexRowLength > 65536) {
+    throw std::runtime_error("Chunk size does not support the requested LOD!");
+  }
+
+  const auto quadCount = chunkSize / step;
+  std::vector<uint16_t> indices;
+  indices.reserve(size_t(quadCount) * quadCount * 6);
+
+  for (auto z = 0; z < chunkSize; z += step) {
+    for (auto x = 0; x < chunkSize; x += step) {
+      const auto topLeft = uint16_t(z * vertexRowLength + x);
+      const auto topRight = uint16_t(topLeft + step);
+      const auto bottomLeft = uint16_t(topLeft + step * vertexRowLength);
+      const auto bottomRight = uint16_t(bottomLeft + step);
+
+      // Alternating the diagonal avoids the directional bias of a uniform split
+      if (usesMainDiagonal(x, z, step)) {
+        indices.insert(indices.end(), {topLeft, bottomLeft, bottomRight, topLeft, bottomRight, topRight});
+      } else {
+        indices.insert(indices.end(), {topLeft, bottomLeft, topRight, topRight, bottomLeft, bottomRight});
+      }
+    }
+  }
+
+  return indices;
+}
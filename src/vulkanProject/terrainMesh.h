@@ -0,0 +1,87 @@
+#pragma once
+
+#include "glm/glm.hpp"
+#include "heightmap.h"
+#include "terrainNormals.h"
+#include "vulkan/vulkan.h"
+#include <array>
+#include <cstdint>
+#include <vector>
+
+constexpr uint32_t kTerrainLodCount = 5; // LOD n draws every 2^n-th vertex of the chunk grid
+// Morph targets read samples up to this far from their vertex, so a changed sample affects the vertices
+// within this distance
+constexpr int kMorphReach = 1 << (kTerrainLodCount - 2);
+
+// 12 bytes per vertex instead of 32 for float position, normal and uv. The position within the grid is the
+// sample index, heights are quantized between the grid's min and max height and normals are oct-encoded.
+// The morph values are the height and normal of the next coarser LOD at the same position, so the vertex
+// shader can blend towards it and LOD transitions don't pop.
+struct TerrainVertex {
+  uint16_t x;
+  uint16_t z;
+  uint16_t height;      // heightOffset + height / 65535 * heightRange
+  uint16_t morphHeight; // Same quantization as height
+  uint16_t normal;      // Octahedral8x2
+  uint16_t morphNormal; // Octahedral8x2
+
+  static VkVertexInputBindingDescription bindingDescription();
+  static std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions();
+};
+
+struct ChunkVertexData {
+  std::vector<TerrainVertex> vertices;
+  float heightOffset = 0.0f;
+  float heightRange = 0.0f;
+};
+
+// Must match the push_constant block in shaders/terrain.vert
+struct TerrainPushConstants {
+  glm::mat4 viewProjection;
+  glm::vec3 cameraPosition;
+  float sampleSpacing;
+  glm::vec2 gridOrigin; // World position of vertex (0, 0)
+  float heightOffset;
+  float heightRange;
+  // Vertices with (x | z) & morphMask == morphBits blend towards their morph values between these distances
+  float morphStart;
+  float morphEnd;
+  uint32_t morphMask;
+  uint32_t morphBits;
+};
+static_assert(sizeof(TerrainPushConstants) == 112, "TerrainPushConstants must match the std430 layout");
+
+enum class MorphTarget {
+  // The grid is drawn with the LOD index buffers, a vertex morphs towards the first LOD that drops it
+  ChunkLods,
+  // The grid is one level of a pyramid, every vertex morphs towards the next level, i.e. the even vertices
+  NextLevel,
+};
+
+// normals are laid out like the heightmap and encoded as normalEncoding
+void packTerrainVertices(const Heightmap &heightmap, const uint8_t *normals, NormalEncoding normalEncoding,
+                         float minHeight, float maxHeight, MorphTarget morphTarget,
+                         ChunkVertexData *vertexData);
+// Packs the vertices of the samples [x0, x1) x [z0, z1) row by row into vertices, e.g. to patch part of an
+// uploaded grid after its heights changed. The heights are quantized with an existing offset and range.
+void packTerrainVertexRect(const Heightmap &heightmap, const uint8_t *normals, NormalEncoding normalEncoding,
+                           float heightOffset, float heightRange, MorphTarget morphTarget, int x0, int z0,
+                           int x1, int z1, TerrainVertex *vertices);
+
+// Push constant morph mask and bits for drawing a chunk grid with the LOD index buffer lod
+void chunkLodMorphBits(uint32_t lod, uint32_t *morphMask, uint32_t *morphBits);
+
+// Both the LOD index buffers and the morph targets split the quad whose top left vertex is (x, z) along the
+// top left to bottom right diagonal when this returns true, step is the vertex step of the LOD
+inline bool usesMainDiagonal(int x, int z, int step) { return ((x ^ z) / step & 1) == 0; }
+
+struct MorphEndpoints {
+  int x0, z0;
+  int x1, z1;
+};
+
+// The mesh that only keeps every 2 * step-th vertex passes through the vertex (x, z) at the midpoint of two
+// of its vertices. Vertices it keeps are their own midpoint.
+MorphEndpoints findMorphEndpoints(int x, int z, int step);
+
+std::vector<uint16_t> buildLodIndices(int chunkSize, uint32_t lod);
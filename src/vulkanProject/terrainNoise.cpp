@@ -0,0 +1,152 @@
+#include "terrainNoise.h"
+
+#include "terrainNoiseKernels.h"
+#include <algorithm>
+
+namespace {
+// Cycles per sample above which an octave aliases
+constexpr float kMaxSampledFrequency = 0.5f;
+
+void generateFbmRowScalar(const FbmParameters &fbmParameters, float x0, float y, float dx, int begin,
+                          int end, float *out) {
+  for (auto i = begin; i < end; ++i) {
+    out[i] = fbmNoise(fbmParameters, x0 + float(i) * dx, y);
+  }
+}
+
+SIMD_TARGET_SSE41 void generateFbmRowSse(const FbmParameters &fbmParameters, float x0, float y, float dx,
+                                         int count, float *out) {
+  const auto laneOffsets = _mm_setr_epi32(0, 1, 2, 3);
+  auto i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const auto index = _mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32(i), laneOffsets));
+    const auto x = _mm_add_ps(_mm_set1_ps(x0), _mm_mul_ps(index, _mm_set1_ps(dx)));
+    _mm_storeu_ps(out + i, fbmNoiseSse<false>(fbmParameters, x, _mm_set1_ps(y)));
+  }
+
+  generateFbmRowScalar(fbmParameters, x0, y, dx, i, count, out);
+}
+
+SIMD_TARGET_AVX2 void generateFbmRowAvx2(const FbmParameters &fbmParameters, float x0, float y, float dx,
+                                         int count, float *out) {
+  const auto laneOffsets = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  auto i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const auto index = _mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(i), laneOffsets));
+    const auto x = _mm256_add_ps(_mm256_set1_ps(x0), _mm256_mul_ps(index, _mm256_set1_ps(dx)));
+    _mm256_storeu_ps(out + i, fbmNoiseAvx2<false>(fbmParameters, x, _mm256_set1_ps(y)));
+  }
+
+  generateFbmRowScalar(fbmParameters, x0, y, dx, i, count, out);
+}
+
+template <bool isRidged>
+void generatePointsScalar(const FbmParameters &fbmParameters, const float *x, const float *y, int begin,
+                          int end, float *out) {
+  for (auto i = begin; i < end; ++i) {
+    out[i] = fbmNoiseScalar<isRidged>(fbmParameters, x[i], y[i]);
+  }
+}
+
+template <bool isRidged>
+SIMD_TARGET_SSE41 void generatePointsSse(const FbmParameters &fbmParameters, const float *x, const float *y,
+                                         int count, float *out) {
+  auto i = 0;
+  for (; i + 4 <= count; i += 4) {
+    _mm_storeu_ps(out + i, fbmNoiseSse<isRidged>(fbmParameters, _mm_loadu_ps(x + i), _mm_loadu_ps(y + i)));
+  }
+
+  generatePointsScalar<isRidged>(fbmParameters, x, y, i, count, out);
+}
+
+template <bool isRidged>
+SIMD_TARGET_AVX2 void generatePointsAvx2(const FbmParameters &fbmParameters, const float *x, const float *y,
+                                         int count, float *out) {
+  auto i = 0;
+  for (; i + 8 <= count; i += 8) {
+    _mm256_storeu_ps(out + i,
+                     fbmNoiseAvx2<isRidged>(fbmParameters, _mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i)));
+  }
+
+  generatePointsScalar<isRidged>(fbmParameters, x, y, i, count, out);
+}
+
+template <bool isRidged>
+void generatePoints(const FbmParameters &fbmParameters, const float *x, const float *y, int count, float *out,
+                    SimdLevel simdLevel) {
+  switch (simdLevel) {
+  case SimdLevel::Avx2:
+    generatePointsAvx2<isRidged>(fbmParameters, x, y, count, out);
+    break;
+  case SimdLevel::Sse41:
+    generatePointsSse<isRidged>(fbmParameters, x, y, count, out);
+    break;
+  default:
+    generatePointsScalar<isRidged>(fbmParameters, x, y, 0, count, out);
+    break;
+  }
+}
+} // namespace
+
+FbmParameters bandLimitFbm(const FbmParameters &fbmParameters, float sampleSpacing) {
+  // Same frequency sequence as the kernels
+  auto limited = fbmParameters;
+  auto frequency = fbmParameters.frequency * fbmParameters.lacunarity;
+  limited.octaveCount = std::min(fbmParameters.octaveCount, 1);
+  while (limited.octaveCount < fbmParameters.octaveCount &&
+         frequency * sampleSpacing < kMaxSampledFrequency) {
+    ++limited.octaveCount;
+    frequency *= fbmParameters.lacunarity;
+  }
+  return limited;
+}
+
+float fbmNoise(const FbmParameters &fbmParameters, float x, float y) {
+  return fbmNoiseScalar<false>(fbmParameters, x, y);
+}
+
+float ridgedFbmNoise(const FbmParameters &fbmParameters, float x, float y) {
+  return fbmNoiseScalar<true>(fbmParameters, x, y);
+}
+
+void generateFbmRow(const FbmParameters &fbmParameters, float x0, float y, float dx, int count, float *out) {
+  generateFbmRow(fbmParameters, x0, y, dx, count, out, detectSimdLevel());
+}
+
+void generateFbmRow(const FbmParameters &fbmParameters, float x0, float y, float dx, int count, float *out,
+                    SimdLevel simdLevel) {
+  switch (simdLevel) {
+  case SimdLevel::Avx2:
+    generateFbmRowAvx2(fbmParameters, x0, y, dx, count, out);
+    break;
+  case SimdLevel::Sse41:
+    generateFbmRowSse(fbmParameters, x0, y, dx, count, out);
+    break;
+  default:
+    generateFbmRowScalar(fbmParameters, x0, y, dx, 0, count, out);
+    break;
+  }
+}
+
+void generateFbmTile(const FbmParameters &fbmParameters, float x0, float y0, float spacing, int width,
+                     int height, float *out, size_t rowPitch) {
+  generateFbmTile(fbmParameters, x0, y0, spacing, width, height, out, rowPitch, detectSimdLevel());
+}
+
+void generateFbmTile(const FbmParameters &fbmParameters, float x0, float y0, float spacing, int width,
+                     int height, float *out, size_t rowPitch, SimdLevel simdLevel) {
+  for (auto row = 0; row < height; ++row) {
+    const auto y = y0 + float(row) * spacing;
+    generateFbmRow(fbmParameters, x0, y, spacing, width, out + size_t(row) * rowPitch, simdLevel);
+  }
+}
+
+void generateFbmPoints(const FbmParameters &fbmParameters, const float *x, const float *y, int count,
+                       float *out, SimdLevel simdLevel) {
+  generatePoints<false>(fbmParameters, x, y, count, out, simdLevel);
+}
+
+void generateRidgedFbmPoints(const FbmParameters &fbmParameters, const float *x, const float *y, int count,
+                             float *out, SimdLevel simdLevel) {
+  generatePoints<true>(fbmParameters, x, y, count, out, simdLevel);
+}
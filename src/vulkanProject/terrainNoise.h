@@ -0,0 +1,46 @@
+#pragma once
+
+#include "simdUtils.h"
+#include <cstddef>
+#include <cstdint>
+
+struct FbmParameters {
+  uint32_t seed = 0;
+  int octaveCount = 6;
+  float frequency = 1.0f / 256.0f; // Frequency of the first octave in samples per world unit
+  float lacunarity = 2.0f;         // Frequency multiplier between octaves
+  float gain = 0.5f;               // Amplitude multiplier between octaves
+  float amplitude = 1.0f;          // Amplitude of the first octave
+};
+
+// The octaves of fBm that survive being sampled every sampleSpacing units of its input coordinates, e.g. at
+// the texel spacing of a coarse LOD level. An octave whose wavelength is not longer than two samples cannot
+// be represented and only adds aliasing, so it is dropped along with the higher ones. The first octave is
+// always kept. Evaluation cost is proportional to the octaves left, so with a lacunarity of 2 every
+// doubling of the spacing saves one.
+FbmParameters bandLimitFbm(const FbmParameters &fbmParameters, float sampleSpacing);
+
+// Every path evaluates the same sequence of float operations per lane, so the scalar, SSE4.1 and AVX2
+// kernels produce bit-identical results and can be mixed freely (e.g. for row tails).
+float fbmNoise(const FbmParameters &fbmParameters, float x, float y);
+// Every octave adds amplitude * (1 - |noise|)^2 instead, which folds the zero crossings of the noise into
+// sharp ridges. Ranges from 0 to the sum of the octave amplitudes.
+float ridgedFbmNoise(const FbmParameters &fbmParameters, float x, float y);
+
+// Writes count samples taken at (x0 + i * dx, y)
+void generateFbmRow(const FbmParameters &fbmParameters, float x0, float y, float dx, int count, float *out);
+void generateFbmRow(const FbmParameters &fbmParameters, float x0, float y, float dx, int count, float *out,
+                    SimdLevel simdLevel);
+
+// Writes a width x height tile whose sample (i, j) is taken at (x0 + i * spacing, y0 + j * spacing).
+// rowPitch is in floats.
+void generateFbmTile(const FbmParameters &fbmParameters, float x0, float y0, float spacing, int width,
+                     int height, float *out, size_t rowPitch);
+void generateFbmTile(const FbmParameters &fbmParameters, float x0, float y0, float spacing, int width,
+                     int height, float *out, size_t rowPitch, SimdLevel simdLevel);
+
+// Write the count samples taken at (x[i], y[i]), e.g. at domain warped coordinates
+void generateFbmPoints(const FbmParameters &fbmParameters, const float *x, const float *y, int count,
+                       float *out, SimdLevel simdLevel);
+void generateRidgedFbmPoints(const FbmParameters &fbmParameters, const float *x, const float *y, int count,
+                             float *out, SimdLevel simdLevel);
@@ -0,0 +1,651 @@
+#include "terrainNoiseGraph.h"
+
+#include "terrainNoiseKernels.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+constexpr uint32_t kWarpSeedOffset = 0x632be5abu; // Decorrelates the y offsets of a warp from its x offsets
+constexpr auto kUnfusedBlockSize = 256; // Samples per block when a graph is not fused, a few KB per buffer
+
+FbmParameters warpOffsetNoiseY(const FbmParameters &offsetNoise) {
+  auto offsetNoiseY = offsetNoise;
+  offsetNoiseY.seed += kWarpSeedOffset;
+  return offsetNoiseY;
+}
+
+// The operators for one sample or one register of samples, every variant with the same float operations
+float terraceScalar(float height, float step, float sharpness) {
+  const auto t = height / step;
+  const auto level = std::floor(t);
+  const auto fraction = t - level;
+  const auto eased = fraction * fraction * (3.0f - 2.0f * fraction);
+  return (level + (fraction + (eased - fraction) * sharpness)) * step;
+}
+
+SIMD_TARGET_SSE41 __m128 terraceSse(__m128 height, float step, float sharpness) {
+  const auto t = _mm_div_ps(height, _mm_set1_ps(step));
+  const auto level = _mm_floor_ps(t);
+  const auto fraction = _mm_sub_ps(t, level);
+  const auto eased = _mm_mul_ps(_mm_mul_ps(fraction, fraction),
+                                _mm_sub_ps(_mm_set1_ps(3.0f), _mm_mul_ps(_mm_set1_ps(2.0f), fraction)));
+  const auto easedFraction =
+      _mm_add_ps(fraction, _mm_mul_ps(_mm_sub_ps(eased, fraction), _mm_set1_ps(sharpness)));
+  return _mm_mul_ps(_mm_add_ps(level, easedFraction), _mm_set1_ps(step));
+}
+
+SIMD_TARGET_AVX2 __m256 terraceAvx2(__m256 height, float step, float sharpness) {
+  const auto t = _mm256_div_ps(height, _mm256_set1_ps(step));
+  const auto level = _mm256_floor_ps(t);
+  const auto fraction = _mm256_sub_ps(t, level);
+  const auto eased =
+      _mm256_mul_ps(_mm256_mul_ps(fraction, fraction),
+                    _mm256_sub_ps(_mm256_set1_ps(3.0f), _mm256_mul_ps(_mm256_set1_ps(2.0f), fraction)));
+  const auto easedFraction =
+      _mm256_add_ps(fraction, _mm256_mul_ps(_mm256_sub_ps(eased, fraction), _mm256_set1_ps(sharpness)));
+  return _mm256_mul_ps(_mm256_add_ps(level, easedFraction), _mm256_set1_ps(step));
+}
+
+// Outside of (0, 1) a blend selects one of its inputs exactly instead of interpolating, so a fused kernel can
+// skip evaluating the other one and still match the unfused result bit for bit
+float blendScalar(float value0, float value1, float mask) {
+  if (!(mask > 0.0f)) {
+    return value0;
+  }
+  return mask < 1.0f ? value0 + (value1 - value0) * mask : value1;
+}
+
+SIMD_TARGET_SSE41 __m128 blendSse(__m128 value0, __m128 value1, __m128 mask) {
+  const auto interpolated = _mm_add_ps(value0, _mm_mul_ps(_mm_sub_ps(value1, value0), mask));
+  const auto upper = _mm_blendv_ps(value1, interpolated, _mm_cmplt_ps(mask, _mm_set1_ps(1.0f)));
+  return _mm_blendv_ps(value0, upper, _mm_cmpgt_ps(mask, _mm_setzero_ps()));
+}
+
+SIMD_TARGET_AVX2 __m256 blendAvx2(__m256 value0, __m256 value1, __m256 mask) {
+  const auto interpolated = _mm256_add_ps(value0, _mm256_mul_ps(_mm256_sub_ps(value1, value0), mask));
+  const auto upper =
+      _mm256_blendv_ps(value1, interpolated, _mm256_cmp_ps(mask, _mm256_set1_ps(1.0f), _CMP_LT_OQ));
+  return _mm256_blendv_ps(value0, upper, _mm256_cmp_ps(mask, _mm256_setzero_ps(), _CMP_GT_OQ));
+}
+
+const NoiseNode &graphNode(const NoiseGraph &graph, int node) { return graph.nodes()[size_t(node)]; }
+
+// Unfused evaluation. Every node evaluates its inputs into buffers of count samples and combines them, the
+// buffers come from a stack sized by scratchBufferCount().
+class ScratchStack {
+public:
+  ScratchStack(int bufferCount, int bufferSize)
+      : storage(size_t(bufferCount) * size_t(bufferSize)), bufferSize(size_t(bufferSize)) {}
+
+  float *push() { return storage.data() + size_t(usedCount++) * bufferSize; }
+  void pop() { --usedCount; }
+
+private:
+  std::vector<float> storage;
+  size_t bufferSize;
+  int usedCount = 0;
+};
+
+int scratchBufferCount(const NoiseGraph &graph, int node) {
+  const auto &noiseNode = graphNode(graph, node);
+  switch (noiseNode.type) {
+  case NoiseNodeType::Fbm:
+  case NoiseNodeType::RidgedFbm:
+    return 0;
+  case NoiseNodeType::DomainWarp:
+    return 2 + scratchBufferCount(graph, noiseNode.inputs[0]);
+  case NoiseNodeType::Terrace:
+  case NoiseNodeType::ScaleBias:
+    return scratchBufferCount(graph, noiseNode.inputs[0]);
+  case NoiseNodeType::Add:
+  case NoiseNodeType::Multiply:
+    return std::max(scratchBufferCount(graph, noiseNode.inputs[0]),
+                    1 + scratchBufferCount(graph, noiseNode.inputs[1]));
+  case NoiseNodeType::Blend:
+    return std::max({scratchBufferCount(graph, noiseNode.inputs[0]),
+                     1 + scratchBufferCount(graph, noiseNode.inputs[1]),
+                     2 + scratchBufferCount(graph, noiseNode.inputs[2])});
+  }
+  return 0;
+}
+
+void evaluateUnfused(const NoiseGraph &graph, int node, const float *x, const float *y, int count, float *out,
+                     SimdLevel simdLevel, ScratchStack *scratch) {
+  const auto &noiseNode = graphNode(graph, node);
+  switch (noiseNode.type) {
+  case NoiseNodeType::Fbm:
+    generateFbmPoints(noiseNode.fbmParameters, x, y, count, out, simdLevel);
+    break;
+  case NoiseNodeType::RidgedFbm:
+    generateRidgedFbmPoints(noiseNode.fbmParameters, x, y, count, out, simdLevel);
+    break;
+  case NoiseNodeType::DomainWarp: {
+    const auto warpedX = scratch->push();
+    const auto warpedY = scratch->push();
+    generateFbmPoints(noiseNode.fbmParameters, x, y, count, warpedX, simdLevel);
+    generateFbmPoints(warpOffsetNoiseY(noiseNode.fbmParameters), x, y, count, warpedY, simdLevel);
+    for (auto i = 0; i < count; ++i) {
+      warpedX[i] = x[i] + noiseNode.warpStrength * warpedX[i];
+      warpedY[i] = y[i] + noiseNode.warpStrength * warpedY[i];
+    }
+    evaluateUnfused(graph, noiseNode.inputs[0], warpedX, warpedY, count, out, simdLevel, scratch);
+    scratch->pop();
+    scratch->pop();
+    break;
+  }
+  case NoiseNodeType::Terrace:
+    evaluateUnfused(graph, noiseNode.inputs[0], x, y, count, out, simdLevel, scratch);
+    for (auto i = 0; i < count; ++i) {
+      out[i] = terraceScalar(out[i], noiseNode.terraceStep, noiseNode.terraceSharpness);
+    }
+    break;
+  case NoiseNodeType::ScaleBias:
+    evaluateUnfused(graph, noiseNode.inputs[0], x, y, count, out, simdLevel, scratch);
+    for (auto i = 0; i < count; ++i) {
+      out[i] = out[i] * noiseNode.scale + noiseNode.bias;
+    }
+    break;
+  case NoiseNodeType::Add:
+  case NoiseNodeType::Multiply: {
+    evaluateUnfused(graph, noiseNode.inputs[0], x, y, count, out, simdLevel, scratch);
+    const auto values = scratch->push();
+    evaluateUnfused(graph, noiseNode.inputs[1], x, y, count, values, simdLevel, scratch);
+    const auto isAdd = noiseNode.type == NoiseNodeType::Add;
+    for (auto i = 0; i < count; ++i) {
+      out[i] = isAdd ? out[i] + values[i] : out[i] * values[i];
+    }
+    scratch->pop();
+    break;
+  }
+  case NoiseNodeType::Blend: {
+    evaluateUnfused(graph, noiseNode.inputs[0], x, y, count, out, simdLevel, scratch);
+    const auto values = scratch->push();
+    evaluateUnfused(graph, noiseNode.inputs[1], x, y, count, values, simdLevel, scratch);
+    const auto mask = scratch->push();
+    evaluateUnfused(graph, noiseNode.inputs[2], x, y, count, mask, simdLevel, scratch);
+    for (auto i = 0; i < count; ++i) {
+      out[i] = blendScalar(out[i], values[i], mask[i]);
+    }
+    scratch->pop();
+    scratch->pop();
+    break;
+  }
+  }
+}
+
+// Fused evaluation. Every node type is a template over the types of its inputs, so a chain of nodes becomes
+// one type whose evaluate functions the compiler inlines into a single kernel. matches() checks a graph
+// against the chain's structure, the node parameters are copied in at construction.
+template <bool isRidged> struct FbmChain {
+  FbmParameters fbmParameters;
+
+  static bool matches(const NoiseGraph &graph, int node) {
+    return graphNode(graph, node).type == (isRidged ? NoiseNodeType::RidgedFbm : NoiseNodeType::Fbm);
+  }
+  FbmChain(const NoiseGraph &graph, int node) : fbmParameters(graphNode(graph, node).fbmParameters) {}
+
+  float evaluate(float x, float y) const { return fbmNoiseScalar<isRidged>(fbmParameters, x, y); }
+  SIMD_TARGET_SSE41 __m128 evaluateSse(__m128 x, __m128 y) const {
+    return fbmNoiseSse<isRidged>(fbmParameters, x, y);
+  }
+  SIMD_TARGET_AVX2 __m256 evaluateAvx2(__m256 x, __m256 y) const {
+    return fbmNoiseAvx2<isRidged>(fbmParameters, x, y);
+  }
+};
+
+template <typename Input> struct DomainWarpChain {
+  FbmParameters offsetNoiseX;
+  FbmParameters offsetNoiseY;
+  float strength;
+  Input input;
+
+  static bool matches(const NoiseGraph &graph, int node) {
+    const auto &noiseNode = graphNode(graph, node);
+    return noiseNode.type == NoiseNodeType::DomainWarp && Input::matches(graph, noiseNode.inputs[0]);
+  }
+  DomainWarpChain(const NoiseGraph &graph, int node)
+      : offsetNoiseX(graphNode(graph, node).fbmParameters),
+        offsetNoiseY(warpOffsetNoiseY(graphNode(graph, node).fbmParameters)),
+        strength(graphNode(graph, node).warpStrength), input(graph, graphNode(graph, node).inputs[0]) {}
+
+  float evaluate(float x, float y) const {
+    return input.evaluate(x + strength * fbmNoiseScalar<false>(offsetNoiseX, x, y),
+                          y + strength * fbmNoiseScalar<false>(offsetNoiseY, x, y));
+  }
+  SIMD_TARGET_SSE41 __m128 evaluateSse(__m128 x, __m128 y) const {
+    const auto offsetX = fbmNoiseSse<false>(offsetNoiseX, x, y);
+    const auto offsetY = fbmNoiseSse<false>(offsetNoiseY, x, y);
+    return input.evaluateSse(_mm_add_ps(x, _mm_mul_ps(_mm_set1_ps(strength), offsetX)),
+                             _mm_add_ps(y, _mm_mul_ps(_mm_set1_ps(strength), offsetY)));
+  }
+  SIMD_TARGET_AVX2 __m256 evaluateAvx2(__m256 x, __m256 y) const {
+    const auto offsetX = fbmNoiseAvx2<false>(offsetNoiseX, x, y);
+    const auto offsetY = fbmNoiseAvx2<false>(offsetNoiseY, x, y);
+    return input.evaluateAvx2(_mm256_add_ps(x, _mm256_mul_ps(_mm256_set1_ps(strength), offsetX)),
+                              _mm256_add_ps(y, _mm256_mul_ps(_mm256_set1_ps(strength), offsetY)));
+  }
+};
+
+template <typename Input> struct TerraceChain {
+  float step;
+  float sharpness;
+  Input input;
+
+  static bool matches(const NoiseGraph &graph, int node) {
+    const auto &noiseNode = graphNode(graph, node);
+    return noiseNode.type == NoiseNodeType::Terrace && Input::matches(graph, noiseNode.inputs[0]);
+  }
+  TerraceChain(const NoiseGraph &graph, int node)
+      : step(graphNode(graph, node).terraceStep), sharpness(graphNode(graph, node).terraceSharpness),
+        input(graph, graphNode(graph, node).inputs[0]) {}
+
+  float evaluate(float x, float y) const { return terraceScalar(input.evaluate(x, y), step, sharpness); }
+  SIMD_TARGET_SSE41 __m128 evaluateSse(__m128 x, __m128 y) const {
+    return terraceSse(input.evaluateSse(x, y), step, sharpness);
+  }
+  SIMD_TARGET_AVX2 __m256 evaluateAvx2(__m256 x, __m256 y) const {
+    return terraceAvx2(input.evaluateAvx2(x, y), step, sharpness);
+  }
+};
+
+template <typename Input> struct ScaleBiasChain {
+  float scale;
+  float bias;
+  Input input;
+
+  static bool matches(const NoiseGraph &graph, int node) {
+    const auto &noiseNode = graphNode(graph, node);
+    return noiseNode.type == NoiseNodeType::ScaleBias && Input::matches(graph, noiseNode.inputs[0]);
+  }
+  ScaleBiasChain(const NoiseGraph &graph, int node)
+      : scale(graphNode(graph, node).scale), bias(graphNode(graph, node).bias),
+        input(graph, graphNode(graph, node).inputs[0]) {}
+
+  float evaluate(float x, float y) const { return input.evaluate(x, y) * scale + bias; }
+  SIMD_TARGET_SSE41 __m128 evaluateSse(__m128 x, __m128 y) const {
+    return _mm_add_ps(_mm_mul_ps(input.evaluateSse(x, y), _mm_set1_ps(scale)), _mm_set1_ps(bias));
+  }
+  SIMD_TARGET_AVX2 __m256 evaluateAvx2(__m256 x, __m256 y) const {
+    return _mm256_add_ps(_mm256_mul_ps(input.evaluateAvx2(x, y), _mm256_set1_ps(scale)),
+                         _mm256_set1_ps(bias));
+  }
+};
+
+// Add or Multiply
+template <typename Input0, typename Input1, NoiseNodeType type> struct CombineChain {
+  static constexpr auto isAdd = type == NoiseNodeType::Add;
+
+  Input0 input0;
+  Input1 input1;
+
+  static bool matches(const NoiseGraph &graph, int node) {
+    const auto &noiseNode = graphNode(graph, node);
+    return noiseNode.type == type && Input0::matches(graph, noiseNode.inputs[0]) &&
+           Input1::matches(graph, noiseNode.inputs[1]);
+  }
+  CombineChain(const NoiseGraph &graph, int node)
+      : input0(graph, graphNode(graph, node).inputs[0]), input1(graph, graphNode(graph, node).inputs[1]) {}
+
+  float evaluate(float x, float y) const {
+    const auto value0 = input0.evaluate(x, y);
+    const auto value1 = input1.evaluate(x, y);
+    return isAdd ? value0 + value1 : value0 * value1;
+  }
+  SIMD_TARGET_SSE41 __m128 evaluateSse(__m128 x, __m128 y) const {
+    const auto value0 = input0.evaluateSse(x, y);
+    const auto value1 = input1.evaluateSse(x, y);
+    return isAdd ? _mm_add_ps(value0, value1) : _mm_mul_ps(value0, value1);
+  }
+  SIMD_TARGET_AVX2 __m256 evaluateAvx2(__m256 x, __m256 y) const {
+    const auto value0 = input0.evaluateAvx2(x, y);
+    const auto value1 = input1.evaluateAvx2(x, y);
+    return isAdd ? _mm256_add_ps(value0, value1) : _mm256_mul_ps(value0, value1);
+  }
+};
+
+template <typename Input0, typename Input1, typename Mask> struct BlendChain {
+  Input0 input0;
+  Input1 input1;
+  Mask mask;
+
+  static bool matches(const NoiseGraph &graph, int node) {
+    const auto &noiseNode = graphNode(graph, node);
+    return noiseNode.type == NoiseNodeType::Blend && Input0::matches(graph, noiseNode.inputs[0]) &&
+           Input1::matches(graph, noiseNode.inputs[1]) && Mask::matches(graph, noiseNode.inputs[2]);
+  }
+  BlendChain(const NoiseGraph &graph, int node)
+      : input0(graph, graphNode(graph, node).inputs[0]), input1(graph, graphNode(graph, node).inputs[1]),
+        mask(graph, graphNode(graph, node).inputs[2]) {}
+
+  // The mask comes first, masks are mostly saturated and then only one input is needed per register
+  float evaluate(float x, float y) const {
+    const auto maskValue = mask.evaluate(x, y);
+    if (!(maskValue > 0.0f)) {
+      return input0.evaluate(x, y);
+    }
+    if (!(maskValue < 1.0f)) {
+      return input1.evaluate(x, y);
+    }
+    return blendScalar(input0.evaluate(x, y), input1.evaluate(x, y), maskValue);
+  }
+  SIMD_TARGET_SSE41 __m128 evaluateSse(__m128 x, __m128 y) const {
+    const auto maskValues = mask.evaluateSse(x, y);
+    const auto above = _mm_movemask_ps(_mm_cmpgt_ps(maskValues, _mm_setzero_ps()));
+    const auto below = _mm_movemask_ps(_mm_cmplt_ps(maskValues, _mm_set1_ps(1.0f)));
+    if (above == 0) {
+      return input0.evaluateSse(x, y);
+    }
+    if (above == 0xf && below == 0) {
+      return input1.evaluateSse(x, y);
+    }
+    return blendSse(input0.evaluateSse(x, y), input1.evaluateSse(x, y), maskValues);
+  }
+  SIMD_TARGET_AVX2 __m256 evaluateAvx2(__m256 x, __m256 y) const {
+    const auto maskValues = mask.evaluateAvx2(x, y);
+    const auto above = _mm256_movemask_ps(_mm256_cmp_ps(maskValues, _mm256_setzero_ps(), _CMP_GT_OQ));
+    const auto below = _mm256_movemask_ps(_mm256_cmp_ps(maskValues, _mm256_set1_ps(1.0f), _CMP_LT_OQ));
+    if (above == 0) {
+      return input0.evaluateAvx2(x, y);
+    }
+    if (above == 0xff && below == 0) {
+      return input1.evaluateAvx2(x, y);
+    }
+    return blendAvx2(input0.evaluateAvx2(x, y), input1.evaluateAvx2(x, y), maskValues);
+  }
+};
+
+template <typename Chain>
+void generateChainRowScalar(const Chain &chain, float x0, float y, float dx, int begin, int end, float *out) {
+  for (auto i = begin; i < end; ++i) {
+    out[i] = chain.evaluate(x0 + float(i) * dx, y);
+  }
+}
+
+template <typename Chain>
+SIMD_TARGET_SSE41 void generateChainRowSse(const Chain &chain, float x0, float y, float dx, int count,
+                                           float *out) {
+  const auto laneOffsets = _mm_setr_epi32(0, 1, 2, 3);
+  auto i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const auto index = _mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32(i), laneOffsets));
+    const auto x = _mm_add_ps(_mm_set1_ps(x0), _mm_mul_ps(index, _mm_set1_ps(dx)));
+    _mm_storeu_ps(out + i, chain.evaluateSse(x, _mm_set1_ps(y)));
+  }
+
+  generateChainRowScalar(chain, x0, y, dx, i, count, out);
+}
+
+template <typename Chain>
+SIMD_TARGET_AVX2 void generateChainRowAvx2(const Chain &chain, float x0, float y, float dx, int count,
+                                           float *out) {
+  const auto laneOffsets = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  auto i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const auto index = _mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(i), laneOffsets));
+    const auto x = _mm256_add_ps(_mm256_set1_ps(x0), _mm256_mul_ps(index, _mm256_set1_ps(dx)));
+    _mm256_storeu_ps(out + i, chain.evaluateAvx2(x, _mm256_set1_ps(y)));
+  }
+
+  generateChainRowScalar(chain, x0, y, dx, i, count, out);
+}
+} // namespace
+
+class FusedNoiseKernel {
+public:
+  virtual ~FusedNoiseKernel() = default;
+
+  virtual float evaluate(float x, float y) const = 0;
+  virtual void generateRow(float x0, float y, float dx, int count, float *out, SimdLevel simdLevel) const = 0;
+};
+
+namespace {
+template <typename Chain> class ChainKernel : public FusedNoiseKernel {
+public:
+  explicit ChainKernel(const NoiseGraph &graph) : chain(graph, graph.outputNode()) {}
+
+  float evaluate(float x, float y) const override { return chain.evaluate(x, y); }
+  void generateRow(float x0, float y, float dx, int count, float *out, SimdLevel simdLevel) const override {
+    switch (simdLevel) {
+    case SimdLevel::Avx2:
+      generateChainRowAvx2(chain, x0, y, dx, count, out);
+      break;
+    case SimdLevel::Sse41:
+      generateChainRowSse(chain, x0, y, dx, count, out);
+      break;
+    default:
+      generateChainRowScalar(chain, x0, y, dx, 0, count, out);
+      break;
+    }
+  }
+
+private:
+  Chain chain;
+};
+
+template <typename Chain, typename... Chains>
+std::shared_ptr<const FusedNoiseKernel> findChainKernel(const NoiseGraph &graph) {
+  if (Chain::matches(graph, graph.outputNode())) {
+    return std::make_shared<ChainKernel<Chain>>(graph);
+  }
+  if constexpr (sizeof...(Chains) > 0) {
+    return findChainKernel<Chains...>(graph);
+  } else {
+    return nullptr;
+  }
+}
+
+typedef FbmChain<false> Fbm;
+typedef FbmChain<true> RidgedFbm;
+typedef TerraceChain<DomainWarpChain<RidgedFbm>> WarpedTerraces;
+typedef CombineChain<RidgedFbm, ScaleBiasChain<Fbm>, NoiseNodeType::Multiply> MaskedRidges;
+
+// Every chain listed here is instantiated for all three SIMD levels, so only chains that are actually built
+// belong here. The last two are defaultTerrainNoiseGraph() and ridges masked onto fBm.
+std::shared_ptr<const FusedNoiseKernel> compileKnownChain(const NoiseGraph &graph) {
+  return findChainKernel<Fbm, RidgedFbm, DomainWarpChain<Fbm>, DomainWarpChain<RidgedFbm>, WarpedTerraces,
+                         BlendChain<Fbm, WarpedTerraces, ScaleBiasChain<Fbm>>,
+                         CombineChain<Fbm, MaskedRidges, NoiseNodeType::Add>>(graph);
+}
+} // namespace
+
+int NoiseGraph::addFbm(const FbmParameters &fbmParameters) {
+  NoiseNode node;
+  node.type = NoiseNodeType::Fbm;
+  node.fbmParameters = fbmParameters;
+  return addNode(node, 0);
+}
+
+int NoiseGraph::addRidgedFbm(const FbmParameters &fbmParameters) {
+  NoiseNode node;
+  node.type = NoiseNodeType::RidgedFbm;
+  node.fbmParameters = fbmParameters;
+  return addNode(node, 0);
+}
+
+int NoiseGraph::addDomainWarp(int input, const FbmParameters &offsetNoise, float strength) {
+  NoiseNode node;
+  node.type = NoiseNodeType::DomainWarp;
+  node.fbmParameters = offsetNoise;
+  node.warpStrength = strength;
+  node.inputs[0] = input;
+  return addNode(node, 1);
+}
+
+int NoiseGraph::addTerrace(int input, float step, float sharpness) {
+  if (!(step > 0.0f)) {
+    throw std::runtime_error("Terrace step has to be positive!");
+  }
+
+  NoiseNode node;
+  node.type = NoiseNodeType::Terrace;
+  node.terraceStep = step;
+  node.terraceSharpness = sharpness;
+  node.inputs[0] = input;
+  return addNode(node, 1);
+}
+
+int NoiseGraph::addScaleBias(int input, float scale, float bias) {
+  NoiseNode node;
+  node.type = NoiseNodeType::ScaleBias;
+  node.scale = scale;
+  node.bias = bias;
+  node.inputs[0] = input;
+  return addNode(node, 1);
+}
+
+int NoiseGraph::addAdd(int input0, int input1) {
+  NoiseNode node;
+  node.type = NoiseNodeType::Add;
+  node.inputs[0] = input0;
+  node.inputs[1] = input1;
+  return addNode(node, 2);
+}
+
+int NoiseGraph::addMultiply(int input0, int input1) {
+  NoiseNode node;
+  node.type = NoiseNodeType::Multiply;
+  node.inputs[0] = input0;
+  node.inputs[1] = input1;
+  return addNode(node, 2);
+}
+
+int NoiseGraph::addBlend(int input0, int input1, int mask) {
+  NoiseNode node;
+  node.type = NoiseNodeType::Blend;
+  node.inputs[0] = input0;
+  node.inputs[1] = input1;
+  node.inputs[2] = mask;
+  return addNode(node, 3);
+}
+
+NoiseGraph NoiseGraph::inSampleSpace(float sampleSpacing) const {
+  auto graph = *this;
+  for (auto &node : graph.nodeList) {
+    if (node.type == NoiseNodeType::Fbm || node.type == NoiseNodeType::RidgedFbm ||
+        node.type == NoiseNodeType::DomainWarp) {
+      node.fbmParameters.frequency *= sampleSpacing;
+      node.fbmParameters = bandLimitFbm(node.fbmParameters, 1.0f);
+    }
+    node.warpStrength /= sampleSpacing;
+  }
+  return graph;
+}
+
+int NoiseGraph::addNode(const NoiseNode &node, int inputCount) {
+  for (auto input = 0; input < inputCount; ++input) {
+    if (node.inputs[input] < 0 || node.inputs[input] >= int(nodeList.size())) {
+      throw std::runtime_error("Noise graph inputs have to be earlier nodes!");
+    }
+  }
+
+  nodeList.push_back(node);
+  return int(nodeList.size()) - 1;
+}
+
+NoiseGraph defaultTerrainNoiseGraph(uint32_t seed) {
+  NoiseGraph graph;
+
+  FbmParameters plainsNoise;
+  plainsNoise.seed = seed;
+  plainsNoise.amplitude = 0.25f;
+  const auto plains = graph.addFbm(plainsNoise);
+
+  FbmParameters mountainNoise;
+  mountainNoise.seed = seed + 1;
+  mountainNoise.octaveCount = 5;
+  mountainNoise.frequency = 1.0f / 384.0f;
+  mountainNoise.amplitude = 0.6f;
+  FbmParameters warpNoise;
+  warpNoise.seed = seed + 2;
+  warpNoise.octaveCount = 3;
+  warpNoise.frequency = 1.0f / 128.0f;
+  const auto mountains = graph.addTerrace(
+      graph.addDomainWarp(graph.addRidgedFbm(mountainNoise), warpNoise, 24.0f), 0.08f, 0.6f);
+
+  FbmParameters maskNoise;
+  maskNoise.seed = seed + 3;
+  maskNoise.octaveCount = 2;
+  maskNoise.frequency = 1.0f / 1024.0f;
+  const auto mask = graph.addScaleBias(graph.addFbm(maskNoise), 2.5f, 0.5f);
+
+  graph.addBlend(plains, mountains, mask);
+  return graph;
+}
+
+void generateNoiseGraphTileUnfused(const NoiseGraph &graph, float x0, float y0, float spacing, int width,
+                                   int height, float *out, size_t rowPitch, SimdLevel simdLevel) {
+  const auto sampleCount = width * height;
+  std::vector<float> x(static_cast<size_t>(sampleCount));
+  std::vector<float> y(static_cast<size_t>(sampleCount));
+  std::vector<float> values(static_cast<size_t>(sampleCount));
+  for (auto row = 0; row < height; ++row) {
+    for (auto column = 0; column < width; ++column) {
+      x[size_t(row) * size_t(width) + size_t(column)] = x0 + float(column) * spacing;
+      y[size_t(row) * size_t(width) + size_t(column)] = y0 + float(row) * spacing;
+    }
+  }
+
+  ScratchStack scratch(scratchBufferCount(graph, graph.outputNode()), sampleCount);
+  evaluateUnfused(graph, graph.outputNode(), x.data(), y.data(), sampleCount, values.data(), simdLevel,
+                  &scratch);
+
+  for (auto row = 0; row < height; ++row) {
+    std::memcpy(out + size_t(row) * rowPitch, values.data() + size_t(row) * size_t(width),
+                size_t(width) * sizeof(float));
+  }
+}
+
+int unfusedBufferCount(const NoiseGraph &graph) {
+  return scratchBufferCount(graph, graph.outputNode()) + 3;
+}
+
+CompiledNoiseGraph::CompiledNoiseGraph(const NoiseGraph &graph)
+    : CompiledNoiseGraph(graph, detectSimdLevel()) {}
+
+CompiledNoiseGraph::CompiledNoiseGraph(const NoiseGraph &graph, SimdLevel simdLevel)
+    : graph(graph), simdLevel(simdLevel) {
+  if (graph.nodes().empty()) {
+    throw std::runtime_error("Noise graph is empty!");
+  }
+
+  fusedKernel = compileKnownChain(graph);
+}
+
+float CompiledNoiseGraph::evaluate(float x, float y) const {
+  if (fusedKernel) {
+    return fusedKernel->evaluate(x, y);
+  }
+
+  auto value = 0.0f;
+  ScratchStack scratch(scratchBufferCount(graph, graph.outputNode()), 1);
+  evaluateUnfused(graph, graph.outputNode(), &x, &y, 1, &value, SimdLevel::Scalar, &scratch);
+  return value;
+}
+
+void CompiledNoiseGraph::generateRow(float x0, float y, float dx, int count, float *out) const {
+  if (fusedKernel) {
+    fusedKernel->generateRow(x0, y, dx, count, out, simdLevel);
+    return;
+  }
+
+  const auto blockSize = std::min(count, kUnfusedBlockSize);
+  std::vector<float> blockX(static_cast<size_t>(blockSize));
+  const std::vector<float> blockY(static_cast<size_t>(blockSize), y);
+  ScratchStack scratch(scratchBufferCount(graph, graph.outputNode()), blockSize);
+  for (auto begin = 0; begin < count; begin += blockSize) {
+    const auto blockCount = std::min(blockSize, count - begin);
+    for (auto i = 0; i < blockCount; ++i) {
+      blockX[size_t(i)] = x0 + float(begin + i) * dx;
+    }
+    evaluateUnfused(graph, graph.outputNode(), blockX.data(), blockY.data(), blockCount, out + begin,
+                    simdLevel, &scratch);
+  }
+}
+
+void CompiledNoiseGraph::generateTile(float x0, float y0, float spacing, int width, int height, float *out,
+                                      size_t rowPitch) const {
+  for (auto row = 0; row < height; ++row) {
+    generateRow(x0, y0 + float(row) * spacing, spacing, width, out + size_t(row) * rowPitch);
+  }
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "simdUtils.h"
+#include "terrainNoise.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+enum class NoiseNodeType : uint32_t { Fbm, RidgedFbm, DomainWarp, Terrace, ScaleBias, Add, Multiply, Blend };
+
+struct NoiseNode {
+  NoiseNodeType type = NoiseNodeType::Fbm;
+  FbmParameters fbmParameters; // Fbm and RidgedFbm, and the offset noise of DomainWarp
+  float warpStrength = 0.0f;   // DomainWarp: largest offset of the input coordinates
+  float terraceStep = 1.0f;    // Terrace: height of one step
+  float terraceSharpness = 1.0f; // Terrace: 0 leaves the input unchanged, 1 eases every step in and out
+  float scale = 1.0f;            // ScaleBias
+  float bias = 0.0f;
+  // Indices of earlier nodes. DomainWarp, Terrace and ScaleBias read one input, Add and Multiply two, Blend
+  // goes from the first to the second by the third clamped to [0, 1].
+  int inputs[3] = {-1, -1, -1};
+};
+
+// Description of a height generator as a tree of noise sources and operators, evaluated at the coordinates
+// of generateFbmTile(). DomainWarp offsets the coordinates its input subtree is evaluated at. The last node
+// added is the output.
+class NoiseGraph {
+public:
+  int addFbm(const FbmParameters &fbmParameters);
+  int addRidgedFbm(const FbmParameters &fbmParameters);
+  int addDomainWarp(int input, const FbmParameters &offsetNoise, float strength);
+  int addTerrace(int input, float step, float sharpness);
+  int addScaleBias(int input, float scale, float bias);
+  int addAdd(int input0, int input1);
+  int addMultiply(int input0, int input1);
+  int addBlend(int input0, int input1, int mask);
+
+  const std::vector<NoiseNode> &nodes() const { return nodeList; }
+  int outputNode() const { return int(nodeList.size()) - 1; }
+
+  // The same graph for coordinates in units of sampleSpacing, with the frequencies multiplied and the warp
+  // strengths divided by it. Octaves that one sample per unit cannot resolve are dropped, see bandLimitFbm().
+  NoiseGraph inSampleSpace(float sampleSpacing) const;
+
+private:
+  int addNode(const NoiseNode &node, int inputCount);
+
+  std::vector<NoiseNode> nodeList;
+};
+
+// Plains of fBm, and mountains of terraced, domain warped ridged fBm where a low frequency mask rises
+NoiseGraph defaultTerrainNoiseGraph(uint32_t seed);
+
+// Evaluates the graph one node at a time over the whole tile, every node writing a full buffer of its own.
+// The reference for CompiledNoiseGraph, and what it is measured against.
+void generateNoiseGraphTileUnfused(const NoiseGraph &graph, float x0, float y0, float spacing, int width,
+                                   int height, float *out, size_t rowPitch, SimdLevel simdLevel);
+// Tile sized buffers generateNoiseGraphTileUnfused() holds at its peak, including the coordinates
+int unfusedBufferCount(const NoiseGraph &graph);
+
+class FusedNoiseKernel;
+
+// A graph compiled for evaluation. Graphs that match one of the node chains known at compile time run as a
+// single kernel specialized for that chain, with every intermediate kept in registers. Any other graph is
+// evaluated node by node over blocks of a few hundred samples, which keeps its buffers in the L1 cache. Both
+// produce bit-identical results to generateNoiseGraphTileUnfused() at every SIMD level.
+class CompiledNoiseGraph {
+public:
+  explicit CompiledNoiseGraph(const NoiseGraph &graph);
+  CompiledNoiseGraph(const NoiseGraph &graph, SimdLevel simdLevel);
+
+  bool isFused() const { return fusedKernel != nullptr; }
+
+  float evaluate(float x, float y) const;
+  // Same sample positions as generateFbmRow() and generateFbmTile()
+  void generateRow(float x0, float y, float dx, int count, float *out) const;
+  void generateTile(float x0, float y0, float spacing, int width, int height, float *out,
+                    size_t rowPitch) const;
+
+private:
+  NoiseGraph graph;
+  SimdLevel simdLevel;
+  std::shared_ptr<const FusedNoiseKernel> fusedKernel;
+};
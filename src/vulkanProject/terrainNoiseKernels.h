@@ -0,0 +1,228 @@
+#pragma once
+
+#include "simdUtils.h"
+#include "terrainNoise.h"
+#include <cmath>
+#include <cstdint>
+#include <immintrin.h>
+
+// Gradient noise for one sample or one SIMD register of samples. Shared by the fBm rows and the noise graph
+// kernels, which rely on every variant performing the same float operations per lane.
+
+constexpr uint32_t kHashPrimeX = 0x27d4eb2du;
+constexpr uint32_t kHashPrimeY = 0x165667b1u;
+constexpr uint32_t kHashMix = 0x85ebca6bu;
+constexpr uint32_t kOctaveSeedStep = 0x9e3779b9u;
+
+// The gradients peak at 1.5 in the cell center, this maps the noise output to [-1, 1]
+constexpr float kNoiseScale = 1.0f / 1.5f;
+
+inline uint32_t hashLattice(int32_t x, int32_t y, uint32_t seed) {
+  auto hash = (uint32_t(x) * kHashPrimeX) ^ (uint32_t(y) * kHashPrimeY) ^ seed;
+  hash ^= hash >> 15;
+  hash *= kHashMix;
+  hash ^= hash >> 13;
+  return hash;
+}
+
+// One of eight gradients (+-1, +-2) / (+-2, +-1), picked without any table lookup
+inline float gradient(uint32_t hash, float x, float y) {
+  const auto u = (hash & 4) ? y : x;
+  const auto v = (hash & 4) ? x : y;
+  const auto a = (hash & 1) ? -u : u;
+  const auto b = (hash & 2) ? -(v + v) : (v + v);
+  return a + b;
+}
+
+inline float fade(float t) { return t * t * t * (t * (t * 6.0f - 15.0f) + 10.0f); }
+
+inline float gradientNoise(float x, float y, uint32_t seed) {
+  const auto xFloor = std::floor(x);
+  const auto yFloor = std::floor(y);
+  const auto ix = int32_t(xFloor);
+  const auto iy = int32_t(yFloor);
+  const auto fx = x - xFloor;
+  const auto fy = y - yFloor;
+  const auto fx1 = fx - 1.0f;
+  const auto fy1 = fy - 1.0f;
+  const auto u = fade(fx);
+  const auto v = fade(fy);
+
+  const auto n00 = gradient(hashLattice(ix, iy, seed), fx, fy);
+  const auto n10 = gradient(hashLattice(ix + 1, iy, seed), fx1, fy);
+  const auto n01 = gradient(hashLattice(ix, iy + 1, seed), fx, fy1);
+  const auto n11 = gradient(hashLattice(ix + 1, iy + 1, seed), fx1, fy1);
+
+  const auto nx0 = n00 + u * (n10 - n00);
+  const auto nx1 = n01 + u * (n11 - n01);
+  return (nx0 + v * (nx1 - nx0)) * kNoiseScale;
+}
+
+template <bool isRidged> inline float fbmNoiseScalar(const FbmParameters &fbmParameters, float x, float y) {
+  auto sum = 0.0f;
+  auto frequency = fbmParameters.frequency;
+  auto amplitude = fbmParameters.amplitude;
+  auto octaveSeed = fbmParameters.seed;
+  for (auto octave = 0; octave < fbmParameters.octaveCount; ++octave) {
+    auto noise = gradientNoise(x * frequency, y * frequency, octaveSeed);
+    if constexpr (isRidged) {
+      const auto ridge = 1.0f - std::abs(noise);
+      noise = ridge * ridge;
+    }
+    sum += amplitude * noise;
+    frequency *= fbmParameters.lacunarity;
+    amplitude *= fbmParameters.gain;
+    octaveSeed += kOctaveSeedStep;
+  }
+
+  return sum;
+}
+
+SIMD_TARGET_SSE41 inline __m128i hashLatticeSse(__m128i x, __m128i y, __m128i seed) {
+  auto hash = _mm_xor_si128(_mm_mullo_epi32(x, _mm_set1_epi32(int32_t(kHashPrimeX))),
+                            _mm_mullo_epi32(y, _mm_set1_epi32(int32_t(kHashPrimeY))));
+  hash = _mm_xor_si128(hash, seed);
+  hash = _mm_xor_si128(hash, _mm_srli_epi32(hash, 15));
+  hash = _mm_mullo_epi32(hash, _mm_set1_epi32(int32_t(kHashMix)));
+  return _mm_xor_si128(hash, _mm_srli_epi32(hash, 13));
+}
+
+SIMD_TARGET_SSE41 inline __m128 gradientSse(__m128i hash, __m128 x, __m128 y) {
+  const auto swapMask = _mm_castsi128_ps(
+      _mm_cmpeq_epi32(_mm_and_si128(hash, _mm_set1_epi32(4)), _mm_set1_epi32(4)));
+  const auto u = _mm_blendv_ps(x, y, swapMask);
+  const auto v = _mm_blendv_ps(y, x, swapMask);
+  const auto signA = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(hash, _mm_set1_epi32(1)), 31));
+  const auto signB = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(hash, _mm_set1_epi32(2)), 30));
+  return _mm_add_ps(_mm_xor_ps(u, signA), _mm_xor_ps(_mm_add_ps(v, v), signB));
+}
+
+SIMD_TARGET_SSE41 inline __m128 fadeSse(__m128 t) {
+  const auto t3 = _mm_mul_ps(_mm_mul_ps(t, t), t);
+  const auto inner = _mm_sub_ps(_mm_mul_ps(t, _mm_set1_ps(6.0f)), _mm_set1_ps(15.0f));
+  return _mm_mul_ps(t3, _mm_add_ps(_mm_mul_ps(t, inner), _mm_set1_ps(10.0f)));
+}
+
+SIMD_TARGET_SSE41 inline __m128 gradientNoiseSse(__m128 x, __m128 y, __m128i seed) {
+  const auto one = _mm_set1_ps(1.0f);
+  const auto xFloor = _mm_floor_ps(x);
+  const auto yFloor = _mm_floor_ps(y);
+  const auto ix = _mm_cvttps_epi32(xFloor);
+  const auto iy = _mm_cvttps_epi32(yFloor);
+  const auto ix1 = _mm_add_epi32(ix, _mm_set1_epi32(1));
+  const auto iy1 = _mm_add_epi32(iy, _mm_set1_epi32(1));
+  const auto fx = _mm_sub_ps(x, xFloor);
+  const auto fy = _mm_sub_ps(y, yFloor);
+  const auto fx1 = _mm_sub_ps(fx, one);
+  const auto fy1 = _mm_sub_ps(fy, one);
+  const auto u = fadeSse(fx);
+  const auto v = fadeSse(fy);
+
+  const auto n00 = gradientSse(hashLatticeSse(ix, iy, seed), fx, fy);
+  const auto n10 = gradientSse(hashLatticeSse(ix1, iy, seed), fx1, fy);
+  const auto n01 = gradientSse(hashLatticeSse(ix, iy1, seed), fx, fy1);
+  const auto n11 = gradientSse(hashLatticeSse(ix1, iy1, seed), fx1, fy1);
+
+  const auto nx0 = _mm_add_ps(n00, _mm_mul_ps(u, _mm_sub_ps(n10, n00)));
+  const auto nx1 = _mm_add_ps(n01, _mm_mul_ps(u, _mm_sub_ps(n11, n01)));
+  return _mm_mul_ps(_mm_add_ps(nx0, _mm_mul_ps(v, _mm_sub_ps(nx1, nx0))), _mm_set1_ps(kNoiseScale));
+}
+
+template <bool isRidged>
+SIMD_TARGET_SSE41 inline __m128 fbmNoiseSse(const FbmParameters &fbmParameters, __m128 x, __m128 y) {
+  auto sum = _mm_setzero_ps();
+  auto frequency = fbmParameters.frequency;
+  auto amplitude = fbmParameters.amplitude;
+  auto octaveSeed = fbmParameters.seed;
+  for (auto octave = 0; octave < fbmParameters.octaveCount; ++octave) {
+    const auto scaledX = _mm_mul_ps(x, _mm_set1_ps(frequency));
+    const auto scaledY = _mm_mul_ps(y, _mm_set1_ps(frequency));
+    auto noise = gradientNoiseSse(scaledX, scaledY, _mm_set1_epi32(int32_t(octaveSeed)));
+    if constexpr (isRidged) {
+      const auto ridge = _mm_sub_ps(_mm_set1_ps(1.0f), _mm_andnot_ps(_mm_set1_ps(-0.0f), noise));
+      noise = _mm_mul_ps(ridge, ridge);
+    }
+    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(amplitude), noise));
+    frequency *= fbmParameters.lacunarity;
+    amplitude *= fbmParameters.gain;
+    octaveSeed += kOctaveSeedStep;
+  }
+
+  return sum;
+}
+
+SIMD_TARGET_AVX2 inline __m256i hashLatticeAvx2(__m256i x, __m256i y, __m256i seed) {
+  auto hash = _mm256_xor_si256(_mm256_mullo_epi32(x, _mm256_set1_epi32(int32_t(kHashPrimeX))),
+                               _mm256_mullo_epi32(y, _mm256_set1_epi32(int32_t(kHashPrimeY))));
+  hash = _mm256_xor_si256(hash, seed);
+  hash = _mm256_xor_si256(hash, _mm256_srli_epi32(hash, 15));
+  hash = _mm256_mullo_epi32(hash, _mm256_set1_epi32(int32_t(kHashMix)));
+  return _mm256_xor_si256(hash, _mm256_srli_epi32(hash, 13));
+}
+
+SIMD_TARGET_AVX2 inline __m256 gradientAvx2(__m256i hash, __m256 x, __m256 y) {
+  const auto swapMask = _mm256_castsi256_ps(
+      _mm256_cmpeq_epi32(_mm256_and_si256(hash, _mm256_set1_epi32(4)), _mm256_set1_epi32(4)));
+  const auto u = _mm256_blendv_ps(x, y, swapMask);
+  const auto v = _mm256_blendv_ps(y, x, swapMask);
+  const auto signA =
+      _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(hash, _mm256_set1_epi32(1)), 31));
+  const auto signB =
+      _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(hash, _mm256_set1_epi32(2)), 30));
+  return _mm256_add_ps(_mm256_xor_ps(u, signA), _mm256_xor_ps(_mm256_add_ps(v, v), signB));
+}
+
+SIMD_TARGET_AVX2 inline __m256 fadeAvx2(__m256 t) {
+  const auto t3 = _mm256_mul_ps(_mm256_mul_ps(t, t), t);
+  const auto inner = _mm256_sub_ps(_mm256_mul_ps(t, _mm256_set1_ps(6.0f)), _mm256_set1_ps(15.0f));
+  return _mm256_mul_ps(t3, _mm256_add_ps(_mm256_mul_ps(t, inner), _mm256_set1_ps(10.0f)));
+}
+
+SIMD_TARGET_AVX2 inline __m256 gradientNoiseAvx2(__m256 x, __m256 y, __m256i seed) {
+  const auto one = _mm256_set1_ps(1.0f);
+  const auto xFloor = _mm256_floor_ps(x);
+  const auto yFloor = _mm256_floor_ps(y);
+  const auto ix = _mm256_cvttps_epi32(xFloor);
+  const auto iy = _mm256_cvttps_epi32(yFloor);
+  const auto ix1 = _mm256_add_epi32(ix, _mm256_set1_epi32(1));
+  const auto iy1 = _mm256_add_epi32(iy, _mm256_set1_epi32(1));
+  const auto fx = _mm256_sub_ps(x, xFloor);
+  const auto fy = _mm256_sub_ps(y, yFloor);
+  const auto fx1 = _mm256_sub_ps(fx, one);
+  const auto fy1 = _mm256_sub_ps(fy, one);
+  const auto u = fadeAvx2(fx);
+  const auto v = fadeAvx2(fy);
+
+  const auto n00 = gradientAvx2(hashLatticeAvx2(ix, iy, seed), fx, fy);
+  const auto n10 = gradientAvx2(hashLatticeAvx2(ix1, iy, seed), fx1, fy);
+  const auto n01 = gradientAvx2(hashLatticeAvx2(ix, iy1, seed), fx, fy1);
+  const auto n11 = gradientAvx2(hashLatticeAvx2(ix1, iy1, seed), fx1, fy1);
+
+  const auto nx0 = _mm256_add_ps(n00, _mm256_mul_ps(u, _mm256_sub_ps(n10, n00)));
+  const auto nx1 = _mm256_add_ps(n01, _mm256_mul_ps(u, _mm256_sub_ps(n11, n01)));
+  return _mm256_mul_ps(_mm256_add_ps(nx0, _mm256_mul_ps(v, _mm256_sub_ps(nx1, nx0))),
+                       _mm256_set1_ps(kNoiseScale));
+}
+
+template <bool isRidged>
+SIMD_TARGET_AVX2 inline __m256 fbmNoiseAvx2(const FbmParameters &fbmParameters, __m256 x, __m256 y) {
+  auto sum = _mm256_setzero_ps();
+  auto frequency = fbmParameters.frequency;
+  auto amplitude = fbmParameters.amplitude;
+  auto octaveSeed = fbmParameters.seed;
+  for (auto octave = 0; octave < fbmParameters.octaveCount; ++octave) {
+    const auto scaledX = _mm256_mul_ps(x, _mm256_set1_ps(frequency));
+    const auto scaledY = _mm256_mul_ps(y, _mm256_set1_ps(frequency));
+    auto noise = gradientNoiseAvx2(scaledX, scaledY, _mm256_set1_epi32(int32_t(octaveSeed)));
+    if constexpr (isRidged) {
+      const auto ridge = _mm256_sub_ps(_mm256_set1_ps(1.0f), _mm256_andnot_ps(_mm256_set1_ps(-0.0f), noise));
+      noise = _mm256_mul_ps(ridge, ridge);
+    }
+    sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(amplitude), noise));
+    frequency *= fbmParameters.lacunarity;
+    amplitude *= fbmParameters.gain;
+    octaveSeed += kOctaveSeedStep;
+  }
+
+  return sum;
+}
@@ -0,0 +1,284 @@
+#include "terrainNormals.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <immintrin.h>
+#include <vector>
+
+namespace {
+float signNotZero(float value) { return value >= 0.0f ? 1.0f : -1.0f; }
+
+// Projects onto the octahedron with y as the pole, so upward facing terrain normals never need the fold
+glm::vec2 octahedralProject(const glm::vec3 &normal) {
+  const auto inverseL1Norm = 1.0f / (std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z));
+  auto projected = glm::vec2(normal.x, normal.z) * inverseL1Norm;
+  if (normal.y < 0.0f) {
+    projected = glm::vec2((1.0f - std::abs(projected.y)) * signNotZero(projected.x),
+                          (1.0f - std::abs(projected.x)) * signNotZero(projected.y));
+  }
+  return projected;
+}
+
+glm::vec3 octahedralUnproject(glm::vec2 projected) {
+  auto normal = glm::vec3(projected.x, 1.0f - std::abs(projected.x) - std::abs(projected.y), projected.y);
+  if (normal.y < 0.0f) {
+    normal.x = (1.0f - std::abs(projected.y)) * signNotZero(projected.x);
+    normal.z = (1.0f - std::abs(projected.x)) * signNotZero(projected.y);
+  }
+  return glm::normalize(normal);
+}
+
+int32_t roundToInt(float value) { return int32_t(value + (value < 0.0f ? -0.5f : 0.5f)); }
+
+int32_t quantizeSnorm(float value, float maxValue) {
+  return roundToInt(std::clamp(value, -1.0f, 1.0f) * maxValue);
+}
+
+// The normal is (-slopeX, 1, -slopeZ) before normalisation and always points up, so the octahedral projection
+// reduces to dividing by the L1 norm and no square root is needed
+template <NormalEncoding encoding> void storeNormal(float slopeX, float slopeZ, void *normals, int index) {
+  if constexpr (encoding == NormalEncoding::Float32x3) {
+    const auto inverseLength = 1.0f / std::sqrt(slopeX * slopeX + slopeZ * slopeZ + 1.0f);
+    auto out = static_cast<float *>(normals) + 3 * size_t(index);
+    out[0] = -slopeX * inverseLength;
+    out[1] = inverseLength;
+    out[2] = -slopeZ * inverseLength;
+  } else if constexpr (encoding == NormalEncoding::Octahedral16x2) {
+    const auto scale = 32767.0f / (std::abs(slopeX) + std::abs(slopeZ) + 1.0f);
+    const auto x = uint16_t(roundToInt(-slopeX * scale));
+    const auto z = uint16_t(roundToInt(-slopeZ * scale));
+    static_cast<uint32_t *>(normals)[index] = uint32_t(x) | (uint32_t(z) << 16);
+  } else {
+    const auto scale = 127.0f / (std::abs(slopeX) + std::abs(slopeZ) + 1.0f);
+    const auto x = uint8_t(roundToInt(-slopeX * scale));
+    const auto z = uint8_t(roundToInt(-slopeZ * scale));
+    static_cast<uint16_t *>(normals)[index] = uint16_t(x | (z << 8));
+  }
+}
+
+// Encodes the octahedral normals of samples [begin, end) four at a time, with the same float operations as
+// storeNormal() so both paths produce identical bits. Returns the first sample that was not encoded.
+template <NormalEncoding encoding>
+SIMD_TARGET_SSE41 int computeOctahedralNormalsSse(const float *above, const float *center,
+                                                  const float *below, int begin, int end,
+                                                  float inverseTwoSpacing, void *normals) {
+  const auto inverseTwoSpacingSse = _mm_set1_ps(inverseTwoSpacing);
+  const auto signMask = _mm_set1_ps(-0.0f);
+  const auto half = _mm_set1_ps(0.5f);
+  const auto one = _mm_set1_ps(1.0f);
+  const auto maxValue = _mm_set1_ps(encoding == NormalEncoding::Octahedral16x2 ? 32767.0f : 127.0f);
+  const auto roundToIntSse = [&](__m128 value) {
+    return _mm_cvttps_epi32(_mm_add_ps(value, _mm_or_ps(_mm_and_ps(value, signMask), half)));
+  };
+
+  auto i = begin;
+  for (; i + 4 <= end; i += 4) {
+    const auto deltaX = _mm_sub_ps(_mm_loadu_ps(center + i + 1), _mm_loadu_ps(center + i - 1));
+    const auto deltaZ = _mm_sub_ps(_mm_loadu_ps(below + i), _mm_loadu_ps(above + i));
+    const auto slopeX = _mm_mul_ps(deltaX, inverseTwoSpacingSse);
+    const auto slopeZ = _mm_mul_ps(deltaZ, inverseTwoSpacingSse);
+    const auto absoluteSlopeX = _mm_andnot_ps(signMask, slopeX);
+    const auto absoluteSlopeZ = _mm_andnot_ps(signMask, slopeZ);
+    const auto l1Norm = _mm_add_ps(_mm_add_ps(absoluteSlopeX, absoluteSlopeZ), one);
+    const auto scale = _mm_div_ps(maxValue, l1Norm);
+    const auto x = roundToIntSse(_mm_mul_ps(_mm_xor_ps(slopeX, signMask), scale));
+    const auto z = roundToIntSse(_mm_mul_ps(_mm_xor_ps(slopeZ, signMask), scale));
+
+    if constexpr (encoding == NormalEncoding::Octahedral16x2) {
+      const auto packed = _mm_or_si128(_mm_and_si128(x, _mm_set1_epi32(0xffff)), _mm_slli_epi32(z, 16));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(static_cast<uint32_t *>(normals) + i), packed);
+    } else {
+      const auto byteMask = _mm_set1_epi32(0xff);
+      const auto packed =
+          _mm_or_si128(_mm_and_si128(x, byteMask), _mm_slli_epi32(_mm_and_si128(z, byteMask), 8));
+      _mm_storel_epi64(reinterpret_cast<__m128i *>(static_cast<uint16_t *>(normals) + i),
+                       _mm_packus_epi32(packed, packed));
+    }
+  }
+
+  return i;
+}
+
+// Normals for one row from central differences with the rows above and below it. leftHalo and rightHalo are
+// the samples just outside the center row.
+template <NormalEncoding encoding>
+void computeNormalRow(const float *above, const float *center, const float *below, float leftHalo,
+                      float rightHalo, int width, float worldSpacing, SimdLevel simdLevel, void *normals) {
+  const auto inverseTwoSpacing = 0.5f / worldSpacing;
+  const auto firstSlopeZ = (below[0] - above[0]) * inverseTwoSpacing;
+  if (width == 1) {
+    storeNormal<encoding>((rightHalo - leftHalo) * inverseTwoSpacing, firstSlopeZ, normals, 0);
+    return;
+  }
+
+  storeNormal<encoding>((center[1] - leftHalo) * inverseTwoSpacing, firstSlopeZ, normals, 0);
+  auto i = 1;
+  if constexpr (encoding != NormalEncoding::Float32x3) {
+    if (simdLevel >= SimdLevel::Sse41) {
+      i = computeOctahedralNormalsSse<encoding>(above, center, below, 1, width - 1, inverseTwoSpacing,
+                                                normals);
+    }
+  }
+  for (; i < width - 1; ++i) {
+    storeNormal<encoding>((center[i + 1] - center[i - 1]) * inverseTwoSpacing,
+                          (below[i] - above[i]) * inverseTwoSpacing, normals, i);
+  }
+  storeNormal<encoding>((rightHalo - center[width - 2]) * inverseTwoSpacing,
+                        (below[width - 1] - above[width - 1]) * inverseTwoSpacing, normals, width - 1);
+}
+
+void computeNormalRow(const float *above, const float *center, const float *below, float leftHalo,
+                      float rightHalo, int width, float worldSpacing, SimdLevel simdLevel,
+                      NormalEncoding encoding, void *normals) {
+  switch (encoding) {
+  case NormalEncoding::Float32x3:
+    computeNormalRow<NormalEncoding::Float32x3>(above, center, below, leftHalo, rightHalo, width,
+                                                worldSpacing, simdLevel, normals);
+    break;
+  case NormalEncoding::Octahedral16x2:
+    computeNormalRow<NormalEncoding::Octahedral16x2>(above, center, below, leftHalo, rightHalo, width,
+                                                     worldSpacing, simdLevel, normals);
+    break;
+  case NormalEncoding::Octahedral8x2:
+    computeNormalRow<NormalEncoding::Octahedral8x2>(above, center, below, leftHalo, rightHalo, width,
+                                                    worldSpacing, simdLevel, normals);
+    break;
+  }
+}
+} // namespace
+
+size_t normalEncodingSize(NormalEncoding encoding) {
+  switch (encoding) {
+  case NormalEncoding::Float32x3:
+    return 3 * sizeof(float);
+  case NormalEncoding::Octahedral16x2:
+    return sizeof(uint32_t);
+  case NormalEncoding::Octahedral8x2:
+    return sizeof(uint16_t);
+  }
+  return 0;
+}
+
+uint32_t encodeOctahedral16(const glm::vec3 &normal) {
+  const auto projected = octahedralProject(normal);
+  return uint32_t(uint16_t(quantizeSnorm(projected.x, 32767.0f))) |
+         (uint32_t(uint16_t(quantizeSnorm(projected.y, 32767.0f))) << 16);
+}
+
+uint16_t encodeOctahedral8(const glm::vec3 &normal) {
+  const auto projected = octahedralProject(normal);
+  return uint16_t(uint8_t(quantizeSnorm(projected.x, 127.0f)) |
+                  (uint8_t(quantizeSnorm(projected.y, 127.0f)) << 8));
+}
+
+glm::vec3 decodeOctahedral16(uint32_t encodedNormal) {
+  const auto x = float(int16_t(encodedNormal & 0xffff)) / 32767.0f;
+  const auto y = float(int16_t(encodedNormal >> 16)) / 32767.0f;
+  return octahedralUnproject(glm::max(glm::vec2(x, y), glm::vec2(-1.0f)));
+}
+
+glm::vec3 decodeOctahedral8(uint16_t encodedNormal) {
+  const auto x = float(int8_t(encodedNormal & 0xff)) / 127.0f;
+  const auto y = float(int8_t(encodedNormal >> 8)) / 127.0f;
+  return octahedralUnproject(glm::max(glm::vec2(x, y), glm::vec2(-1.0f)));
+}
+
+glm::vec3 decodeNormal(const void *encodedNormal, NormalEncoding encoding) {
+  switch (encoding) {
+  case NormalEncoding::Float32x3: {
+    glm::vec3 normal;
+    std::memcpy(&normal, encodedNormal, sizeof(normal));
+    return normal;
+  }
+  case NormalEncoding::Octahedral16x2: {
+    uint32_t packed;
+    std::memcpy(&packed, encodedNormal, sizeof(packed));
+    return decodeOctahedral16(packed);
+  }
+  case NormalEncoding::Octahedral8x2: {
+    uint16_t packed;
+    std::memcpy(&packed, encodedNormal, sizeof(packed));
+    return decodeOctahedral8(packed);
+  }
+  }
+  return glm::vec3(0.0f, 1.0f, 0.0f);
+}
+
+void generateHeightsAndNormals(const FbmParameters &fbmParameters, float x0, float y0, float spacing,
+                               int width, int height, float worldSpacing, float *heights,
+                               size_t heightRowPitch, NormalEncoding encoding, void *normals,
+                               size_t normalRowPitch) {
+  const auto simdLevel = detectSimdLevel();
+  const auto normalRowBytes = normalRowPitch * normalEncodingSize(encoding);
+  const auto haloX0 = x0 - spacing;
+  const auto haloX1 = x0 + float(width) * spacing;
+
+  // Rows are generated straight into the output, only the halo rows above and below the tile need storage
+  std::vector<float> topHaloRow(static_cast<size_t>(width));
+  std::vector<float> bottomHaloRow(static_cast<size_t>(width));
+  const auto rowPointer = [&](int row) {
+    if (row < 0) {
+      return topHaloRow.data();
+    }
+    return row < height ? heights + size_t(row) * heightRowPitch : bottomHaloRow.data();
+  };
+  const auto generateRow = [&](int row) {
+    generateFbmRow(fbmParameters, x0, y0 + float(row) * spacing, spacing, width, rowPointer(row), simdLevel);
+  };
+
+  generateRow(-1);
+  generateRow(0);
+  for (auto row = 0; row < height; ++row) {
+    generateRow(row + 1);
+
+    const auto y = y0 + float(row) * spacing;
+    computeNormalRow(rowPointer(row - 1), rowPointer(row), rowPointer(row + 1),
+                     fbmNoise(fbmParameters, haloX0, y), fbmNoise(fbmParameters, haloX1, y), width,
+                     worldSpacing, simdLevel, encoding,
+                     static_cast<uint8_t *>(normals) + size_t(row) * normalRowBytes);
+  }
+}
+
+void computeHaloedNormals(const float *heights, size_t heightRowPitch, int width, int height,
+                          float worldSpacing, NormalEncoding encoding, void *normals, size_t normalRowPitch) {
+  const auto simdLevel = detectSimdLevel();
+  const auto normalRowBytes = normalRowPitch * normalEncodingSize(encoding);
+
+  for (auto row = 0; row < height; ++row) {
+    const auto center = heights + ptrdiff_t(row) * ptrdiff_t(heightRowPitch);
+    computeNormalRow(center - heightRowPitch, center, center + heightRowPitch, center[-1], center[width],
+                     width, worldSpacing, simdLevel, encoding,
+                     static_cast<uint8_t *>(normals) + size_t(row) * normalRowBytes);
+  }
+}
+
+void computeHeightmapNormals(const Heightmap &heightmap, float worldSpacing, NormalEncoding encoding,
+                             void *normals, size_t normalRowPitch) {
+  const auto width = heightmap.width;
+  const auto height = heightmap.height;
+  const auto simdLevel = detectSimdLevel();
+  const auto normalRowBytes = normalRowPitch * normalEncodingSize(encoding);
+
+  // The halo continues the slope at the border, so the central differences there reduce to one-sided
+  // differences over a single sample spacing
+  std::vector<float> haloRow(static_cast<size_t>(width));
+  const auto extrapolateRow = [&](int borderRow, int innerRow) {
+    const auto border = heightmap.row(borderRow);
+    const auto inner = heightmap.row(innerRow);
+    for (auto x = 0; x < width; ++x) {
+      haloRow[size_t(x)] = 2.0f * border[x] - inner[x];
+    }
+    return haloRow.data();
+  };
+
+  for (auto row = 0; row < height; ++row) {
+    const auto center = heightmap.row(row);
+    const auto above = row > 0 ? heightmap.row(row - 1) : extrapolateRow(0, std::min(1, height - 1));
+    const auto below =
+        row < height - 1 ? heightmap.row(row + 1) : extrapolateRow(height - 1, std::max(height - 2, 0));
+    computeNormalRow(above, center, below, 2.0f * center[0] - center[std::min(1, width - 1)],
+                     2.0f * center[width - 1] - center[std::max(width - 2, 0)], width, worldSpacing,
+                     simdLevel, encoding, static_cast<uint8_t *>(normals) + size_t(row) * normalRowBytes);
+  }
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "glm/glm.hpp"
+#include "heightmap.h"
+#include "terrainNoise.h"
+#include <cstddef>
+#include <cstdint>
+
+// Per-vertex normal storage. The octahedral encodings map the unit sphere onto a square and store it as two
+// snorm components, which is 3x (16-bit) or 6x (8-bit) smaller than three floats.
+enum class NormalEncoding : uint32_t { Float32x3, Octahedral16x2, Octahedral8x2 };
+
+size_t normalEncodingSize(NormalEncoding encoding);
+
+uint32_t encodeOctahedral16(const glm::vec3 &normal);
+uint16_t encodeOctahedral8(const glm::vec3 &normal);
+glm::vec3 decodeOctahedral16(uint32_t encodedNormal);
+glm::vec3 decodeOctahedral8(uint16_t encodedNormal);
+glm::vec3 decodeNormal(const void *encodedNormal, NormalEncoding encoding);
+
+// Heightfield tangents point along +x and are fully determined by the normal, so they are reconstructed
+// instead of stored
+inline glm::vec3 heightfieldTangent(const glm::vec3 &normal) {
+  return glm::normalize(glm::vec3(normal.y, -normal.x, 0.0f));
+}
+
+// Generates a width x height tile of fBm heights together with their normals. The one sample halo around the
+// tile is taken from the noise itself, so the border normals match those of the neighbouring tile exactly,
+// which computeHeightmapNormals() cannot do for a tile on its own. Rows are produced into a three row window
+// and their normals taken while they are still in cache, but the noise dominates the cost, so this is no
+// faster than the two passes. The heights are bit-identical to generateFbmTile() with the same arguments.
+// worldSpacing is the distance between two samples in world units and the row pitches are in elements.
+void generateHeightsAndNormals(const FbmParameters &fbmParameters, float x0, float y0, float spacing,
+                               int width, int height, float worldSpacing, float *heights,
+                               size_t heightRowPitch, NormalEncoding encoding, void *normals,
+                               size_t normalRowPitch);
+
+// Normals of a width x height block whose heights are surrounded by a one sample halo on every side, heights
+// points at the first sample inside the halo. Used to refresh the normals around an edit without touching
+// the rest of the heightmap.
+void computeHaloedNormals(const float *heights, size_t heightRowPitch, int width, int height,
+                          float worldSpacing, NormalEncoding encoding, void *normals, size_t normalRowPitch);
+
+// Normals for an existing heightmap (e.g. after erosion or import), with one-sided differences at the borders
+void computeHeightmapNormals(const Heightmap &heightmap, float worldSpacing, NormalEncoding encoding,
+                             void *normals, size_t normalRowPitch);
@@ -0,0 +1,501 @@
+#include "terrainQueries.h"
+
+#include <algorithm>
+#include <cmath>
+#include <immintrin.h>
+#include <limits>
+
+namespace {
+constexpr auto kSweepStepSize = 0.5f; // In samples, keeps ridges narrower than a cell from being stepped over
+constexpr auto kSweepRefineIterations = 8;
+constexpr size_t kMaxChunkBuckets = 4096; // Counting sort buckets allowed beyond one per query
+
+// Everything the kernels need to interpolate the heightmap of one chunk
+struct ChunkSampler {
+  const float *heights;
+  int width;
+  float originX;
+  float originZ;
+  float inverseSpacing;
+  float maxCell;
+};
+
+// The same operations in the same order as the SIMD kernels, so all paths return bit-identical results
+void sampleRunScalar(const ChunkSampler &sampler, const int32_t *indices, size_t begin, size_t end,
+                     const float *positionX, const float *positionZ, float *heights, float *normalX,
+                     float *normalY, float *normalZ) {
+  for (auto i = begin; i < end; ++i) {
+    const auto query = size_t(indices[i]);
+    const auto gridX = (positionX[query] - sampler.originX) * sampler.inverseSpacing;
+    const auto gridZ = (positionZ[query] - sampler.originZ) * sampler.inverseSpacing;
+    const auto cellX = std::min(std::max(std::floor(gridX), 0.0f), sampler.maxCell);
+    const auto cellZ = std::min(std::max(std::floor(gridZ), 0.0f), sampler.maxCell);
+    const auto fractionX = std::min(std::max(gridX - cellX, 0.0f), 1.0f);
+    const auto fractionZ = std::min(std::max(gridZ - cellZ, 0.0f), 1.0f);
+
+    const auto corner = sampler.heights + int(cellZ) * sampler.width + int(cellX);
+    const auto height00 = corner[0];
+    const auto height10 = corner[1];
+    const auto height01 = corner[sampler.width];
+    const auto height11 = corner[sampler.width + 1];
+
+    const auto top = height00 + (height10 - height00) * fractionX;
+    const auto bottom = height01 + (height11 - height01) * fractionX;
+    heights[query] = top + (bottom - top) * fractionZ;
+
+    if (normalX != nullptr) {
+      const auto slopeTop = height10 - height00;
+      const auto slopeBottom = height11 - height01;
+      const auto slopeLeft = height01 - height00;
+      const auto slopeRight = height11 - height10;
+      const auto slopeX = (slopeTop + (slopeBottom - slopeTop) * fractionZ) * sampler.inverseSpacing;
+      const auto slopeZ = (slopeLeft + (slopeRight - slopeLeft) * fractionX) * sampler.inverseSpacing;
+      const auto inverseLength = 1.0f / std::sqrt(slopeX * slopeX + slopeZ * slopeZ + 1.0f);
+      normalX[query] = -slopeX * inverseLength;
+      normalY[query] = inverseLength;
+      normalZ[query] = -slopeZ * inverseLength;
+    }
+  }
+}
+
+SIMD_TARGET_SSE41 __m128 gatherSse(const float *values, const int32_t *indices) {
+  return _mm_setr_ps(values[indices[0]], values[indices[1]], values[indices[2]], values[indices[3]]);
+}
+
+SIMD_TARGET_SSE41 void scatterSse(__m128 values, const int32_t *indices, float *output) {
+  alignas(16) float lanes[4];
+  _mm_store_ps(lanes, values);
+  for (auto lane = 0; lane < 4; ++lane) {
+    output[indices[lane]] = lanes[lane];
+  }
+}
+
+// SSE4.1 has no gathers, the corners are loaded per lane while the interpolation runs 4 wide
+SIMD_TARGET_SSE41 void sampleRunSse(const ChunkSampler &sampler, const int32_t *indices, size_t count,
+                                    const float *positionX, const float *positionZ, float *heights,
+                                    float *normalX, float *normalY, float *normalZ) {
+  const auto zero = _mm_setzero_ps();
+  const auto one = _mm_set1_ps(1.0f);
+  const auto originX = _mm_set1_ps(sampler.originX);
+  const auto originZ = _mm_set1_ps(sampler.originZ);
+  const auto inverseSpacing = _mm_set1_ps(sampler.inverseSpacing);
+  const auto maxCell = _mm_set1_ps(sampler.maxCell);
+  const auto width = _mm_set1_epi32(sampler.width);
+
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const auto gridX = _mm_mul_ps(_mm_sub_ps(gatherSse(positionX, indices + i), originX), inverseSpacing);
+    const auto gridZ = _mm_mul_ps(_mm_sub_ps(gatherSse(positionZ, indices + i), originZ), inverseSpacing);
+    const auto cellX = _mm_min_ps(_mm_max_ps(_mm_floor_ps(gridX), zero), maxCell);
+    const auto cellZ = _mm_min_ps(_mm_max_ps(_mm_floor_ps(gridZ), zero), maxCell);
+    const auto fractionX = _mm_min_ps(_mm_max_ps(_mm_sub_ps(gridX, cellX), zero), one);
+    const auto fractionZ = _mm_min_ps(_mm_max_ps(_mm_sub_ps(gridZ, cellZ), zero), one);
+
+    alignas(16) int32_t cornerIndices[4];
+    _mm_store_si128(reinterpret_cast<__m128i *>(cornerIndices),
+                    _mm_add_epi32(_mm_mullo_epi32(_mm_cvttps_epi32(cellZ), width), _mm_cvttps_epi32(cellX)));
+    const auto height00 = gatherSse(sampler.heights, cornerIndices);
+    const auto height10 = gatherSse(sampler.heights + 1, cornerIndices);
+    const auto height01 = gatherSse(sampler.heights + sampler.width, cornerIndices);
+    const auto height11 = gatherSse(sampler.heights + sampler.width + 1, cornerIndices);
+
+    const auto slopeTop = _mm_sub_ps(height10, height00);
+    const auto slopeBottom = _mm_sub_ps(height11, height01);
+    const auto top = _mm_add_ps(height00, _mm_mul_ps(slopeTop, fractionX));
+    const auto bottom = _mm_add_ps(height01, _mm_mul_ps(slopeBottom, fractionX));
+    scatterSse(_mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), fractionZ)), indices + i, heights);
+
+    if (normalX != nullptr) {
+      const auto slopeLeft = _mm_sub_ps(height01, height00);
+      const auto slopeRight = _mm_sub_ps(height11, height10);
+      const auto slopeX = _mm_mul_ps(
+          _mm_add_ps(slopeTop, _mm_mul_ps(_mm_sub_ps(slopeBottom, slopeTop), fractionZ)), inverseSpacing);
+      const auto slopeZ = _mm_mul_ps(
+          _mm_add_ps(slopeLeft, _mm_mul_ps(_mm_sub_ps(slopeRight, slopeLeft), fractionX)), inverseSpacing);
+      const auto lengthSquared =
+          _mm_add_ps(_mm_add_ps(_mm_mul_ps(slopeX, slopeX), _mm_mul_ps(slopeZ, slopeZ)), one);
+      const auto inverseLength = _mm_div_ps(one, _mm_sqrt_ps(lengthSquared));
+      scatterSse(_mm_mul_ps(_mm_sub_ps(zero, slopeX), inverseLength), indices + i, normalX);
+      scatterSse(inverseLength, indices + i, normalY);
+      scatterSse(_mm_mul_ps(_mm_sub_ps(zero, slopeZ), inverseLength), indices + i, normalZ);
+    }
+  }
+
+  sampleRunScalar(sampler, indices, i, count, positionX, positionZ, heights, normalX, normalY, normalZ);
+}
+
+SIMD_TARGET_AVX2 void scatterAvx2(__m256 values, const int32_t *indices, float *output) {
+  alignas(32) float lanes[8];
+  _mm256_store_ps(lanes, values);
+  for (auto lane = 0; lane < 8; ++lane) {
+    output[indices[lane]] = lanes[lane];
+  }
+}
+
+SIMD_TARGET_AVX2 void sampleRunAvx2(const ChunkSampler &sampler, const int32_t *indices, size_t count,
+                                    const float *positionX, const float *positionZ, float *heights,
+                                    float *normalX, float *normalY, float *normalZ) {
+  const auto zero = _mm256_setzero_ps();
+  const auto one = _mm256_set1_ps(1.0f);
+  const auto originX = _mm256_set1_ps(sampler.originX);
+  const auto originZ = _mm256_set1_ps(sampler.originZ);
+  const auto inverseSpacing = _mm256_set1_ps(sampler.inverseSpacing);
+  const auto maxCell = _mm256_set1_ps(sampler.maxCell);
+  const auto width = _mm256_set1_epi32(sampler.width);
+
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const auto queries = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(indices + i));
+    const auto gridX =
+        _mm256_mul_ps(_mm256_sub_ps(_mm256_i32gather_ps(positionX, queries, 4), originX), inverseSpacing);
+    const auto gridZ =
+        _mm256_mul_ps(_mm256_sub_ps(_mm256_i32gather_ps(positionZ, queries, 4), originZ), inverseSpacing);
+    const auto cellX = _mm256_min_ps(_mm256_max_ps(_mm256_floor_ps(gridX), zero), maxCell);
+    const auto cellZ = _mm256_min_ps(_mm256_max_ps(_mm256_floor_ps(gridZ), zero), maxCell);
+    const auto fractionX = _mm256_min_ps(_mm256_max_ps(_mm256_sub_ps(gridX, cellX), zero), one);
+    const auto fractionZ = _mm256_min_ps(_mm256_max_ps(_mm256_sub_ps(gridZ, cellZ), zero), one);
+
+    const auto corners =
+        _mm256_add_epi32(_mm256_mullo_epi32(_mm256_cvttps_epi32(cellZ), width), _mm256_cvttps_epi32(cellX));
+    const auto height00 = _mm256_i32gather_ps(sampler.heights, corners, 4);
+    const auto height10 = _mm256_i32gather_ps(sampler.heights + 1, corners, 4);
+    const auto height01 = _mm256_i32gather_ps(sampler.heights + sampler.width, corners, 4);
+    const auto height11 = _mm256_i32gather_ps(sampler.heights + sampler.width + 1, corners, 4);
+
+    const auto slopeTop = _mm256_sub_ps(height10, height00);
+    const auto slopeBottom = _mm256_sub_ps(height11, height01);
+    const auto top = _mm256_add_ps(height00, _mm256_mul_ps(slopeTop, fractionX));
+    const auto bottom = _mm256_add_ps(height01, _mm256_mul_ps(slopeBottom, fractionX));
+    scatterAvx2(_mm256_add_ps(top, _mm256_mul_ps(_mm256_sub_ps(bottom, top), fractionZ)), indices + i,
+                heights);
+
+    if (normalX != nullptr) {
+      const auto slopeLeft = _mm256_sub_ps(height01, height00);
+      const auto slopeRight = _mm256_sub_ps(height11, height10);
+      const auto slopeX = _mm256_mul_ps(
+          _mm256_add_ps(slopeTop, _mm256_mul_ps(_mm256_sub_ps(slopeBottom, slopeTop), fractionZ)),
+          inverseSpacing);
+      const auto slopeZ = _mm256_mul_ps(
+          _mm256_add_ps(slopeLeft, _mm256_mul_ps(_mm256_sub_ps(slopeRight, slopeLeft), fractionX)),
+          inverseSpacing);
+      const auto lengthSquared =
+          _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(slopeX, slopeX), _mm256_mul_ps(slopeZ, slopeZ)), one);
+      const auto inverseLength = _mm256_div_ps(one, _mm256_sqrt_ps(lengthSquared));
+      scatterAvx2(_mm256_mul_ps(_mm256_sub_ps(zero, slopeX), inverseLength), indices + i, normalX);
+      scatterAvx2(inverseLength, indices + i, normalY);
+      scatterAvx2(_mm256_mul_ps(_mm256_sub_ps(zero, slopeZ), inverseLength), indices + i, normalZ);
+    }
+  }
+
+  sampleRunScalar(sampler, indices, i, count, positionX, positionZ, heights, normalX, normalY, normalZ);
+}
+
+// Distance from the sphere to the tangent plane of the ground below its center, negative once they overlap
+float sphereClearance(float centerY, float radius, float groundHeight, float groundNormalY) {
+  return (centerY - groundHeight) * groundNormalY - radius;
+}
+} // namespace
+
+TerrainQueries::TerrainQueries(const ChunkManager *chunkManager)
+    : TerrainQueries(chunkManager->streamingParameters().chunkSize,
+                     chunkManager->streamingParameters().sampleSpacing,
+                     [chunkManager](ChunkCoord coord) { return chunkManager->findChunk(coord); }) {}
+
+TerrainQueries::TerrainQueries(int chunkSize, float sampleSpacing, FindChunkFunction findChunk)
+    : TerrainQueries(chunkSize, sampleSpacing, std::move(findChunk), detectSimdLevel()) {}
+
+TerrainQueries::TerrainQueries(int chunkSize, float sampleSpacing, FindChunkFunction findChunk,
+                               SimdLevel simdLevel)
+    : chunkSize(chunkSize), sampleSpacing(sampleSpacing), findChunk(std::move(findChunk)),
+      simdLevel(simdLevel) {}
+
+void TerrainQueries::sample(size_t count, const float *positionX, const float *positionZ, float *heights,
+                            float *normalX, float *normalY, float *normalZ) {
+  if (count == 0) {
+    return;
+  }
+
+  const auto chunkExtent = float(chunkSize) * sampleSpacing;
+  queryCoords.resize(count);
+  auto minCoord = ChunkCoord{std::numeric_limits<int32_t>::max(), std::numeric_limits<int32_t>::max()};
+  auto maxCoord = ChunkCoord{std::numeric_limits<int32_t>::min(), std::numeric_limits<int32_t>::min()};
+  for (size_t i = 0; i < count; ++i) {
+    const ChunkCoord coord{int32_t(std::floor(positionX[i] / chunkExtent)),
+                           int32_t(std::floor(positionZ[i] / chunkExtent))};
+    queryCoords[i] = coord;
+    minCoord = {std::min(minCoord.x, coord.x), std::min(minCoord.z, coord.z)};
+    maxCoord = {std::max(maxCoord.x, coord.x), std::max(maxCoord.z, coord.z)};
+  }
+
+  // Agents usually stay within the streamed area, so a counting sort over the chunks of their bounding box
+  // groups them in linear time. Queries keep their order within a chunk either way.
+  sortedIndices.resize(count);
+  const auto boxWidth = int64_t(maxCoord.x) - int64_t(minCoord.x) + 1;
+  const auto boxHeight = int64_t(maxCoord.z) - int64_t(minCoord.z) + 1;
+  if (boxWidth * boxHeight <= int64_t(std::max(count, kMaxChunkBuckets))) {
+    const auto bucketOf = [&](size_t query) {
+      const auto &coord = queryCoords[query];
+      return size_t(int64_t(coord.z - minCoord.z) * boxWidth + int64_t(coord.x - minCoord.x));
+    };
+    bucketOffsets.assign(size_t(boxWidth * boxHeight) + 1, 0);
+    for (size_t i = 0; i < count; ++i) {
+      ++bucketOffsets[bucketOf(i) + 1];
+    }
+    for (size_t bucket = 1; bucket < bucketOffsets.size(); ++bucket) {
+      bucketOffsets[bucket] += bucketOffsets[bucket - 1];
+    }
+    for (size_t i = 0; i < count; ++i) {
+      sortedIndices[bucketOffsets[bucketOf(i)]++] = int32_t(i);
+    }
+  } else {
+    for (size_t i = 0; i < count; ++i) {
+      sortedIndices[i] = int32_t(i);
+    }
+    std::sort(sortedIndices.begin(), sortedIndices.end(), [&](int32_t a, int32_t b) {
+      const auto &coordA = queryCoords[size_t(a)];
+      const auto &coordB = queryCoords[size_t(b)];
+      if (coordA.z != coordB.z) {
+        return coordA.z < coordB.z;
+      }
+      return coordA.x != coordB.x ? coordA.x < coordB.x : a < b;
+    });
+  }
+
+  for (size_t runBegin = 0; runBegin < count;) {
+    const auto coord = queryCoords[size_t(sortedIndices[runBegin])];
+    auto runEnd = runBegin + 1;
+    while (runEnd < count && queryCoords[size_t(sortedIndices[runEnd])] == coord) {
+      ++runEnd;
+    }
+
+    const auto runIndices = sortedIndices.data() + runBegin;
+    const auto runCount = runEnd - runBegin;
+    const auto chunk = findChunk(coord);
+    if (chunk == nullptr) {
+      for (size_t i = 0; i < runCount; ++i) {
+        heights[runIndices[i]] = std::numeric_limits<float>::quiet_NaN();
+        if (normalX != nullptr) {
+          normalX[runIndices[i]] = 0.0f;
+          normalY[runIndices[i]] = 1.0f;
+          normalZ[runIndices[i]] = 0.0f;
+        }
+      }
+    } else {
+      ChunkSampler sampler;
+      sampler.heights = chunk->heightmap().heights.data();
+      sampler.width = chunk->heightmap().width;
+      sampler.originX = float(coord.x) * chunkExtent;
+      sampler.originZ = float(coord.z) * chunkExtent;
+      sampler.inverseSpacing = 1.0f / sampleSpacing;
+      sampler.maxCell = float(chunk->heightmap().width - 2);
+
+      switch (simdLevel) {
+      case SimdLevel::Avx2:
+        sampleRunAvx2(sampler, runIndices, runCount, positionX, positionZ, heights, normalX, normalY,
+                      normalZ);
+        break;
+      case SimdLevel::Sse41:
+        sampleRunSse(sampler, runIndices, runCount, positionX, positionZ, heights, normalX, normalY,
+                     normalZ);
+        break;
+      default:
+        sampleRunScalar(sampler, runIndices, 0, runCount, positionX, positionZ, heights, normalX, normalY,
+                        normalZ);
+        break;
+      }
+    }
+
+    runBegin = runEnd;
+  }
+}
+
+void TerrainQueries::sampleScratch(size_t count, const float *positionX, const float *positionZ) {
+  sampleHeights.resize(count);
+  sampleNormalX.resize(count);
+  sampleNormalY.resize(count);
+  sampleNormalZ.resize(count);
+  sample(count, positionX, positionZ, sampleHeights.data(), sampleNormalX.data(), sampleNormalY.data(),
+         sampleNormalZ.data());
+}
+
+void TerrainQueries::sweepSpheres(const TerrainSweepQueries &queries, const TerrainSweepHits &hits) {
+  const auto count = queries.count;
+  const auto positionAt = [&](size_t sweep, float fraction) {
+    return glm::vec3(queries.startX[sweep] + (queries.endX[sweep] - queries.startX[sweep]) * fraction,
+                     queries.startY[sweep] + (queries.endY[sweep] - queries.startY[sweep]) * fraction,
+                     queries.startZ[sweep] + (queries.endZ[sweep] - queries.startZ[sweep]) * fraction);
+  };
+  const auto recordContact = [&](uint32_t sweep, size_t sampleIndex) {
+    if (hits.normalX != nullptr) {
+      hits.normalX[sweep] = sampleNormalX[sampleIndex];
+      hits.normalY[sweep] = sampleNormalY[sampleIndex];
+      hits.normalZ[sweep] = sampleNormalZ[sampleIndex];
+    }
+  };
+
+  // Every round samples the ground below all sweeps that are still in flight in one batch
+  const auto sampleActiveSweeps = [&](const auto &fractionOf) {
+    samplePositionX.resize(activeSweeps.size());
+    samplePositionZ.resize(activeSweeps.size());
+    for (size_t i = 0; i < activeSweeps.size(); ++i) {
+      const auto position = positionAt(activeSweeps[i], fractionOf(activeSweeps[i]));
+      samplePositionX[i] = position.x;
+      samplePositionZ[i] = position.z;
+    }
+    sampleScratch(activeSweeps.size(), samplePositionX.data(), samplePositionZ.data());
+  };
+  const auto isTouching = [&](uint32_t sweep, size_t sampleIndex, float fraction) {
+    return sphereClearance(positionAt(sweep, fraction).y, queries.radius[sweep], sampleHeights[sampleIndex],
+                           sampleNormalY[sampleIndex]) <= 0.0f;
+  };
+
+  sweepStepCounts.resize(count);
+  sweepSafeFractions.assign(count, 0.0f);
+  sweepContactFractions.assign(count, 1.0f);
+  activeSweeps.resize(count);
+  for (size_t sweep = 0; sweep < count; ++sweep) {
+    const auto moveX = queries.endX[sweep] - queries.startX[sweep];
+    const auto moveZ = queries.endZ[sweep] - queries.startZ[sweep];
+    const auto moveSamples = std::sqrt(moveX * moveX + moveZ * moveZ) / sampleSpacing;
+    sweepStepCounts[sweep] = std::max(1u, uint32_t(std::ceil(moveSamples / kSweepStepSize)));
+    hits.isHit[sweep] = 0;
+    hits.fraction[sweep] = 1.0f;
+    activeSweeps[sweep] = uint32_t(sweep);
+  }
+
+  // Shapes that already touch the ground at the start cannot move at all
+  sampleActiveSweeps([](uint32_t) { return 0.0f; });
+  auto keptCount = size_t(0);
+  for (size_t i = 0; i < activeSweeps.size(); ++i) {
+    const auto sweep = activeSweeps[i];
+    if (isTouching(sweep, i, 0.0f)) {
+      hits.isHit[sweep] = 1;
+      hits.fraction[sweep] = 0.0f;
+      recordContact(sweep, i);
+    } else {
+      activeSweeps[keptCount++] = sweep;
+    }
+  }
+  activeSweeps.resize(keptCount);
+
+  // Step along the sweeps until each one either touches the ground or reaches its end
+  touchingSweeps.clear();
+  for (uint32_t step = 1; !activeSweeps.empty(); ++step) {
+    const auto fractionOf = [&](uint32_t sweep) { return float(step) / float(sweepStepCounts[sweep]); };
+    sampleActiveSweeps(fractionOf);
+
+    keptCount = 0;
+    for (size_t i = 0; i < activeSweeps.size(); ++i) {
+      const auto sweep = activeSweeps[i];
+      if (isTouching(sweep, i, fractionOf(sweep))) {
+        sweepSafeFractions[sweep] = float(step - 1) / float(sweepStepCounts[sweep]);
+        sweepContactFractions[sweep] = fractionOf(sweep);
+        recordContact(sweep, i);
+        touchingSweeps.push_back(sweep);
+      } else if (step < sweepStepCounts[sweep]) {
+        activeSweeps[keptCount++] = sweep;
+      }
+    }
+    activeSweeps.resize(keptCount);
+  }
+
+  // Bisect the step in which the contact happened
+  activeSweeps.swap(touchingSweeps);
+  for (auto iteration = 0; iteration < kSweepRefineIterations && !activeSweeps.empty(); ++iteration) {
+    const auto fractionOf = [&](uint32_t sweep) {
+      return 0.5f * (sweepSafeFractions[sweep] + sweepContactFractions[sweep]);
+    };
+    sampleActiveSweeps(fractionOf);
+
+    for (size_t i = 0; i < activeSweeps.size(); ++i) {
+      const auto sweep = activeSweeps[i];
+      const auto fraction = fractionOf(sweep);
+      if (isTouching(sweep, i, fraction)) {
+        sweepContactFractions[sweep] = fraction;
+        recordContact(sweep, i);
+      } else {
+        sweepSafeFractions[sweep] = fraction;
+      }
+    }
+  }
+
+  for (const auto sweep : activeSweeps) {
+    hits.isHit[sweep] = 1;
+    hits.fraction[sweep] = sweepSafeFractions[sweep];
+  }
+  activeSweeps.clear();
+}
+
+void TerrainQueries::sweepCapsules(const TerrainSweepQueries &queries, const TerrainSweepHits &hits) {
+  capsuleSphereStartX.clear();
+  capsuleSphereStartY.clear();
+  capsuleSphereStartZ.clear();
+  capsuleSphereEndX.clear();
+  capsuleSphereEndY.clear();
+  capsuleSphereEndZ.clear();
+  capsuleSphereRadius.clear();
+  capsuleSphereOwners.clear();
+
+  for (size_t capsule = 0; capsule < queries.count; ++capsule) {
+    const glm::vec3 axis(queries.axisX[capsule], queries.axisY[capsule], queries.axisZ[capsule]);
+    const auto segmentCount = std::max(1, int(std::ceil(glm::length(axis) / sampleSpacing)));
+    for (auto sphere = 0; sphere <= segmentCount; ++sphere) {
+      const auto offset = axis * (float(sphere) / float(segmentCount));
+      capsuleSphereStartX.push_back(queries.startX[capsule] + offset.x);
+      capsuleSphereStartY.push_back(queries.startY[capsule] + offset.y);
+      capsuleSphereStartZ.push_back(queries.startZ[capsule] + offset.z);
+      capsuleSphereEndX.push_back(queries.endX[capsule] + offset.x);
+      capsuleSphereEndY.push_back(queries.endY[capsule] + offset.y);
+      capsuleSphereEndZ.push_back(queries.endZ[capsule] + offset.z);
+      capsuleSphereRadius.push_back(queries.radius[capsule]);
+      capsuleSphereOwners.push_back(uint32_t(capsule));
+    }
+  }
+
+  const auto sphereCount = capsuleSphereOwners.size();
+  capsuleSphereIsHit.resize(sphereCount);
+  capsuleSphereFractions.resize(sphereCount);
+  capsuleSphereNormalX.resize(sphereCount);
+  capsuleSphereNormalY.resize(sphereCount);
+  capsuleSphereNormalZ.resize(sphereCount);
+
+  TerrainSweepQueries sphereQueries;
+  sphereQueries.count = sphereCount;
+  sphereQueries.startX = capsuleSphereStartX.data();
+  sphereQueries.startY = capsuleSphereStartY.data();
+  sphereQueries.startZ = capsuleSphereStartZ.data();
+  sphereQueries.endX = capsuleSphereEndX.data();
+  sphereQueries.endY = capsuleSphereEndY.data();
+  sphereQueries.endZ = capsuleSphereEndZ.data();
+  sphereQueries.radius = capsuleSphereRadius.data();
+
+  TerrainSweepHits sphereHits;
+  sphereHits.isHit = capsuleSphereIsHit.data();
+  sphereHits.fraction = capsuleSphereFractions.data();
+  sphereHits.normalX = capsuleSphereNormalX.data();
+  sphereHits.normalY = capsuleSphereNormalY.data();
+  sphereHits.normalZ = capsuleSphereNormalZ.data();
+  sweepSpheres(sphereQueries, sphereHits);
+
+  for (size_t capsule = 0; capsule < queries.count; ++capsule) {
+    hits.isHit[capsule] = 0;
+    hits.fraction[capsule] = 1.0f;
+  }
+
+  // The capsule stops where its first sphere does
+  for (size_t sphere = 0; sphere < sphereCount; ++sphere) {
+    const auto capsule = capsuleSphereOwners[sphere];
+    if (capsuleSphereIsHit[sphere] == 0 ||
+        (hits.isHit[capsule] != 0 && capsuleSphereFractions[sphere] >= hits.fraction[capsule])) {
+      continue;
+    }
+
+    hits.isHit[capsule] = 1;
+    hits.fraction[capsule] = capsuleSphereFractions[sphere];
+    if (hits.normalX != nullptr) {
+      hits.normalX[capsule] = capsuleSphereNormalX[sphere];
+      hits.normalY[capsule] = capsuleSphereNormalY[sphere];
+      hits.normalZ[capsule] = capsuleSphereNormalZ[sphere];
+    }
+  }
+}
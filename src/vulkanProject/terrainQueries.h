@@ -0,0 +1,97 @@
+#pragma once
+
+#include "simdUtils.h"
+#include "terrainChunks.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Structure of arrays, every array holds count elements. Capsules are the segment from a position to
+// position + axis, swept from start to end without rotating.
+struct TerrainSweepQueries {
+  size_t count = 0;
+  const float *startX = nullptr;
+  const float *startY = nullptr;
+  const float *startZ = nullptr;
+  const float *endX = nullptr;
+  const float *endY = nullptr;
+  const float *endZ = nullptr;
+  const float *radius = nullptr;
+  const float *axisX = nullptr; // Capsules only
+  const float *axisY = nullptr;
+  const float *axisZ = nullptr;
+};
+
+struct TerrainSweepHits {
+  uint8_t *isHit = nullptr;
+  float *fraction = nullptr; // Of the way from start to end the shape can move without touching the ground
+  float *normalX = nullptr;  // Ground normal at the contact, optional
+  float *normalY = nullptr;
+  float *normalZ = nullptr;
+};
+
+// Batched height, normal and sweep queries against the resident chunks, for simulations that query thousands
+// of agents per tick. Queries are sorted by chunk so each chunk is looked up once per batch and its samples
+// stay in cache, the bilinear interpolation then runs over 4 or 8 queries at a time with gathered corners.
+//
+// Heights and normals follow the bilinear surface through the heightmap samples, which is within a fraction
+// of a sample of the triangles drawn by the terrain mesh. Queries over chunks that are not resident return a
+// NaN height and never hit anything. The scratch buffers are reused between calls, so every thread needs
+// its own instance.
+class TerrainQueries {
+public:
+  typedef std::function<const TerrainChunk *(ChunkCoord)> FindChunkFunction;
+
+  // The chunk manager must outlive the queries, which may only run on the thread that calls its update()
+  explicit TerrainQueries(const ChunkManager *chunkManager);
+  TerrainQueries(int chunkSize, float sampleSpacing, FindChunkFunction findChunk);
+  TerrainQueries(int chunkSize, float sampleSpacing, FindChunkFunction findChunk, SimdLevel simdLevel);
+
+  // The normal arrays are optional
+  void sample(size_t count, const float *positionX, const float *positionZ, float *heights, float *normalX,
+              float *normalY, float *normalZ);
+  void sweepSpheres(const TerrainSweepQueries &queries, const TerrainSweepHits &hits);
+  // Tested as spheres along the axis at most one sample spacing apart
+  void sweepCapsules(const TerrainSweepQueries &queries, const TerrainSweepHits &hits);
+
+private:
+  // Samples the positions into the sample* scratch arrays
+  void sampleScratch(size_t count, const float *positionX, const float *positionZ);
+
+  int chunkSize;
+  float sampleSpacing;
+  FindChunkFunction findChunk;
+  SimdLevel simdLevel;
+
+  std::vector<ChunkCoord> queryCoords;
+  std::vector<uint32_t> bucketOffsets;
+  std::vector<int32_t> sortedIndices; // Query indices grouped by chunk
+
+  std::vector<float> samplePositionX;
+  std::vector<float> samplePositionZ;
+  std::vector<float> sampleHeights;
+  std::vector<float> sampleNormalX;
+  std::vector<float> sampleNormalY;
+  std::vector<float> sampleNormalZ;
+
+  std::vector<uint32_t> activeSweeps;
+  std::vector<uint32_t> touchingSweeps;
+  std::vector<uint32_t> sweepStepCounts;
+  std::vector<float> sweepSafeFractions;    // Last fraction known to be clear of the ground
+  std::vector<float> sweepContactFractions; // First fraction known to touch it
+
+  std::vector<float> capsuleSphereStartX;
+  std::vector<float> capsuleSphereStartY;
+  std::vector<float> capsuleSphereStartZ;
+  std::vector<float> capsuleSphereEndX;
+  std::vector<float> capsuleSphereEndY;
+  std::vector<float> capsuleSphereEndZ;
+  std::vector<float> capsuleSphereRadius;
+  std::vector<uint32_t> capsuleSphereOwners;
+  std::vector<uint8_t> capsuleSphereIsHit;
+  std::vector<float> capsuleSphereFractions;
+  std::vector<float> capsuleSphereNormalX;
+  std::vector<float> capsuleSphereNormalY;
+  std::vector<float> capsuleSphereNormalZ;
+};
@@ -0,0 +1,49 @@
+#include "terrainRandom.h"
+
+#include <cstring>
+
+namespace {
+constexpr uint64_t kHashPrime1 = 0x9e3779b185ebca87ull;
+constexpr uint64_t kHashPrime2 = 0xc2b2ae3d27d4eb4full;
+constexpr auto kHashLaneCount = 4;
+
+uint64_t rotateLeft(uint64_t value, int bits) { return (value << bits) | (value >> (64 - bits)); }
+
+uint64_t loadWord(const uint8_t *bytes) {
+  uint64_t word;
+  std::memcpy(&word, bytes, sizeof(word));
+  return word;
+}
+
+uint64_t hashWord(uint64_t lane, uint64_t word) {
+  return rotateLeft(lane + word * kHashPrime2, 31) * kHashPrime1;
+}
+} // namespace
+
+void ContentHash::add(const void *data, size_t size) {
+  const auto bytes = static_cast<const uint8_t *>(data);
+
+  // Four independent lanes over 32 byte stripes keep several multiplies in flight, which is what makes
+  // hashing a chunk cheap next to generating it
+  uint64_t lanes[kHashLaneCount] = {state + kHashPrime1 + kHashPrime2, state + kHashPrime2, state,
+                                    state - kHashPrime1};
+  size_t offset = 0;
+  for (; offset + kHashLaneCount * sizeof(uint64_t) <= size; offset += kHashLaneCount * sizeof(uint64_t)) {
+    for (auto lane = 0; lane < kHashLaneCount; ++lane) {
+      lanes[lane] = hashWord(lanes[lane], loadWord(bytes + offset + size_t(lane) * sizeof(uint64_t)));
+    }
+  }
+
+  auto digest = uint64_t(size) * kHashPrime1;
+  for (auto lane = 0; lane < kHashLaneCount; ++lane) {
+    digest = rotateLeft(digest ^ hashWord(0, lanes[lane]), 27) * kHashPrime1 + kHashPrime2;
+  }
+  for (; offset + sizeof(uint64_t) <= size; offset += sizeof(uint64_t)) {
+    digest = rotateLeft(digest ^ hashWord(0, loadWord(bytes + offset)), 27) * kHashPrime1 + kHashPrime2;
+  }
+  for (; offset < size; ++offset) {
+    digest = rotateLeft(digest ^ (uint64_t(bytes[offset]) * kHashPrime2), 11) * kHashPrime1;
+  }
+
+  state = mixBits64(state ^ digest) + kHashPrime2;
+}
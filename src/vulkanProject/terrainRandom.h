@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Generation stages that draw random numbers, each one gets streams of its own. The noise needs none, its
+// lattice gradients are already a hash of the lattice coordinates and the seed.
+enum class GenerationStage : uint32_t { Erosion, Scatter };
+
+// SplitMix64 finalizer, a bijection that spreads every input bit over the whole output
+inline uint64_t mixBits64(uint64_t value) {
+  value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+  value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+  return value ^ (value >> 31);
+}
+
+// Key of an independent random stream for one stage of one chunk or tile. A stage that needs several
+// streams per chunk tells them apart by substream.
+inline uint64_t randomStreamKey(uint32_t seed, int32_t x, int32_t z, GenerationStage stage,
+                                uint32_t substream = 0) {
+  auto key = mixBits64((uint64_t(seed) << 32) | uint64_t(stage));
+  key = mixBits64(key ^ ((uint64_t(uint32_t(x)) << 32) | uint64_t(uint32_t(z))));
+  return mixBits64(key ^ uint64_t(substream));
+}
+
+// Counter-based generator: the n-th value of a stream is a pure function of its key and n, so results never
+// depend on which thread draws them or in which order the streams are consumed
+class CounterRandom {
+public:
+  explicit CounterRandom(uint64_t key, uint64_t counter = 0) : key(key), counter(counter) {}
+
+  static uint64_t valueAt(uint64_t key, uint64_t counter) {
+    return mixBits64(key + (counter + 1) * 0x9e3779b97f4a7c15ull);
+  }
+
+  uint64_t next() { return valueAt(key, counter++); }
+  float nextUnitFloat() { return float(next() >> 40) * (1.0f / 16777216.0f); } // [0, 1)
+
+private:
+  uint64_t key;
+  uint64_t counter;
+};
+
+// 64-bit hash of generated data for cache validation and regression checks, not suitable for anything
+// adversarial. Every add() hashes its whole block, so the result depends on how the data is split into
+// blocks as well as on the bytes themselves.
+class ContentHash {
+public:
+  void add(const void *data, size_t size);
+  template <typename T> void add(const std::vector<T> &values) {
+    add(values.data(), values.size() * sizeof(T));
+  }
+  template <typename T> void addValue(const T &value) { add(&value, sizeof(T)); }
+
+  uint64_t value() const { return mixBits64(state); }
+
+private:
+  uint64_t state = 0x243f6a8885a308d3ull;
+};
@@ -0,0 +1,347 @@
+#include "terrainRaycast.h"
+
+#include "terrainMesh.h"
+#include <algorithm>
+#include <cmath>
+#include <immintrin.h>
+#include <limits>
+
+namespace {
+constexpr auto kCellHitTolerance = 1.0e-4f;
+
+// Height range of the four corners of every cell between two heightmap rows
+void buildCellRangesScalar(const float *row0, const float *row1, int begin, int end, float *minHeights,
+                           float *maxHeights) {
+  for (auto x = begin; x < end; ++x) {
+    minHeights[x] = std::min(std::min(row0[x], row0[x + 1]), std::min(row1[x], row1[x + 1]));
+    maxHeights[x] = std::max(std::max(row0[x], row0[x + 1]), std::max(row1[x], row1[x + 1]));
+  }
+}
+
+SIMD_TARGET_SSE41 void buildCellRangesSse(const float *row0, const float *row1, int cellCount,
+                                          float *minHeights, float *maxHeights) {
+  auto x = 0;
+  for (; x + 4 <= cellCount; x += 4) {
+    const auto left0 = _mm_loadu_ps(row0 + x);
+    const auto right0 = _mm_loadu_ps(row0 + x + 1);
+    const auto left1 = _mm_loadu_ps(row1 + x);
+    const auto right1 = _mm_loadu_ps(row1 + x + 1);
+    _mm_storeu_ps(minHeights + x, _mm_min_ps(_mm_min_ps(left0, right0), _mm_min_ps(left1, right1)));
+    _mm_storeu_ps(maxHeights + x, _mm_max_ps(_mm_max_ps(left0, right0), _mm_max_ps(left1, right1)));
+  }
+
+  buildCellRangesScalar(row0, row1, x, cellCount, minHeights, maxHeights);
+}
+
+// One row of the next level from two rows of the finer one. An odd last column only has one child column,
+// an odd last row is passed as both rows.
+void downsampleRowScalar(const float *min0, const float *min1, const float *max0, const float *max1,
+                         int fineWidth, int begin, int end, float *minHeights, float *maxHeights) {
+  for (auto x = begin; x < end; ++x) {
+    const auto x0 = 2 * x;
+    const auto x1 = std::min(2 * x + 1, fineWidth - 1);
+    minHeights[x] = std::min(std::min(min0[x0], min0[x1]), std::min(min1[x0], min1[x1]));
+    maxHeights[x] = std::max(std::max(max0[x0], max0[x1]), std::max(max1[x0], max1[x1]));
+  }
+}
+
+SIMD_TARGET_SSE41 __m128 reducePairsSse(__m128 low, __m128 high, bool isMin) {
+  const auto even = _mm_shuffle_ps(low, high, _MM_SHUFFLE(2, 0, 2, 0));
+  const auto odd = _mm_shuffle_ps(low, high, _MM_SHUFFLE(3, 1, 3, 1));
+  return isMin ? _mm_min_ps(even, odd) : _mm_max_ps(even, odd);
+}
+
+SIMD_TARGET_SSE41 void downsampleRowSse(const float *min0, const float *min1, const float *max0,
+                                        const float *max1, int fineWidth, int coarseWidth, float *minHeights,
+                                        float *maxHeights) {
+  // Vertical pairs first, then the horizontal pairs are deinterleaved by shuffling
+  auto x = 0;
+  for (; x + 4 <= coarseWidth && 2 * x + 8 <= fineWidth; x += 4) {
+    const auto minLow = _mm_min_ps(_mm_loadu_ps(min0 + 2 * x), _mm_loadu_ps(min1 + 2 * x));
+    const auto minHigh = _mm_min_ps(_mm_loadu_ps(min0 + 2 * x + 4), _mm_loadu_ps(min1 + 2 * x + 4));
+    const auto maxLow = _mm_max_ps(_mm_loadu_ps(max0 + 2 * x), _mm_loadu_ps(max1 + 2 * x));
+    const auto maxHigh = _mm_max_ps(_mm_loadu_ps(max0 + 2 * x + 4), _mm_loadu_ps(max1 + 2 * x + 4));
+    _mm_storeu_ps(minHeights + x, reducePairsSse(minLow, minHigh, true));
+    _mm_storeu_ps(maxHeights + x, reducePairsSse(maxLow, maxHigh, false));
+  }
+
+  downsampleRowScalar(min0, min1, max0, max1, fineWidth, x, coarseWidth, minHeights, maxHeights);
+}
+
+// On a cell boundary the ray belongs to the cell it moves into. Rounding can put positions on the edge of the
+// pyramid slightly outside of it, those are clamped back.
+int cellIndex(float position, float direction, float cellSize, int cellCount) {
+  const auto cell =
+      direction < 0.0f ? int(std::ceil(position / cellSize)) - 1 : int(std::floor(position / cellSize));
+  return std::clamp(cell, 0, cellCount - 1);
+}
+
+// Always makes progress, even when rounding puts the exit of a cell at or before the current distance
+float advanceDistance(float distance, float cellExit) {
+  return std::max(cellExit, std::nextafter(distance, std::numeric_limits<float>::infinity()));
+}
+
+// Two-sided Möller-Trumbore, returns a negative distance on a miss
+float intersectTriangle(const glm::vec3 &origin, const glm::vec3 &direction, const glm::vec3 &corner0,
+                        const glm::vec3 &corner1, const glm::vec3 &corner2) {
+  const auto edge1 = corner1 - corner0;
+  const auto edge2 = corner2 - corner0;
+  const auto directionCrossEdge2 = glm::cross(direction, edge2);
+  const auto determinant = glm::dot(edge1, directionCrossEdge2);
+  if (std::abs(determinant) < 1.0e-12f) {
+    return -1.0f;
+  }
+
+  const auto inverseDeterminant = 1.0f / determinant;
+  const auto originOffset = origin - corner0;
+  const auto u = glm::dot(originOffset, directionCrossEdge2) * inverseDeterminant;
+  if (u < 0.0f || u > 1.0f) {
+    return -1.0f;
+  }
+
+  const auto originCrossEdge1 = glm::cross(originOffset, edge1);
+  const auto v = glm::dot(direction, originCrossEdge1) * inverseDeterminant;
+  if (v < 0.0f || u + v > 1.0f) {
+    return -1.0f;
+  }
+
+  return glm::dot(edge2, originCrossEdge1) * inverseDeterminant;
+}
+} // namespace
+
+HeightPyramid::HeightPyramid(const Heightmap *heightmap, const glm::vec2 &origin, float sampleSpacing)
+    : HeightPyramid(heightmap, origin, sampleSpacing, detectSimdLevel()) {}
+
+HeightPyramid::HeightPyramid(const Heightmap *heightmap, const glm::vec2 &origin, float sampleSpacing,
+                             SimdLevel simdLevel)
+    : heightmap(heightmap), origin(origin), sampleSpacing(sampleSpacing) {
+  if (heightmap->width < 2 || heightmap->height < 2) {
+    return;
+  }
+
+  // Both passes are bound by memory bandwidth, AVX2 would not gain anything over SSE here
+  const auto isSimd = simdLevel != SimdLevel::Scalar;
+
+  Level cellLevel;
+  cellLevel.width = heightmap->width - 1;
+  cellLevel.height = heightmap->height - 1;
+  cellLevel.minHeights.resize(size_t(cellLevel.width) * size_t(cellLevel.height));
+  cellLevel.maxHeights.resize(cellLevel.minHeights.size());
+  for (auto y = 0; y < cellLevel.height; ++y) {
+    const auto offset = size_t(y) * size_t(cellLevel.width);
+    if (isSimd) {
+      buildCellRangesSse(heightmap->row(y), heightmap->row(y + 1), cellLevel.width,
+                         cellLevel.minHeights.data() + offset, cellLevel.maxHeights.data() + offset);
+    } else {
+      buildCellRangesScalar(heightmap->row(y), heightmap->row(y + 1), 0, cellLevel.width,
+                            cellLevel.minHeights.data() + offset, cellLevel.maxHeights.data() + offset);
+    }
+  }
+  levels.push_back(std::move(cellLevel));
+
+  while (levels.back().width > 1 || levels.back().height > 1) {
+    const auto &fineLevel = levels.back();
+    Level coarseLevel;
+    coarseLevel.width = (fineLevel.width + 1) / 2;
+    coarseLevel.height = (fineLevel.height + 1) / 2;
+    coarseLevel.minHeights.resize(size_t(coarseLevel.width) * size_t(coarseLevel.height));
+    coarseLevel.maxHeights.resize(coarseLevel.minHeights.size());
+
+    for (auto y = 0; y < coarseLevel.height; ++y) {
+      const auto fineOffset0 = size_t(2 * y) * size_t(fineLevel.width);
+      const auto fineOffset1 = size_t(std::min(2 * y + 1, fineLevel.height - 1)) * size_t(fineLevel.width);
+      const auto min0 = fineLevel.minHeights.data() + fineOffset0;
+      const auto min1 = fineLevel.minHeights.data() + fineOffset1;
+      const auto max0 = fineLevel.maxHeights.data() + fineOffset0;
+      const auto max1 = fineLevel.maxHeights.data() + fineOffset1;
+      const auto coarseMinHeights = coarseLevel.minHeights.data() + size_t(y) * size_t(coarseLevel.width);
+      const auto coarseMaxHeights = coarseLevel.maxHeights.data() + size_t(y) * size_t(coarseLevel.width);
+      if (isSimd) {
+        downsampleRowSse(min0, min1, max0, max1, fineLevel.width, coarseLevel.width, coarseMinHeights,
+                         coarseMaxHeights);
+      } else {
+        downsampleRowScalar(min0, min1, max0, max1, fineLevel.width, 0, coarseLevel.width, coarseMinHeights,
+                            coarseMaxHeights);
+      }
+    }
+
+    levels.push_back(std::move(coarseLevel));
+  }
+}
+
+void HeightPyramid::update(int x0, int y0, int x1, int y1) {
+  if (levels.empty()) {
+    return;
+  }
+
+  // A sample is a corner of the cells on both of its sides
+  auto cellX0 = std::max(x0 - 1, 0);
+  auto cellY0 = std::max(y0 - 1, 0);
+  auto cellX1 = std::min(x1, levels[0].width);
+  auto cellY1 = std::min(y1, levels[0].height);
+  if (cellX0 >= cellX1 || cellY0 >= cellY1) {
+    return;
+  }
+
+  auto &cellLevel = levels[0];
+  for (auto y = cellY0; y < cellY1; ++y) {
+    const auto offset = size_t(y) * size_t(cellLevel.width);
+    buildCellRangesScalar(heightmap->row(y), heightmap->row(y + 1), cellX0, cellX1,
+                          cellLevel.minHeights.data() + offset, cellLevel.maxHeights.data() + offset);
+  }
+
+  for (size_t level = 1; level < levels.size(); ++level) {
+    const auto &fineLevel = levels[level - 1];
+    auto &coarseLevel = levels[level];
+    cellX0 /= 2;
+    cellY0 /= 2;
+    cellX1 = (cellX1 + 1) / 2;
+    cellY1 = (cellY1 + 1) / 2;
+
+    for (auto y = cellY0; y < cellY1; ++y) {
+      const auto fineOffset0 = size_t(2 * y) * size_t(fineLevel.width);
+      const auto fineOffset1 = size_t(std::min(2 * y + 1, fineLevel.height - 1)) * size_t(fineLevel.width);
+      const auto coarseOffset = size_t(y) * size_t(coarseLevel.width);
+      const auto minHeights = fineLevel.minHeights.data();
+      const auto maxHeights = fineLevel.maxHeights.data();
+      downsampleRowScalar(minHeights + fineOffset0, minHeights + fineOffset1, maxHeights + fineOffset0,
+                          maxHeights + fineOffset1, fineLevel.width, cellX0, cellX1,
+                          coarseLevel.minHeights.data() + coarseOffset,
+                          coarseLevel.maxHeights.data() + coarseOffset);
+    }
+  }
+}
+
+TerrainRayHit HeightPyramid::raycast(const TerrainRay &ray) const {
+  TerrainRayHit hit;
+  const auto directionLength = glm::length(ray.direction);
+  if (levels.empty() || directionLength == 0.0f) {
+    return hit;
+  }
+
+  // Grid space has x and z in samples and keeps y in world units, distances along the ray stay the same
+  const auto worldDirection = ray.direction / directionLength;
+  const glm::vec3 gridOrigin((ray.origin.x - origin.x) / sampleSpacing, ray.origin.y,
+                             (ray.origin.z - origin.y) / sampleSpacing);
+  const glm::vec3 gridDirection(worldDirection.x / sampleSpacing, worldDirection.y,
+                                worldDirection.z / sampleSpacing);
+
+  const auto topLevel = int(levels.size()) - 1;
+  const glm::vec3 boundsMin(0.0f, levels.back().minHeights[0], 0.0f);
+  const glm::vec3 boundsMax(float(levels[0].width), levels.back().maxHeights[0], float(levels[0].height));
+  auto distance = 0.0f;
+  auto maxDistance = ray.maxDistance;
+  for (auto axis = 0; axis < 3; ++axis) {
+    if (gridDirection[axis] == 0.0f) {
+      if (gridOrigin[axis] < boundsMin[axis] || gridOrigin[axis] > boundsMax[axis]) {
+        return hit;
+      }
+      continue;
+    }
+
+    const auto distance0 = (boundsMin[axis] - gridOrigin[axis]) / gridDirection[axis];
+    const auto distance1 = (boundsMax[axis] - gridOrigin[axis]) / gridDirection[axis];
+    distance = std::max(distance, std::min(distance0, distance1));
+    maxDistance = std::min(maxDistance, std::max(distance0, distance1));
+  }
+
+  auto level = topLevel;
+  while (distance <= maxDistance) {
+    const auto position = gridOrigin + distance * gridDirection;
+    const auto cellSize = float(1 << level);
+    const auto cellX = cellIndex(position.x, gridDirection.x, cellSize, levels[size_t(level)].width);
+    const auto cellY = cellIndex(position.z, gridDirection.z, cellSize, levels[size_t(level)].height);
+
+    auto cellExit = maxDistance;
+    if (gridDirection.x != 0.0f) {
+      const auto boundaryX = (gridDirection.x > 0.0f ? float(cellX + 1) : float(cellX)) * cellSize;
+      cellExit = std::min(cellExit, (boundaryX - gridOrigin.x) / gridDirection.x);
+    }
+    if (gridDirection.z != 0.0f) {
+      const auto boundaryZ = (gridDirection.z > 0.0f ? float(cellY + 1) : float(cellY)) * cellSize;
+      cellExit = std::min(cellExit, (boundaryZ - gridOrigin.z) / gridDirection.z);
+    }
+
+    // Nodes the ray passes entirely above or below cannot contain a hit
+    const auto enterHeight = gridOrigin.y + distance * gridDirection.y;
+    const auto exitHeight = gridOrigin.y + std::max(cellExit, distance) * gridDirection.y;
+    if (std::min(enterHeight, exitHeight) > maxHeight(level, cellX, cellY) ||
+        std::max(enterHeight, exitHeight) < minHeight(level, cellX, cellY)) {
+      distance = advanceDistance(distance, cellExit);
+      level = std::min(level + 1, topLevel);
+      continue;
+    }
+
+    if (level > 0) {
+      --level;
+      continue;
+    }
+
+    if (intersectCell(cellX, cellY, gridOrigin, gridDirection, distance, cellExit, &hit)) {
+      hit.position = ray.origin + hit.distance * worldDirection;
+      return hit;
+    }
+
+    distance = advanceDistance(distance, cellExit);
+    level = std::min(level + 1, topLevel);
+  }
+
+  return hit;
+}
+
+void HeightPyramid::raycast(const TerrainRay *rays, size_t rayCount, TerrainRayHit *hits,
+                            JobSystem *jobSystem, size_t grainSize) const {
+  if (jobSystem == nullptr) {
+    for (size_t i = 0; i < rayCount; ++i) {
+      hits[i] = raycast(rays[i]);
+    }
+    return;
+  }
+
+  jobSystem->parallelFor(0, rayCount, grainSize, [&](size_t begin, size_t end) {
+    for (auto i = begin; i < end; ++i) {
+      hits[i] = raycast(rays[i]);
+    }
+  });
+}
+
+bool HeightPyramid::intersectCell(int x, int y, const glm::vec3 &origin, const glm::vec3 &direction,
+                                  float minDistance, float maxDistance, TerrainRayHit *hit) const {
+  const glm::vec3 corner00(float(x), heightmap->at(x, y), float(y));
+  const glm::vec3 corner10(float(x + 1), heightmap->at(x + 1, y), float(y));
+  const glm::vec3 corner01(float(x), heightmap->at(x, y + 1), float(y + 1));
+  const glm::vec3 corner11(float(x + 1), heightmap->at(x + 1, y + 1), float(y + 1));
+
+  // The same split as the terrain mesh
+  glm::vec3 triangles[2][3] = {{corner00, corner01, corner10}, {corner10, corner01, corner11}};
+  if (usesMainDiagonal(x, y, 1)) {
+    triangles[0][2] = corner11;
+    triangles[1][0] = corner00;
+    triangles[1][1] = corner11;
+    triangles[1][2] = corner10;
+  }
+
+  auto bestDistance = std::numeric_limits<float>::infinity();
+  const glm::vec3 *bestTriangle = nullptr;
+  for (const auto &triangle : triangles) {
+    const auto distance = intersectTriangle(origin, direction, triangle[0], triangle[1], triangle[2]);
+    if (distance >= 0.0f && distance >= minDistance - kCellHitTolerance &&
+        distance <= maxDistance + kCellHitTolerance && distance < bestDistance) {
+      bestDistance = distance;
+      bestTriangle = triangle;
+    }
+  }
+
+  if (bestTriangle == nullptr) {
+    return false;
+  }
+
+  // Back to world units before taking the normal, grid space is not uniformly scaled
+  const glm::vec3 scale(sampleSpacing, 1.0f, sampleSpacing);
+  auto normal = glm::normalize(
+      glm::cross((bestTriangle[1] - bestTriangle[0]) * scale, (bestTriangle[2] - bestTriangle[0]) * scale));
+  hit->isHit = true;
+  hit->distance = bestDistance;
+  hit->normal = normal.y < 0.0f ? -normal : normal;
+  return true;
+}
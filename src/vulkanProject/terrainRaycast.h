@@ -0,0 +1,75 @@
+#pragma once
+
+#include "glm/glm.hpp"
+#include "heightmap.h"
+#include "jobSystem.h"
+#include "simdUtils.h"
+#include <cstddef>
+#include <vector>
+
+struct TerrainRay {
+  glm::vec3 origin;
+  glm::vec3 direction; // Does not need to be normalized
+  float maxDistance = 1.0e30f;
+};
+
+struct TerrainRayHit {
+  bool isHit = false;
+  float distance = 0.0f; // Along the normalized direction
+  glm::vec3 position = glm::vec3(0.0f);
+  glm::vec3 normal = glm::vec3(0.0f, 1.0f, 0.0f);
+};
+
+// Min/max height pyramid over the cells of one heightmap tile, sample (x, y) lies at
+// (origin.x + x * sampleSpacing, height, origin.y + y * sampleSpacing). Level 0 holds the height range of
+// every cell's four corners, each further level the range of 2x2 cells of the level below. Rays hit the same
+// two triangles per cell that the terrain mesh draws, see usesMainDiagonal().
+//
+// Raycasts descend the pyramid like quadtree relief mapping: a node the ray passes entirely above is skipped
+// in one step, so open terrain costs a handful of nodes per ray instead of one step per cell.
+class HeightPyramid {
+public:
+  HeightPyramid() = default;
+  // The heightmap must outlive the pyramid, after its heights change the pyramid has to be rebuilt or updated
+  HeightPyramid(const Heightmap *heightmap, const glm::vec2 &origin, float sampleSpacing);
+  HeightPyramid(const Heightmap *heightmap, const glm::vec2 &origin, float sampleSpacing,
+                SimdLevel simdLevel);
+
+  // Refreshes the nodes covering the samples [x0, x1) x [y0, y1) after only those heights changed, e.g. by a
+  // sculpting brush. Costs the area of the rectangle plus one node per level, not a rebuild.
+  void update(int x0, int y0, int x1, int y1);
+
+  TerrainRayHit raycast(const TerrainRay &ray) const;
+  // Spreads the rays over the job system in batches of grainSize
+  void raycast(const TerrainRay *rays, size_t rayCount, TerrainRayHit *hits, JobSystem *jobSystem,
+               size_t grainSize = 256) const;
+
+  int levelCount() const { return int(levels.size()); }
+  int levelWidth(int level) const { return levels[size_t(level)].width; }
+  int levelHeight(int level) const { return levels[size_t(level)].height; }
+  float minHeight(int level, int x, int y) const {
+    return levels[size_t(level)].minHeights[index(level, x, y)];
+  }
+  float maxHeight(int level, int x, int y) const {
+    return levels[size_t(level)].maxHeights[index(level, x, y)];
+  }
+
+private:
+  struct Level {
+    int width = 0; // In cells of this level, the last row and column may cover fewer level 0 cells
+    int height = 0;
+    std::vector<float> minHeights;
+    std::vector<float> maxHeights;
+  };
+
+  size_t index(int level, int x, int y) const {
+    return size_t(y) * size_t(levels[size_t(level)].width) + size_t(x);
+  }
+  bool intersectCell(int x, int y, const glm::vec3 &origin, const glm::vec3 &direction, float minDistance,
+                     float maxDistance, TerrainRayHit *hit) const;
+
+  const Heightmap *heightmap = nullptr;
+  glm::vec2 origin = glm::vec2(0.0f);
+  float sampleSpacing = 1.0f;
+  std::vector<Level> levels;
+};
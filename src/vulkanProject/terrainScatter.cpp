@@ -0,0 +1,187 @@
+#include "terrainScatter.h"
+
+#include "terrainRandom.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+constexpr auto kTwoPi = 6.28318530718f;
+
+float sampleHeight(const Heightmap &heightmap, float x, float y) {
+  const auto x0 = std::clamp(int(x), 0, heightmap.width - 2);
+  const auto y0 = std::clamp(int(y), 0, heightmap.height - 2);
+  const auto fractionX = x - float(x0);
+  const auto fractionY = y - float(y0);
+  const auto top = glm::mix(heightmap.at(x0, y0), heightmap.at(x0 + 1, y0), fractionX);
+  const auto bottom = glm::mix(heightmap.at(x0, y0 + 1), heightmap.at(x0 + 1, y0 + 1), fractionX);
+  return glm::mix(top, bottom, fractionY);
+}
+
+float layerDensity(const ScatterLayer &layer, Biome biome, float slope) {
+  const auto slopeFade = 1.0f - std::clamp((slope - layer.maxSlope) / layer.slopeBlend, 0.0f, 1.0f);
+  return layer.biomeDensity[size_t(biome)] * slopeFade;
+}
+} // namespace
+
+std::vector<ScatterLayer> defaultScatterLayers() {
+  ScatterLayer trees;
+  trees.seed = 1;
+  trees.minDistance = 6.0f;
+  trees.maxSlope = 0.25f;
+  trees.biomeDensity[size_t(Biome::Tundra)] = 0.05f;
+  trees.biomeDensity[size_t(Biome::Taiga)] = 0.8f;
+  trees.biomeDensity[size_t(Biome::Grassland)] = 0.1f;
+  trees.biomeDensity[size_t(Biome::Forest)] = 0.9f;
+  trees.biomeDensity[size_t(Biome::Rainforest)] = 1.0f;
+
+  ScatterLayer bushes;
+  bushes.seed = 2;
+  bushes.minDistance = 2.5f;
+  bushes.minScale = 0.5f;
+  bushes.maxScale = 1.0f;
+  bushes.biomeDensity[size_t(Biome::Tundra)] = 0.2f;
+  bushes.biomeDensity[size_t(Biome::Taiga)] = 0.2f;
+  bushes.biomeDensity[size_t(Biome::Grassland)] = 0.5f;
+  bushes.biomeDensity[size_t(Biome::Forest)] = 0.3f;
+  bushes.biomeDensity[size_t(Biome::Desert)] = 0.05f;
+  bushes.biomeDensity[size_t(Biome::Rainforest)] = 0.6f;
+
+  ScatterLayer rocks;
+  rocks.seed = 3;
+  rocks.minDistance = 8.0f;
+  rocks.maxSlope = 0.6f;
+  rocks.minScale = 0.5f;
+  rocks.maxScale = 2.0f;
+  rocks.biomeDensity.fill(0.05f);
+  rocks.biomeDensity[size_t(Biome::Water)] = 0.0f;
+  rocks.biomeDensity[size_t(Biome::Beach)] = 0.1f;
+  rocks.biomeDensity[size_t(Biome::Rock)] = 0.5f;
+  rocks.biomeDensity[size_t(Biome::Tundra)] = 0.2f;
+  rocks.biomeDensity[size_t(Biome::Desert)] = 0.2f;
+
+  return {trees, bushes, rocks};
+}
+
+void generatePoissonDiskPoints(float width, float height, float minDistance, int candidateCount,
+                               uint64_t randomKey, std::vector<glm::vec2> *points) {
+  points->clear();
+  if (width < 0.0f || height < 0.0f || minDistance <= 0.0f) {
+    return;
+  }
+
+  const auto cellSize = minDistance / std::sqrt(2.0f);
+  const auto gridWidth = int(width / cellSize) + 1;
+  const auto gridHeight = int(height / cellSize) + 1;
+  std::vector<int32_t> grid(size_t(gridWidth) * size_t(gridHeight), -1); // Point index per cell
+  std::vector<uint32_t> activePoints;
+  CounterRandom random(randomKey);
+
+  const auto addPoint = [&](const glm::vec2 &point) {
+    const auto cellX = std::min(int(point.x / cellSize), gridWidth - 1);
+    const auto cellY = std::min(int(point.y / cellSize), gridHeight - 1);
+    grid[size_t(cellY) * size_t(gridWidth) + size_t(cellX)] = int32_t(points->size());
+    activePoints.push_back(uint32_t(points->size()));
+    points->push_back(point);
+  };
+
+  const auto isFarEnough = [&](const glm::vec2 &candidate) {
+    const auto cellX = std::min(int(candidate.x / cellSize), gridWidth - 1);
+    const auto cellY = std::min(int(candidate.y / cellSize), gridHeight - 1);
+    for (auto y = std::max(cellY - 2, 0); y <= std::min(cellY + 2, gridHeight - 1); ++y) {
+      for (auto x = std::max(cellX - 2, 0); x <= std::min(cellX + 2, gridWidth - 1); ++x) {
+        const auto pointIndex = grid[size_t(y) * size_t(gridWidth) + size_t(x)];
+        if (pointIndex >= 0) {
+          const auto offset = (*points)[size_t(pointIndex)] - candidate;
+          if (glm::dot(offset, offset) < minDistance * minDistance) {
+            return false;
+          }
+        }
+      }
+    }
+    return true;
+  };
+
+  addPoint({random.nextUnitFloat() * width, random.nextUnitFloat() * height});
+
+  while (!activePoints.empty()) {
+    const auto activeIndex = size_t(random.nextUnitFloat() * float(activePoints.size()));
+    const auto center = (*points)[activePoints[activeIndex]];
+
+    auto isRetired = true;
+    for (auto candidate = 0; candidate < candidateCount; ++candidate) {
+      // Uniform over the annulus between minDistance and 2 * minDistance
+      const auto radius = minDistance * std::sqrt(1.0f + 3.0f * random.nextUnitFloat());
+      const auto angle = kTwoPi * random.nextUnitFloat();
+      const auto point = center + radius * glm::vec2(std::cos(angle), std::sin(angle));
+      if (point.x >= 0.0f && point.x <= width && point.y >= 0.0f && point.y <= height && isFarEnough(point)) {
+        addPoint(point);
+        isRetired = false;
+        break;
+      }
+    }
+
+    if (isRetired) {
+      activePoints[activeIndex] = activePoints.back();
+      activePoints.pop_back();
+    }
+  }
+}
+
+void generateScatterPoints(const ScatterLayer &layer, float regionWidth, float regionHeight, int32_t regionX,
+                           int32_t regionZ, std::vector<glm::vec2> *points) {
+  const auto margin = 0.5f * layer.minDistance;
+  generatePoissonDiskPoints(regionWidth - 2.0f * margin, regionHeight - 2.0f * margin, layer.minDistance,
+                            layer.candidateCount,
+                            randomStreamKey(layer.seed, regionX, regionZ, GenerationStage::Scatter, 0),
+                            points);
+  for (auto &point : *points) {
+    point += margin;
+  }
+}
+
+void placeScatterInstances(const ScatterLayer &layer, uint32_t layerIndex,
+                           const std::vector<glm::vec2> &points, const Heightmap &heightmap,
+                           const void *normals, NormalEncoding normalEncoding, const BiomeMap &biomeMap,
+                           const glm::vec2 &origin, float sampleSpacing, int32_t regionX, int32_t regionZ,
+                           std::vector<ScatterInstance> *instances) {
+  const auto normalSize = normalEncodingSize(normalEncoding);
+  CounterRandom random(randomStreamKey(layer.seed, regionX, regionZ, GenerationStage::Scatter, 1));
+
+  for (const auto &point : points) {
+    // Random numbers are drawn for every point, so that the density mask never shifts the sequence
+    const auto keepThreshold = random.nextUnitFloat();
+    const auto rotation = kTwoPi * random.nextUnitFloat();
+    const auto scale = glm::mix(layer.minScale, layer.maxScale, random.nextUnitFloat());
+
+    const auto texelX = point.x / sampleSpacing;
+    const auto texelY = point.y / sampleSpacing;
+    const auto nearestX = std::min(int(texelX + 0.5f), heightmap.width - 1);
+    const auto nearestY = std::min(int(texelY + 0.5f), heightmap.height - 1);
+    const auto texelIndex = size_t(nearestY) * size_t(heightmap.width) + size_t(nearestX);
+    const auto normal =
+        decodeNormal(static_cast<const uint8_t *>(normals) + texelIndex * normalSize, normalEncoding);
+    if (keepThreshold >= layerDensity(layer, biomeMap.biomes[texelIndex], 1.0f - normal.y)) {
+      continue;
+    }
+
+    const auto worldPosition = origin + point;
+    const auto height = sampleHeight(heightmap, texelX, texelY);
+    instances->push_back({glm::vec3(worldPosition.x, height, worldPosition.y), rotation, scale, layerIndex});
+  }
+}
+
+void scatterObjects(const std::vector<ScatterLayer> &layers, const Heightmap &heightmap, const void *normals,
+                    NormalEncoding normalEncoding, const BiomeMap &biomeMap, const glm::vec2 &origin,
+                    float sampleSpacing, int32_t regionX, int32_t regionZ,
+                    std::vector<ScatterInstance> *instances) {
+  instances->clear();
+
+  const auto regionWidth = float(heightmap.width - 1) * sampleSpacing;
+  const auto regionHeight = float(heightmap.height - 1) * sampleSpacing;
+  std::vector<glm::vec2> points;
+  for (size_t layerIndex = 0; layerIndex < layers.size(); ++layerIndex) {
+    generateScatterPoints(layers[layerIndex], regionWidth, regionHeight, regionX, regionZ, &points);
+    placeScatterInstances(layers[layerIndex], uint32_t(layerIndex), points, heightmap, normals,
+                          normalEncoding, biomeMap, origin, sampleSpacing, regionX, regionZ, instances);
+  }
+}
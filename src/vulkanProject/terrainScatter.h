@@ -0,0 +1,62 @@
+#pragma once
+
+#include "glm/glm.hpp"
+#include "heightmap.h"
+#include "terrainBiomes.h"
+#include "terrainNormals.h"
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// One kind of scattered object. Every layer is a Poisson-disk point set thinned by its density mask, which
+// keeps the minimum distance intact. Layers are independent of each other, so a rock may end up under a tree.
+struct ScatterLayer {
+  uint32_t seed = 0;
+  float minDistance = 4.0f; // World units between two instances of this layer
+  int candidateCount = 30;  // Candidates tried around an active point before it is retired
+  std::array<float, kBiomeCount> biomeDensity = {}; // Fraction of the Poisson-disk points kept per biome
+  // Density fades out over slopeBlend above maxSlope, both as 1 - normal.y
+  float maxSlope = 0.35f;
+  float slopeBlend = 0.1f;
+  float minScale = 0.8f;
+  float maxScale = 1.2f;
+};
+
+// Trees, bushes and rocks
+std::vector<ScatterLayer> defaultScatterLayers();
+
+struct ScatterInstance {
+  glm::vec3 position; // World space, on the terrain surface
+  float rotation;     // Around the y axis in radians
+  float scale;
+  uint32_t layer; // Index into the scatter layers
+};
+
+// Bridson's algorithm over [0, width] x [0, height]. A background grid with cells of minDistance / sqrt(2)
+// holds at most one point per cell, so every candidate is checked against a 5x5 cell neighbourhood instead
+// of all previous points. The output only depends on the arguments, randomKey selects the CounterRandom
+// stream.
+void generatePoissonDiskPoints(float width, float height, float minDistance, int candidateCount,
+                               uint64_t randomKey, std::vector<glm::vec2> *points);
+
+// Poisson-disk points of one layer over a region, relative to its corner and minDistance / 2 away from its
+// edges. They only depend on the layer's seed, minDistance and candidateCount and on the region, so they can
+// be kept while the masks are edited.
+void generateScatterPoints(const ScatterLayer &layer, float regionWidth, float regionHeight, int32_t regionX,
+                           int32_t regionZ, std::vector<glm::vec2> *points);
+// Appends the points that pass the layer's biome and slope masks to instances
+void placeScatterInstances(const ScatterLayer &layer, uint32_t layerIndex,
+                           const std::vector<glm::vec2> &points, const Heightmap &heightmap,
+                           const void *normals, NormalEncoding normalEncoding, const BiomeMap &biomeMap,
+                           const glm::vec2 &origin, float sampleSpacing, int32_t regionX, int32_t regionZ,
+                           std::vector<ScatterInstance> *instances);
+
+// Scatters the layers over one region, typically a chunk. Texel (i, j) of the heightmap, normals and biome
+// map lies at origin + (i, j) * sampleSpacing. Every layer draws from streams keyed by its seed and
+// (regionX, regionZ), so regions can be scattered independently and in any order. Points keep
+// minDistance / 2 away from the region's edges, which keeps the minimum distance across the seams to the
+// neighbouring regions as well.
+void scatterObjects(const std::vector<ScatterLayer> &layers, const Heightmap &heightmap, const void *normals,
+                    NormalEncoding normalEncoding, const BiomeMap &biomeMap, const glm::vec2 &origin,
+                    float sampleSpacing, int32_t regionX, int32_t regionZ,
+                    std::vector<ScatterInstance> *instances);
@@ -0,0 +1,224 @@
+#include "terrainSculpt.h"
+
+#include <cmath>
+#include <limits>
+
+namespace {
+int floorDivide(int value, int divisor) {
+  return value >= 0 ? value / divisor : -((-value + divisor - 1) / divisor);
+}
+
+float brushFalloff(float distance, float radius) {
+  const auto t = distance / radius;
+  return t < 1.0f ? 1.0f - t * t * (3.0f - 2.0f * t) : 0.0f;
+}
+
+// Samples [x0, x1) x [z0, z1) in global sample space, where chunk (cx, cz) holds the samples from
+// (cx, cz) * chunkSize up to and including (cx + 1, cz + 1) * chunkSize
+struct SampleRect {
+  int x0;
+  int z0;
+  int x1;
+  int z1;
+};
+
+DirtyRect localRect(const SampleRect &rect, ChunkCoord coord, int chunkSize) {
+  const auto originX = coord.x * chunkSize;
+  const auto originZ = coord.z * chunkSize;
+  return {std::max(rect.x0 - originX, 0), std::max(rect.z0 - originZ, 0),
+          std::min(rect.x1 - originX, chunkSize + 1), std::min(rect.z1 - originZ, chunkSize + 1)};
+}
+} // namespace
+
+void applySculptBrush(ChunkManager *chunkManager, const SculptBrush &brush, const glm::vec2 &worldPosition,
+                      std::vector<SculptChunkEdit> *edits) {
+  const auto &parameters = chunkManager->streamingParameters();
+  const auto chunkSize = parameters.chunkSize;
+  const auto sampleCount = chunkSize + 1;
+  const auto missingHeight = std::numeric_limits<float>::quiet_NaN();
+
+  // A sample on a shared edge is held by up to four chunks with equal copies, any resident one will do
+  const auto heightAt = [&](int x, int z) {
+    for (const auto chunkZ : {floorDivide(z, chunkSize), floorDivide(z - 1, chunkSize)}) {
+      for (const auto chunkX : {floorDivide(x, chunkSize), floorDivide(x - 1, chunkSize)}) {
+        if (const auto chunk = chunkManager->findChunk({chunkX, chunkZ})) {
+          return chunk->heightmap().at(x - chunkX * chunkSize, z - chunkZ * chunkSize);
+        }
+      }
+    }
+    return missingHeight;
+  };
+
+  const auto center = worldPosition / parameters.sampleSpacing;
+  const auto radius = brush.radius / parameters.sampleSpacing;
+  const auto footprint = SampleRect{int(std::ceil(center.x - radius)), int(std::ceil(center.y - radius)),
+                                    int(std::floor(center.x + radius)) + 1,
+                                    int(std::floor(center.y + radius)) + 1};
+  if (radius <= 0.0f || footprint.x0 >= footprint.x1 || footprint.z0 >= footprint.z1) {
+    return;
+  }
+
+  // The pre-dab heights with a one sample halo for smoothing, so the result does not depend on the order the
+  // samples are visited in
+  const auto footprintWidth = footprint.x1 - footprint.x0;
+  const auto footprintHeight = footprint.z1 - footprint.z0;
+  const auto sourceWidth = footprintWidth + 2;
+  std::vector<float> sourceHeights(size_t(sourceWidth) * size_t(footprintHeight + 2));
+  for (auto z = 0; z < footprintHeight + 2; ++z) {
+    for (auto x = 0; x < sourceWidth; ++x) {
+      sourceHeights[size_t(z) * size_t(sourceWidth) + size_t(x)] =
+          heightAt(footprint.x0 + x - 1, footprint.z0 + z - 1);
+    }
+  }
+  const auto sourceAt = [&](int x, int z) {
+    return sourceHeights[size_t(z - footprint.z0 + 1) * size_t(sourceWidth) + size_t(x - footprint.x0 + 1)];
+  };
+
+  std::vector<float> newHeights(size_t(footprintWidth) * size_t(footprintHeight), missingHeight);
+  for (auto z = footprint.z0; z < footprint.z1; ++z) {
+    for (auto x = footprint.x0; x < footprint.x1; ++x) {
+      const auto height = sourceAt(x, z);
+      if (std::isnan(height)) {
+        continue;
+      }
+
+      const auto weight = brushFalloff(glm::length(glm::vec2(float(x), float(z)) - center), radius);
+      auto newHeight = height;
+      switch (brush.mode) {
+      case SculptMode::Raise:
+        newHeight = height + brush.strength * weight;
+        break;
+      case SculptMode::Lower:
+        newHeight = height - brush.strength * weight;
+        break;
+      case SculptMode::Smooth: {
+        auto sum = 0.0f;
+        auto count = 0;
+        for (auto dz = -1; dz <= 1; ++dz) {
+          for (auto dx = -1; dx <= 1; ++dx) {
+            const auto neighbour = sourceAt(x + dx, z + dz);
+            if (!std::isnan(neighbour)) {
+              sum += neighbour;
+              ++count;
+            }
+          }
+        }
+        newHeight = height + (sum / float(count) - height) * std::min(brush.strength * weight, 1.0f);
+        break;
+      }
+      case SculptMode::Flatten:
+        newHeight = height + (brush.targetHeight - height) * std::min(brush.strength * weight, 1.0f);
+        break;
+      }
+      newHeights[size_t(z - footprint.z0) * size_t(footprintWidth) + size_t(x - footprint.x0)] = newHeight;
+    }
+  }
+
+  // Normals read the heights one sample further out, so chunks next to the footprint may need new normals
+  // without any of their heights changing
+  const auto normalFootprint =
+      SampleRect{footprint.x0 - 1, footprint.z0 - 1, footprint.x1 + 1, footprint.z1 + 1};
+  const auto firstEdit = edits->size();
+  for (auto chunkZ = floorDivide(normalFootprint.z0, chunkSize) - 1;
+       chunkZ <= floorDivide(normalFootprint.z1, chunkSize); ++chunkZ) {
+    for (auto chunkX = floorDivide(normalFootprint.x0, chunkSize) - 1;
+         chunkX <= floorDivide(normalFootprint.x1, chunkSize); ++chunkX) {
+      const auto coord = ChunkCoord{chunkX, chunkZ};
+      const auto chunk = chunkManager->findChunk(coord);
+      if (chunk == nullptr) {
+        continue;
+      }
+
+      SculptChunkEdit edit;
+      edit.chunk = chunk;
+      edit.heights = localRect(footprint, coord, chunkSize);
+      edit.normals = localRect(normalFootprint, coord, chunkSize);
+      if (edit.normals.isEmpty()) {
+        continue;
+      }
+
+      // The chunk stops sharing its heights with the stage cache here, before anything is written
+      const auto heights = chunk->editHeights();
+      auto &heightmap = heights->heightmap;
+      auto minHeight = heights->minHeight;
+      auto maxHeight = heights->maxHeight;
+      auto isRescanNeeded = false;
+      for (auto z = edit.heights.z0; z < edit.heights.z1; ++z) {
+        const auto row = heightmap.row(z);
+        const auto globalZ = coord.z * chunkSize + z;
+        for (auto x = edit.heights.x0; x < edit.heights.x1; ++x) {
+          const auto globalX = coord.x * chunkSize + x;
+          const auto newHeight = newHeights[size_t(globalZ - footprint.z0) * size_t(footprintWidth) +
+                                            size_t(globalX - footprint.x0)];
+          if (!std::isnan(newHeight)) {
+            // Only an extreme that moves inwards can narrow the range, and only a rescan finds the new one
+            isRescanNeeded |= (row[x] == heights->minHeight && newHeight > row[x]) ||
+                              (row[x] == heights->maxHeight && newHeight < row[x]);
+            minHeight = std::min(minHeight, newHeight);
+            maxHeight = std::max(maxHeight, newHeight);
+            row[x] = newHeight;
+          }
+        }
+      }
+      if (isRescanNeeded) {
+        const auto minMaxHeights = std::minmax_element(heightmap.heights.begin(), heightmap.heights.end());
+        minHeight = *minMaxHeights.first;
+        maxHeight = *minMaxHeights.second;
+      }
+      heights->minHeight = minHeight;
+      heights->maxHeight = maxHeight;
+      edits->push_back(edit);
+    }
+  }
+
+  // Raise and Lower keep moving the same samples by up to strength per dab
+  const auto dabHeadroom = brush.mode == SculptMode::Raise || brush.mode == SculptMode::Lower
+                               ? kSculptDabHeadroom * std::abs(brush.strength)
+                               : 0.0f;
+
+  // Only once every copy of the shared edge samples has been written
+  const auto normalSize = normalEncodingSize(parameters.normalEncoding);
+  std::vector<float> haloHeights;
+  for (auto editIndex = firstEdit; editIndex < edits->size(); ++editIndex) {
+    auto &edit = (*edits)[editIndex];
+    const auto chunk = edit.chunk;
+    const auto heights = chunk->editHeights();
+    const auto &rect = edit.normals;
+
+    // Missing neighbours continue the slope at the chunk's own border, like computeHeightmapNormals()
+    const auto haloWidth = rect.width() + 2;
+    haloHeights.resize(size_t(haloWidth) * size_t(rect.height() + 2));
+    for (auto z = rect.z0 - 1; z <= rect.z1; ++z) {
+      for (auto x = rect.x0 - 1; x <= rect.x1; ++x) {
+        auto height = heightAt(chunk->coord.x * chunkSize + x, chunk->coord.z * chunkSize + z);
+        if (std::isnan(height)) {
+          const auto borderX = std::clamp(x, 0, chunkSize);
+          const auto borderZ = std::clamp(z, 0, chunkSize);
+          height = 2.0f * heights->heightmap.at(borderX, borderZ) -
+                   heights->heightmap.at(2 * borderX - x, 2 * borderZ - z);
+        }
+        haloHeights[size_t(z - rect.z0 + 1) * size_t(haloWidth) + size_t(x - rect.x0 + 1)] = height;
+      }
+    }
+    const auto normalOffset = (size_t(rect.z0) * size_t(sampleCount) + size_t(rect.x0)) * normalSize;
+    computeHaloedNormals(haloHeights.data() + haloWidth + 1, size_t(haloWidth), rect.width(), rect.height(),
+                         parameters.sampleSpacing, parameters.normalEncoding,
+                         heights->normals.data() + normalOffset, size_t(sampleCount));
+
+    if (!edit.heights.isEmpty()) {
+      const auto &vertexData = chunk->vertexData;
+      edit.needsFullRepack = heights->minHeight < vertexData.heightOffset ||
+                             heights->maxHeight - vertexData.heightOffset > vertexData.heightRange;
+      if (edit.needsFullRepack) {
+        // Repacking to exactly the new range would make the next dab on a peak or in a pit repack again
+        const auto headroom = std::max((heights->maxHeight - heights->minHeight) * kSculptRangeHeadroom,
+                                       dabHeadroom);
+        edit.heightOffset = heights->minHeight - headroom;
+        edit.heightRange = heights->maxHeight - heights->minHeight + 2.0f * headroom;
+      }
+    }
+    edit.vertices = edit.needsFullRepack ? DirtyRect{0, 0, sampleCount, sampleCount}
+                                         : rect.expanded(kMorphReach, sampleCount);
+    chunk->isContentHashDirty = true;
+  }
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "glm/glm.hpp"
+#include "terrainChunks.h"
+#include <algorithm>
+#include <vector>
+
+// A full repack requantizes a chunk with headroom on both sides of its heights: this fraction of their range,
+// or kSculptDabHeadroom dabs of a Raise or Lower brush if that is more
+constexpr float kSculptRangeHeadroom = 0.25f;
+constexpr float kSculptDabHeadroom = 16.0f;
+
+enum class SculptMode : uint32_t { Raise, Lower, Smooth, Flatten };
+
+// One dab of a brush. The falloff is a smoothstep from full strength at the center to zero at radius.
+struct SculptBrush {
+  SculptMode mode = SculptMode::Raise;
+  float radius = 8.0f; // World units
+  // Height change at the center in world units for Raise and Lower, the fraction of the way towards the
+  // neighbourhood average or targetHeight for Smooth and Flatten
+  float strength = 0.5f;
+  float targetHeight = 0.0f; // Flatten only
+};
+
+// Samples [x0, x1) x [z0, z1) of one chunk's heightmap
+struct DirtyRect {
+  int x0 = 0;
+  int z0 = 0;
+  int x1 = 0;
+  int z1 = 0;
+
+  bool isEmpty() const { return x0 >= x1 || z0 >= z1; }
+  int width() const { return x1 - x0; }
+  int height() const { return z1 - z0; }
+
+  DirtyRect merged(const DirtyRect &other) const {
+    if (isEmpty()) {
+      return other;
+    }
+    if (other.isEmpty()) {
+      return *this;
+    }
+    return {std::min(x0, other.x0), std::min(z0, other.z0), std::max(x1, other.x1), std::max(z1, other.z1)};
+  }
+
+  // Grown by margin on every side and clamped to a sampleCount x sampleCount grid
+  DirtyRect expanded(int margin, int sampleCount) const {
+    return {std::max(x0 - margin, 0), std::max(z0 - margin, 0), std::min(x1 + margin, sampleCount),
+            std::min(z1 + margin, sampleCount)};
+  }
+};
+
+// What one brush dab changed in one chunk. Every rect only covers what has to be refreshed downstream: the
+// heights rect for height pyramids and collision, the normals rect one sample further out, and the vertices
+// rect the packed vertices whose morph targets read any of those.
+struct SculptChunkEdit {
+  TerrainChunk *chunk = nullptr; // Valid until the next ChunkManager::update()
+  DirtyRect heights;
+  DirtyRect normals;
+  DirtyRect vertices;
+  // The heights left the range the uploaded vertices are quantized to, see ChunkVertexData::heightOffset
+  bool needsFullRepack = false;
+  // With needsFullRepack, the range to requantize the chunk to, including the headroom
+  float heightOffset = 0.0f;
+  float heightRange = 0.0f;
+};
+
+// Applies one dab centered on worldPosition (x, z) to the resident chunks it touches, including the chunks
+// that only share an edge or a normal halo with the footprint, and appends one edit per changed chunk.
+// Samples on a shared chunk edge are written to every chunk holding them, so the seams stay closed. The
+// chunks' min/max heights are updated from the dirty rect and their content hashes marked dirty, the packed
+// vertices are left to the caller.
+// Edits only live in the cached chunks: a chunk that is evicted or regenerated after
+// ChunkManager::setStreamingParameters() comes back without them.
+void applySculptBrush(ChunkManager *chunkManager, const SculptBrush &brush, const glm::vec2 &worldPosition,
+                      std::vector<SculptChunkEdit> *edits);
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "heightmap.h"
+#include "terrainBiomes.h"
+#include "terrainScatter.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Outputs of the chunk generation stages, see generateChunk()
+struct HeightStageResult {
+  Heightmap heightmap;
+  std::vector<uint8_t> normals;
+  float minHeight = 0.0f;
+  float maxHeight = 0.0f;
+};
+
+struct BiomeStageResult {
+  BiomeMap biomeMap;
+};
+
+// One layer, see generateScatterPoints()
+struct ScatterPointsResult {
+  std::vector<glm::vec2> points;
+};
+
+struct ScatterStageResult {
+  std::vector<ScatterInstance> instances;
+};
+
+// LRU of stage results keyed by the hash of everything the stage read, parameters and upstream results
+// alike. Safe to share between generation jobs, results are immutable once inserted.
+template <typename Result> class StageResultCache {
+public:
+  explicit StageResultCache(size_t capacity) : capacity(capacity) {}
+
+  std::shared_ptr<const Result> find(uint64_t key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    const auto entry = entries.find(key);
+    if (entry == entries.end()) {
+      ++missCount;
+      return nullptr;
+    }
+
+    ++hitCount;
+    lruOrder.splice(lruOrder.begin(), lruOrder, entry->second.lruPosition);
+    return entry->second.result;
+  }
+
+  void insert(uint64_t key, std::shared_ptr<const Result> result) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (entries.find(key) != entries.end()) {
+      return; // Another job computed the same result, both are identical
+    }
+
+    lruOrder.push_front(key);
+    entries[key] = {std::move(result), lruOrder.begin()};
+    while (entries.size() > capacity) {
+      entries.erase(lruOrder.back());
+      lruOrder.pop_back();
+    }
+  }
+
+  size_t hits() const { return hitCount.load(); }
+  size_t misses() const { return missCount.load(); }
+
+private:
+  struct Entry {
+    std::shared_ptr<const Result> result;
+    std::list<uint64_t>::iterator lruPosition;
+  };
+
+  size_t capacity;
+  std::mutex mutex;
+  std::unordered_map<uint64_t, Entry> entries;
+  std::list<uint64_t> lruOrder; // Most recently used first
+  std::atomic<size_t> hitCount = 0;
+  std::atomic<size_t> missCount = 0;
+};
+
+// An edit to the generation parameters only changes the keys of the stages that read them and of the stages
+// downstream of those, every other stage is served from here
+struct ChunkStageCache {
+  static constexpr size_t kScatterLayersPerChunk = 4; // Point sets cached per chunk
+
+  // In chunks
+  explicit ChunkStageCache(size_t capacity)
+      : heights(capacity), biomes(capacity), scatterPoints(capacity * kScatterLayersPerChunk),
+        scatter(capacity) {}
+
+  StageResultCache<HeightStageResult> heights;
+  StageResultCache<BiomeStageResult> biomes;
+  StageResultCache<ScatterPointsResult> scatterPoints; // Survive edits to everything but the point spacing
+  StageResultCache<ScatterStageResult> scatter;
+};
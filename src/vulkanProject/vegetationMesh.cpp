@@ -0,0 +1,58 @@
+#include "vegetationMesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+namespace {
+constexpr auto kConeHeight = 4.0f;
+constexpr auto kConeRadius = 1.5f;
+constexpr uint32_t kConeSideCount = 12;
+} // namespace
+
+VkVertexInputBindingDescription VegetationVertex::bindingDescription() {
+  VkVertexInputBindingDescription vertexInputBindingDescription = {};
+  vertexInputBindingDescription.binding = 0;
+  vertexInputBindingDescription.stride = sizeof(VegetationVertex);
+  vertexInputBindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+  return vertexInputBindingDescription;
+}
+
+std::array<VkVertexInputAttributeDescription, 2> VegetationVertex::attributeDescriptions() {
+  std::array<VkVertexInputAttributeDescription, 2> vertexInputAttributeDescriptions = {};
+
+  vertexInputAttributeDescriptions[0].location = 0;
+  vertexInputAttributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
+  vertexInputAttributeDescriptions[0].offset = offsetof(VegetationVertex, position);
+
+  vertexInputAttributeDescriptions[1].location = 1;
+  vertexInputAttributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
+  vertexInputAttributeDescriptions[1].offset = offsetof(VegetationVertex, normal);
+
+  return vertexInputAttributeDescriptions;
+}
+
+VegetationMesh buildVegetationMesh(uint32_t lod) {
+  const auto sideCount = std::max(kConeSideCount >> lod, 3u);
+  const glm::vec3 apex(0.0f, kConeHeight, 0.0f);
+
+  VegetationMesh mesh;
+  mesh.boundingRadius = std::max(kConeHeight, kConeRadius);
+  for (uint32_t side = 0; side < sideCount; ++side) {
+    const auto angle0 = 6.28318530718f * float(side) / float(sideCount);
+    const auto angle1 = 6.28318530718f * float(side + 1) / float(sideCount);
+    const glm::vec3 base0(kConeRadius * std::cos(angle0), 0.0f, kConeRadius * std::sin(angle0));
+    const glm::vec3 base1(kConeRadius * std::cos(angle1), 0.0f, kConeRadius * std::sin(angle1));
+    const auto normal = glm::normalize(glm::cross(apex - base0, base1 - base0));
+
+    const auto firstVertex = uint16_t(mesh.vertices.size());
+    mesh.vertices.push_back({base0, normal});
+    mesh.vertices.push_back({apex, normal});
+    mesh.vertices.push_back({base1, normal});
+    for (uint16_t corner = 0; corner < 3; ++corner) {
+      mesh.indices.push_back(uint16_t(firstVertex + corner));
+    }
+  }
+
+  return mesh;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "glm/glm.hpp"
+#include "vulkan/vulkan.h"
+#include <array>
+#include <cstdint>
+#include <vector>
+
+constexpr uint32_t kVegetationLodCount = 3; // LOD n is a cone with 12 >> n sides
+constexpr uint32_t kVegetationCullGroupSize = 64; // Must match local_size_x in shaders/vegetationCull.comp
+
+// Per-instance arrays of the instance storage buffer, in this order. Each array has one entry per instance
+// slot, Layer holds uint32_t bits. Must match shaders/vegetationCull.comp and shaders/vegetation.vert.
+enum class VegetationInstanceField : uint32_t { PositionX, PositionY, PositionZ, Rotation, Scale, Layer };
+constexpr uint32_t kVegetationInstanceFieldCount = 6;
+
+struct VegetationVertex {
+  glm::vec3 position;
+  glm::vec3 normal;
+
+  static VkVertexInputBindingDescription bindingDescription();
+  static std::array<VkVertexInputAttributeDescription, 2> attributeDescriptions();
+};
+
+struct VegetationMesh {
+  std::vector<VegetationVertex> vertices;
+  std::vector<uint16_t> indices;
+  float boundingRadius = 0.0f; // Around the origin at scale 1
+};
+
+// Flat shaded placeholder cone standing on the origin, shared by every scatter layer until there are real
+// meshes
+VegetationMesh buildVegetationMesh(uint32_t lod);
+
+// Must match the push_constant block in shaders/vegetationCull.comp
+struct VegetationCullPushConstants {
+  glm::vec4 frustumPlanes[6]; // See Frustum in terrainCulling.h
+  glm::vec3 cameraPosition;
+  uint32_t chunkInstanceCapacity;
+  glm::vec3 lodEndDistances; // The last one is the cull distance
+  float boundingRadius;
+};
+static_assert(sizeof(VegetationCullPushConstants) == 128,
+              "Vulkan only guarantees 128 bytes of push constants");
+
+// Must match the push_constant block in shaders/vegetation.vert
+struct VegetationDrawPushConstants {
+  glm::mat4 viewProjection;
+  uint32_t visibleInstanceOffset; // Start of the LOD's list in the visible instance buffer
+  uint32_t instanceCapacity;      // Length of every array in the instance buffer
+};
+static_assert(sizeof(VegetationDrawPushConstants) == 72,
+              "VegetationDrawPushConstants must match the std430 layout");
@@ -0,0 +1,80 @@
+#include "vulkanBuffer.h"
+
+#include "vulkanUtils.h"
+#include <cstring>
+#include <stdexcept>
+
+uint32_t findMemoryType(VkPhysicalDevice physicalDevice, uint32_t memoryTypeBits,
+                        VkMemoryPropertyFlags memoryPropertyFlags) {
+  VkPhysicalDeviceMemoryProperties physicalDeviceMemoryProperties;
+  vkGetPhysicalDeviceMemoryProperties(physicalDevice, &physicalDeviceMemoryProperties);
+
+  for (uint32_t i = 0; i < physicalDeviceMemoryProperties.memoryTypeCount; ++i) {
+    if ((memoryTypeBits & (1u << i)) &&
+        (physicalDeviceMemoryProperties.memoryTypes[i].propertyFlags & memoryPropertyFlags) ==
+            memoryPropertyFlags) {
+      return i;
+    }
+  }
+
+  throw std::runtime_error("Failed to find a suitable memory type!");
+}
+
+void createBuffer(VulkanSetupData *vulkanSetupData, VkDeviceSize size, VkBufferUsageFlags usage,
+                  VkMemoryPropertyFlags memoryPropertyFlags, VkBuffer *buffer, VkDeviceMemory *bufferMemory) {
+  VkBufferCreateInfo bufferCreateInfo = {};
+  bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferCreateInfo.size = size;
+  bufferCreateInfo.usage = usage;
+  bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+  if (vkCreateBuffer(vulkanSetupData->device, &bufferCreateInfo, nullptr, buffer) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create buffer!");
+  }
+
+  VkMemoryRequirements memoryRequirements;
+  vkGetBufferMemoryRequirements(vulkanSetupData->device, *buffer, &memoryRequirements);
+
+  VkMemoryAllocateInfo memoryAllocateInfo = {};
+  memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  memoryAllocateInfo.allocationSize = memoryRequirements.size;
+  memoryAllocateInfo.memoryTypeIndex =
+      findMemoryType(vulkanSetupData->physicalDevice, memoryRequirements.memoryTypeBits, memoryPropertyFlags);
+
+  if (vkAllocateMemory(vulkanSetupData->device, &memoryAllocateInfo, nullptr, bufferMemory) != VK_SUCCESS) {
+    vkDestroyBuffer(vulkanSetupData->device, *buffer, nullptr);
+    *buffer = VK_NULL_HANDLE;
+    throw std::runtime_error("Failed to allocate buffer memory!");
+  }
+
+  vkBindBufferMemory(vulkanSetupData->device, *buffer, *bufferMemory, 0);
+}
+
+void createHostVisibleBuffer(VulkanSetupData *vulkanSetupData, const void *data, VkDeviceSize size,
+                             VkBufferUsageFlags usage, VkBuffer *buffer, VkDeviceMemory *bufferMemory) {
+  const auto memoryPropertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+  createBuffer(vulkanSetupData, size, usage, memoryPropertyFlags, buffer, bufferMemory);
+
+  void *mappedMemory;
+  vkMapMemory(vulkanSetupData->device, *bufferMemory, 0, size, 0, &mappedMemory);
+  std::memcpy(mappedMemory, data, size_t(size));
+  vkUnmapMemory(vulkanSetupData->device, *bufferMemory);
+}
+
+void recordMemoryBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags sourceStages,
+                         VkAccessFlags sourceAccess, VkPipelineStageFlags destinationStages,
+                         VkAccessFlags destinationAccess) {
+  VkMemoryBarrier memoryBarrier = {};
+  memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  memoryBarrier.srcAccessMask = sourceAccess;
+  memoryBarrier.dstAccessMask = destinationAccess;
+  vkCmdPipelineBarrier(commandBuffer, sourceStages, destinationStages, 0, 1, &memoryBarrier, 0, nullptr, 0,
+                       nullptr);
+}
+
+void destroyBuffer(VulkanSetupData *vulkanSetupData, VkBuffer *buffer, VkDeviceMemory *bufferMemory) {
+  vkDestroyBuffer(vulkanSetupData->device, *buffer, nullptr);
+  vkFreeMemory(vulkanSetupData->device, *bufferMemory, nullptr);
+  *buffer = VK_NULL_HANDLE;
+  *bufferMemory = VK_NULL_HANDLE;
+}
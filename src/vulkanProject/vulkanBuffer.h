@@ -0,0 +1,18 @@
+#pragma once
+
+#include "vulkan/vulkan.h"
+
+struct VulkanSetupData;
+
+uint32_t findMemoryType(VkPhysicalDevice physicalDevice, uint32_t memoryTypeBits,
+                        VkMemoryPropertyFlags memoryPropertyFlags);
+void createBuffer(VulkanSetupData *vulkanSetupData, VkDeviceSize size, VkBufferUsageFlags usage,
+                  VkMemoryPropertyFlags memoryPropertyFlags, VkBuffer *buffer, VkDeviceMemory *bufferMemory);
+// Creates a host visible, coherent buffer and fills it with size bytes of data
+void createHostVisibleBuffer(VulkanSetupData *vulkanSetupData, const void *data, VkDeviceSize size,
+                             VkBufferUsageFlags usage, VkBuffer *buffer, VkDeviceMemory *bufferMemory);
+// Global memory barrier, enough for buffers shared by passes of the same queue
+void recordMemoryBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags sourceStages,
+                         VkAccessFlags sourceAccess, VkPipelineStageFlags destinationStages,
+                         VkAccessFlags destinationAccess);
+void destroyBuffer(VulkanSetupData *vulkanSetupData, VkBuffer *buffer, VkDeviceMemory *bufferMemory);
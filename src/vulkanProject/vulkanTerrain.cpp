@@ -0,0 +1,180 @@
+#include "vulkanTerrain.h"
+
+#include "terrainMesh.h"
+#include "vulkanBuffer.h"
+#include "vulkanUtils.h"
+#include "vulkanVegetation.h"
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+// Contiguous, an allocation that would wrap around the end of the ring starts at its beginning instead
+bool allocateStaging(VulkanSetupData *vulkanSetupData, VkDeviceSize size, VkDeviceSize *offset) {
+  auto &terrainData = vulkanSetupData->terrainData;
+  auto head = terrainData.stagingHead;
+  const auto position = head % terrainData.stagingRingSize;
+  if (position + size > terrainData.stagingRingSize) {
+    head += terrainData.stagingRingSize - position;
+  }
+  if (head + size - terrainData.stagingTail > terrainData.stagingRingSize) {
+    return false;
+  }
+
+  *offset = head % terrainData.stagingRingSize;
+  terrainData.stagingHead = head + size;
+  return true;
+}
+} // namespace
+
+void createTerrainIndexBuffers(VulkanSetupData *vulkanSetupData) {
+  auto &terrainData = vulkanSetupData->terrainData;
+  terrainData.indexBuffers.resize(kTerrainLodCount);
+  terrainData.indexBufferMemories.resize(kTerrainLodCount);
+  terrainData.indexCounts.resize(kTerrainLodCount);
+
+  for (uint32_t lod = 0; lod < kTerrainLodCount; ++lod) {
+    const auto indices = buildLodIndices(terrainData.chunkSize, lod);
+    createHostVisibleBuffer(vulkanSetupData, indices.data(), indices.size() * sizeof(uint16_t),
+                            VK_BUFFER_USAGE_INDEX_BUFFER_BIT, &terrainData.indexBuffers[lod],
+                            &terrainData.indexBufferMemories[lod]);
+    terrainData.indexCounts[lod] = uint32_t(indices.size());
+  }
+}
+
+void destroyTerrainIndexBuffers(VulkanSetupData *vulkanSetupData) {
+  auto &terrainData = vulkanSetupData->terrainData;
+  for (size_t lod = 0; lod < terrainData.indexBuffers.size(); ++lod) {
+    destroyBuffer(vulkanSetupData, &terrainData.indexBuffers[lod], &terrainData.indexBufferMemories[lod]);
+  }
+
+  terrainData.indexBuffers.clear();
+  terrainData.indexBufferMemories.clear();
+  terrainData.indexCounts.clear();
+}
+
+void createChunkGpuData(VulkanSetupData *vulkanSetupData, TerrainChunk *chunk) {
+  const auto &vertices = chunk->vertexData.vertices;
+  createHostVisibleBuffer(vulkanSetupData, vertices.data(), vertices.size() * sizeof(TerrainVertex),
+                          VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                          &chunk->gpuData.vertexBuffer,
+                          &chunk->gpuData.vertexBufferMemory);
+
+  std::vector<TerrainVertex>().swap(chunk->vertexData.vertices);
+
+  uploadChunkVegetation(vulkanSetupData, chunk);
+}
+
+void destroyChunkGpuData(VulkanSetupData *vulkanSetupData, ChunkGpuData *gpuData) {
+  // Frames in flight may still draw the chunk, so the buffer lives on until the frame being recorded is done
+  if (gpuData->vertexBuffer != VK_NULL_HANDLE) {
+    auto &terrainData = vulkanSetupData->terrainData;
+    terrainData.retiredVertexBuffers[terrainData.stagingFrame].push_back(
+        {gpuData->vertexBuffer, gpuData->vertexBufferMemory});
+    gpuData->vertexBuffer = VK_NULL_HANDLE;
+    gpuData->vertexBufferMemory = VK_NULL_HANDLE;
+  }
+
+  releaseChunkVegetation(vulkanSetupData, gpuData);
+}
+
+void createTerrainStagingRing(VulkanSetupData *vulkanSetupData) {
+  auto &terrainData = vulkanSetupData->terrainData;
+  createBuffer(vulkanSetupData, terrainData.stagingRingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+               &terrainData.stagingBuffer, &terrainData.stagingBufferMemory);
+  void *mappedStaging;
+  vkMapMemory(vulkanSetupData->device, terrainData.stagingBufferMemory, 0, VK_WHOLE_SIZE, 0, &mappedStaging);
+  terrainData.mappedStaging = static_cast<uint8_t *>(mappedStaging);
+
+  terrainData.stagingHead = 0;
+  terrainData.stagingTail = 0;
+  terrainData.stagingFrameEnds.assign(terrainData.stagingFrameCount, 0);
+  terrainData.stagingFrame = 0;
+  terrainData.retiredVertexBuffers.assign(terrainData.stagingFrameCount, {});
+}
+
+void destroyTerrainStagingRing(VulkanSetupData *vulkanSetupData) {
+  auto &terrainData = vulkanSetupData->terrainData;
+  vkUnmapMemory(vulkanSetupData->device, terrainData.stagingBufferMemory);
+  terrainData.mappedStaging = nullptr;
+  destroyBuffer(vulkanSetupData, &terrainData.stagingBuffer, &terrainData.stagingBufferMemory);
+  terrainData.stagingFrameEnds.clear();
+
+  for (auto &retiredBuffers : terrainData.retiredVertexBuffers) {
+    for (auto &retiredBuffer : retiredBuffers) {
+      destroyBuffer(vulkanSetupData, &retiredBuffer.buffer, &retiredBuffer.bufferMemory);
+    }
+  }
+  terrainData.retiredVertexBuffers.clear();
+}
+
+void beginTerrainUploadFrame(VulkanSetupData *vulkanSetupData, uint32_t frameIndex) {
+  auto &terrainData = vulkanSetupData->terrainData;
+  if (frameIndex >= terrainData.stagingFrameCount) {
+    throw std::runtime_error("Frame index exceeds the staging frame count!");
+  }
+
+  // The frame that last used this slot has finished, and with it every frame before it
+  terrainData.stagingFrameEnds[terrainData.stagingFrame] = terrainData.stagingHead;
+  terrainData.stagingFrame = frameIndex;
+  terrainData.stagingTail = std::max(terrainData.stagingTail, terrainData.stagingFrameEnds[frameIndex]);
+
+  for (auto &retiredBuffer : terrainData.retiredVertexBuffers[frameIndex]) {
+    destroyBuffer(vulkanSetupData, &retiredBuffer.buffer, &retiredBuffer.bufferMemory);
+  }
+  terrainData.retiredVertexBuffers[frameIndex].clear();
+}
+
+bool recordChunkVertexUpdate(VulkanSetupData *vulkanSetupData, VkCommandBuffer commandBuffer,
+                             const SculptChunkEdit &edit, NormalEncoding normalEncoding) {
+  const auto chunk = edit.chunk;
+  const auto &rect = edit.vertices;
+  if (rect.isEmpty() || chunk->gpuData.vertexBuffer == VK_NULL_HANDLE) {
+    return true;
+  }
+
+  auto heightOffset = chunk->vertexData.heightOffset;
+  auto heightRange = chunk->vertexData.heightRange;
+  if (edit.needsFullRepack) {
+    heightOffset = edit.heightOffset;
+    heightRange = edit.heightRange;
+  }
+
+  auto &terrainData = vulkanSetupData->terrainData;
+  const auto sampleCount = chunk->heightmap().width;
+  const auto rowSize = VkDeviceSize(rect.width()) * sizeof(TerrainVertex);
+  VkDeviceSize stagingOffset;
+  if (!allocateStaging(vulkanSetupData, rowSize * VkDeviceSize(rect.height()), &stagingOffset)) {
+    return false;
+  }
+
+  packTerrainVertexRect(chunk->heightmap(), chunk->normals().data(), normalEncoding, heightOffset,
+                        heightRange, MorphTarget::ChunkLods, rect.x0, rect.z0, rect.x1, rect.z1,
+                        reinterpret_cast<TerrainVertex *>(terrainData.mappedStaging + stagingOffset));
+
+  // Full rows are contiguous in the vertex buffer as well
+  std::vector<VkBufferCopy> regions;
+  const auto destinationOffset = [&](int z) {
+    return (VkDeviceSize(z) * VkDeviceSize(sampleCount) + VkDeviceSize(rect.x0)) * sizeof(TerrainVertex);
+  };
+  if (rect.width() == sampleCount) {
+    regions.push_back({stagingOffset, destinationOffset(rect.z0), rowSize * VkDeviceSize(rect.height())});
+  } else {
+    for (auto z = rect.z0; z < rect.z1; ++z) {
+      regions.push_back({stagingOffset + VkDeviceSize(z - rect.z0) * rowSize, destinationOffset(z), rowSize});
+    }
+  }
+
+  // Earlier frames may still be drawing from the vertices that are about to be overwritten
+  recordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                      0);
+  vkCmdCopyBuffer(commandBuffer, terrainData.stagingBuffer, chunk->gpuData.vertexBuffer,
+                  uint32_t(regions.size()), regions.data());
+  recordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                      VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+
+  chunk->vertexData.heightOffset = heightOffset;
+  chunk->vertexData.heightRange = heightRange;
+  return true;
+}
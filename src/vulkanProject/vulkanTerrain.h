@@ -0,0 +1,31 @@
+#pragma once
+
+#include "terrainChunks.h"
+#include "terrainSculpt.h"
+#include "vulkan/vulkan.h"
+
+struct VulkanSetupData;
+
+// One index buffer per LOD for vulkanSetupData->terrainData.chunkSize, shared by every chunk
+void createTerrainIndexBuffers(VulkanSetupData *vulkanSetupData);
+void destroyTerrainIndexBuffers(VulkanSetupData *vulkanSetupData);
+
+// Uploads the packed vertices and the scatter instances and releases the CPU copies, the heightmap is kept
+// for CPU side queries
+void createChunkGpuData(VulkanSetupData *vulkanSetupData, TerrainChunk *chunk);
+// Retires the vertex buffer and vegetation slot until the frame being recorded has finished
+void destroyChunkGpuData(VulkanSetupData *vulkanSetupData, ChunkGpuData *gpuData);
+
+void createTerrainStagingRing(VulkanSetupData *vulkanSetupData);
+void destroyTerrainStagingRing(VulkanSetupData *vulkanSetupData);
+// Has to be called once per frame before any update is recorded, after waiting for the fence of the frame
+// that last used frameIndex. Everything that frame staged is then free again, and so are the vertex buffers
+// of the chunks released while it was recorded.
+void beginTerrainUploadFrame(VulkanSetupData *vulkanSetupData, uint32_t frameIndex);
+// Repacks the vertices in edit.vertices into the staging ring and copies them into the chunk's vertex buffer
+// with one region per row, so a brush dab moves a few kilobytes instead of the whole chunk. An edit that
+// needs a full repack requantizes the chunk to edit.heightOffset and edit.heightRange. Has to be recorded
+// outside of a render pass. Returns false without recording anything when the ring is full, the edit should
+// then be retried in a later frame.
+bool recordChunkVertexUpdate(VulkanSetupData *vulkanSetupData, VkCommandBuffer commandBuffer,
+                             const SculptChunkEdit &edit, NormalEncoding normalEncoding);
@@ -1,8 +1,14 @@
 #include "vulkanUtils.h"
 
+#include "terrainMesh.h"
+#include "vegetationMesh.h"
+#include "vulkanBuffer.h"
 #include "vulkanDevice.h"
 #include "vulkanSwapChain.h"
+#include "vulkanTerrain.h"
+#include "vulkanVegetation.h"
 #include "windowDefs.h"
+#include <fstream>
 #include <iostream>
 
 #ifndef NDEBUG
@@ -81,8 +87,344 @@ void createInstance(VulkanSetupData *vulkanSetupData) {
     throw std::runtime_error("Failed to create VkInstance");
 }
 
-void createGraphicsPipeline() {
+std::vector<char> readShaderFile(const std::string &path) {
+  std::ifstream file(path, std::ios::ate | std::ios::binary);
+  if (!file.is_open()) {
+    throw std::runtime_error("Failed to open shader " + path);
+  }
+
+  std::vector<char> code(size_t(file.tellg()));
+  file.seekg(0);
+  file.read(code.data(), std::streamsize(code.size()));
+  return code;
+}
+
+VkShaderModule createShaderModule(VulkanSetupData *vulkanSetupData, const std::vector<char> &code) {
+  VkShaderModuleCreateInfo shaderModuleCreateInfo = {};
+  shaderModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+  shaderModuleCreateInfo.codeSize = code.size();
+  shaderModuleCreateInfo.pCode = reinterpret_cast<const uint32_t *>(code.data());
+
+  VkShaderModule shaderModule;
+  if (vkCreateShaderModule(vulkanSetupData->device, &shaderModuleCreateInfo, nullptr, &shaderModule) !=
+      VK_SUCCESS) {
+    throw std::runtime_error("Failed to create shader module!");
+  }
+
+  return shaderModule;
+}
+
+VkFormat findDepthFormat(VkPhysicalDevice physicalDevice) {
+  const VkFormat candidateFormats[] = {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT,
+                                      VK_FORMAT_D24_UNORM_S8_UINT};
+  for (const auto format : candidateFormats) {
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &formatProperties);
+    if (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) {
+      return format;
+    }
+  }
+
+  throw std::runtime_error("Failed to find a supported depth format!");
+}
+
+void createDepthResources(VulkanSetupData *vulkanSetupData) {
+  auto &depthData = vulkanSetupData->depthData;
+  depthData.depthFormat = findDepthFormat(vulkanSetupData->physicalDevice);
+
+  VkImageCreateInfo imageCreateInfo = {};
+  imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+  imageCreateInfo.extent.width = vulkanSetupData->swapChainData.swapChainExtent.width;
+  imageCreateInfo.extent.height = vulkanSetupData->swapChainData.swapChainExtent.height;
+  imageCreateInfo.extent.depth = 1;
+  imageCreateInfo.mipLevels = 1;
+  imageCreateInfo.arrayLayers = 1;
+  imageCreateInfo.format = depthData.depthFormat;
+  imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+  imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  imageCreateInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+  imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+  imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+  if (vkCreateImage(vulkanSetupData->device, &imageCreateInfo, nullptr, &depthData.depthImage) !=
+      VK_SUCCESS) {
+    throw std::runtime_error("Failed to create depth image!");
+  }
 
+  VkMemoryRequirements memoryRequirements;
+  vkGetImageMemoryRequirements(vulkanSetupData->device, depthData.depthImage, &memoryRequirements);
+
+  VkMemoryAllocateInfo memoryAllocateInfo = {};
+  memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  memoryAllocateInfo.allocationSize = memoryRequirements.size;
+  memoryAllocateInfo.memoryTypeIndex = findMemoryType(vulkanSetupData->physicalDevice,
+                                                      memoryRequirements.memoryTypeBits,
+                                                      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+  if (vkAllocateMemory(vulkanSetupData->device, &memoryAllocateInfo, nullptr, &depthData.depthImageMemory) !=
+      VK_SUCCESS) {
+    throw std::runtime_error("Failed to allocate depth image memory!");
+  }
+  vkBindImageMemory(vulkanSetupData->device, depthData.depthImage, depthData.depthImageMemory, 0);
+
+  VkImageViewCreateInfo imageViewCreateInfo = {};
+  imageViewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  imageViewCreateInfo.image = depthData.depthImage;
+  imageViewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+  imageViewCreateInfo.format = depthData.depthFormat;
+  imageViewCreateInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+  imageViewCreateInfo.subresourceRange.baseMipLevel = 0;
+  imageViewCreateInfo.subresourceRange.levelCount = 1;
+  imageViewCreateInfo.subresourceRange.baseArrayLayer = 0;
+  imageViewCreateInfo.subresourceRange.layerCount = 1;
+
+  if (vkCreateImageView(vulkanSetupData->device, &imageViewCreateInfo, nullptr, &depthData.depthImageView) !=
+      VK_SUCCESS) {
+    throw std::runtime_error("Failed to create depth image view!");
+  }
+}
+
+void createRenderPass(VulkanSetupData *vulkanSetupData) {
+  VkAttachmentDescription attachmentDescriptions[2] = {};
+  auto &colorAttachment = attachmentDescriptions[0];
+  colorAttachment.format = vulkanSetupData->swapChainData.swapChainImageFormat;
+  colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+  colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+  colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+  auto &depthAttachment = attachmentDescriptions[1];
+  depthAttachment.format = vulkanSetupData->depthData.depthFormat;
+  depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+  depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+  VkAttachmentReference colorAttachmentReference = {0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+  VkAttachmentReference depthAttachmentReference = {1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+
+  VkSubpassDescription subpassDescription = {};
+  subpassDescription.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+  subpassDescription.colorAttachmentCount = 1;
+  subpassDescription.pColorAttachments = &colorAttachmentReference;
+  subpassDescription.pDepthStencilAttachment = &depthAttachmentReference;
+
+  VkSubpassDependency subpassDependency = {};
+  subpassDependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+  subpassDependency.dstSubpass = 0;
+  subpassDependency.srcStageMask =
+      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+  subpassDependency.dstStageMask =
+      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+  subpassDependency.dstAccessMask =
+      VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+  VkRenderPassCreateInfo renderPassCreateInfo = {};
+  renderPassCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+  renderPassCreateInfo.attachmentCount = 2;
+  renderPassCreateInfo.pAttachments = attachmentDescriptions;
+  renderPassCreateInfo.subpassCount = 1;
+  renderPassCreateInfo.pSubpasses = &subpassDescription;
+  renderPassCreateInfo.dependencyCount = 1;
+  renderPassCreateInfo.pDependencies = &subpassDependency;
+
+  if (vkCreateRenderPass(vulkanSetupData->device, &renderPassCreateInfo, nullptr,
+                         &vulkanSetupData->renderPass) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create render pass!");
+  }
+}
+
+VkPipelineLayout createPipelineLayout(VulkanSetupData *vulkanSetupData,
+                                      VkDescriptorSetLayout descriptorSetLayout,
+                                      const VkPushConstantRange &pushConstantRange) {
+  VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
+  pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pipelineLayoutCreateInfo.setLayoutCount = descriptorSetLayout != VK_NULL_HANDLE ? 1 : 0;
+  pipelineLayoutCreateInfo.pSetLayouts = &descriptorSetLayout;
+  pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+  pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+
+  VkPipelineLayout pipelineLayout;
+  if (vkCreatePipelineLayout(vulkanSetupData->device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayout) !=
+      VK_SUCCESS) {
+    throw std::runtime_error("Failed to create pipeline layout!");
+  }
+
+  return pipelineLayout;
+}
+
+// Opaque, depth tested triangle lists in the render pass, with dynamic viewport and scissor
+VkPipeline createGraphicsPipeline(VulkanSetupData *vulkanSetupData, const std::string &vertexShaderPath,
+                                  const std::string &fragmentShaderPath,
+                                  const VkVertexInputBindingDescription &vertexBindingDescription,
+                                  const VkVertexInputAttributeDescription *vertexAttributeDescriptions,
+                                  uint32_t vertexAttributeDescriptionCount, VkPipelineLayout pipelineLayout) {
+  const auto vertexShaderModule = createShaderModule(vulkanSetupData, readShaderFile(vertexShaderPath));
+  const auto fragmentShaderModule = createShaderModule(vulkanSetupData, readShaderFile(fragmentShaderPath));
+
+  VkPipelineShaderStageCreateInfo shaderStageCreateInfos[2] = {};
+  shaderStageCreateInfos[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  shaderStageCreateInfos[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+  shaderStageCreateInfos[0].module = vertexShaderModule;
+  shaderStageCreateInfos[0].pName = "main";
+  shaderStageCreateInfos[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  shaderStageCreateInfos[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+  shaderStageCreateInfos[1].module = fragmentShaderModule;
+  shaderStageCreateInfos[1].pName = "main";
+
+  VkPipelineVertexInputStateCreateInfo vertexInputStateCreateInfo = {};
+  vertexInputStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+  vertexInputStateCreateInfo.vertexBindingDescriptionCount = 1;
+  vertexInputStateCreateInfo.pVertexBindingDescriptions = &vertexBindingDescription;
+  vertexInputStateCreateInfo.vertexAttributeDescriptionCount = vertexAttributeDescriptionCount;
+  vertexInputStateCreateInfo.pVertexAttributeDescriptions = vertexAttributeDescriptions;
+
+  VkPipelineInputAssemblyStateCreateInfo inputAssemblyStateCreateInfo = {};
+  inputAssemblyStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+  inputAssemblyStateCreateInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+  inputAssemblyStateCreateInfo.primitiveRestartEnable = VK_FALSE;
+
+  VkPipelineViewportStateCreateInfo viewportStateCreateInfo = {};
+  viewportStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+  viewportStateCreateInfo.viewportCount = 1;
+  viewportStateCreateInfo.scissorCount = 1;
+
+  VkPipelineRasterizationStateCreateInfo rasterizationStateCreateInfo = {};
+  rasterizationStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+  rasterizationStateCreateInfo.polygonMode = VK_POLYGON_MODE_FILL;
+  rasterizationStateCreateInfo.lineWidth = 1.0f;
+  rasterizationStateCreateInfo.cullMode = VK_CULL_MODE_BACK_BIT;
+  rasterizationStateCreateInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+
+  VkPipelineMultisampleStateCreateInfo multisampleStateCreateInfo = {};
+  multisampleStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+  multisampleStateCreateInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+  VkPipelineDepthStencilStateCreateInfo depthStencilStateCreateInfo = {};
+  depthStencilStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+  depthStencilStateCreateInfo.depthTestEnable = VK_TRUE;
+  depthStencilStateCreateInfo.depthWriteEnable = VK_TRUE;
+  depthStencilStateCreateInfo.depthCompareOp = VK_COMPARE_OP_LESS;
+
+  VkPipelineColorBlendAttachmentState colorBlendAttachmentState = {};
+  colorBlendAttachmentState.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+                                             VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+  colorBlendAttachmentState.blendEnable = VK_FALSE;
+
+  VkPipelineColorBlendStateCreateInfo colorBlendStateCreateInfo = {};
+  colorBlendStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+  colorBlendStateCreateInfo.attachmentCount = 1;
+  colorBlendStateCreateInfo.pAttachments = &colorBlendAttachmentState;
+
+  const VkDynamicState dynamicStates[] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+  VkPipelineDynamicStateCreateInfo dynamicStateCreateInfo = {};
+  dynamicStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+  dynamicStateCreateInfo.dynamicStateCount = 2;
+  dynamicStateCreateInfo.pDynamicStates = dynamicStates;
+
+  VkGraphicsPipelineCreateInfo graphicsPipelineCreateInfo = {};
+  graphicsPipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+  graphicsPipelineCreateInfo.stageCount = 2;
+  graphicsPipelineCreateInfo.pStages = shaderStageCreateInfos;
+  graphicsPipelineCreateInfo.pVertexInputState = &vertexInputStateCreateInfo;
+  graphicsPipelineCreateInfo.pInputAssemblyState = &inputAssemblyStateCreateInfo;
+  graphicsPipelineCreateInfo.pViewportState = &viewportStateCreateInfo;
+  graphicsPipelineCreateInfo.pRasterizationState = &rasterizationStateCreateInfo;
+  graphicsPipelineCreateInfo.pMultisampleState = &multisampleStateCreateInfo;
+  graphicsPipelineCreateInfo.pDepthStencilState = &depthStencilStateCreateInfo;
+  graphicsPipelineCreateInfo.pColorBlendState = &colorBlendStateCreateInfo;
+  graphicsPipelineCreateInfo.pDynamicState = &dynamicStateCreateInfo;
+  graphicsPipelineCreateInfo.layout = pipelineLayout;
+  graphicsPipelineCreateInfo.renderPass = vulkanSetupData->renderPass;
+  graphicsPipelineCreateInfo.subpass = 0;
+
+  VkPipeline graphicsPipeline;
+  const auto result = vkCreateGraphicsPipelines(vulkanSetupData->device, VK_NULL_HANDLE, 1,
+                                                &graphicsPipelineCreateInfo, nullptr, &graphicsPipeline);
+
+  vkDestroyShaderModule(vulkanSetupData->device, fragmentShaderModule, nullptr);
+  vkDestroyShaderModule(vulkanSetupData->device, vertexShaderModule, nullptr);
+
+  if (result != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create graphics pipeline!");
+  }
+
+  return graphicsPipeline;
+}
+
+VkPipeline createComputePipeline(VulkanSetupData *vulkanSetupData, const std::string &computeShaderPath,
+                                 VkPipelineLayout pipelineLayout) {
+  const auto computeShaderModule = createShaderModule(vulkanSetupData, readShaderFile(computeShaderPath));
+
+  VkComputePipelineCreateInfo computePipelineCreateInfo = {};
+  computePipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  computePipelineCreateInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  computePipelineCreateInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+  computePipelineCreateInfo.stage.module = computeShaderModule;
+  computePipelineCreateInfo.stage.pName = "main";
+  computePipelineCreateInfo.layout = pipelineLayout;
+
+  VkPipeline computePipeline;
+  const auto result = vkCreateComputePipelines(vulkanSetupData->device, VK_NULL_HANDLE, 1,
+                                               &computePipelineCreateInfo, nullptr, &computePipeline);
+
+  vkDestroyShaderModule(vulkanSetupData->device, computeShaderModule, nullptr);
+
+  if (result != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create compute pipeline!");
+  }
+
+  return computePipeline;
+}
+
+void createTerrainPipeline(VulkanSetupData *vulkanSetupData) {
+  // Per chunk origin and height dequantization, no descriptor sets are needed
+  VkPushConstantRange pushConstantRange = {};
+  pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+  pushConstantRange.offset = 0;
+  pushConstantRange.size = sizeof(TerrainPushConstants);
+  vulkanSetupData->pipelineLayout = createPipelineLayout(vulkanSetupData, VK_NULL_HANDLE, pushConstantRange);
+
+  // Chunks only bind their own compact vertex buffer, the index buffer is shared per LOD
+  const auto vertexAttributeDescriptions = TerrainVertex::attributeDescriptions();
+  vulkanSetupData->graphicsPipeline = createGraphicsPipeline(
+      vulkanSetupData, "shaders/terrain.vert.spv", "shaders/terrain.frag.spv",
+      TerrainVertex::bindingDescription(), vertexAttributeDescriptions.data(),
+      uint32_t(vertexAttributeDescriptions.size()), vulkanSetupData->pipelineLayout);
+}
+
+void createVegetationPipelines(VulkanSetupData *vulkanSetupData) {
+  auto &vegetationData = vulkanSetupData->vegetationData;
+
+  VkPushConstantRange cullingPushConstantRange = {};
+  cullingPushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  cullingPushConstantRange.offset = 0;
+  cullingPushConstantRange.size = sizeof(VegetationCullPushConstants);
+  vegetationData.cullingPipelineLayout =
+      createPipelineLayout(vulkanSetupData, vegetationData.descriptorSetLayout, cullingPushConstantRange);
+  vegetationData.cullingPipeline = createComputePipeline(vulkanSetupData, "shaders/vegetationCull.comp.spv",
+                                                         vegetationData.cullingPipelineLayout);
+
+  // Instance data comes from the storage buffers, only the LOD meshes are vertex buffers
+  VkPushConstantRange pushConstantRange = {};
+  pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+  pushConstantRange.offset = 0;
+  pushConstantRange.size = sizeof(VegetationDrawPushConstants);
+  vegetationData.pipelineLayout =
+      createPipelineLayout(vulkanSetupData, vegetationData.descriptorSetLayout, pushConstantRange);
+
+  const auto vertexAttributeDescriptions = VegetationVertex::attributeDescriptions();
+  vegetationData.graphicsPipeline = createGraphicsPipeline(
+      vulkanSetupData, "shaders/vegetation.vert.spv", "shaders/vegetation.frag.spv",
+      VegetationVertex::bindingDescription(), vertexAttributeDescriptions.data(),
+      uint32_t(vertexAttributeDescriptions.size()), vegetationData.pipelineLayout);
 }
 
 } // namespace
@@ -120,7 +462,11 @@ QueueFamilyIndices findQueueFamilies(VkPhysicalDevice physicalDevice, VkSurfaceK
   vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
 
   for (size_t i = 0; i < queueFamilies.size(); ++i) {
-    if (queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+    // Vegetation culling is dispatched into the graphics command buffer right before the draws that consume
+    // its output, so the graphics family has to support compute as well. Vulkan guarantees such a family
+    // whenever there is one with graphics.
+    const auto graphicsAndCompute = VkQueueFlags(VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT);
+    if ((queueFamilies[i].queueFlags & graphicsAndCompute) == graphicsAndCompute) {
       queueFamilyIndices.graphicsFamily = uint32_t(i);
     }
 
@@ -149,7 +495,14 @@ void initVulkan(VulkanSetupData *vulkanSetupData, GLFWwindow *window) {
   createSurface(vulkanSetupData, window);
   pickPhysicalDevice(vulkanSetupData);
   createLogicalDevice(vulkanSetupData);
+  createTerrainIndexBuffers(vulkanSetupData);
+  createTerrainStagingRing(vulkanSetupData);
+  createVegetationResources(vulkanSetupData);
   createSwapChain(vulkanSetupData, window);
+  createDepthResources(vulkanSetupData);
+  createRenderPass(vulkanSetupData);
+  createTerrainPipeline(vulkanSetupData);
+  createVegetationPipelines(vulkanSetupData);
 }
 
 void cleanupVulkan(VulkanSetupData *vulkanSetupData) {
@@ -159,6 +512,24 @@ void cleanupVulkan(VulkanSetupData *vulkanSetupData) {
   cleanupDebugMessenger(&vulkanSetupData->instance);
 #endif
 
+  const auto &vegetationData = vulkanSetupData->vegetationData;
+  vkDestroyPipeline(vulkanSetupData->device, vegetationData.graphicsPipeline, nullptr);
+  vkDestroyPipelineLayout(vulkanSetupData->device, vegetationData.pipelineLayout, nullptr);
+  vkDestroyPipeline(vulkanSetupData->device, vegetationData.cullingPipeline, nullptr);
+  vkDestroyPipelineLayout(vulkanSetupData->device, vegetationData.cullingPipelineLayout, nullptr);
+
+  vkDestroyPipeline(vulkanSetupData->device, vulkanSetupData->graphicsPipeline, nullptr);
+  vkDestroyPipelineLayout(vulkanSetupData->device, vulkanSetupData->pipelineLayout, nullptr);
+  vkDestroyRenderPass(vulkanSetupData->device, vulkanSetupData->renderPass, nullptr);
+
+  vkDestroyImageView(vulkanSetupData->device, vulkanSetupData->depthData.depthImageView, nullptr);
+  vkDestroyImage(vulkanSetupData->device, vulkanSetupData->depthData.depthImage, nullptr);
+  vkFreeMemory(vulkanSetupData->device, vulkanSetupData->depthData.depthImageMemory, nullptr);
+
+  destroyVegetationResources(vulkanSetupData);
+  destroyTerrainStagingRing(vulkanSetupData);
+  destroyTerrainIndexBuffers(vulkanSetupData);
+
   for (auto imageView : vulkanSetupData->swapChainData.swapChainImageViews) {
     vkDestroyImageView(vulkanSetupData->device, imageView, nullptr);
   }
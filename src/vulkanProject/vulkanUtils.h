@@ -1,10 +1,12 @@
 #pragma once
 
+#include "glm/glm.hpp"
 #include "vulkan/vulkan.h"
 #include <optional>
 #include <vector>
 
 struct GLFWwindow;
+struct TerrainChunk;
 
 struct SwapChainSupportDetails {
   VkSurfaceCapabilitiesKHR surfaceCapabilities;
@@ -13,10 +15,16 @@ struct SwapChainSupportDetails {
 };
 
 struct QueueFamilyIndices {
-  std::optional<uint32_t> graphicsFamily;
+  std::optional<uint32_t> graphicsFamily; // Supports compute as well, for the vegetation culling
   std::optional<uint32_t> presentFamily;
 };
 
+// A buffer that frames in flight may still read, destroyed once their fences have signalled
+struct RetiredBuffer {
+  VkBuffer buffer = VK_NULL_HANDLE;
+  VkDeviceMemory bufferMemory = VK_NULL_HANDLE;
+};
+
 struct VulkanSetupData {
   VkInstance instance = nullptr;                    // Instance to vulkan library
   VkPhysicalDevice physicalDevice = VK_NULL_HANDLE; // Graphic card
@@ -33,6 +41,82 @@ struct VulkanSetupData {
     VkExtent2D swapChainExtent;
   } swapChainData;
 
+  struct {
+    VkImage depthImage = VK_NULL_HANDLE;
+    VkDeviceMemory depthImageMemory = VK_NULL_HANDLE;
+    VkImageView depthImageView = VK_NULL_HANDLE;
+    VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+  } depthData;
+
+  VkRenderPass renderPass = VK_NULL_HANDLE;
+  VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+  VkPipeline graphicsPipeline = VK_NULL_HANDLE;
+
+  struct {
+    int chunkSize = 128; // Has to match ChunkStreamingParameters::chunkSize
+    std::vector<VkBuffer> indexBuffers; // One per LOD, shared by all chunks
+    std::vector<VkDeviceMemory> indexBufferMemories;
+    std::vector<uint32_t> indexCounts;
+
+    // Staging ring for partial vertex updates after sculpting. Offsets count every byte ever allocated, the
+    // ring position is the offset modulo stagingRingSize.
+    VkDeviceSize stagingRingSize = 4 << 20;
+    uint32_t stagingFrameCount = 2; // Frames in flight that may still read from the ring
+    VkBuffer stagingBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory stagingBufferMemory = VK_NULL_HANDLE;
+    uint8_t *mappedStaging = nullptr;
+    VkDeviceSize stagingHead = 0; // Next allocation
+    VkDeviceSize stagingTail = 0; // Oldest allocation the GPU may still read
+    std::vector<VkDeviceSize> stagingFrameEnds; // stagingHead at the end of the last frame in each slot
+    uint32_t stagingFrame = 0;
+    // Vertex buffers of released chunks, per frame slot like stagingFrameEnds and freed by
+    // beginTerrainUploadFrame() once that slot comes around again
+    std::vector<std::vector<RetiredBuffer>> retiredVertexBuffers;
+  } terrainData;
+
+  struct {
+    uint32_t maxChunkCount = 512; // Has to cover ChunkStreamingParameters::maxCachedChunks
+    uint32_t chunkInstanceCapacity = 2048; // Instances per chunk slot, a multiple of kVegetationCullGroupSize
+    glm::vec3 lodEndDistances = glm::vec3(100.0f, 300.0f, 800.0f); // The last one is the cull distance
+    std::vector<uint32_t> freeChunkSlots;
+    // Released slots wait here until no frame in flight may still read them, see beginVegetationFrame()
+    uint32_t retireFrameCount = 2; // Frames in flight that may still draw a released slot
+    std::vector<std::vector<uint32_t>> retiredChunkSlots; // Released while recording the frame in each slot
+    uint32_t retireFrame = 0;
+    // Chunks that still hold their scatter instances because no slot was free, see uploadChunkVegetation()
+    std::vector<TerrainChunk *> waitingChunks;
+
+    // Written once per chunk when it is uploaded, the GPU reads them every frame
+    VkBuffer instanceBuffer = VK_NULL_HANDLE; // Structure of arrays, see VegetationInstanceField
+    VkDeviceMemory instanceBufferMemory = VK_NULL_HANDLE;
+    void *mappedInstances = nullptr;
+    VkBuffer chunkInstanceCountBuffer = VK_NULL_HANDLE; // Per chunk slot, 0 for free slots
+    VkDeviceMemory chunkInstanceCountBufferMemory = VK_NULL_HANDLE;
+    uint32_t *mappedChunkInstanceCounts = nullptr;
+
+    // Written by the culling pass and consumed by the indirect draws
+    VkBuffer visibleInstanceBuffer = VK_NULL_HANDLE; // One list of instance indices per LOD
+    VkDeviceMemory visibleInstanceBufferMemory = VK_NULL_HANDLE;
+    VkBuffer drawCommandBuffer = VK_NULL_HANDLE; // One VkDrawIndexedIndirectCommand per LOD
+    VkDeviceMemory drawCommandBufferMemory = VK_NULL_HANDLE;
+    std::vector<VkDrawIndexedIndirectCommand> drawCommands; // With instanceCount 0, copied before culling
+
+    // The meshes of all LODs
+    VkBuffer vertexBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory vertexBufferMemory = VK_NULL_HANDLE;
+    VkBuffer indexBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory indexBufferMemory = VK_NULL_HANDLE;
+    float boundingRadius = 0.0f;
+
+    VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE; // Shared by culling and drawing
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+    VkPipelineLayout cullingPipelineLayout = VK_NULL_HANDLE;
+    VkPipeline cullingPipeline = VK_NULL_HANDLE;
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline graphicsPipeline = VK_NULL_HANDLE;
+  } vegetationData;
+
   std::vector<const char *> extensions;
 };
 
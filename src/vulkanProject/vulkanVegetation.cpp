@@ -0,0 +1,349 @@
+#include "vulkanVegetation.h"
+
+#include "terrainCulling.h"
+#include "vegetationMesh.h"
+#include "vulkanBuffer.h"
+#include "vulkanUtils.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+constexpr uint32_t kVegetationBindingCount = 4;
+
+size_t instanceCapacity(const VulkanSetupData &vulkanSetupData) {
+  return size_t(vulkanSetupData.vegetationData.maxChunkCount) *
+         size_t(vulkanSetupData.vegetationData.chunkInstanceCapacity);
+}
+
+void createVegetationMeshBuffers(VulkanSetupData *vulkanSetupData) {
+  auto &vegetationData = vulkanSetupData->vegetationData;
+
+  std::vector<VegetationVertex> vertices;
+  std::vector<uint16_t> indices;
+  vegetationData.drawCommands.clear();
+  for (uint32_t lod = 0; lod < kVegetationLodCount; ++lod) {
+    const auto mesh = buildVegetationMesh(lod);
+
+    VkDrawIndexedIndirectCommand drawCommand = {};
+    drawCommand.indexCount = uint32_t(mesh.indices.size());
+    drawCommand.firstIndex = uint32_t(indices.size());
+    drawCommand.vertexOffset = int32_t(vertices.size());
+    vegetationData.drawCommands.push_back(drawCommand);
+
+    vertices.insert(vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+    indices.insert(indices.end(), mesh.indices.begin(), mesh.indices.end());
+    vegetationData.boundingRadius = std::max(vegetationData.boundingRadius, mesh.boundingRadius);
+  }
+
+  createHostVisibleBuffer(vulkanSetupData, vertices.data(), vertices.size() * sizeof(VegetationVertex),
+                          VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, &vegetationData.vertexBuffer,
+                          &vegetationData.vertexBufferMemory);
+  createHostVisibleBuffer(vulkanSetupData, indices.data(), indices.size() * sizeof(uint16_t),
+                          VK_BUFFER_USAGE_INDEX_BUFFER_BIT, &vegetationData.indexBuffer,
+                          &vegetationData.indexBufferMemory);
+}
+
+void createVegetationDescriptorSet(VulkanSetupData *vulkanSetupData) {
+  auto &vegetationData = vulkanSetupData->vegetationData;
+
+  // Instances, chunk instance counts, visible instances and draw commands
+  VkDescriptorSetLayoutBinding descriptorSetLayoutBindings[kVegetationBindingCount] = {};
+  for (uint32_t binding = 0; binding < kVegetationBindingCount; ++binding) {
+    descriptorSetLayoutBindings[binding].binding = binding;
+    descriptorSetLayoutBindings[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptorSetLayoutBindings[binding].descriptorCount = 1;
+    descriptorSetLayoutBindings[binding].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  }
+  descriptorSetLayoutBindings[0].stageFlags |= VK_SHADER_STAGE_VERTEX_BIT;
+  descriptorSetLayoutBindings[2].stageFlags |= VK_SHADER_STAGE_VERTEX_BIT;
+
+  VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo = {};
+  descriptorSetLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  descriptorSetLayoutCreateInfo.bindingCount = kVegetationBindingCount;
+  descriptorSetLayoutCreateInfo.pBindings = descriptorSetLayoutBindings;
+
+  if (vkCreateDescriptorSetLayout(vulkanSetupData->device, &descriptorSetLayoutCreateInfo, nullptr,
+                                  &vegetationData.descriptorSetLayout) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create vegetation descriptor set layout!");
+  }
+
+  VkDescriptorPoolSize descriptorPoolSize = {};
+  descriptorPoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  descriptorPoolSize.descriptorCount = kVegetationBindingCount;
+
+  VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {};
+  descriptorPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  descriptorPoolCreateInfo.maxSets = 1;
+  descriptorPoolCreateInfo.poolSizeCount = 1;
+  descriptorPoolCreateInfo.pPoolSizes = &descriptorPoolSize;
+
+  if (vkCreateDescriptorPool(vulkanSetupData->device, &descriptorPoolCreateInfo, nullptr,
+                             &vegetationData.descriptorPool) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create vegetation descriptor pool!");
+  }
+
+  VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = {};
+  descriptorSetAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  descriptorSetAllocateInfo.descriptorPool = vegetationData.descriptorPool;
+  descriptorSetAllocateInfo.descriptorSetCount = 1;
+  descriptorSetAllocateInfo.pSetLayouts = &vegetationData.descriptorSetLayout;
+
+  if (vkAllocateDescriptorSets(vulkanSetupData->device, &descriptorSetAllocateInfo,
+                               &vegetationData.descriptorSet) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to allocate vegetation descriptor set!");
+  }
+
+  const VkBuffer buffers[kVegetationBindingCount] = {
+      vegetationData.instanceBuffer, vegetationData.chunkInstanceCountBuffer,
+      vegetationData.visibleInstanceBuffer, vegetationData.drawCommandBuffer};
+  VkDescriptorBufferInfo descriptorBufferInfos[kVegetationBindingCount] = {};
+  VkWriteDescriptorSet writeDescriptorSets[kVegetationBindingCount] = {};
+  for (uint32_t binding = 0; binding < kVegetationBindingCount; ++binding) {
+    descriptorBufferInfos[binding].buffer = buffers[binding];
+    descriptorBufferInfos[binding].offset = 0;
+    descriptorBufferInfos[binding].range = VK_WHOLE_SIZE;
+
+    writeDescriptorSets[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writeDescriptorSets[binding].dstSet = vegetationData.descriptorSet;
+    writeDescriptorSets[binding].dstBinding = binding;
+    writeDescriptorSets[binding].descriptorCount = 1;
+    writeDescriptorSets[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    writeDescriptorSets[binding].pBufferInfo = &descriptorBufferInfos[binding];
+  }
+
+  vkUpdateDescriptorSets(vulkanSetupData->device, kVegetationBindingCount, writeDescriptorSets, 0, nullptr);
+}
+} // namespace
+
+void createVegetationResources(VulkanSetupData *vulkanSetupData) {
+  auto &vegetationData = vulkanSetupData->vegetationData;
+  if (vegetationData.chunkInstanceCapacity % kVegetationCullGroupSize != 0) {
+    throw std::runtime_error("Vegetation chunk instance capacity must be a multiple of the group size!");
+  }
+
+  const auto hostVisibleFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+  const auto capacity = instanceCapacity(*vulkanSetupData);
+
+  // Instances only ever get written when a chunk is uploaded, so they stay mapped
+  createBuffer(vulkanSetupData, capacity * kVegetationInstanceFieldCount * sizeof(float),
+               VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostVisibleFlags, &vegetationData.instanceBuffer,
+               &vegetationData.instanceBufferMemory);
+  if (vkMapMemory(vulkanSetupData->device, vegetationData.instanceBufferMemory, 0, VK_WHOLE_SIZE, 0,
+                  &vegetationData.mappedInstances) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to map vegetation instance buffer!");
+  }
+
+  createBuffer(vulkanSetupData, vegetationData.maxChunkCount * sizeof(uint32_t),
+               VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostVisibleFlags, &vegetationData.chunkInstanceCountBuffer,
+               &vegetationData.chunkInstanceCountBufferMemory);
+  void *mappedChunkInstanceCounts;
+  if (vkMapMemory(vulkanSetupData->device, vegetationData.chunkInstanceCountBufferMemory, 0, VK_WHOLE_SIZE, 0,
+                  &mappedChunkInstanceCounts) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to map vegetation chunk instance count buffer!");
+  }
+  vegetationData.mappedChunkInstanceCounts = static_cast<uint32_t *>(mappedChunkInstanceCounts);
+  std::fill_n(vegetationData.mappedChunkInstanceCounts, vegetationData.maxChunkCount, 0u);
+
+  vegetationData.freeChunkSlots.resize(vegetationData.maxChunkCount);
+  for (uint32_t slot = 0; slot < vegetationData.maxChunkCount; ++slot) {
+    vegetationData.freeChunkSlots[slot] = vegetationData.maxChunkCount - 1 - slot;
+  }
+  vegetationData.retiredChunkSlots.assign(vegetationData.retireFrameCount, {});
+  vegetationData.retireFrame = 0;
+
+  createBuffer(vulkanSetupData, capacity * kVegetationLodCount * sizeof(uint32_t),
+               VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+               &vegetationData.visibleInstanceBuffer, &vegetationData.visibleInstanceBufferMemory);
+  createBuffer(vulkanSetupData, kVegetationLodCount * sizeof(VkDrawIndexedIndirectCommand),
+               VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                   VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+               VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &vegetationData.drawCommandBuffer,
+               &vegetationData.drawCommandBufferMemory);
+
+  createVegetationMeshBuffers(vulkanSetupData);
+  createVegetationDescriptorSet(vulkanSetupData);
+}
+
+void destroyVegetationResources(VulkanSetupData *vulkanSetupData) {
+  auto &vegetationData = vulkanSetupData->vegetationData;
+
+  vkDestroyDescriptorPool(vulkanSetupData->device, vegetationData.descriptorPool, nullptr);
+  vkDestroyDescriptorSetLayout(vulkanSetupData->device, vegetationData.descriptorSetLayout, nullptr);
+  vegetationData.descriptorPool = VK_NULL_HANDLE;
+  vegetationData.descriptorSetLayout = VK_NULL_HANDLE;
+  vegetationData.descriptorSet = VK_NULL_HANDLE;
+
+  vkUnmapMemory(vulkanSetupData->device, vegetationData.instanceBufferMemory);
+  vkUnmapMemory(vulkanSetupData->device, vegetationData.chunkInstanceCountBufferMemory);
+  vegetationData.mappedInstances = nullptr;
+  vegetationData.mappedChunkInstanceCounts = nullptr;
+
+  destroyBuffer(vulkanSetupData, &vegetationData.instanceBuffer, &vegetationData.instanceBufferMemory);
+  destroyBuffer(vulkanSetupData, &vegetationData.chunkInstanceCountBuffer,
+                &vegetationData.chunkInstanceCountBufferMemory);
+  destroyBuffer(vulkanSetupData, &vegetationData.visibleInstanceBuffer,
+                &vegetationData.visibleInstanceBufferMemory);
+  destroyBuffer(vulkanSetupData, &vegetationData.drawCommandBuffer, &vegetationData.drawCommandBufferMemory);
+  destroyBuffer(vulkanSetupData, &vegetationData.vertexBuffer, &vegetationData.vertexBufferMemory);
+  destroyBuffer(vulkanSetupData, &vegetationData.indexBuffer, &vegetationData.indexBufferMemory);
+
+  vegetationData.freeChunkSlots.clear();
+  vegetationData.retiredChunkSlots.clear();
+  vegetationData.waitingChunks.clear();
+  vegetationData.drawCommands.clear();
+}
+
+void uploadChunkVegetation(VulkanSetupData *vulkanSetupData, TerrainChunk *chunk) {
+  auto &vegetationData = vulkanSetupData->vegetationData;
+  if (!chunk->scatter) {
+    return;
+  }
+  const auto &instances = chunk->scatter->instances;
+  if (instances.empty()) {
+    chunk->scatter.reset();
+    return;
+  }
+
+  // Running out of slots means maxChunkCount is below the number of chunks the cache holds. The chunk keeps
+  // its instances and is drawn without vegetation until beginVegetationFrame() has a slot for it.
+  if (vegetationData.freeChunkSlots.empty()) {
+    if (std::find(vegetationData.waitingChunks.begin(), vegetationData.waitingChunks.end(), chunk) ==
+        vegetationData.waitingChunks.end()) {
+      vegetationData.waitingChunks.push_back(chunk);
+    }
+    return;
+  }
+  const auto slot = vegetationData.freeChunkSlots.back();
+  vegetationData.freeChunkSlots.pop_back();
+
+  if (instances.size() > vegetationData.chunkInstanceCapacity) {
+    std::cerr << "Chunk (" << chunk->coord.x << ", " << chunk->coord.z << ") scatters " << instances.size()
+              << " vegetation instances, only the first " << vegetationData.chunkInstanceCapacity
+              << " are drawn" << std::endl;
+  }
+
+  const auto capacity = instanceCapacity(*vulkanSetupData);
+  const auto slotFields = static_cast<float *>(vegetationData.mappedInstances) +
+                          size_t(slot) * size_t(vegetationData.chunkInstanceCapacity);
+  const auto fieldArray = [&](VegetationInstanceField field) {
+    return slotFields + size_t(field) * capacity;
+  };
+
+  const auto instanceCount = std::min(uint32_t(instances.size()), vegetationData.chunkInstanceCapacity);
+  for (uint32_t i = 0; i < instanceCount; ++i) {
+    const auto &instance = instances[i];
+    fieldArray(VegetationInstanceField::PositionX)[i] = instance.position.x;
+    fieldArray(VegetationInstanceField::PositionY)[i] = instance.position.y;
+    fieldArray(VegetationInstanceField::PositionZ)[i] = instance.position.z;
+    fieldArray(VegetationInstanceField::Rotation)[i] = instance.rotation;
+    fieldArray(VegetationInstanceField::Scale)[i] = instance.scale;
+    std::memcpy(fieldArray(VegetationInstanceField::Layer) + i, &instance.layer, sizeof(uint32_t));
+  }
+
+  vegetationData.mappedChunkInstanceCounts[slot] = instanceCount;
+  chunk->gpuData.vegetationSlot = slot;
+  chunk->scatter.reset();
+}
+
+void releaseChunkVegetation(VulkanSetupData *vulkanSetupData, ChunkGpuData *gpuData) {
+  // The chunk is about to go away, so it must not be picked up from the waiting list anymore
+  auto &vegetationData = vulkanSetupData->vegetationData;
+  auto &waitingChunks = vegetationData.waitingChunks;
+  waitingChunks.erase(std::remove_if(waitingChunks.begin(), waitingChunks.end(),
+                                     [&](const TerrainChunk *chunk) { return &chunk->gpuData == gpuData; }),
+                      waitingChunks.end());
+
+  if (gpuData->vegetationSlot == kInvalidVegetationSlot) {
+    return;
+  }
+
+  // Frames still in flight may read either count, but the instances have to stay until they are done, so the
+  // slot is only handed out again once the current frame slot comes around
+  vegetationData.mappedChunkInstanceCounts[gpuData->vegetationSlot] = 0;
+  vegetationData.retiredChunkSlots[vegetationData.retireFrame].push_back(gpuData->vegetationSlot);
+  gpuData->vegetationSlot = kInvalidVegetationSlot;
+}
+
+void beginVegetationFrame(VulkanSetupData *vulkanSetupData, uint32_t frameIndex) {
+  auto &vegetationData = vulkanSetupData->vegetationData;
+  if (frameIndex >= vegetationData.retireFrameCount) {
+    throw std::runtime_error("Frame index exceeds the vegetation retire frame count!");
+  }
+
+  // The frame that last used this slot has finished, and with it every frame before it
+  auto &retiredSlots = vegetationData.retiredChunkSlots[frameIndex];
+  vegetationData.freeChunkSlots.insert(vegetationData.freeChunkSlots.end(), retiredSlots.begin(),
+                                       retiredSlots.end());
+  retiredSlots.clear();
+  vegetationData.retireFrame = frameIndex;
+
+  // Oldest first, each upload takes one of the slots just freed
+  auto &waitingChunks = vegetationData.waitingChunks;
+  size_t uploadedCount = 0;
+  while (uploadedCount < waitingChunks.size() && !vegetationData.freeChunkSlots.empty()) {
+    uploadChunkVegetation(vulkanSetupData, waitingChunks[uploadedCount++]);
+  }
+  waitingChunks.erase(waitingChunks.begin(), waitingChunks.begin() + ptrdiff_t(uploadedCount));
+}
+
+void recordVegetationCulling(VulkanSetupData *vulkanSetupData, VkCommandBuffer commandBuffer,
+                             const glm::mat4 &viewProjection, const glm::vec3 &cameraPosition) {
+  const auto &vegetationData = vulkanSetupData->vegetationData;
+
+  // The previous frame's draws have to be done with the lists before they are rewritten
+  const auto drawStages = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT;
+  recordMemoryBarrier(commandBuffer, drawStages, 0,
+                      VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0);
+  vkCmdUpdateBuffer(commandBuffer, vegetationData.drawCommandBuffer, 0,
+                    vegetationData.drawCommands.size() * sizeof(VkDrawIndexedIndirectCommand),
+                    vegetationData.drawCommands.data());
+  recordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                      VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+  const auto frustum = extractFrustum(viewProjection);
+  VegetationCullPushConstants pushConstants = {};
+  std::copy(std::begin(frustum.planes), std::end(frustum.planes), pushConstants.frustumPlanes);
+  pushConstants.cameraPosition = cameraPosition;
+  pushConstants.chunkInstanceCapacity = vegetationData.chunkInstanceCapacity;
+  pushConstants.lodEndDistances = vegetationData.lodEndDistances;
+  pushConstants.boundingRadius = vegetationData.boundingRadius;
+
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, vegetationData.cullingPipeline);
+  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, vegetationData.cullingPipelineLayout,
+                          0, 1, &vegetationData.descriptorSet, 0, nullptr);
+  vkCmdPushConstants(commandBuffer, vegetationData.cullingPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                     sizeof(pushConstants), &pushConstants);
+  vkCmdDispatch(commandBuffer, vegetationData.chunkInstanceCapacity / kVegetationCullGroupSize,
+                vegetationData.maxChunkCount, 1);
+
+  recordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                      drawStages, VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT);
+}
+
+void recordVegetationDraws(VulkanSetupData *vulkanSetupData, VkCommandBuffer commandBuffer,
+                           const glm::mat4 &viewProjection) {
+  const auto &vegetationData = vulkanSetupData->vegetationData;
+
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vegetationData.graphicsPipeline);
+  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vegetationData.pipelineLayout, 0, 1,
+                          &vegetationData.descriptorSet, 0, nullptr);
+  const VkDeviceSize vertexBufferOffset = 0;
+  vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vegetationData.vertexBuffer, &vertexBufferOffset);
+  vkCmdBindIndexBuffer(commandBuffer, vegetationData.indexBuffer, 0, VK_INDEX_TYPE_UINT16);
+
+  // Separate draws instead of one multi draw, which would need the multiDrawIndirect feature
+  VegetationDrawPushConstants pushConstants = {};
+  pushConstants.viewProjection = viewProjection;
+  pushConstants.instanceCapacity = uint32_t(instanceCapacity(*vulkanSetupData));
+  for (uint32_t lod = 0; lod < kVegetationLodCount; ++lod) {
+    pushConstants.visibleInstanceOffset = lod * pushConstants.instanceCapacity;
+    vkCmdPushConstants(commandBuffer, vegetationData.pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0,
+                       sizeof(pushConstants), &pushConstants);
+    vkCmdDrawIndexedIndirect(commandBuffer, vegetationData.drawCommandBuffer,
+                             lod * sizeof(VkDrawIndexedIndirectCommand), 1,
+                             sizeof(VkDrawIndexedIndirectCommand));
+  }
+}
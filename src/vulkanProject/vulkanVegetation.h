@@ -0,0 +1,33 @@
+#pragma once
+
+#include "glm/glm.hpp"
+#include "terrainChunks.h"
+#include "vulkan/vulkan.h"
+
+struct VulkanSetupData;
+
+// Instance, culling and draw buffers, the LOD meshes and the descriptor set shared by the culling and draw
+// pipelines
+void createVegetationResources(VulkanSetupData *vulkanSetupData);
+void destroyVegetationResources(VulkanSetupData *vulkanSetupData);
+
+// Copies the chunk's scatter instances into a free chunk slot of the instance buffer and drops the chunk's
+// reference to the CPU copy. Instances beyond vegetationData.chunkInstanceCapacity are dropped with a
+// warning. Without a free slot the chunk keeps its instances and waits for beginVegetationFrame().
+void uploadChunkVegetation(VulkanSetupData *vulkanSetupData, TerrainChunk *chunk);
+// The slot is retired with the frame being recorded and only reused after beginVegetationFrame() has come
+// around to that frame again
+void releaseChunkVegetation(VulkanSetupData *vulkanSetupData, ChunkGpuData *gpuData);
+// Has to be called once per frame before any chunk is uploaded or released, after waiting for the fence of
+// the frame that last used frameIndex. The slots released while recording that frame are free again and
+// go to the chunks waiting for one.
+void beginVegetationFrame(VulkanSetupData *vulkanSetupData, uint32_t frameIndex);
+
+// Frustum culls every instance slot and compacts the survivors into one list per LOD, setting the instance
+// counts of the indirect draw commands on the way. Has to be recorded outside of the render pass into the
+// graphics command buffer that also records the draws, the graphics family is picked to support compute.
+void recordVegetationCulling(VulkanSetupData *vulkanSetupData, VkCommandBuffer commandBuffer,
+                             const glm::mat4 &viewProjection, const glm::vec3 &cameraPosition);
+// One vkCmdDrawIndexedIndirect() per LOD, recorded inside the render pass after recordVegetationCulling()
+void recordVegetationDraws(VulkanSetupData *vulkanSetupData, VkCommandBuffer commandBuffer,
+                           const glm::mat4 &viewProjection);